@@ -0,0 +1,123 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_ADJACENCY_H_
+#define IGA_ADJACENCY_H_
+
+#include "IGADataView.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iga_fileio
+{
+	class IGAEvaluator;
+	struct Vector3d;
+
+	/// The element adjacency graph of a model in compressed sparse row form. Each
+	/// element's neighbors are entries [ offsets()[ elem ], offsets()[ elem + 1 ] )
+	/// of the other arrays, which is the same range as the element's edges, so an
+	/// edge_index of the model can be used directly as an index here.
+	///
+	/// For each edge this also records the edge on the neighbor that leads back
+	/// (its twin) and which side of its element the edge is on, so traversals don't
+	/// have to search the neighbor's edges or walk the layouts.
+	///
+	/// The model is only read during build(). Afterwards the graph holds its own
+	/// arrays and doesn't notice edits to the model, so it must be rebuilt after
+	/// them. IGAData::adjacency() keeps one built on demand and drops it when the
+	/// elements, edges or layouts change. The arrays are never written after
+	/// build(), so any number of threads may walk the graph together.
+	class IGAAdjacency
+	{
+	public:
+		IGAAdjacency() = default;
+		IGAAdjacency( const IGAAdjacency & ) = delete;
+		IGAAdjacency &operator=( const IGAAdjacency & ) = delete;
+		IGAAdjacency( IGAAdjacency && ) = default;
+		IGAAdjacency &operator=( IGAAdjacency && ) = default;
+
+		/// Builds the graph for every element of 'data', replacing the contents,
+		/// using up to thread_count threads (0 means defaultThreadCount()). The data
+		/// must be valid (see IGAData::isValid).
+		void build( const IGADataView &data, unsigned thread_count = 0 );
+
+		/// Empties the graph.
+		void clear();
+
+		/// The number of elements in the graph.
+		uint32_t elemCount() const { return mOffsets.empty() ? 0 : static_cast< uint32_t >( mOffsets.size() - 1 ); }
+
+		/// The number of edges in the graph, which is the length of neighbors(),
+		/// reverseEdges() and sides().
+		uint32_t edgeCount() const { return static_cast< uint32_t >( mNeighbors.size() ); }
+
+		/// The start of each element's edges, followed by the total edge count, so
+		/// there are elemCount() + 1 entries.
+		IGASpan< uint32_t > offsets() const { return mOffsets; }
+
+		/// The element across each edge, or INVALID_INDEX on a boundary. This is the
+		/// same as IGAData::edgeOther().
+		IGASpan< uint32_t > neighbors() const { return mNeighbors; }
+
+		/// The edge of the neighbor which leads back across each edge, or
+		/// INVALID_INDEX if there is no neighbor or the neighbor has no edge back.
+		/// Where a neighbor can be reached by more than one edge, each of them is
+		/// paired with the edge leading back whose midpoint is nearest its own. If
+		/// the two elements don't have the same number of edges to each other, or
+		/// two of the edges are nearest the same edge, none of those edges are
+		/// paired. Where an edge is paired, its reverse edge leads back to it.
+		IGASpan< uint32_t > reverseEdges() const { return mReverseEdges; }
+
+		/// The side of its element each edge is on, in the range 0..3 as in
+		/// IGAData::sideBegin().
+		IGASpan< uint8_t > sides() const { return mSides; }
+
+		/// The first of an element's edges. elem_index must be less than elemCount().
+		uint32_t edgeBegin( uint32_t elem_index ) const { return mOffsets[ elem_index ]; }
+
+		/// The end of an element's edges. Pairs with edgeBegin().
+		uint32_t edgeEnd( uint32_t elem_index ) const { return mOffsets[ elem_index + 1 ]; }
+
+		/// The element an edge belongs to, found by a binary search of offsets().
+		/// edge_index must be less than edgeCount().
+		uint32_t edgeElem( uint32_t edge_index ) const;
+
+		/// See neighbors(). edge_index must be less than edgeCount().
+		uint32_t neighbor( uint32_t edge_index ) const { return mNeighbors[ edge_index ]; }
+
+		/// See reverseEdges(). edge_index must be less than edgeCount().
+		uint32_t reverseEdge( uint32_t edge_index ) const { return mReverseEdges[ edge_index ]; }
+
+		/// See sides(). edge_index must be less than edgeCount().
+		int side( uint32_t edge_index ) const { return mSides[ edge_index ]; }
+
+	private:
+		/// Pairs several edges of elem_index that lead to 'other' with the edges of
+		/// 'other' leading back, by their midpoints. See reverseEdges().
+		void pairByPosition( const IGADataView &data, IGAEvaluator &evaluator, uint32_t elem_index,
+			const std::vector< uint32_t > &group_edges, uint32_t other, const std::vector< uint32_t > &back_edges );
+
+		/// Evaluates the middle of an edge. Returns false if it isn't finite.
+		bool edgeMidpoint( const IGADataView &data, IGAEvaluator &evaluator, uint32_t elem_index,
+			uint32_t edge_index, Vector3d &position ) const;
+
+		std::vector< uint32_t > mOffsets;
+		std::vector< uint32_t > mNeighbors;
+		std::vector< uint32_t > mReverseEdges;
+		std::vector< uint8_t > mSides;
+	};
+}
+
+#endif
@@ -0,0 +1,139 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_ASYNC_READER_H_
+#define IGA_ASYNC_READER_H_
+
+#include "IGAReader.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace iga_fileio
+{
+	/// A reader for a file on disk that keeps several large reads in flight ahead
+	/// of the read position, so that fetching the next blocks overlaps with
+	/// placing the current one in the IGAData.
+	///
+	/// The reads are done by a service shared by every IGAAsyncFileReader in the
+	/// process: io_uring on Linux kernels that support it, and otherwise a few
+	/// threads calling pread (or ReadFile on Windows). Loading many files at once
+	/// therefore doesn't take a thread per file for I/O; see readIGAFileAsync.
+	///
+	/// readDataAt is supported too, so readIGAFileParallel and loadIGAModels can
+	/// read from several threads at once.
+	class IGAAsyncFileReader : public IGAReader
+	{
+	public:
+		/// Reads ahead using up to buffer_count reads of buffer_size bytes each.
+		explicit IGAAsyncFileReader( size_t buffer_size = 1 << 20, unsigned buffer_count = 4 );
+		IGAAsyncFileReader( const IGAAsyncFileReader & ) = delete;
+		IGAAsyncFileReader &operator=( const IGAAsyncFileReader & ) = delete;
+		~IGAAsyncFileReader();
+
+		/// Open the named file for reading. Returns false if the file couldn't be
+		/// opened. Any previously opened file is closed first.
+		bool open( const char *filename );
+
+		/// Close the file, after waiting for any reads that are still in flight.
+		void close();
+
+		/// Copies from the read-ahead buffers, waiting for them to arrive if need be,
+		/// and starts further reads as the buffers are used up.
+		bool readData( char *destination, size_t length ) override;
+
+		/// Advances the read position. Read-ahead buffers that are skipped over
+		/// entirely are dropped.
+		bool skipData( uint64_t length ) override;
+
+		/// Moves the read position. If it moves outside the read-ahead buffers, they
+		/// are dropped and reading ahead starts again from the new position.
+		bool seekData( uint64_t offset ) override;
+
+		/// The size of the file.
+		uint64_t sourceSize() override { return mSize; }
+
+		/// Reads directly from the file. This is thread-safe.
+		bool readDataAt( uint64_t offset, char *destination, size_t length ) override;
+
+		/// Drops the read-ahead buffers; the file stays open.
+		void readFinished() override;
+
+	private:
+		/// One read-ahead buffer and the read that fills it. Defined in the .cpp.
+		struct ReadAhead;
+
+		/// Starts reads until there are mBufferCount of them or the end of the file
+		/// is reached.
+		void startReads();
+
+		/// Waits for the oldest read to finish, and drops it.
+		void dropOldest();
+
+		/// Waits for every read to finish, and drops them all.
+		void dropAll();
+
+		/// See the constructor.
+		size_t mBufferSize = 0;
+		unsigned mBufferCount = 0;
+
+		#ifdef _WIN32
+		/// The Windows file handle.
+		void *mFileHandle = nullptr;
+		#else
+		/// The file descriptor.
+		int mFile = -1;
+		#endif
+
+		/// The size of the file.
+		uint64_t mSize = 0;
+
+		/// The position of the next readData() call.
+		uint64_t mPosition = 0;
+
+		/// Where the next read-ahead will start.
+		uint64_t mNextRead = 0;
+
+		/// The reads in flight or finished, in file order. Each one starts where the
+		/// previous one ends.
+		std::deque< std::unique_ptr< ReadAhead > > mReadAhead;
+
+		/// Buffers from dropped reads, kept for reuse.
+		std::vector< std::vector< char > > mSpareBuffers;
+
+		/// Guards the 'done' flags of mReadAhead, which are set on I/O threads.
+		std::mutex mMutex;
+
+		/// Signalled whenever a read finishes.
+		std::condition_variable mReadDone;
+	};
+
+	/// Opens the named file with an IGAAsyncFileReader and loads it with
+	/// readIGAFile on a background thread (see IGAReader::readIGAFileAsync). The
+	/// result is false if the file can't be opened or loaded. geometry must not be
+	/// used until the result is ready.
+	std::future< bool > readIGAFileAsync( const char *filename, IGAData &geometry, uint32_t block_mask = BLOCK_ALL );
+
+	/// The same as the future-based readIGAFileAsync, but calls
+	/// on_finished( result ) on the background thread once the load is done.
+	void readIGAFileAsync( const char *filename, IGAData &geometry, std::function< void( bool ) > on_finished,
+		uint32_t block_mask = BLOCK_ALL );
+}
+
+#endif
@@ -0,0 +1,145 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_BVH_H_
+#define IGA_BVH_H_
+
+#include "IGAEvaluator.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace iga_fileio
+{
+	/// An axis-aligned box. A box that contains nothing has min above max, which
+	/// is how it's constructed.
+	struct IGABoundingBox
+	{
+		Vector3d min = { std::numeric_limits< double >::infinity(), std::numeric_limits< double >::infinity(), std::numeric_limits< double >::infinity() };
+		Vector3d max = { -std::numeric_limits< double >::infinity(), -std::numeric_limits< double >::infinity(), -std::numeric_limits< double >::infinity() };
+
+		/// True if the box contains nothing.
+		bool empty() const { return !( min.x <= max.x && min.y <= max.y && min.z <= max.z ); }
+	};
+
+	/// The points origin + t * direction for t in [ t_min, t_max ]. The direction
+	/// needn't be normalized; distances along the ray are measured in t.
+	struct IGARay
+	{
+		Vector3d origin;
+		Vector3d direction;
+		double t_min = 0;
+		double t_max = std::numeric_limits< double >::infinity();
+	};
+
+	/// An element found by an IGABVH query. For a ray, the distances are the
+	/// range of t over which the ray is inside the element's box. For a point, they
+	/// are the distances to the nearest and farthest points of the box, which bound
+	/// the distance to the nearest point of the element.
+	struct IGABVHHit
+	{
+		uint32_t elem = INVALID_INDEX;
+		double near_distance = 0;
+		double far_distance = 0;
+	};
+
+	/// A bounding volume hierarchy over the elements of a model, for finding the
+	/// elements near a ray or a point without looking at all of them. Each element
+	/// is bounded by the box around its control points (see IGAData::piecePoint),
+	/// with the weights divided out. The surface of an element lies in the convex
+	/// hull of those points so long as its basis functions aren't negative, as
+	/// with B-splines and T-splines, so the box bounds it too. Points with a zero
+	/// weight are ignored, and an element without any other points has an empty
+	/// box, which is never found.
+	///
+	/// Since only the boxes are known, queries return candidates: every element
+	/// which might be hit by a ray, or might hold the nearest point to a point.
+	/// Exact tests are left to the caller, e.g. with IGAEvaluator.
+	///
+	/// build() keeps only the boxes and element numbers, not the model, so the
+	/// hierarchy can outlive the model. It must be rebuilt if the model's points
+	/// change. A query keeps its state on the stack and writes only to the hits
+	/// it's given, so threads may query one hierarchy together as long as each
+	/// passes its own hits.
+	class IGABVH
+	{
+	public:
+		IGABVH() = default;
+		IGABVH( const IGABVH & ) = delete;
+		IGABVH &operator=( const IGABVH & ) = delete;
+		IGABVH( IGABVH && ) = default;
+		IGABVH &operator=( IGABVH && ) = default;
+
+		/// Builds the hierarchy for every element of 'data', replacing the contents,
+		/// using up to thread_count threads (0 means defaultThreadCount()). The data
+		/// must be valid (see IGAData::isValid).
+		void build( const IGADataView &data, unsigned thread_count = 0 );
+
+		/// Empties the hierarchy.
+		void clear();
+
+		/// The number of elements in the hierarchy.
+		uint32_t elemCount() const { return static_cast< uint32_t >( mElemBoxes.size() ); }
+
+		/// The box around an element. elem_index must be less than elemCount().
+		const IGABoundingBox &elemBox( uint32_t elem_index ) const { return mElemBoxes[ elem_index ]; }
+
+		/// The box around every element.
+		IGABoundingBox bounds() const { return mNodes.empty() ? IGABoundingBox() : mNodes[ 0 ].box; }
+
+		/// Finds the elements whose boxes the ray passes through, replacing the
+		/// contents of 'hits'. They are sorted by near_distance.
+		void intersectRay( const IGARay &ray, std::vector< IGABVHHit > &hits ) const;
+
+		/// Runs intersectRay for 'count' rays, using up to thread_count threads (0
+		/// means defaultThreadCount()). The hits of all the rays are put in 'hits',
+		/// one ray after another, and hit_ends[ i ] is set to the end of the hits of
+		/// rays[ i ], as with the pieces of an Elem.
+		void intersectRays( const IGARay *rays, size_t count, std::vector< size_t > &hit_ends,
+			std::vector< IGABVHHit > &hits, unsigned thread_count = 0 ) const;
+
+		/// Finds the elements which might hold the nearest point of the model to
+		/// 'point', replacing the contents of 'hits': those whose boxes are no farther
+		/// away than the farthest point of the nearest box. They are sorted by
+		/// near_distance, so the first is the element with the nearest box.
+		void findNearest( const Vector3d &point, std::vector< IGABVHHit > &hits ) const;
+
+		/// Runs findNearest for 'count' points, returning the hits as intersectRays
+		/// does.
+		void findNearest( const Vector3d *points, size_t count, std::vector< size_t > &hit_ends,
+			std::vector< IGABVHHit > &hits, unsigned thread_count = 0 ) const;
+
+	private:
+		/// A node of the tree. The nodes are stored depth first, so the left child
+		/// of an interior node follows it directly, and 'first' is its right child.
+		/// A leaf has elem_count > 0, and its elements are mElemOrder[ first ] on.
+		struct Node
+		{
+			IGABoundingBox box;
+			uint32_t first = 0;
+			uint32_t elem_count = 0;
+		};
+
+		/// Adds the nodes for the elements mElemOrder[ begin, end ), whose Morton
+		/// codes are codes[ begin, end ), and returns the index of the first.
+		uint32_t buildNode( const std::vector< uint64_t > &codes, uint32_t begin, uint32_t end );
+
+		std::vector< IGABoundingBox > mElemBoxes;
+		std::vector< uint32_t > mElemOrder;
+		std::vector< Node > mNodes;
+	};
+}
+
+#endif
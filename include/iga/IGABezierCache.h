@@ -0,0 +1,89 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_BEZIER_CACHE_H_
+#define IGA_BEZIER_CACHE_H_
+
+#include "IGAEvaluator.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iga_fileio
+{
+	/// The Bezier form of every element of a model (see extractBezierElem), built
+	/// once so that evaluating an element doesn't have to go through its pieces,
+	/// the coefficient dictionary and the points again. All the control points are
+	/// kept in one array, element after element, so an element's patches are
+	/// contiguous in memory.
+	///
+	/// build() copies the control points out of the model, so the model may be
+	/// changed or freed afterwards. The patches from elemPatches() point into the
+	/// cache's own buffer. They last until the cache is rebuilt, cleared or
+	/// destroyed, and moving the cache takes the buffer with it. evaluate() keeps no
+	/// scratch state, so many threads may evaluate from one cache while nothing
+	/// rebuilds it.
+	class IGABezierCache
+	{
+	public:
+		IGABezierCache() = default;
+		IGABezierCache( const IGABezierCache & ) = delete;
+		IGABezierCache &operator=( const IGABezierCache & ) = delete;
+		IGABezierCache( IGABezierCache &&other );
+		IGABezierCache &operator=( IGABezierCache &&other );
+
+		/// Builds the cache for every element of 'data', replacing its contents,
+		/// using up to thread_count threads (0 means defaultThreadCount()). The data
+		/// must be valid (see IGAData::isValid).
+		void build( const IGADataView &data, unsigned thread_count = 0 );
+
+		/// Empties the cache.
+		void clear();
+
+		/// The number of elements in the cache.
+		uint32_t elemCount() const { return static_cast< uint32_t >( mPatchEnds.size() ); }
+
+		/// The patches of an element, which has elemPatchCount( elem_index ) of them.
+		/// elem_index must be less than elemCount().
+		const IGABezierPatchRef *elemPatches( uint32_t elem_index ) const { return mPatches.data() + patchBegin( elem_index ); }
+
+		/// The number of patches of an element.
+		size_t elemPatchCount( uint32_t elem_index ) const { return mPatchEnds[ elem_index ] - patchBegin( elem_index ); }
+
+		/// Evaluates an element; see evaluateBezierElem(). elem_index must be less
+		/// than elemCount().
+		void evaluate( uint32_t elem_index, const double *s, const double *t, size_t count,
+			Vector3d *positions, Vector3d *s_derivs = nullptr, Vector3d *t_derivs = nullptr ) const
+		{
+			evaluateBezierPatches( elemPatches( elem_index ), elemPatchCount( elem_index ), s, t, count, positions, s_derivs, t_derivs );
+		}
+
+	private:
+		size_t patchBegin( uint32_t elem_index ) const { return elem_index == 0 ? 0 : mPatchEnds[ elem_index - 1 ]; }
+
+		/// Every element's patches, in order. Their points are in mPoints.
+		std::vector< IGABezierPatchRef > mPatches;
+
+		/// The end of each element's patches in mPatches, as with the pieces of an
+		/// Elem.
+		std::vector< size_t > mPatchEnds;
+
+		/// The control points of every patch. mPoints is the first 64-byte boundary
+		/// in mStorage, so no point straddles a cache line.
+		std::vector< uint64_t > mStorage;
+		Point3d *mPoints = nullptr;
+	};
+}
+
+#endif
@@ -0,0 +1,44 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_CHECKSUM_H_
+#define IGA_CHECKSUM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace iga_fileio
+{
+	/// Computes the CRC-32C (Castagnoli) checksum of 'length' bytes, continuing from
+	/// a previous result 'crc'. Pass 0 for the first piece of data; passing the
+	/// result back in for the next piece gives the checksum of all of the data, so
+	/// a block can be checked as it's read.
+	///
+	/// This uses the SSE4.2 or ARMv8 CRC instructions when the processor has them,
+	/// which is checked at run time, and a table-driven version otherwise.
+	uint32_t crc32c( uint32_t crc, const void *data, size_t length );
+
+	/// The contents of a CRC32C block, which holds the checksum of the next block in
+	/// the file (not counting PADDING blocks).
+	struct ChecksumBlock
+	{
+		/// The tag of the block being checked.
+		uint64_t tag = 0;
+		/// The crc32c of that block's contents.
+		uint32_t crc = 0;
+		uint32_t reserved = 0;
+	};
+}
+
+#endif
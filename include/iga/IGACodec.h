@@ -0,0 +1,73 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_CODEC_H_
+#define IGA_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iga_fileio
+{
+	/// The codecs used for PACKED blocks. Each one rearranges the block's contents to
+	/// make them more compressible, then compresses the result with a small LZ77
+	/// coder.
+	///
+	/// CODEC_SHUFFLE_LZ treats the contents as 'stride'-byte values, and stores the
+	/// first byte of every value, then the second byte of every value, and so on.
+	/// This groups the sign/exponent bytes of doubles together, which makes them
+	/// very repetitive.
+	const uint32_t CODEC_SHUFFLE_LZ = 1;
+
+	/// CODEC_DELTA_VARINT_LZ treats the contents as uint32_t words. Each word is
+	/// stored as its difference from the word 'stride' words earlier (so each field
+	/// of a struct is compared with the same field of the previous struct), as a
+	/// zigzag-encoded LEB128 varint. Steadily increasing indices become one byte each.
+	const uint32_t CODEC_DELTA_VARINT_LZ = 2;
+
+	/// The start of a PACKED block's contents. The compressed data follows.
+	struct PackedBlockHeader
+	{
+		/// The tag of the block that was compressed.
+		uint64_t inner_tag = 0;
+		/// The length of the original block contents.
+		uint64_t raw_len = 0;
+		/// The length of the data after the codec's transform, and before LZ
+		/// compression.
+		uint64_t coded_len = 0;
+		/// One of the CODEC_ values.
+		uint32_t codec = 0;
+		/// The value size, in bytes, for CODEC_SHUFFLE_LZ, or the word distance for
+		/// CODEC_DELTA_VARINT_LZ.
+		uint32_t stride = 0;
+	};
+
+	/// Compresses a block's contents into 'packed', which receives a complete PACKED
+	/// block (a PackedBlockHeader followed by the compressed data). The codec is
+	/// chosen from the block's tag. Returns false if the block is of a type that
+	/// isn't compressed, or if compression wouldn't make it smaller, in which case
+	/// the block should be written as it is.
+	bool packBlock( uint64_t tag, const char *contents, size_t length, std::vector< char > &packed );
+
+	/// Reads and checks the header at the start of a PACKED block's contents.
+	bool readPackedHeader( const char *packed, size_t packed_len, PackedBlockHeader &header );
+
+	/// Decompresses a PACKED block's contents into 'destination', which must have
+	/// room for the raw_len bytes given in its header. Returns false if the data is
+	/// corrupt; every length and offset in it is checked.
+	bool unpackBlock( const char *packed, size_t packed_len, char *destination );
+}
+
+#endif
@@ -15,6 +15,8 @@
 #ifndef IGA_COMMON_H_
 #define IGA_COMMON_H_
 
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -34,8 +36,44 @@ namespace iga_fileio
 	#define IGA_MAX_ALLOC 256000000
 	#endif
 
+	/// Flags for selecting which blocks IGAReader::readIGAFile should load. Blocks
+	/// that aren't selected are skipped, as are blocks the reader doesn't recognize.
+	/// SRFTYPE blocks are always read, since they mark the start of a model.
+	const uint32_t BLOCK_VECDICT = 1u << 0;
+	const uint32_t BLOCK_PT3DW = 1u << 1;
+	const uint32_t BLOCK_2DPIECE = 1u << 2;
+	const uint32_t BLOCK_LAYOUT = 1u << 3;
+	const uint32_t BLOCK_EDGES = 1u << 4;
+	const uint32_t BLOCK_KNOTINT = 1u << 5;
+	const uint32_t BLOCK_SHAPE = 1u << 6;
+	const uint32_t BLOCK_ALL = 0xFFFFFFFF;
+
 	using CoeffVector = std::vector< double >;
 
+	/// A read-only, non-owning view of a contiguous array. This is used where
+	/// the library hands out data that it does not own, such as arrays that
+	/// live inside a memory-mapped file. The viewed memory must outlive the span.
+	template< typename T >
+	class IGASpan
+	{
+	public:
+		IGASpan() = default;
+		IGASpan( const T *data, size_t size ) : mData( data ), mSize( size ) {}
+		IGASpan( const std::vector< T > &vec ) : mData( vec.data() ), mSize( vec.size() ) {}
+
+		const T *begin() const { return mData; }
+		const T *end() const { return mData + mSize; }
+		const T *data() const { return mData; }
+		bool empty() const { return mSize == 0; }
+		size_t size() const { return mSize; }
+		const T &back() const { return mData[ mSize - 1 ]; }
+		const T &operator[]( size_t index ) const { return mData[ index ]; }
+
+	private:
+		const T *mData = nullptr;
+		size_t mSize = 0;
+	};
+
 	#ifdef _MSC_VER
 	/// Cross-Platform macro to allow the use of finite() on Windows. Note that the
 	/// specification differs between Posix and Visual Studio: on Windows, NAN is finite,
@@ -59,6 +97,29 @@ namespace iga_fileio
 		uint64_t block_len = 0;
 	};
 
+	/// An INDEX block holds an array of these, one for each block in the file
+	/// before the INDEX block itself, in file order.
+	struct BlockIndexEntry
+	{
+		uint64_t tag = 0;
+		uint64_t id = 0;
+		/// The offset from the start of the file to the block's header.
+		uint64_t offset = 0;
+		/// The length of the block's contents (not including the header).
+		uint64_t block_len = 0;
+	};
+
+	/// The contents of a DICTREF block, which says that a model's coefficient
+	/// dictionary starts with the coefficients of a shared dictionary (see
+	/// IGASharedDictionary).
+	struct SharedDictionaryRef
+	{
+		/// The IGASharedDictionary::id() of the dictionary.
+		uint64_t dict_id = 0;
+		/// The number of coefficients in it, as a check.
+		uint64_t coeff_count = 0;
+	};
+
 	/// The tags in IGA/TSS files are 64-bit integers, but they are built
 	/// from mnemonic strings. This converts from the mnemonic string format
 	/// to the 64-bit integer format.
@@ -0,0 +1,44 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_COMPACT_H_
+#define IGA_COMPACT_H_
+
+#include "IGACreator.h"
+
+namespace iga_fileio
+{
+	/// Rebuilds the dictionaries of 'data' in place, for files written by tools
+	/// that don't share their coefficient vectors, points or layouts. Coefficients
+	/// and points that no piece uses, and layouts that no element uses, are
+	/// dropped. Duplicate coefficient vectors, points and layouts are merged, and
+	/// the pieces and elements are renumbered to match. The elements, pieces and
+	/// edges themselves keep their order, and the vectors and points that remain
+	/// keep theirs.
+	///
+	/// Vectors and points are merged as IGACreator merges them, using the
+	/// tolerances in 'options'; points are always merged, whatever merge_points
+	/// says, and by default only exact duplicates are. If 'data' uses a shared
+	/// dictionary, it still does afterwards, and vectors that are in the dictionary
+	/// are pointed at it. The adjacency is rebuilt when next asked for.
+	///
+	/// The work is spread over up to thread_count threads (0 means
+	/// defaultThreadCount()), apart from adding each distinct vector and point to
+	/// the new dictionaries. Returns false, leaving 'data' unchanged, if it isn't
+	/// valid apart from having duplicate layouts (see IGAData::validate), or if
+	/// the tolerances are bad.
+	bool compact( IGAData &data, const IGADedupOptions &options = IGADedupOptions(), unsigned thread_count = 0 );
+}
+
+#endif
@@ -20,14 +20,79 @@
 
 namespace iga_fileio
 {
+	/// Orders coefficient vectors lexicographically. IGACreator no longer uses this,
+	/// but it is kept for code that builds its own lookup tables with it.
 	struct CoeffVectorLessThan
 	{
 		bool operator()( const CoeffVector &a, const CoeffVector &b ) const;
 	};
 
-	/// Type used for coefficient vector lookup tables.
+	/// Type used for coefficient vector lookup tables. IGACreator now uses
+	/// CoeffHashLookup instead.
 	using CoeffLookup = std::map< CoeffVector, uint32_t, CoeffVectorLessThan >;
 
+	/// The lookup table used to find coefficient vectors that are already in the
+	/// coefficient dictionary. This is an open-addressing hash table which doesn't
+	/// store the vectors themselves; each entry records where a vector starts in
+	/// the dictionary (IGAData::coeffs()) and how long it is, so adding a vector
+	/// costs no allocations beyond the dictionary itself.
+	///
+	/// Vectors match if their coefficients compare equal, so 0.0 and -0.0 are
+	/// treated as the same value. The coefficients must not be NAN.
+	class CoeffHashLookup
+	{
+	public:
+		/// Computes the hash used by find() and insert().
+		static uint64_t hashCoeffs( const double *coeffs, size_t length );
+
+		/// Returns the dictionary index of a vector equal to the 'length' coefficients
+		/// at 'coeffs', or INVALID_INDEX if there isn't one. 'hash' must be the
+		/// result of hashCoeffs for the same coefficients.
+		uint32_t find( IGASpan< double > dictionary, const double *coeffs, size_t length, uint64_t hash ) const;
+
+		/// The same as find(), except that a vector matches if each of its
+		/// coefficients is within 'tolerance' of the corresponding one in 'coeffs'.
+		/// 'hash' must be the hash the vector was inserted with.
+		uint32_t findNear( IGASpan< double > dictionary, const double *coeffs, size_t length, uint64_t hash, double tolerance ) const;
+
+		/// Records that the 'length' coefficients at dictionary index 'dict_index'
+		/// have the given hash.
+		void insert( uint64_t hash, uint32_t dict_index, uint32_t length );
+
+		/// Removes every entry.
+		void clear();
+
+	private:
+		struct Entry
+		{
+			uint64_t hash = 0;
+			/// INVALID_INDEX marks an empty slot.
+			uint32_t dict_index = INVALID_INDEX;
+			uint32_t length = 0;
+		};
+
+		/// The slots of the table. The size is always zero or a power of two.
+		std::vector< Entry > mSlots;
+
+		/// The number of slots in use.
+		size_t mCount = 0;
+	};
+
+	/// Settings for merging near-duplicate coefficient vectors and points in
+	/// IGACreator. See IGACreator::setDedupOptions().
+	struct IGADedupOptions
+	{
+		/// Coefficient vectors are merged if each of their coefficients differs by
+		/// no more than this. 0 merges only exact matches, which is the default.
+		double coeff_tolerance = 0;
+
+		/// If true, addPoint returns an existing point if each of its x, y, z and w
+		/// is within point_tolerance of the new point's, rather than adding another.
+		/// Off by default, in which case every call to addPoint adds a point.
+		bool merge_points = false;
+		double point_tolerance = 0;
+	};
+
 	/// Type used for face layout lookup tables.
 	using LayoutLookup = std::map< FaceLayout, uint32_t >;
 
@@ -40,6 +105,7 @@ namespace iga_fileio
 		/// This constructor clears the parent IGAData. It would probably
 		/// be possible to rebuild the lookup tables for the parent IGAData and
 		/// thus allow editing of existing ones, but we don't need that currently.
+		/// To rebuild the dictionaries of an existing IGAData, use compact().
 		IGACreator( IGAData *parent );
 
 		/// Add a vector of coefficients and returns the (first) index added.
@@ -47,21 +113,66 @@ namespace iga_fileio
 		/// INVALID_INDEX if the operation fails.
 		uint32_t addCoeffs( const CoeffVector &coeffs );
 
+		/// The same as addCoeffs( const CoeffVector & ), but takes the coefficients
+		/// as a pointer to 'coeff_count' values so you don't have to build a vector.
+		uint32_t addCoeffs( const double *coeffs, size_t coeff_count );
+
 		/// Add an edge and its interval. Pass a negative number for the
 		/// knot_interval if you don't want to save intervals, or pass a value
 		/// >= 0.0 if you do. You must be consistent about this, and it will
 		/// return INVALID_INDEX (failure) if you aren't.
 		uint32_t addEdge( uint32_t elem, double knot_interval );
 
+		/// Appends 'count' edges and returns the index of the first one. Pass
+		/// nullptr for knot_intervals if you aren't saving intervals, or 'count'
+		/// intervals (all >= 0.0) if you are. The same consistency rule as addEdge
+		/// applies. Returns INVALID_INDEX, having added nothing, on failure.
+		uint32_t addEdges( const uint32_t *edges, const double *knot_intervals, size_t count );
+
 		/// Adds an Elem and returns the index added. Returns INVALID_INDEX if
 		/// the operation fails.
 		uint32_t addElem( const Elem &elem );
 
+		/// Appends 'count' Elems and returns the index of the first one. Returns
+		/// INVALID_INDEX, having added nothing, if the operation fails. The ends
+		/// stored in each Elem are indices into the whole pieces and edges arrays,
+		/// as they are in the file, and they aren't checked here; use
+		/// IGAData::isValid once you're finished. This is meant for data you
+		/// already hold in flat arrays, and costs little more than a memcpy.
+		uint32_t addElems( const Elem *elems, size_t count );
+
 		/// Adds a single explicit piece to the end of the data vector. Note that
 		/// all pieces for a given patch must be added together. The t_order can
 		/// be inferred from the size of coeffs.
 		uint32_t addExplicitPiece( int s_order, uint32_t pt_index, const CoeffVector &coeffs );
 
+		/// The same as the CoeffVector version of addExplicitPiece, but takes the
+		/// coefficients as a pointer to 'coeff_count' values, which may be in a
+		/// stack array or your own buffers. They are only copied if they aren't
+		/// already in the dictionary.
+		uint32_t addExplicitPiece( int s_order, uint32_t pt_index, const double *coeffs, size_t coeff_count );
+
+		/// Appends the elements of several separately built IGAData objects (shards),
+		/// in order, as if all of their elements had been added through this creator.
+		/// This lets you build the shards on different threads, each with its own
+		/// IGACreator, and then combine them. The shards' coefficient vectors and
+		/// layouts are merged into this creator's dictionaries, and the pieces and
+		/// elements are remapped to match; the checks and the copying are done in
+		/// parallel using up to thread_count threads (0 means defaultThreadCount()).
+		///
+		/// In each shard, the pieces' pt_index values refer to the shard's own points,
+		/// and the shard must end with a finished element. The edges hold element
+		/// indices in the final IGAData, so they are copied unchanged. All of the
+		/// shards (and anything already added here) must agree about saving intervals.
+		/// The shards' points are copied as they are, without being merged.
+		///
+		/// If the shards were built with getDictionaryIndex (or addTensorPiece and
+		/// addExplicitPiece) and getLayoutIndex, each adding its elements' own points,
+		/// the result is identical to adding the same elements through one IGACreator.
+		/// Returns false if the shards are inconsistent, in which case this creator's
+		/// IGAData may have been partly extended.
+		bool appendShards( const std::vector< const IGAData * > &shards, unsigned thread_count = 0 );
+
 		/// Adds a FaceLayout and returns the index added. Returns INVALID_INDEX
 		/// if the operation fails.
 		uint32_t addLayout( const FaceLayout &layout );
@@ -71,13 +182,38 @@ namespace iga_fileio
 		/// yourself; use addExplicitPiece or addTensorPiece to avoid that.
 		uint32_t addPiece( const Piece2D &piece );
 
+		/// Appends 'count' Piece2Ds and returns the index of the first one. Returns
+		/// INVALID_INDEX, having added nothing, if the operation fails. As with
+		/// addPiece, the dictionary indices aren't checked.
+		uint32_t addPieces( const Piece2D *pieces, size_t count );
+
 		/// Adds a Point3d and returns the index added. Returns INVALID_INDEX if
-		/// the operation fails.
+		/// the operation fails. If points are being merged (see setDedupOptions),
+		/// this may instead return the index of an existing point.
 		uint32_t addPoint( const Point3d &pt );
 
-		// Must implement this before I'm done.
+		/// Appends 'count' Point3ds and returns the index of the first one. Returns
+		/// INVALID_INDEX, having added nothing, if the operation fails. The points
+		/// are never merged, since they must be given consecutive indices; use the
+		/// version that takes 'indices' for that. Points added later may still be
+		/// merged with them.
+		uint32_t addPoints( const Point3d *pts, size_t count );
+
+		/// Adds 'count' Point3ds as addPoint would, merging them if that's enabled,
+		/// and stores the index of each in 'indices'. Returns false if a point
+		/// couldn't be added, in which case the earlier ones have been.
+		bool addPoints( const Point3d *pts, size_t count, uint32_t *indices );
+
+		/// Adds a tensor-product piece whose s and t coefficient vectors are stored
+		/// separately in the dictionary. The orders are the sizes of the vectors.
 		uint32_t addTensorPiece( const CoeffVector &s_coeffs, const CoeffVector &t_coeffs, uint32_t pt_index );
 
+		/// The same as the CoeffVector version of addTensorPiece, but takes each
+		/// coefficient vector as a pointer to 'order' values, which may be in a stack
+		/// array or your own buffers. They are only copied if they aren't already
+		/// in the dictionary.
+		uint32_t addTensorPiece( const double *s_coeffs, int s_order, const double *t_coeffs, int t_order, uint32_t pt_index );
+
 		/// Call this after you've finished adding all the pieces and edges for
 		/// the current element. Pass the index of the layout being used, which must
 		/// be consistent with the number of edges which were added (otherwise it
@@ -85,13 +221,61 @@ namespace iga_fileio
 		uint32_t finishElem( uint32_t layout_index );
 
 		/// Given the coefficient vector 'coeffs', get an index in mCoeffDictionary
-		/// that can be used to represent the start of that coefficient block.
+		/// that can be used to represent the start of that coefficient block. If
+		/// the coeff_tolerance is set (see setDedupOptions), this may be the index
+		/// of a vector that is only close to 'coeffs'.
 		uint32_t getDictionaryIndex( const CoeffVector &coeffs );
 
+		/// The same as getDictionaryIndex( const CoeffVector & ), but takes the
+		/// coefficients as a pointer to 'coeff_count' values.
+		uint32_t getDictionaryIndex( const double *coeffs, size_t coeff_count );
+
+		/// The largest difference so far between a coefficient passed to this
+		/// creator and the one stored in its place, because its vector was merged
+		/// with a near-duplicate. This is 0 unless the coeff_tolerance is set.
+		double maxCoeffError() const { return mMaxCoeffError; }
+
+		/// The largest difference so far between a coordinate (or weight) of a point
+		/// passed to addPoint and that of the point it was merged with.
+		double maxPointError() const { return mMaxPointError; }
+
 		/// Given a face layout, returns the index used for representing that layout in
 		/// the layout dictionary. Adds the layout if it didn't already have an index.
 		uint32_t getLayoutIndex( const FaceLayout &layout );
 
+		/// Reserves space for the given numbers of elements, pieces, edges, points
+		/// and dictionary coefficients, so that adding them doesn't need to regrow
+		/// the arrays. The counts are totals, not additions to what's already there.
+		/// Intervals are reserved along with the edges once the first one is added.
+		void reserve( size_t elem_count, size_t piece_count, size_t edge_count, size_t point_count, size_t coeff_count );
+
+		/// Sets how near-duplicate coefficient vectors and points are merged. Merging
+		/// shrinks the VECDICT and PT3DW blocks of files whose values differ only by
+		/// rounding, at the cost of moving them by up to the tolerance; see
+		/// maxCoeffError() and maxPointError() for how far they actually moved.
+		///
+		/// Values are found by rounding them to a grid whose spacing is the
+		/// tolerance, and comparing them with those in the same cell. Each value that
+		/// is close to the edge of its cell is also looked for in the next cell, up to
+		/// four per vector, so values that differ by much less than the tolerance
+		/// are nearly always merged, and always are in vectors of up to four values
+		/// and in points; values that differ by nearly the tolerance may not be.
+		/// Merged values are never further apart than the tolerance.
+		///
+		/// This must be called before any coefficients or points are added,
+		/// including by setSharedDictionary; the options don't affect anything else.
+		/// Returns false if some have been added, or if a tolerance is negative or
+		/// not finite.
+		bool setDedupOptions( const IGADedupOptions &options );
+
+		/// Starts the coefficient dictionary with a copy of a shared dictionary's
+		/// coefficients, so that its vectors are found by getDictionaryIndex without
+		/// being added again, and IGAWriter refers to the shared dictionary instead of
+		/// writing them. This must be called before any coefficients are added; it
+		/// returns false if some already have been. Pass null to stop using one,
+		/// which is also only possible before adding coefficients.
+		bool setSharedDictionary( std::shared_ptr< const IGASharedDictionary > dictionary );
+
 		/// Set a string to record the type of surface that's being saved.
 		void setSurfaceType( const std::string &surface_type );
 
@@ -101,10 +285,24 @@ namespace iga_fileio
 		IGAData *mParent = nullptr;
 
 		/// A lookup table used to add new vectors to the coeff dictionary.
-		CoeffLookup mCoeffLookup;
+		CoeffHashLookup mCoeffLookup;
 
 		/// A lookup table for the face layouts.
 		LayoutLookup mLayoutLookup;
+
+		/// See setDedupOptions().
+		IGADedupOptions mDedupOptions;
+
+		/// A lookup table used to merge points, if that's enabled. It treats the
+		/// points as a dictionary of vectors of 4 doubles.
+		CoeffHashLookup mPointLookup;
+
+		/// See maxCoeffError() and maxPointError().
+		double mMaxCoeffError = 0;
+		double mMaxPointError = 0;
+
+		/// Scratch space for rounding values to the grid.
+		std::vector< double > mCells;
 	};
 }
 
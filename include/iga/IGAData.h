@@ -16,10 +16,14 @@
 #define IGA_DATA_H_
 
 #include "IGACommon.h"
+#include <memory>
 #include <string>
 
 namespace iga_fileio
 {
+	class IGAAdjacency;
+	class IGASharedDictionary;
+
 	/// 3d points in Grassmann space
 	struct Point3d
 	{
@@ -58,6 +62,19 @@ namespace iga_fileio
 		uint32_t edge_end_index = 0;
 	};
 
+	/// A problem found by IGAData::validate().
+	struct IGAValidationError
+	{
+		/// The array holding the bad item: "coeffs", "points", "layouts", "pieces",
+		/// "intervals", "edges" or "elems". This is empty for problems that involve
+		/// the model as a whole, in which case 'index' is meaningless.
+		const char *array = "";
+		/// The index of the bad item in that array.
+		size_t index = 0;
+		/// A description of the problem, the same as isValid() would print.
+		std::string message;
+	};
+
 	/// A class that represents in memory that data held in an IGA file. This class
 	/// only contains getter methods and a simple clear() function. The setter
 	/// methods are in IGACreator.
@@ -70,6 +87,15 @@ namespace iga_fileio
 	class IGAData
 	{
 	public:
+		/// The element adjacency graph of this data, with the reverse edge and side
+		/// of every edge. It is built the first time it is asked for, using up to
+		/// thread_count threads (0 means defaultThreadCount()), and kept until the
+		/// elements, edges or layouts change. The data must be valid (see isValid).
+		///
+		/// This may be called from several threads at once. The reference stays
+		/// valid until this IGAData is next modified, cleared or destroyed.
+		const IGAAdjacency &adjacency( unsigned thread_count = 0 ) const;
+
 		/// Clear the contents of this IGAData.
 		void clear();
 
@@ -135,6 +161,16 @@ namespace iga_fileio
 		/// an ostream. This function returns true if all data appears to be self-consistent.
 		bool isValid() const;
 
+		/// Runs the same checks as isValid(), splitting each array into chunks that are
+		/// checked by up to thread_count threads (0 means defaultThreadCount()). Small
+		/// models are checked on the calling thread. The problems found are appended to
+		/// 'errors', and true is returned if there weren't any.
+		///
+		/// If collect_all is false, the checks stop at the first problem, which is the
+		/// one isValid() would report. Otherwise every problem is reported, in the order
+		/// isValid() would find them.
+		bool validate( std::vector< IGAValidationError > &errors, bool collect_all = false, unsigned thread_count = 0 ) const;
+
 		/// Returns the layout structure for the given layout_index. Even if there are
 		/// no layouts stored, passing 0 guarantees that the default layout
 		/// { 0, 1, 2, 3, 4 } will be returned.
@@ -225,6 +261,10 @@ namespace iga_fileio
 		/// The counterpart to sideBegin().
 		uint32_t sideEnd( uint32_t elem_index, int side ) const;
 
+		/// The shared dictionary that this data's coefficients start with, or null if
+		/// it doesn't use one. See IGASharedDictionary.
+		const std::shared_ptr< const IGASharedDictionary > &sharedDictionary() const { return mSharedDictionary; }
+
 		/// Returns a reference to the string which holds the saved surface type.
 		/// The default value is "unknown."
 		const std::string &surfaceType() const { return mSrfType; }
@@ -238,6 +278,10 @@ namespace iga_fileio
 		/// Referenced by the pieces.
 		std::vector< double > mCoeffs;
 
+		/// If this is set, mCoeffs starts with a copy of its coefficients, which
+		/// IGAWriter writes as a reference to the dictionary.
+		std::shared_ptr< const IGASharedDictionary > mSharedDictionary;
+
 		/// The control point geometry. Referenced by the pieces.
 		std::vector< Point3d > mPoints;
 
@@ -261,6 +305,30 @@ namespace iga_fileio
 		/// and a face layout.
 		std::vector< Elem > mElems;
 
+		/// Holds the graph built by adjacency(). Copies share the graph, since it
+		/// can't change; anything that modifies mElems, mEdges or mLayouts must
+		/// reset it. The pointer is only accessed atomically, so that adjacency()
+		/// is safe to call from several threads.
+		class AdjacencyCache
+		{
+		public:
+			AdjacencyCache() = default;
+			AdjacencyCache( const AdjacencyCache &rhs ) : mGraph( rhs.load() ) {}
+			AdjacencyCache &operator=( const AdjacencyCache &rhs ) { store( rhs.load() ); return *this; }
+
+			std::shared_ptr< const IGAAdjacency > load() const { return std::atomic_load( &mGraph ); }
+			void store( std::shared_ptr< const IGAAdjacency > graph ) { std::atomic_store( &mGraph, std::move( graph ) ); }
+			void reset() { store( nullptr ); }
+
+			/// Stores 'graph' unless another thread got there first, and returns
+			/// whichever is now held.
+			std::shared_ptr< const IGAAdjacency > publish( std::shared_ptr< const IGAAdjacency > graph );
+
+		private:
+			std::shared_ptr< const IGAAdjacency > mGraph;
+		};
+		mutable AdjacencyCache mAdjacency;
+
 		/// The IGACreator has all the functions which write to this class.
 		friend class IGACreator;
 
@@ -0,0 +1,145 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_DATA_SOA_H_
+#define IGA_DATA_SOA_H_
+
+#include "IGADataView.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iga_fileio
+{
+	/// The pieces of a model rearranged as a structure of arrays, for vectorized
+	/// code. Each field of the pieces, and each coordinate of their points, has an
+	/// array of its own, so consecutive pieces can be loaded into vector registers
+	/// without gathering or unpacking st_order. The pieces are grouped by their
+	/// (s_order, t_order), so a kernel can handle a whole group with one piece size;
+	/// within a group they stay in their original order.
+	///
+	/// Entry i of every array describes the same piece, whose index in the model is
+	/// pieceIds()[ i ]; soaIndices() maps the other way. Every array starts on a
+	/// 64-byte boundary.
+	///
+	/// The point coordinates are copied along with the indices, so the arrays
+	/// don't follow later edits to the model and must be rebuilt to see them. All
+	/// of the arrays share one buffer, which the returned spans point into; they
+	/// last until the next build() or clear(). Moving the object hands the buffer
+	/// over and leaves the source empty. Nothing is cached on access, so several
+	/// threads may read the arrays at once.
+	class IGADataSoA
+	{
+	public:
+		/// A run of pieces which all have the same orders. The pieces are entries
+		/// [ begin, end ) of the arrays.
+		struct Group
+		{
+			int s_order = 0;
+			int t_order = 0;
+			uint32_t begin = 0;
+			uint32_t end = 0;
+		};
+
+		IGADataSoA() = default;
+		IGADataSoA( const IGADataSoA & ) = delete;
+		IGADataSoA &operator=( const IGADataSoA & ) = delete;
+		IGADataSoA( IGADataSoA &&other );
+		IGADataSoA &operator=( IGADataSoA &&other );
+
+		/// Builds the arrays for every piece of 'data', replacing the contents, using
+		/// up to thread_count threads (0 means defaultThreadCount()). The data must
+		/// be valid (see IGAData::isValid).
+		void build( const IGADataView &data, unsigned thread_count = 0 );
+
+		/// Empties the arrays.
+		void clear();
+
+		/// The number of pieces, which is the length of every array.
+		uint32_t pieceCount() const { return mPieceCount; }
+
+		/// The groups of pieces, in increasing order of s_order and then t_order.
+		const std::vector< Group > &groups() const { return mGroups; }
+
+		/// The orders of each piece.
+		IGASpan< uint32_t > sOrders() const { return indexArray( ARRAY_S_ORDER ); }
+		IGASpan< uint32_t > tOrders() const { return indexArray( ARRAY_T_ORDER ); }
+
+		/// The dictionary indices of each piece, as in Piece2D. The t index is
+		/// INVALID_INDEX for explicit pieces.
+		IGASpan< uint32_t > sIndices() const { return indexArray( ARRAY_S_INDEX ); }
+		IGASpan< uint32_t > tIndices() const { return indexArray( ARRAY_T_INDEX ); }
+
+		/// The index of each piece's point in the model.
+		IGASpan< uint32_t > pointIndices() const { return indexArray( ARRAY_POINT_INDEX ); }
+
+		/// The element each piece belongs to.
+		IGASpan< uint32_t > elems() const { return indexArray( ARRAY_ELEM ); }
+
+		/// The index of each piece in the model.
+		IGASpan< uint32_t > pieceIds() const { return indexArray( ARRAY_PIECE_ID ); }
+
+		/// For each piece of the model, in model order, its entry in these arrays.
+		IGASpan< uint32_t > soaIndices() const { return indexArray( ARRAY_SOA_INDEX ); }
+
+		/// The coordinates of each piece's point, with the weight multiplied in as in
+		/// Point3d.
+		IGASpan< double > pointX() const { return coordArray( ARRAY_X ); }
+		IGASpan< double > pointY() const { return coordArray( ARRAY_Y ); }
+		IGASpan< double > pointZ() const { return coordArray( ARRAY_Z ); }
+		IGASpan< double > pointW() const { return coordArray( ARRAY_W ); }
+
+	private:
+		enum Array
+		{
+			ARRAY_S_ORDER,
+			ARRAY_T_ORDER,
+			ARRAY_S_INDEX,
+			ARRAY_T_INDEX,
+			ARRAY_POINT_INDEX,
+			ARRAY_ELEM,
+			ARRAY_PIECE_ID,
+			ARRAY_SOA_INDEX,
+			ARRAY_X,
+			ARRAY_Y,
+			ARRAY_Z,
+			ARRAY_W,
+			ARRAY_COUNT
+		};
+
+		/// The start of an array within the aligned part of mStorage.
+		char *arrayData( Array array ) const { return mAligned + mOffsets[ array ]; }
+
+		IGASpan< uint32_t > indexArray( Array array ) const
+		{
+			return IGASpan< uint32_t >( reinterpret_cast< const uint32_t * >( arrayData( array ) ), mPieceCount );
+		}
+
+		IGASpan< double > coordArray( Array array ) const
+		{
+			return IGASpan< double >( reinterpret_cast< const double * >( arrayData( array ) ), mPieceCount );
+		}
+
+		uint32_t mPieceCount = 0;
+		std::vector< Group > mGroups;
+
+		/// Every array, one after another. mAligned is the first 64-byte boundary in
+		/// it, and mOffsets gives each array's start in bytes from there.
+		std::vector< uint64_t > mStorage;
+		char *mAligned = nullptr;
+		size_t mOffsets[ ARRAY_COUNT ] = {};
+	};
+}
+
+#endif
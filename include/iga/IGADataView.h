@@ -0,0 +1,198 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_DATA_VIEW_H_
+#define IGA_DATA_VIEW_H_
+
+#include "IGAData.h"
+#include <iosfwd>
+#include <memory>
+
+namespace iga_fileio
+{
+	/// A read-only view of IGA data whose arrays are owned by someone else. It has
+	/// the same accessors as IGAData, but each array is an IGASpan rather than a
+	/// std::vector. There are two ways to get one:
+	///
+	///   - Construct it from an IGAData. The view borrows the IGAData's vectors,
+	///     so the IGAData must outlive the view and must not be modified.
+	///   - Load it with IGAMappedReader::readIGAView. The view borrows the file
+	///     mapping, so the reader must stay open for the lifetime of the view.
+	///
+	/// As with IGAData, most of the accessors do not check their arguments. Use
+	/// isValid() before trusting the contents of a file.
+	class IGADataView
+	{
+	public:
+		IGADataView() = default;
+
+		/// Borrows the arrays held by 'data'. This is intentionally not explicit
+		/// so that an IGAData can be passed to anything that takes a view.
+		IGADataView( const IGAData &data );
+
+		/// Reset this view to be empty. Any blocks which had to be copied are released.
+		void clear();
+
+		/// See IGAData::coeffs().
+		IGASpan< double > coeffs() const { return mCoeffs; }
+
+		/// See IGAData::edges().
+		IGASpan< uint32_t > edges() const { return mEdges; }
+
+		/// See IGAData::edgeBegin().
+		uint32_t edgeBegin( uint32_t elem_index ) const;
+
+		/// See IGAData::edgeCount().
+		uint32_t edgeCount() const;
+
+		/// See IGAData::edgeEnd().
+		uint32_t edgeEnd( uint32_t elem_index ) const;
+
+		/// See IGAData::edgeInterval().
+		double edgeInterval( uint32_t edge_index ) const;
+
+		/// See IGAData::edgeOther().
+		uint32_t edgeOther( uint32_t edge_index ) const;
+
+		/// See IGAData::elems().
+		IGASpan< Elem > elems() const { return mElems; }
+
+		/// See IGAData::elemCount().
+		uint32_t elemCount() const;
+
+		/// See IGAData::elemEdgeCount().
+		uint32_t elemEdgeCount( uint32_t elem_index ) const;
+
+		/// See IGAData::elemEdgesOnSide().
+		uint32_t elemEdgesOnSide( uint32_t elem_index, int side ) const;
+
+		/// See IGAData::intervals().
+		IGASpan< double > intervals() const { return mIntervals; }
+
+		/// See IGAData::isValid( std::ostream & ).
+		bool isValid( std::ostream &err ) const;
+
+		/// See IGAData::isValid().
+		bool isValid() const;
+
+		/// See IGAData::validate().
+		bool validate( std::vector< IGAValidationError > &errors, bool collect_all = false, unsigned thread_count = 0 ) const;
+
+		/// Runs the checks that validate() makes on a layout dictionary on its own:
+		/// layout 0 must be the default layout, every layout must have an edge on
+		/// each side, no two may be the same, and a model with more than one must
+		/// have intervals. For readers such as IGAElementCursor, which check the rest
+		/// of a model an element at a time.
+		static bool validateLayouts( IGASpan< FaceLayout > layouts, bool has_intervals, std::vector< IGAValidationError > &errors, bool collect_all = false );
+
+		/// See IGAData::layout().
+		const FaceLayout &layout( uint32_t layout_index ) const;
+
+		/// See IGAData::layoutIndex().
+		uint32_t layoutIndex( uint32_t elem_index ) const;
+
+		/// See IGAData::layouts().
+		IGASpan< FaceLayout > layouts() const { return mLayouts; }
+
+		/// See IGAData::pieceBegin().
+		uint32_t pieceBegin( uint32_t elem_index ) const;
+
+		/// See IGAData::pieceCount().
+		uint32_t pieceCount() const;
+
+		/// See IGAData::pieceEnd().
+		uint32_t pieceEnd( uint32_t elem_index ) const;
+
+		/// See IGAData::pieceExplicitCoeffs().
+		const double *pieceExplicitCoeffs( uint32_t piece_index ) const;
+
+		/// See IGAData::pieceIsExplicit().
+		bool pieceIsExplicit( uint32_t piece_index ) const;
+
+		/// See IGAData::pieceIsTensor().
+		bool pieceIsTensor( uint32_t piece_index ) const;
+
+		/// See IGAData::piecePoint().
+		const Point3d &piecePoint( uint32_t piece_index ) const;
+
+		/// See IGAData::piecePointIndex().
+		uint32_t piecePointIndex( uint32_t piece_index ) const;
+
+		/// See IGAData::pieces().
+		IGASpan< Piece2D > pieces() const { return mPieces; }
+
+		/// See IGAData::pieceSIndex().
+		uint32_t pieceSIndex( uint32_t piece_index ) const;
+
+		/// See IGAData::pieceSCoeffs().
+		const double *pieceSCoeffs( uint32_t piece_index ) const;
+
+		/// See IGAData::pieceSOrder().
+		int pieceSOrder( uint32_t piece_index ) const;
+
+		/// See IGAData::pieceTIndex().
+		uint32_t pieceTIndex( uint32_t piece_index ) const;
+
+		/// See IGAData::pieceTCoeffs().
+		const double *pieceTCoeffs( uint32_t piece_index ) const;
+
+		/// See IGAData::pieceTOrder().
+		int pieceTOrder( uint32_t piece_index ) const;
+
+		/// See IGAData::pointCount().
+		uint32_t pointCount() const;
+
+		/// See IGAData::points().
+		IGASpan< Point3d > points() const { return mPoints; }
+
+		/// See IGAData::sideBegin().
+		uint32_t sideBegin( uint32_t elem_index, int side ) const;
+
+		/// See IGAData::sideEnd().
+		uint32_t sideEnd( uint32_t elem_index, int side ) const;
+
+		/// See IGAData::sharedDictionary(). A view holds on to the dictionary, since
+		/// its coefficients may be those of the dictionary itself.
+		const std::shared_ptr< const IGASharedDictionary > &sharedDictionary() const { return mSharedDictionary; }
+
+		/// See IGAData::surfaceType().
+		const std::string &surfaceType() const { return mSrfType; }
+
+	private:
+		/// The surface type is tiny, so the view keeps its own copy.
+		std::string mSrfType{ "unknown" };
+
+		IGASpan< double > mCoeffs;
+		IGASpan< Point3d > mPoints;
+		IGASpan< Piece2D > mPieces;
+		IGASpan< uint32_t > mEdges;
+		IGASpan< double > mIntervals;
+		IGASpan< FaceLayout > mLayouts;
+		IGASpan< Elem > mElems;
+
+		/// A block can only be viewed in place if its payload is suitably aligned
+		/// for its element type. Blocks which aren't are copied into these buffers,
+		/// and the spans above point into the copies instead. They are shared so
+		/// that copies of this view remain valid.
+		std::vector< std::shared_ptr< std::vector< uint64_t > > > mOwnedBlocks;
+
+		/// See sharedDictionary().
+		std::shared_ptr< const IGASharedDictionary > mSharedDictionary;
+
+		/// The IGAMappedReader fills in the spans directly.
+		friend class IGAMappedReader;
+	};
+}
+
+#endif
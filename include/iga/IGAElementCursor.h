@@ -0,0 +1,212 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_ELEMENT_CURSOR_H_
+#define IGA_ELEMENT_CURSOR_H_
+
+#include "IGAData.h"
+#include "IGAReader.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace iga_fileio
+{
+	/// One element, with copies of everything it refers to, as returned by
+	/// IGAElementCursor::next(). The vectors keep their capacity from one element
+	/// to the next, so reusing the same IGAStreamElem doesn't allocate once they
+	/// have grown large enough.
+	struct IGAStreamElem
+	{
+		/// The element's index in the model.
+		uint32_t elem_index = 0;
+
+		/// The element's layout, and its index in the layout dictionary.
+		uint32_t layout_index = 0;
+		FaceLayout layout;
+
+		/// The element's pieces, as stored in the file. Their indices refer to the
+		/// whole model, not to the vectors here.
+		std::vector< Piece2D > pieces;
+
+		/// The point of each piece; points[ i ] belongs to pieces[ i ].
+		std::vector< Point3d > points;
+
+		/// The coefficients of all the pieces. Piece i's coefficients start at
+		/// coeffs[ coeff_begin[ i ] ]: the S coefficients followed by the T
+		/// coefficients for a tensor-product piece, or all s_order * t_order
+		/// coefficients for an explicit piece. coeff_begin has one more entry than
+		/// pieces, so the last entry is coeffs.size().
+		std::vector< uint32_t > coeff_begin;
+		std::vector< double > coeffs;
+
+		/// The indices of the elements across each of this element's edges, and the
+		/// edges' knot intervals. intervals is empty if the model has none.
+		std::vector< uint32_t > edges;
+		std::vector< double > intervals;
+
+		/// The S coefficients of piece i for a tensor-product piece, or all of its
+		/// coefficients for an explicit one.
+		const double *pieceSCoeffs( size_t piece ) const { return coeffs.data() + coeff_begin[ piece ]; }
+
+		/// The T coefficients of piece i, which must be a tensor-product piece.
+		const double *pieceTCoeffs( size_t piece ) const { return pieceSCoeffs( piece ) + ( pieces[ piece ].st_order & 0xFFFF ); }
+	};
+
+	/// Reads the elements of a model one at a time, in order, without loading the
+	/// whole model. Only the layout dictionary is loaded up front; everything else
+	/// is read from the file as it's needed, through a cache of fixed-size pages
+	/// whose total size is set by the constructor. The memory used is therefore
+	/// bounded however large the model is, which lets you process models that don't
+	/// fit in memory.
+	///
+	/// The reader must be able to seek (see IGAReader::seekData). It's read with
+	/// seekData and readData, so it must not be used for anything else while the
+	/// cursor is in use. IGAAsyncFileReader and IGAMappedReader both work well.
+	///
+	/// Since the model as a whole isn't checked, open() checks the layout
+	/// dictionary and each element's indices are checked as it's read; next()
+	/// fails if they don't fit the model. error() says what was wrong, in the same
+	/// words as IGAData::validate where it's a problem that would find. The blocks
+	/// must not be compressed (see IGAWriter::setCompressBlocks), since a PACKED
+	/// block can only be decompressed as a whole, and CRC32C checksums aren't
+	/// checked, since that would mean reading whole blocks.
+	///
+	/// A model built with a shared dictionary can only be read if the dictionary
+	/// has been given to the reader with IGAReader::addSharedDictionary. Its
+	/// coefficients are then read from the dictionary, and the model's own from
+	/// the file.
+	class IGAElementCursor
+	{
+	public:
+		/// The cache holds at most cache_bytes of the file, in pages of page_bytes
+		/// each. At least a few pages are always kept.
+		explicit IGAElementCursor( size_t cache_bytes = 64 << 20, size_t page_bytes = 256 << 10 );
+
+		/// Prepares to read the last model in the file, which is the one
+		/// readIGAFile would load. Returns false if the file can't be read or
+		/// doesn't suit the cursor, or if its layouts aren't valid.
+		bool open( IGAReader &reader );
+
+		/// Prepares to read a model found by IGAReader::readIGAModels.
+		bool open( IGAReader &reader, const IGAModelHandle &model );
+
+		/// The number of elements in the model.
+		uint32_t elemCount() const { return mElemCount; }
+
+		/// The model's surface type.
+		const std::string &surfaceType() const { return mSrfType; }
+
+		/// The model's layout dictionary.
+		const std::vector< FaceLayout > &layouts() const { return mLayouts; }
+
+		/// True if the model has knot intervals.
+		bool hasIntervals() const { return mBlocks[ ARRAY_KNOTINT ].length > 0; }
+
+		/// Reads the next element into 'elem'. Returns false once every element has
+		/// been read, or if reading fails, in which case failed() returns true.
+		bool next( IGAStreamElem &elem );
+
+		/// True if open() or next() failed because the file couldn't be read, or
+		/// because it wasn't valid.
+		bool failed() const { return mFailed; }
+
+		/// Why open() or next() failed, or an empty string if they haven't.
+		const std::string &error() const { return mError; }
+
+		/// Goes back to the first element.
+		void rewind();
+
+	private:
+		/// The arrays read through the page cache.
+		enum Array
+		{
+			ARRAY_VECDICT,
+			ARRAY_PT3DW,
+			ARRAY_2DPIECE,
+			ARRAY_EDGES,
+			ARRAY_KNOTINT,
+			ARRAY_SHAPE,
+			ARRAY_COUNT
+		};
+
+		/// Where an array's contents are in the file.
+		struct BlockLocation
+		{
+			uint64_t offset = 0;
+			uint64_t length = 0;
+		};
+
+		/// One page of an array.
+		struct Page
+		{
+			uint64_t key = ~0ull;
+			uint64_t last_use = 0;
+			std::vector< char > data;
+		};
+
+		/// Copies 'count' items of T, starting at item 'first', from an array. Returns
+		/// false if they aren't all in the array or can't be read.
+		template< typename T >
+		bool readItems( Array array, uint64_t first, size_t count, T *destination );
+
+		/// Copies 'count' coefficients, starting at index 'first' in the model's
+		/// coefficients, which start with those of the shared dictionary if there is
+		/// one. Returns false if they aren't all there or can't be read.
+		bool readCoeffs( uint64_t first, size_t count, double *destination );
+
+		/// Copies bytes from an array through the page cache.
+		bool readBytes( Array array, uint64_t offset, size_t length, char *destination );
+
+		/// Returns the page holding bytes from page_index * mPageBytes in an array,
+		/// reading it if it isn't cached, or nullptr on failure.
+		const Page *findPage( Array array, uint64_t page_index );
+
+		/// Sets mFailed and mError, and returns false.
+		bool fail( const std::string &message );
+
+		/// See the constructor.
+		size_t mPageBytes = 0;
+		size_t mMaxPages = 0;
+
+		IGAReader *mReader = nullptr;
+		BlockLocation mBlocks[ ARRAY_COUNT ];
+		std::string mSrfType;
+		std::vector< FaceLayout > mLayouts;
+		std::shared_ptr< const IGASharedDictionary > mSharedDictionary;
+		uint32_t mElemCount = 0;
+		uint32_t mPointCount = 0;
+
+		/// The number of coefficients, counting those in the shared dictionary.
+		uint64_t mCoeffCount = 0;
+
+		/// The next element to read, and where its pieces and edges start.
+		uint32_t mNextElem = 0;
+		uint32_t mPieceBegin = 0;
+		uint32_t mEdgeBegin = 0;
+		bool mFailed = false;
+		std::string mError;
+
+		/// The page cache. mPageSlots maps a page's key (array and page index) to
+		/// its position in mPages; the least recently used page is replaced when
+		/// the cache is full.
+		std::vector< Page > mPages;
+		std::unordered_map< uint64_t, size_t > mPageSlots;
+		uint64_t mUseCounter = 0;
+	};
+}
+
+#endif
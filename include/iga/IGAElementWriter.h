@@ -0,0 +1,182 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_ELEMENT_WRITER_H_
+#define IGA_ELEMENT_WRITER_H_
+
+#include "IGACreator.h"
+#include "IGAWriter.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace iga_fileio
+{
+	/// Writes a model to an IGAWriter as it's built, without ever holding the whole
+	/// model in memory. It's used like IGACreator: add each element's points,
+	/// pieces and edges, then call finishElem, and call finish() once every element
+	/// has been added. The results are the same as building an IGAData with
+	/// IGACreator and passing it to IGAWriter::writeIGAFile.
+	///
+	/// Only the dictionaries (the coefficients and the layouts) are kept in memory.
+	/// The points, pieces, edges, intervals and elements are collected in buffers,
+	/// and once a buffer grows past the size given to the constructor, it and
+	/// everything after it is moved to a temporary file (see std::tmpfile). When
+	/// finish() is called, the file is assembled from the dictionaries and the
+	/// buffers or temporary files, in the usual block order. The memory used is
+	/// therefore proportional to the dictionaries rather than to the mesh.
+	///
+	/// The writer's setAlignBlocks, setWriteIndex and setWriteChecksums options are
+	/// honored. setCompressBlocks only applies to the blocks that stayed in memory;
+	/// blocks that were moved to temporary files are written uncompressed. Those
+	/// blocks are passed to IGAWriter::writeDataV a buffer at a time rather than
+	/// through IGAWriter::writeBlock, so an override of writeBlock won't see them.
+	///
+	/// As with IGACreator, the functions that add things return the index added,
+	/// or INVALID_INDEX on failure. Nothing is written to the IGAWriter until
+	/// finish() is called.
+	class IGAElementWriter
+	{
+	public:
+		/// The writer must outlive this object. Each of the five streamed arrays
+		/// keeps up to buffer_bytes in memory before it moves to a temporary file.
+		IGAElementWriter( IGAWriter &writer, size_t buffer_bytes = 1 << 20 );
+
+		~IGAElementWriter();
+
+		IGAElementWriter( const IGAElementWriter & ) = delete;
+		IGAElementWriter &operator=( const IGAElementWriter & ) = delete;
+
+		/// Add an edge and its interval. Pass a negative number for the
+		/// knot_interval if you don't want to save intervals, or pass a value
+		/// >= 0.0 if you do. As with IGACreator, you must be consistent about this.
+		uint32_t addEdge( uint32_t elem, double knot_interval );
+
+		/// Appends 'count' edges and returns the index of the first one. Pass
+		/// nullptr for knot_intervals if you aren't saving intervals. See
+		/// IGACreator::addEdges.
+		uint32_t addEdges( const uint32_t *edges, const double *knot_intervals, size_t count );
+
+		/// Adds an explicit piece. See IGACreator::addExplicitPiece.
+		uint32_t addExplicitPiece( int s_order, uint32_t pt_index, const CoeffVector &coeffs );
+		uint32_t addExplicitPiece( int s_order, uint32_t pt_index, const double *coeffs, size_t coeff_count );
+
+		/// Adds a Piece2D that you've built yourself. The dictionary indices aren't
+		/// checked.
+		uint32_t addPiece( const Piece2D &piece );
+
+		/// Appends 'count' Piece2Ds and returns the index of the first one.
+		uint32_t addPieces( const Piece2D *pieces, size_t count );
+
+		/// Adds a Point3d and returns the index added.
+		uint32_t addPoint( const Point3d &pt );
+
+		/// Appends 'count' Point3ds and returns the index of the first one.
+		uint32_t addPoints( const Point3d *pts, size_t count );
+
+		/// Adds a tensor-product piece. See IGACreator::addTensorPiece.
+		uint32_t addTensorPiece( const CoeffVector &s_coeffs, const CoeffVector &t_coeffs, uint32_t pt_index );
+		uint32_t addTensorPiece( const double *s_coeffs, int s_order, const double *t_coeffs, int t_order, uint32_t pt_index );
+
+		/// Call this after you've finished adding all the pieces and edges for
+		/// the current element. See IGACreator::finishElem.
+		uint32_t finishElem( uint32_t layout_index );
+
+		/// Returns the dictionary index of the given coefficients, adding them if
+		/// they aren't already there. See IGACreator::getDictionaryIndex.
+		uint32_t getDictionaryIndex( const CoeffVector &coeffs );
+		uint32_t getDictionaryIndex( const double *coeffs, size_t coeff_count );
+
+		/// Returns the index of a face layout, adding it if needed. See
+		/// IGACreator::getLayoutIndex.
+		uint32_t getLayoutIndex( const FaceLayout &layout );
+
+		/// Set a string to record the type of surface that's being saved.
+		void setSurfaceType( const std::string &surface_type ) { mSrfType = surface_type; }
+
+		/// Writes the file through the IGAWriter, in the same way as
+		/// IGAWriter::writeIGAFile. Returns false if the last element wasn't
+		/// finished, if anything added earlier failed for lack of disk space, or if
+		/// the writes fail. Either way, this object is then empty again, and may be
+		/// used to write another file.
+		bool finish();
+
+	private:
+		/// The arrays that are streamed, in the order they're written.
+		enum Array
+		{
+			ARRAY_PT3DW,
+			ARRAY_2DPIECE,
+			ARRAY_EDGES,
+			ARRAY_KNOTINT,
+			ARRAY_SHAPE,
+			ARRAY_COUNT
+		};
+
+		/// The contents of one streamed block. Once 'file' is open, 'buffer' holds
+		/// the contents that follow what's in the file.
+		struct Spool
+		{
+			std::vector< char > buffer;
+			std::FILE *file = nullptr;
+			uint64_t length = 0;
+			uint32_t crc = 0;
+		};
+
+		/// Appends 'count' items of 'item_size' bytes to a spool and returns the
+		/// index of the first, or INVALID_INDEX if the indices would overflow or the
+		/// temporary file can't be written.
+		uint32_t appendItems( Array array, const void *items, size_t item_size, size_t count );
+
+		/// Moves the contents of a spool's buffer to its temporary file, opening the
+		/// file if need be.
+		bool spill( Spool &spool );
+
+		/// Writes a spool's contents as a block through mWriter.
+		bool writeSpool( const char *block_type, Spool &spool );
+
+		/// The number of items in an array.
+		uint32_t itemCount( Array array, size_t item_size ) const
+		{
+			return static_cast< uint32_t >( mSpools[ array ].length / item_size );
+		}
+
+		/// Closes the temporary files and empties everything.
+		void clear();
+
+		IGAWriter *mWriter = nullptr;
+		size_t mBufferBytes = 0;
+
+		Spool mSpools[ ARRAY_COUNT ];
+
+		/// Set if a temporary file couldn't be written, which makes finish() fail.
+		bool mFailed = false;
+
+		/// The pieces and edges before these belong to finished elements.
+		uint32_t mElemPieceBegin = 0;
+		uint32_t mElemEdgeBegin = 0;
+
+		/// The resident parts of the model.
+		std::string mSrfType = "unknown";
+		std::vector< double > mCoeffs;
+		std::vector< FaceLayout > mLayouts;
+
+		/// The lookup tables for the dictionaries, as in IGACreator.
+		CoeffHashLookup mCoeffLookup;
+		LayoutLookup mLayoutLookup;
+	};
+}
+
+#endif
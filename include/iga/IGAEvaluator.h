@@ -0,0 +1,131 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_EVALUATOR_H_
+#define IGA_EVALUATOR_H_
+
+#include "IGADataView.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iga_fileio
+{
+	/// A position or derivative computed by the evaluator.
+	struct Vector3d
+	{
+		double x = 0, y = 0, z = 0;
+	};
+
+	/// A rational Bezier patch in homogeneous form. The control point for basis
+	/// functions (s, t) is points[ s + t * s_order ], with its weight multiplied
+	/// in, just like the points of an IGAData.
+	struct IGABezierPatch
+	{
+		int s_order = 0;
+		int t_order = 0;
+		std::vector< Point3d > points;
+	};
+
+	/// A Bezier patch laid out like an IGABezierPatch, whose control points are
+	/// stored elsewhere (for example in an IGABezierCache).
+	struct IGABezierPatchRef
+	{
+		int s_order = 0;
+		int t_order = 0;
+		const Point3d *points = nullptr;
+	};
+
+	/// An element in Bezier form. Each of an element's pieces is a grid of
+	/// Bernstein coefficients times a control point, so the pieces with the same
+	/// orders add up to a single Bezier patch; elements usually have only one.
+	/// The surface is the sum of the patches, divided through by the weight.
+	struct IGABezierElem
+	{
+		std::vector< IGABezierPatch > patches;
+
+		/// The highest s or t order of any patch.
+		int maxOrder() const;
+	};
+
+	/// Sums the pieces of an element into Bezier patches, reusing the memory
+	/// already held by 'bezier'. The patches are in the order in which their orders
+	/// first appear among the pieces. Returns false if elem_index is out of range;
+	/// otherwise the data must be valid (see IGAData::isValid).
+	bool extractBezierElem( const IGADataView &data, uint32_t elem_index, IGABezierElem &bezier );
+
+	/// Evaluates an element at 'count' parameter pairs ( s[ i ], t[ i ] ), each
+	/// in [ 0, 1 ], writing the position of each to positions[ i ]. If s_derivs and
+	/// t_derivs aren't null, the first derivatives with respect to s and t are
+	/// written to them as well.
+	///
+	/// Several parameter pairs are evaluated at once using AVX-512 or AVX2 when
+	/// the processor has them, which is checked at run time; see setEvalKernel().
+	/// Pass large batches, such as all the samples of an element, to get the most
+	/// out of them. Every kernel does the same arithmetic in the same order, without
+	/// fusing multiplies and adds, so they all give exactly the same results.
+	void evaluateBezierElem( const IGABezierElem &bezier, const double *s, const double *t, size_t count,
+		Vector3d *positions, Vector3d *s_derivs = nullptr, Vector3d *t_derivs = nullptr );
+
+	/// The same as evaluateBezierElem, for an element given as 'patch_count'
+	/// patches whose control points are stored elsewhere.
+	void evaluateBezierPatches( const IGABezierPatchRef *patches, size_t patch_count, const double *s, const double *t, size_t count,
+		Vector3d *positions, Vector3d *s_derivs = nullptr, Vector3d *t_derivs = nullptr );
+
+	/// The instruction sets evaluateBezierElem can use.
+	enum EvalKernel
+	{
+		/// The best one this processor supports. This is the default.
+		EVAL_KERNEL_AUTO,
+		/// Plain C++, one parameter pair at a time.
+		EVAL_KERNEL_SCALAR,
+		/// AVX2, four parameter pairs at a time.
+		EVAL_KERNEL_AVX2,
+		/// AVX-512, eight parameter pairs at a time.
+		EVAL_KERNEL_AVX512
+	};
+
+	/// Chooses the instruction set used by evaluateBezierElem, for every thread.
+	/// Returns false, changing nothing, if this build or processor doesn't support
+	/// it. Mostly useful for testing and benchmarking.
+	bool setEvalKernel( EvalKernel kernel );
+
+	/// The instruction set evaluateBezierElem is using. This is never
+	/// EVAL_KERNEL_AUTO.
+	EvalKernel evalKernel();
+
+	/// Evaluates the elements of one model. This keeps the Bezier form of the last
+	/// element it evaluated, so evaluate all the parameters you need for an element
+	/// before moving on to the next. The view's arrays must outlive the evaluator.
+	/// Each thread needs its own IGAEvaluator.
+	class IGAEvaluator
+	{
+	public:
+		IGAEvaluator( const IGADataView &data );
+
+		/// Evaluates an element; see evaluateBezierElem(). Returns false if
+		/// elem_index is out of range.
+		bool evaluate( uint32_t elem_index, const double *s, const double *t, size_t count,
+			Vector3d *positions, Vector3d *s_derivs = nullptr, Vector3d *t_derivs = nullptr );
+
+	private:
+		IGADataView mData;
+
+		/// The Bezier form of element mBezierIndex.
+		IGABezierElem mBezier;
+		uint32_t mBezierIndex = INVALID_INDEX;
+	};
+}
+
+#endif
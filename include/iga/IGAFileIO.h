@@ -19,10 +19,27 @@
 // You can use this if you don't want to include individual headers
 // separately for each class.
 
+#include "IGAAdjacency.h"
+#include "IGAAsyncReader.h"
+#include "IGABVH.h"
+#include "IGABezierCache.h"
+#include "IGAChecksum.h"
+#include "IGACodec.h"
 #include "IGACommon.h"
+#include "IGACompact.h"
 #include "IGACreator.h"
 #include "IGAData.h"
+#include "IGADataSoA.h"
+#include "IGADataView.h"
+#include "IGAElementCursor.h"
+#include "IGAElementWriter.h"
+#include "IGAEvaluator.h"
+#include "IGAFileWriter.h"
+#include "IGAMappedReader.h"
+#include "IGAParallel.h"
 #include "IGAReader.h"
+#include "IGASharedDictionary.h"
+#include "IGATessellator.h"
 #include "IGAWriter.h"
 
 #endif
@@ -0,0 +1,60 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_FILE_WRITER_H_
+#define IGA_FILE_WRITER_H_
+
+#include "IGAWriter.h"
+#include <cstddef>
+
+namespace iga_fileio
+{
+	/// A writer that saves directly to a file. Its writeDataV uses a single
+	/// gather-write (writev on POSIX systems) for many segments at a time, so
+	/// writeIGAFile only needs a handful of system calls however many blocks
+	/// the file has.
+	class IGAFileWriter : public IGAWriter
+	{
+	public:
+		IGAFileWriter() = default;
+		IGAFileWriter( const IGAFileWriter & ) = delete;
+		IGAFileWriter &operator=( const IGAFileWriter & ) = delete;
+		~IGAFileWriter();
+
+		/// Create (or truncate) the named file for writing. Returns false if the
+		/// file couldn't be opened. Any previously opened file is closed first.
+		bool open( const char *filename );
+
+		/// Close the file. Returns false if there was nothing open, or if closing
+		/// reported an error.
+		bool close();
+
+		/// Writes to the file. Returns false if nothing is open or the write fails.
+		bool writeData( const char *data_block, size_t length ) override;
+
+		/// Writes all of the segments using as few system calls as possible.
+		bool writeDataV( const IGAWriteSegment *segments, size_t segment_count ) override;
+
+	private:
+		#ifdef _WIN32
+		/// The Windows file handle.
+		void *mFileHandle = nullptr;
+		#else
+		/// The file descriptor.
+		int mFile = -1;
+		#endif
+	};
+}
+
+#endif
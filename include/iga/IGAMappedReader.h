@@ -0,0 +1,133 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_MAPPED_READER_H_
+#define IGA_MAPPED_READER_H_
+
+#include "IGAReader.h"
+#include <cstdint>
+
+namespace iga_fileio
+{
+	class IGADataView;
+
+	/// A reader that memory-maps an IGA file (or wraps a buffer that is already in
+	/// memory). It can be used in two ways:
+	///
+	///   - readIGAView() checks the block headers in place and points an IGADataView
+	///     at the block contents, without copying them. The cost is proportional to
+	///     the number of blocks rather than the size of the file. The view borrows
+	///     the mapping, so this reader must stay open while the view is in use.
+	///   - readIGAFile(), inherited from IGAReader, copies everything into an IGAData
+	///     as usual. In this case the reader may be closed as soon as it returns.
+	///
+	/// The blocks written by IGAWriter are not normally aligned, so their contents
+	/// can't be viewed in place; readIGAView copies those blocks into memory owned
+	/// by the view. Use IGAWriter::setAlignBlocks() when writing files that you
+	/// intend to map.
+	class IGAMappedReader : public IGAReader
+	{
+	public:
+		IGAMappedReader() = default;
+		IGAMappedReader( const IGAMappedReader & ) = delete;
+		IGAMappedReader &operator=( const IGAMappedReader & ) = delete;
+		~IGAMappedReader();
+
+		/// Map the named file for reading. Returns false if the file couldn't be
+		/// opened or mapped. Any previously opened file is closed first.
+		bool open( const char *filename );
+
+		/// Read from a buffer that the caller has already loaded or mapped. The buffer
+		/// is not copied, and must outlive both this reader and any views made from it.
+		void openBuffer( const char *data, size_t size );
+
+		/// Unmap the file. Any IGADataView read from it becomes invalid.
+		void close();
+
+		/// The start of the mapped bytes, or nullptr if nothing is open.
+		const char *data() const { return mData; }
+
+		/// The number of mapped bytes.
+		uint64_t size() const { return mSize; }
+
+		/// Copies from the mapping and advances the read position.
+		bool readData( char *destination, size_t length ) override;
+
+		/// Advances the read position without touching the skipped bytes.
+		bool skipData( uint64_t length ) override;
+
+		/// Moves the read position within the mapping.
+		bool seekData( uint64_t offset ) override;
+
+		/// The number of mapped bytes.
+		uint64_t sourceSize() override { return mSize; }
+
+		/// Copies from the mapping. This is thread-safe, so loadIGAModels can load
+		/// models from a mapped file in parallel.
+		bool readDataAt( uint64_t offset, char *destination, size_t length ) override;
+
+		/// Points 'view' at the blocks in the mapped file. This applies the same rules
+		/// as readIGAFile: the file must start with the TSS header and the IGAFILE
+		/// block, unknown blocks are skipped, and a SRFTYPE block discards anything
+		/// read before it. Every block header and trailing length is checked against
+		/// the bounds of the mapping. Returns false if the file is malformed.
+		///
+		/// The block_mask works the same way as it does for readIGAFile, although
+		/// there is little to gain from it unless the file's blocks are misaligned.
+		bool readIGAView( IGADataView &view, uint32_t block_mask = BLOCK_ALL );
+
+		/// Points 'view' at one of the models found by readIGAModels. Views of
+		/// different models may be made from several threads at once.
+		bool readIGAView( const IGAModelHandle &model, IGADataView &view, uint32_t block_mask = BLOCK_ALL ) const;
+
+	private:
+		/// The contents of the last CRC32C block seen by viewBlock, if 'valid' is set.
+		struct PendingChecksum
+		{
+			ChecksumBlock block;
+			bool valid = false;
+		};
+
+		/// Checks the block that starts at 'offset' and, if it's one selected by the
+		/// block_mask, points the appropriate span of the view at its contents. The
+		/// block's header is returned in block_header. CRC32C blocks are recorded in
+		/// 'checksum', and checked against the contents of the next block viewed.
+		bool viewBlock( uint64_t offset, IGADataView &view, uint32_t block_mask, BlockHeader &block_header,
+			PendingChecksum &checksum ) const;
+
+		/// Puts the coefficients of the shared dictionary named by a DICTREF block,
+		/// if any, in front of the model's own, once all the blocks are viewed.
+		static bool resolveSharedDictionary( IGADataView &view );
+
+		/// The mapped bytes.
+		const char *mData = nullptr;
+
+		/// The number of mapped bytes.
+		uint64_t mSize = 0;
+
+		/// The position of the next readData() call.
+		uint64_t mPosition = 0;
+
+		/// True if mData came from open() and must be unmapped by close().
+		bool mOwnsMapping = false;
+
+		#ifdef _WIN32
+		/// The Windows file and file-mapping handles.
+		void *mFileHandle = nullptr;
+		void *mMappingHandle = nullptr;
+		#endif
+	};
+}
+
+#endif
@@ -0,0 +1,125 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_PARALLEL_H_
+#define IGA_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace iga_fileio
+{
+	/// The number of threads used by the library's parallel functions when they
+	/// are passed a thread_count of 0.
+	inline unsigned defaultThreadCount()
+	{
+		unsigned hardware_threads = std::thread::hardware_concurrency();
+		return hardware_threads > 0 ? hardware_threads : 1;
+	}
+
+	/// Runs task on one of a fixed set of defaultThreadCount() background threads,
+	/// which are shared by the whole library and started on first use. Tasks run
+	/// in the order they're submitted, as threads become free; so submitting
+	/// hundreds of tasks doesn't start hundreds of threads. The task must not throw,
+	/// and must not wait for a task submitted after it, which may never start.
+	void runInBackground( std::function< void() > task );
+
+	/// The state shared by the threads working on one parallelRanges call. The
+	/// helpers hold on to it, as they may not start until the call has returned.
+	struct ParallelRangesState
+	{
+		/// The next range to hand out, and how many there are.
+		std::atomic< size_t > next_range{ 0 };
+		size_t range_count = 0;
+
+		/// The number of ranges finished, which is guarded by 'mutex'.
+		size_t finished_count = 0;
+		std::mutex mutex;
+		std::condition_variable all_finished;
+	};
+
+	/// Splits [0..count) into consecutive ranges of at least min_range items, and
+	/// calls func( begin, end ) once for each range, using up to thread_count threads
+	/// (0 means defaultThreadCount()). The calling thread does some of the work, and
+	/// this returns once every range is finished. Ranges are handed out on demand,
+	/// so uneven amounts of work per item still balance across the threads.
+	///
+	/// The other threads are borrowed from the runInBackground pool rather than
+	/// started for each call, so short parallel steps don't pay for creating
+	/// threads. The calling thread only waits for ranges that another thread has
+	/// already started; if the pool is busy, it does the rest itself. So this may be
+	/// called from a background task, or from inside func.
+	///
+	/// The ranges may be processed in any order, so func must be safe to call
+	/// concurrently on different ranges. func must not throw.
+	template< typename Func >
+	void parallelRanges( size_t count, size_t min_range, unsigned thread_count, Func func )
+	{
+		if( count == 0 )
+			return;
+		if( thread_count == 0 )
+			thread_count = defaultThreadCount();
+		if( min_range == 0 )
+			min_range = 1;
+
+		// Aim for a few ranges per thread so that a slow range doesn't hold
+		// everyone else up.
+		size_t range_size = std::max( min_range, count / ( size_t( thread_count ) * 4 ) + 1 );
+		size_t range_count = ( count + range_size - 1 ) / range_size;
+		size_t worker_count = std::min( size_t( thread_count ), range_count );
+		if( worker_count <= 1 )
+		{
+			func( size_t( 0 ), count );
+			return;
+		}
+
+		// A helper that starts after every range has been handed out returns
+		// without touching func, which may be gone by then.
+		std::shared_ptr< ParallelRangesState > state = std::make_shared< ParallelRangesState >();
+		state->range_count = range_count;
+		Func *shared_func = &func;
+		auto worker = [state, shared_func, range_size, count]() {
+			size_t finished = 0;
+			for( ;; )
+			{
+				size_t irange = state->next_range++;
+				if( irange >= state->range_count )
+					break;
+				size_t begin = irange * range_size;
+				( *shared_func )( begin, std::min( begin + range_size, count ) );
+				++finished;
+			}
+			if( finished == 0 )
+				return;
+			std::lock_guard< std::mutex > lock( state->mutex );
+			state->finished_count += finished;
+			if( state->finished_count == state->range_count )
+				state->all_finished.notify_all();
+		};
+		for( size_t ithread = 1; ithread < worker_count; ++ithread )
+			runInBackground( worker );
+		worker();
+
+		std::unique_lock< std::mutex > lock( state->mutex );
+		state->all_finished.wait( lock, [&state]() { return state->finished_count == state->range_count; } );
+	}
+}
+
+#endif
@@ -15,11 +15,27 @@
 #ifndef IGA_READER_H_
 #define IGA_READER_H_
 
+#include "IGAChecksum.h"
+#include "IGACommon.h"
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
 #include <vector>
 
 namespace iga_fileio
 {
 	class IGAData;
+	class IGASharedDictionary;
+
+	/// The location of one model within a file that holds several of them. These
+	/// are cheap to make and hold no geometry; see IGAReader::readIGAModels.
+	struct IGAModelHandle
+	{
+		/// The model's blocks in file order. Normally the first one is the model's
+		/// SRFTYPE block.
+		std::vector< BlockIndexEntry > blocks;
+	};
 
 	/// A pure virtual base class for reading IGA data from a stream or file.
 	class IGAReader
@@ -42,6 +58,40 @@ namespace iga_fileio
 		/// { return !read( static_cast< char * >( destination, length ).bad(); }
 		virtual bool readData( char *destination, size_t length ) = 0;
 
+		/// Skip over 'length' bytes of the stream. This is used for blocks that
+		/// aren't recognized and blocks that weren't selected for reading. The
+		/// default implementation reads the bytes into a small buffer and discards
+		/// them; if your stream can seek, you should override this. For example,
+		/// with an istream:
+		///
+		/// { return !seekg( length, std::ios::cur ).fail(); }
+		///
+		/// As with readData, return false if the bytes could not be skipped.
+		virtual bool skipData( uint64_t length );
+
+		/// Optional. Move the read position to 'offset' bytes from the start of
+		/// the stream. Return false if the stream can't seek; this is what the
+		/// default implementation does.
+		///
+		/// If you provide both this and sourceSize(), readIGAFile will look for an
+		/// INDEX block at the end of the file, and if it finds one, it will seek
+		/// directly to the blocks it needs instead of reading through the file.
+		virtual bool seekData( uint64_t /*offset*/ ) { return false; }
+
+		/// Optional. The total size of the stream in bytes, or 0 if it isn't known,
+		/// which is what the default implementation returns. See seekData().
+		virtual uint64_t sourceSize() { return 0; }
+
+		/// Optional. Read 'length' bytes starting 'offset' bytes from the start of the
+		/// stream, without using or changing the read position used by readData.
+		/// Unlike the other functions here, this may be called from several threads
+		/// at once, so your implementation must be thread-safe (pread() is a good
+		/// fit). Return false if that isn't possible; this is what the default
+		/// implementation does.
+		///
+		/// If you provide this, loadIGAModels can load several models in parallel.
+		virtual bool readDataAt( uint64_t /*offset*/, char * /*destination*/, size_t /*length*/ ) { return false; }
+
 		/// This will be called after the final file read is finished to
 		/// allow you to do any cleanup you need. Possibly useful for closing
 		/// the file or similar.
@@ -49,11 +99,148 @@ namespace iga_fileio
 
 		/// The core read function. Generates a series of readData calls
 		/// and returns true if reading the file succeeds.
-		bool readIGAFile( IGAData &geometry );
+		///
+		/// Pass a combination of the BLOCK_ flags from IGACommon.h as the block_mask
+		/// to load only some of the blocks; the others are skipped with skipData.
+		/// For example, BLOCK_SHAPE | BLOCK_EDGES | BLOCK_LAYOUT | BLOCK_KNOTINT
+		/// loads the element topology without any of the geometry. Be aware that a
+		/// partially loaded IGAData will generally not pass isValid().
+		bool readIGAFile( IGAData &geometry, uint32_t block_mask = BLOCK_ALL );
+
+		/// Runs readIGAFile on a background thread (see runInBackground in
+		/// IGAParallel.h) and returns its result through the future. Neither this
+		/// reader nor geometry may be used until the result is ready. Loads started
+		/// this way share a fixed set of threads, so many files can be loaded at once
+		/// without a thread for each; IGAAsyncFileReader also shares its I/O threads.
+		std::future< bool > readIGAFileAsync( IGAData &geometry, uint32_t block_mask = BLOCK_ALL );
+
+		/// The same as the future-based readIGAFileAsync, but calls
+		/// on_finished( result ) on the background thread once the load is done.
+		void readIGAFileAsync( IGAData &geometry, std::function< void( bool ) > on_finished, uint32_t block_mask = BLOCK_ALL );
+
+		/// Finds every model in a file, without loading any of them. A file may hold
+		/// many models one after another, each starting with a SRFTYPE block;
+		/// readIGAFile only keeps the last of them. Use loadIGAModel or loadIGAModels
+		/// to load the models you need.
+		///
+		/// This requires seekData() and sourceSize(). If the file has an INDEX
+		/// block, it is used; otherwise the block headers are read and the blocks'
+		/// contents are skipped. Returns false if the file is malformed or if the
+		/// reader can't seek. Note that readFinished() is not called by this or by
+		/// the model loading functions, since you may load further models later.
+		bool readIGAModels( std::vector< IGAModelHandle > &models );
+
+		/// Loads a model found by readIGAModels. The block_mask works as it does for
+		/// readIGAFile. Returns false if the model's blocks can't be read.
+		bool loadIGAModel( const IGAModelHandle &model, IGAData &geometry, uint32_t block_mask = BLOCK_ALL );
+
+		/// Loads a model found by readIGAModels, reading and decoding its blocks in
+		/// parallel using up to thread_count threads (0 means defaultThreadCount()).
+		/// This needs readDataAt(); readers without it load the blocks one at a time,
+		/// as loadIGAModel does. When a model has several blocks of the same kind,
+		/// only the one that would end up in the IGAData is read.
+		bool loadIGAModelParallel( const IGAModelHandle &model, IGAData &geometry,
+			uint32_t block_mask = BLOCK_ALL, unsigned thread_count = 0 );
+
+		/// The same as readIGAFile, except that it finds the blocks of the file's last
+		/// model first (from the INDEX block, or by reading just the block headers) and
+		/// then loads them with loadIGAModelParallel. This helps most with large,
+		/// compressed files on fast storage. Readers that can't seek, or don't provide
+		/// readDataAt(), fall back to readIGAFile.
+		bool readIGAFileParallel( IGAData &geometry, uint32_t block_mask = BLOCK_ALL, unsigned thread_count = 0 );
+
+		/// Loads several models found by readIGAModels; geometry is resized to match
+		/// models. If this reader provides readDataAt(), the models are loaded in
+		/// parallel using up to thread_count threads (0 means defaultThreadCount());
+		/// otherwise they are loaded one at a time. Returns false if any model fails
+		/// to load.
+		bool loadIGAModels( const std::vector< IGAModelHandle > &models, std::vector< IGAData > &geometry,
+			uint32_t block_mask = BLOCK_ALL, unsigned thread_count = 0 );
+
+		/// If enabled, a block that follows a CRC32C block (see
+		/// IGAWriter::setWriteChecksums) is checked against the checksum as it's read,
+		/// and reading fails if they don't match. Blocks that are skipped, or that
+		/// have no checksum, aren't checked. Enabled by default.
+		void setVerifyChecksums( bool verify_checksums ) { mVerifyChecksums = verify_checksums; }
+
+		/// See setVerifyChecksums().
+		bool verifyChecksums() const { return mVerifyChecksums; }
+
+		/// Lets this reader load models that refer to the given shared dictionary
+		/// (see IGASharedDictionary). Such a model's coefficients are the dictionary's
+		/// followed by those in the model's own VECDICT block. Loading a model fails
+		/// if the dictionary it refers to hasn't been added.
+		void addSharedDictionary( std::shared_ptr< const IGASharedDictionary > dictionary );
+
+		/// The dictionary added with addSharedDictionary whose id() is 'dict_id', or
+		/// null if there isn't one. This may be called from several threads at once.
+		std::shared_ptr< const IGASharedDictionary > findSharedDictionary( uint64_t dict_id ) const;
+
+		/// The dictionaries added with addSharedDictionary.
+		const std::vector< std::shared_ptr< const IGASharedDictionary > > &sharedDictionaries() const { return mSharedDictionaries; }
 
 	private:
+		/// Reads the contents of a block into dst, checking them against
+		/// mExpectedChecksum if mCheckNextBlock is set.
+		template< typename T >
+		bool readBlock( std::vector< T > &dst, uint64_t len );
+
+		/// Reads the contents of a PACKED block and decompresses them into dst.
 		template< typename T >
-		bool readBlock( std::vector< T > &dst, size_t len );
+		bool readPackedBlock( std::vector< T > &dst, uint64_t inner_tag, uint64_t len );
+
+		/// Calls readPackedBlock if 'packed' is set, otherwise readBlock.
+		template< typename T >
+		bool readAnyBlock( std::vector< T > &dst, bool packed, uint64_t inner_tag, uint64_t len );
+
+		/// Skips the contents of a block and checks its trailing length.
+		bool skipBlock( uint64_t len );
+
+		/// Reads the contents of a DICTREF block, and finds the dictionary it names.
+		bool readDictionaryRef( IGAData &geometry, bool packed, uint64_t len );
+
+		/// Puts the coefficients of the shared dictionary found by readDictionaryRef,
+		/// if any, in front of the model's own. Called once a model is loaded.
+		bool resolveSharedDictionary( IGAData &geometry ) const;
+
+		/// Reads or skips the contents of a block with the given tag and id, as
+		/// appropriate for the block_mask. PACKED blocks are decompressed, and a
+		/// CRC32C block's checksum is kept for the block that follows it.
+		bool readBlockContents( IGAData &geometry, uint64_t tag, uint64_t id, uint64_t len, uint32_t block_mask );
+
+		/// Reads a block described by an index entry into geometry, after checking
+		/// that its header agrees with the entry.
+		bool loadIndexedBlock( const BlockIndexEntry &entry, IGAData &geometry, uint32_t block_mask );
+
+		/// If the block at model.blocks[ iblock ] has a CRC32C block before it,
+		/// reads the checksum so that loadIndexedBlock will check the block.
+		bool loadChecksumFor( const IGAModelHandle &model, size_t iblock, IGAData &geometry );
+
+		/// True if readDataAt() works for this reader.
+		bool supportsReadDataAt();
+
+		/// Loads and checks the INDEX block at the end of the stream. Returns false
+		/// if there isn't one, or if it doesn't exactly describe the file's blocks.
+		bool readIndex( std::vector< BlockIndexEntry > &index );
+
+		/// Lists the file's blocks by reading their headers and skipping their contents.
+		bool scanBlocks( std::vector< BlockIndexEntry > &blocks );
+
+		/// See setVerifyChecksums().
+		bool mVerifyChecksums = true;
+
+		/// See addSharedDictionary().
+		std::vector< std::shared_ptr< const IGASharedDictionary > > mSharedDictionaries;
+
+		/// The contents of the last CRC32C block, if mHaveChecksum is set. This is
+		/// cleared by the next block other than a PADDING block.
+		ChecksumBlock mChecksum;
+		bool mHaveChecksum = false;
+
+		/// Set by readBlockContents when the block being read has a checksum, which
+		/// the next readBlock checks. skipBlock clears it.
+		bool mCheckNextBlock = false;
+		uint32_t mExpectedChecksum = 0;
 	};
 }
 
@@ -0,0 +1,159 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_SHARED_DICTIONARY_H_
+#define IGA_SHARED_DICTIONARY_H_
+
+#include "IGACreator.h"
+#include "IGADataView.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace iga_fileio
+{
+	class IGAMappedReader;
+	class IGAReader;
+	class IGAWriter;
+
+	/// A coefficient dictionary that lives in a file of its own, so that many models
+	/// can share it. Models built from the same kinds of knot spans tend to use the
+	/// same handful of coefficient vectors; with a shared dictionary each model
+	/// file only stores the vectors that the dictionary doesn't have.
+	///
+	/// To use one, build it from some typical models with addModel(), save it with
+	/// write(), and pass it to IGACreator::setSharedDictionary() when building
+	/// models. The model's coefficients then start with a copy of the dictionary's,
+	/// so every vector in the dictionary is found at the same index in every model,
+	/// and IGAWriter writes a DICTREF block in place of them. To read such a model,
+	/// give the reader the dictionary with IGAReader::addSharedDictionary(); the
+	/// coefficients are put back in front of the model's own as it's loaded.
+	///
+	/// An IGAData always holds its own copy of the coefficients. A view made by
+	/// IGAMappedReader::readIGAView of a model with no coefficients of its own
+	/// points straight at the dictionary, so when the dictionary is opened with
+	/// open(), every such model in the process shares one mapped copy.
+	///
+	/// The dictionary file is an ordinary IGA file holding a single model, whose
+	/// surface type is "shared-dictionary". Its VECDICT block holds the
+	/// coefficients, and its 2DPIECE block has an explicit piece with a t_order of 1
+	/// for each vector, giving where the vector starts and how long it is. A
+	/// dictionary is identified by a hash of its coefficients (see id()), so a
+	/// model can't be loaded with a dictionary whose contents differ from the one
+	/// it was built with.
+	///
+	/// A dictionary built with addCoeffs() or read() owns its arrays. One opened
+	/// with open() may instead point into the mapped file, which stays open for
+	/// as long as the dictionary does. Either way, coeffs() and vectors() are only
+	/// valid until the dictionary changes, and addCoeffs() on a mapped dictionary
+	/// copies everything first. Readers and views hold dictionaries through
+	/// shared_ptr, so a dictionary in use isn't destroyed under them. The const
+	/// members only read, so several threads may use one dictionary while nothing
+	/// modifies it. Moving a dictionary hands over its arrays or mapping and
+	/// leaves the source empty.
+	class IGASharedDictionary
+	{
+	public:
+		IGASharedDictionary();
+		~IGASharedDictionary();
+		IGASharedDictionary( const IGASharedDictionary & ) = delete;
+		IGASharedDictionary &operator=( const IGASharedDictionary & ) = delete;
+		IGASharedDictionary( IGASharedDictionary && );
+		IGASharedDictionary &operator=( IGASharedDictionary && );
+
+		/// Adds a vector of coefficients, unless an equal one is already in the
+		/// dictionary, and returns its index in coeffs(). Returns INVALID_INDEX if
+		/// the coefficients aren't finite or the dictionary is full. If the
+		/// dictionary was opened from a file, it is copied into memory first.
+		uint32_t addCoeffs( const double *coeffs, size_t coeff_count );
+
+		/// Adds every coefficient vector used by the pieces of 'data'. Returns false,
+		/// having added some of them, if a piece refers to coefficients that 'data'
+		/// doesn't have, or if addCoeffs fails.
+		bool addModel( const IGADataView &data );
+
+		/// Empties the dictionary, closing any file it was opened from.
+		void clear();
+
+		/// All of the coefficients, one vector after another.
+		IGASpan< double > coeffs() const { return mCoeffs; }
+
+		/// The number of coefficients, which is the number a model's coefficients
+		/// are offset by when it uses this dictionary.
+		uint32_t coeffCount() const { return static_cast< uint32_t >( mCoeffs.size() ); }
+
+		/// Returns the index in coeffs() of a vector equal to the 'coeff_count'
+		/// coefficients at 'coeffs', or INVALID_INDEX if there isn't one.
+		uint32_t find( const double *coeffs, size_t coeff_count ) const;
+
+		/// A hash of the coefficients, which models record to say which dictionary
+		/// they were built with.
+		uint64_t id() const { return mId; }
+
+		/// Maps a dictionary file, replacing the contents. The coefficients are used
+		/// in place if the file was written with IGAWriter::setAlignBlocks and not
+		/// compressed, and are otherwise copied. The file stays mapped until the
+		/// dictionary is cleared or destroyed. Returns false, leaving the dictionary
+		/// empty, if the file can't be mapped or isn't a dictionary.
+		bool open( const char *filename );
+
+		/// Reads a dictionary file from any reader, replacing the contents. Returns
+		/// false, leaving the dictionary empty, if it isn't a dictionary.
+		bool read( IGAReader &reader );
+
+		/// The number of vectors.
+		uint32_t vectorCount() const { return static_cast< uint32_t >( mVectors.size() ); }
+
+		/// The vectors, as explicit pieces with a t_order of 1: s_index is where the
+		/// vector starts in coeffs(), and the s_order is its length.
+		IGASpan< Piece2D > vectors() const { return mVectors; }
+
+		/// Writes the dictionary as a file. The writer's settings, such as
+		/// setAlignBlocks, apply as they do to any other file.
+		bool write( IGAWriter &writer ) const;
+
+	private:
+		/// Points the dictionary at the given arrays, checks them, and builds the
+		/// lookup table and id. Returns false, leaving the dictionary empty, if the
+		/// vectors don't fit the coefficients.
+		bool attach( IGASpan< double > coeffs, IGASpan< Piece2D > vectors );
+
+		/// Copies mapped arrays into mOwnedCoeffs and mOwnedVectors, and closes the
+		/// mapping.
+		void makeOwned();
+
+		/// The arrays, which are either mOwnedCoeffs and mOwnedVectors or views of a
+		/// mapped file.
+		IGASpan< double > mCoeffs;
+		IGASpan< Piece2D > mVectors;
+
+		std::vector< double > mOwnedCoeffs;
+		std::vector< Piece2D > mOwnedVectors;
+
+		/// The file opened by open(), and the view of it.
+		std::unique_ptr< IGAMappedReader > mMapping;
+		IGADataView mView;
+
+		/// Finds vectors by their contents.
+		CoeffHashLookup mLookup;
+
+		/// The hash of the coefficients so far, before finishing, and the finished
+		/// hash returned by id().
+		uint64_t mHashState = 0;
+		uint64_t mId = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,138 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IGA_TESSELLATOR_H_
+#define IGA_TESSELLATOR_H_
+
+#include "IGAEvaluator.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace iga_fileio
+{
+	class IGAAdjacency;
+
+	/// How finely IGATessellator divides the elements.
+	struct IGATessellationOptions
+	{
+		/// The number of segments along each side of every element, if
+		/// chord_tolerance is 0. Elements are always divided into at least two
+		/// segments each way, so that they have a vertex inside them, and at most
+		/// 4096.
+		int segments = 8;
+
+		/// If this is greater than 0, each element is divided finely enough that
+		/// the triangles are expected to stay within this distance of the surface,
+		/// judged from the curvature of the element in each direction. The number of
+		/// segments is kept between min_segments and max_segments. An element whose
+		/// samples aren't all finite gets the fewest segments allowed, two.
+		double chord_tolerance = 0;
+		int min_segments = 2;
+		int max_segments = 64;
+	};
+
+	/// Turns a model into an indexed triangle mesh. Each element is divided into a
+	/// grid in its parameter space, and each of its edges is divided into segments
+	/// which are shared with the element across the edge, vertices and all. So
+	/// elements meet without cracks, even where they are divided differently or
+	/// meet at T-junctions; the edges on a side are sized by their knot intervals
+	/// (see IGAData::edgeInterval). Each shared vertex is evaluated on just one of
+	/// the elements, so where a model's elements don't quite meet, the mesh
+	/// closes the gap rather than following both.
+	///
+	/// Tessellating is done in two steps, so that the caller can allocate the
+	/// buffers: plan() works out how everything is divided and how big the mesh
+	/// will be, and tessellate() evaluates the vertices and writes the mesh. Both
+	/// run on several threads.
+	///
+	/// The mesh is laid out as follows. First come the vertices where edges meet,
+	/// then the vertices inside the edges, then the vertices inside each element
+	/// in turn. The triangles are grouped by element, in element order, and wind
+	/// counter-clockwise around the normal, which is the cross product of the s and
+	/// t derivatives.
+	class IGATessellator
+	{
+	public:
+		/// Works out how to divide every element of 'data', using up to thread_count
+		/// threads (0 means defaultThreadCount()), replacing any earlier plan. The
+		/// edges are paired with data.adjacency(). Returns false if the options make
+		/// no sense, or if the mesh would have too many vertices to index with 32
+		/// bits. The data must be valid (see IGAData::isValid), and it must outlive
+		/// this plan and not change while it's in use.
+		bool plan( const IGAData &data, const IGATessellationOptions &options = IGATessellationOptions(), unsigned thread_count = 0 );
+
+		/// The number of vertices in the planned mesh.
+		size_t vertexCount() const { return mVertexCount; }
+
+		/// The number of triangles in the planned mesh. The index buffer needs three
+		/// times this many entries.
+		size_t triangleCount() const { return mElems.empty() ? 0 : mElems.back().triangle_end; }
+
+		/// The first of the triangles for an element. elem_index must be less than
+		/// the number of elements planned.
+		size_t elemTriangleBegin( uint32_t elem_index ) const { return elem_index == 0 ? 0 : mElems[ elem_index - 1 ].triangle_end; }
+
+		/// The end of the triangles for an element. Pairs with elemTriangleBegin().
+		size_t elemTriangleEnd( uint32_t elem_index ) const { return mElems[ elem_index ].triangle_end; }
+
+		/// Writes the planned mesh, using up to thread_count threads (0 means
+		/// defaultThreadCount()). 'positions' must have room for vertexCount()
+		/// vertices, and 'indices' for 3 * triangleCount() indices. If 'normals' isn't
+		/// null, it must have room for vertexCount() unit normals, which are zero
+		/// where the surface is degenerate. Returns false if nothing is planned.
+		bool tessellate( Vector3d *positions, Vector3d *normals, uint32_t *indices, unsigned thread_count = 0 ) const;
+
+	private:
+		/// How an element is divided.
+		struct ElemPlan
+		{
+			/// The number of grid cells along s and t.
+			uint32_t s_segments = 0;
+			uint32_t t_segments = 0;
+			/// The first of the vertices inside the element.
+			uint32_t vertex_begin = 0;
+			/// The end of the element's triangles.
+			size_t triangle_end = 0;
+		};
+
+		/// How an edge is divided.
+		struct EdgePlan
+		{
+			/// Where the edge starts and ends along its side, from 0 to 1 going
+			/// counter-clockwise.
+			double begin = 0;
+			double end = 0;
+			/// The number of segments, which is the same for both edges of a pair.
+			uint32_t segments = 1;
+			/// The vertex at the start of the edge.
+			uint32_t point = 0;
+			/// The first vertex inside the edge. An edge that is paired with a lower
+			/// edge uses that edge's vertices, backwards.
+			uint32_t interior_begin = 0;
+			/// True if this edge evaluates the vertex at its start.
+			bool owns_point = false;
+			/// True if this edge evaluates the vertices inside it.
+			bool owns_interior = false;
+		};
+
+		IGADataView mData;
+		const IGAAdjacency *mAdjacency = nullptr;
+		std::vector< ElemPlan > mElems;
+		std::vector< EdgePlan > mEdges;
+		size_t mVertexCount = 0;
+	};
+}
+
+#endif
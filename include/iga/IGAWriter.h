@@ -15,12 +15,26 @@
 #ifndef IGA_WRITER_H_
 #define IGA_WRITER_H_
 
+#include "IGAChecksum.h"
+#include "IGACommon.h"
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
 
 namespace iga_fileio
 {
 	class IGAData;
 
+	/// One piece of the data passed to IGAWriter::writeDataV. This has the same
+	/// meaning as a POSIX iovec.
+	struct IGAWriteSegment
+	{
+		const char *data = nullptr;
+		size_t length = 0;
+	};
+
 	/// A pure virtual base class for writing to a stream/file.
 	class IGAWriter
 	{
@@ -31,13 +45,27 @@ namespace iga_fileio
 		/// return true if the write was successful and false if it was not.
 		virtual bool writeData( const char *data_block, size_t length ) = 0;
 
+		/// Write several pieces of data, one after another, as if by calling writeData
+		/// for each of them in turn. The default implementation does exactly that;
+		/// override it if your destination has a gather-write operation (such as
+		/// POSIX writev), or if it pays to write data in large pieces. See
+		/// IGAFileWriter for an example.
+		virtual bool writeDataV( const IGAWriteSegment *segments, size_t segment_count );
+
 		/// Used to write a full block to the output file. If you don't
 		/// provide an override for this function in your writer then it will
-		/// be implemented in terms of writeData. If you do provide an
+		/// be implemented in terms of writeDataV. If you do provide an
 		/// override, then you will need to write the blocks in whatever way
 		/// you see fit. Note that writeData is still called when writing
-		/// the TSS header ("#TSS0001"), but is otherwise only used in the
-		/// default implementation of writeBlock.
+		/// the TSS header ("#TSS0001"), but is otherwise only used by the
+		/// default implementations of writeBlock and writeDataV.
+		///
+		/// While writeIGAFile or writeIGAModels is running, the default
+		/// implementation doesn't write anything itself; it queues the block's
+		/// header, contents and trailing length, and the queue is passed to
+		/// writeDataV in large batches. If your override writes some blocks itself
+		/// and passes others on to IGAWriter::writeBlock, call flushBlocks() before
+		/// writing anything directly.
 		///
 		/// The default implementation will call tagValue() on the passed
 		/// block_type, so you can use the short-form names for blocks safely.
@@ -55,6 +83,140 @@ namespace iga_fileio
 		/// The core writer function. Generates a series of writeBlock calls
 		/// and returns true if they succeed.
 		bool writeIGAFile( const IGAData &geometry );
+
+		/// Writes several models into one file, one after another, in the given
+		/// order. Use IGAReader::readIGAModels to read them back; note that
+		/// IGAReader::readIGAFile only returns the last model in a file. Combined
+		/// with setWriteIndex, a reader can find each model without reading the
+		/// others.
+		bool writeIGAModels( const std::vector< const IGAData * > &models );
+
+		/// If enabled, writeIGAFile inserts small PADDING blocks so that the contents
+		/// of every array block start on an 8-byte boundary within the file. Readers
+		/// that don't know about PADDING blocks skip them, so the file stays readable
+		/// everywhere, but a memory-mapped file can then be viewed in place (see
+		/// IGAMappedReader). Disabled by default.
+		///
+		/// If you override writeBlock, the padding is only correct if your override
+		/// writes blocks in the standard layout.
+		void setAlignBlocks( bool align_blocks ) { mAlignBlocks = align_blocks; }
+
+		/// If enabled, writeIGAFile finishes the file with an INDEX block, which
+		/// records the tag, id, offset and length of every other block. A reader
+		/// that can seek uses it to go straight to the blocks it needs instead of
+		/// reading through the whole file. Disabled by default.
+		///
+		/// As with setAlignBlocks, the offsets are only correct if any override of
+		/// writeBlock writes blocks in the standard layout.
+		void setWriteIndex( bool write_index ) { mWriteIndex = write_index; }
+
+		/// If enabled, writeIGAFile compresses the array blocks, writing each one that
+		/// gets smaller as a PACKED block (see IGACodec.h). IGAReader and
+		/// IGAMappedReader decompress them transparently; older readers skip them as
+		/// unknown blocks, so they can't load the compressed parts of the model.
+		/// Disabled by default.
+		///
+		/// Compressed blocks aren't padded by setAlignBlocks, since they are always
+		/// decompressed into new memory when they're read.
+		void setCompressBlocks( bool compress_blocks ) { mCompressBlocks = compress_blocks; }
+
+		/// If enabled, writeIGAFile puts a CRC32C block before each block of the
+		/// model other than SRFTYPE, holding the crc32c of that block's contents (after
+		/// compression, if any). IGAReader and IGAMappedReader check the contents
+		/// against it as they read them; older readers skip CRC32C blocks as unknown
+		/// blocks. Each checksum adds 56 bytes to the file. Disabled by default.
+		void setWriteChecksums( bool write_checksums ) { mWriteChecksums = write_checksums; }
+
+	protected:
+		/// Writes any blocks queued by the default writeBlock. Returns false if the
+		/// write fails.
+		bool flushBlocks();
+
+	private:
+		/// IGAElementWriter writes its model through the functions below.
+		friend class IGAElementWriter;
+
+		/// The implementation of writeIGAFile and writeIGAModels.
+		bool writeModels( const IGAData *const *models, size_t model_count );
+
+		/// Writes the TSS header and the IGAFILE block, and starts queueing blocks.
+		bool beginFile();
+
+		/// Writes the INDEX block, if enabled, flushes the queue and calls
+		/// writeFinished(). Pass false for 'ok' if writing the models failed, in
+		/// which case the queue is flushed but nothing else is written.
+		bool finishFile( bool ok );
+
+		/// Writes the blocks for a single model, starting with its SRFTYPE block.
+		bool writeModelBlocks( const IGAData &geometry );
+
+		/// Writes a block through writeIndexedBlock, compressed if compression is
+		/// enabled and worthwhile, or else preceded by a PADDING block if alignment is
+		/// enabled and the contents would otherwise be misaligned. If checksums are
+		/// enabled, the CRC32C block comes first of all.
+		bool writeFileBlock( const char *block_type, const char *contents, size_t length );
+
+		/// Writes a block whose contents are too large to hold in memory. The
+		/// 'length' bytes of contents are fetched a piece at a time by calling
+		/// read_contents( buffer, count ) and passed straight to writeDataV, rather
+		/// than through writeBlock; 'crc' must be their crc32c. The block is never
+		/// compressed, but is otherwise written as writeFileBlock would write it.
+		bool writeStreamedBlock( const char *block_type, uint64_t length, uint32_t crc,
+			const std::function< bool( char *, size_t ) > &read_contents, char *buffer, size_t buffer_size );
+
+		/// Writes the CRC32C block for a block with the given tag and checksum.
+		bool writeChecksumBlock( uint64_t tag, uint32_t crc );
+
+		/// Writes a PADDING block, if needed, so that the next block's contents start
+		/// on an 8-byte boundary.
+		bool writeAlignment();
+
+		/// Writes a block through writeBlock, and records it for the index.
+		bool writeIndexedBlock( const char *block_type, const char *contents, size_t length, uint64_t id );
+
+		/// The header and trailing length of a block queued by writeBlock.
+		struct QueuedBlock
+		{
+			BlockHeader header;
+			uint64_t final_len = 0;
+		};
+
+		/// True while writeModels is running, which makes writeBlock queue blocks.
+		bool mQueueBlocks = false;
+
+		/// The data queued by writeBlock, waiting to be passed to writeDataV.
+		std::vector< IGAWriteSegment > mQueue;
+
+		/// Storage for the headers in mQueue. A deque never moves its elements, so
+		/// mQueue can point into it.
+		std::deque< QueuedBlock > mQueuedBlocks;
+
+		/// See setAlignBlocks().
+		bool mAlignBlocks = false;
+
+		/// See setWriteIndex().
+		bool mWriteIndex = false;
+
+		/// See setCompressBlocks().
+		bool mCompressBlocks = false;
+
+		/// The contents of the PACKED blocks in mQueue.
+		std::deque< std::vector< char > > mPackedBlocks;
+
+		/// See setWriteChecksums().
+		bool mWriteChecksums = false;
+
+		/// The contents of the CRC32C blocks in mQueue.
+		std::deque< ChecksumBlock > mChecksums;
+
+		/// The contents of the DICTREF blocks in mQueue.
+		std::deque< SharedDictionaryRef > mDictionaryRefs;
+
+		/// The blocks written so far by writeIGAFile.
+		std::vector< BlockIndexEntry > mIndex;
+
+		/// The number of bytes written so far by writeIGAFile.
+		uint64_t mOffset = 0;
 	};
 }
 
@@ -0,0 +1,219 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAAdjacency.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "iga/IGAEvaluator.h"
+#include "iga/IGAParallel.h"
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// Most elements have four edges, each needing only a short scan of one
+		// neighbor, so ranges are long to make each one worth a thread.
+		const size_t MIN_ELEMS_PER_RANGE = 4096;
+	}
+
+	void IGAAdjacency::build( const IGADataView &data, unsigned thread_count )
+	{
+		uint32_t elem_count = data.elemCount();
+		IGASpan< uint32_t > edges = data.edges();
+
+		mOffsets.resize( elem_count + size_t( 1 ) );
+		mNeighbors.assign( edges.begin(), edges.end() );
+		mReverseEdges.assign( edges.size(), INVALID_INDEX );
+		mSides.assign( edges.size(), 0 );
+		mOffsets[ 0 ] = 0;
+		parallelRanges( elem_count, MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				uint32_t edge_begin = ielem == 0 ? 0 : data.elems()[ ielem - 1 ].edge_end_index;
+				uint32_t edge_end = data.elems()[ ielem ].edge_end_index;
+				mOffsets[ ielem + 1 ] = edge_end;
+				const FaceLayout &layout = data.layout( data.layoutIndex( static_cast< uint32_t >( ielem ) ) );
+				int side = 0;
+				for( uint32_t iedge = edge_begin; iedge < edge_end; ++iedge )
+				{
+					while( side < 3 && iedge - edge_begin >= layout.side_range[ side + 1 ] )
+						++side;
+					mSides[ iedge ] = static_cast< uint8_t >( side );
+				}
+			}
+		} );
+
+		// Each pair of neighbors is done by the lower numbered of the two, which
+		// writes the reverse edges on both sides, so every edge is written by just
+		// one thread.
+		parallelRanges( elem_count, MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			IGAEvaluator evaluator( data );
+			std::vector< std::pair< uint32_t, uint32_t > > links;
+			std::vector< uint32_t > group_edges, back_edges;
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				uint32_t elem_index = static_cast< uint32_t >( ielem );
+				links.clear();
+				for( uint32_t iedge = mOffsets[ ielem ]; iedge < mOffsets[ ielem + 1 ]; ++iedge )
+				{
+					uint32_t other = mNeighbors[ iedge ];
+					if( other >= elem_index && other < elem_count )
+						links.emplace_back( other, iedge );
+				}
+				std::sort( links.begin(), links.end() );
+
+				for( size_t group_begin = 0, group_end; group_begin < links.size(); group_begin = group_end )
+				{
+					uint32_t other = links[ group_begin ].first;
+					for( group_end = group_begin + 1; group_end < links.size() && links[ group_end ].first == other; ++group_end )
+						;
+					back_edges.clear();
+					for( uint32_t iback = mOffsets[ other ]; iback < mOffsets[ other + size_t( 1 ) ]; ++iback )
+					{
+						if( mNeighbors[ iback ] == elem_index )
+							back_edges.push_back( iback );
+					}
+					if( back_edges.size() != group_end - group_begin )
+						continue;
+
+					if( back_edges.size() == 1 )
+					{
+						mReverseEdges[ links[ group_begin ].second ] = back_edges[ 0 ];
+						mReverseEdges[ back_edges[ 0 ] ] = links[ group_begin ].second;
+						continue;
+					}
+					group_edges.clear();
+					for( size_t ilink = group_begin; ilink < group_end; ++ilink )
+						group_edges.push_back( links[ ilink ].second );
+					pairByPosition( data, evaluator, elem_index, group_edges, other, back_edges );
+				}
+			}
+		} );
+	}
+
+	void IGAAdjacency::pairByPosition( const IGADataView &data, IGAEvaluator &evaluator, uint32_t elem_index,
+		const std::vector< uint32_t > &group_edges, uint32_t other, const std::vector< uint32_t > &back_edges )
+	{
+		// The elements may be parameterized in any direction relative to each
+		// other, so the order of the edges along their shared boundary says nothing
+		// about which are twins. Instead each edge is paired with the edge of the
+		// other element whose midpoint is nearest to its own.
+		size_t count = back_edges.size();
+		std::vector< Vector3d > midpoints( count ), back_midpoints( count );
+		for( size_t i = 0; i < count; ++i )
+		{
+			if( !edgeMidpoint( data, evaluator, elem_index, group_edges[ i ], midpoints[ i ] ) ||
+				!edgeMidpoint( data, evaluator, other, back_edges[ i ], back_midpoints[ i ] ) )
+				return;
+		}
+
+		std::vector< size_t > nearest( count, count );
+		std::vector< uint8_t > taken( count, 0 );
+		for( size_t i = 0; i < count; ++i )
+		{
+			double best = std::numeric_limits< double >::infinity();
+			for( size_t j = 0; j < count; ++j )
+			{
+				// An element adjacent to itself has the same edges on both sides, and
+				// an edge is never its own twin.
+				if( back_edges[ j ] == group_edges[ i ] )
+					continue;
+				double dx = midpoints[ i ].x - back_midpoints[ j ].x;
+				double dy = midpoints[ i ].y - back_midpoints[ j ].y;
+				double dz = midpoints[ i ].z - back_midpoints[ j ].z;
+				double distance = dx * dx + dy * dy + dz * dz;
+				if( distance < best )
+				{
+					best = distance;
+					nearest[ i ] = j;
+				}
+			}
+			// If two edges are nearest to the same edge, the twins can't be told
+			// apart, so none of them are paired.
+			if( nearest[ i ] == count || taken[ nearest[ i ] ] )
+				return;
+			taken[ nearest[ i ] ] = 1;
+		}
+		if( other == elem_index )
+		{
+			// Here back_edges is the same list as group_edges, so the pairs must also
+			// agree in both directions.
+			for( size_t i = 0; i < count; ++i )
+			{
+				if( nearest[ nearest[ i ] ] != i )
+					return;
+			}
+		}
+
+		for( size_t i = 0; i < count; ++i )
+		{
+			mReverseEdges[ group_edges[ i ] ] = back_edges[ nearest[ i ] ];
+			mReverseEdges[ back_edges[ nearest[ i ] ] ] = group_edges[ i ];
+		}
+	}
+
+	bool IGAAdjacency::edgeMidpoint( const IGADataView &data, IGAEvaluator &evaluator, uint32_t elem_index,
+		uint32_t edge_index, Vector3d &position ) const
+	{
+		// Place the edge along its side the same way IGATessellator does: by its
+		// knot interval, or evenly if the side has no usable intervals.
+		uint32_t side_begin = edge_index, side_end = edge_index + 1;
+		while( side_begin > mOffsets[ elem_index ] && mSides[ side_begin - 1 ] == mSides[ edge_index ] )
+			--side_begin;
+		while( side_end < mOffsets[ elem_index + size_t( 1 ) ] && mSides[ side_end ] == mSides[ edge_index ] )
+			++side_end;
+		double total = 0, before = 0;
+		for( uint32_t iedge = side_begin; iedge < side_end; ++iedge )
+		{
+			double interval = std::max( data.edgeInterval( iedge ), 0.0 );
+			before += iedge < edge_index ? interval : 0;
+			total += interval;
+		}
+		double f;
+		if( total > 0 && finite( total ) )
+			f = ( before + 0.5 * std::max( data.edgeInterval( edge_index ), 0.0 ) ) / total;
+		else
+			f = ( edge_index - side_begin + 0.5 ) / ( side_end - side_begin );
+
+		double s, t;
+		switch( mSides[ edge_index ] )
+		{
+		case 0: s = f; t = 0; break;
+		case 1: s = 1; t = f; break;
+		case 2: s = 1 - f; t = 1; break;
+		default: s = 0; t = 1 - f; break;
+		}
+		return evaluator.evaluate( elem_index, &s, &t, 1, &position ) &&
+			finite( position.x ) && finite( position.y ) && finite( position.z );
+	}
+
+	void IGAAdjacency::clear()
+	{
+		mOffsets.clear();
+		mNeighbors.clear();
+		mReverseEdges.clear();
+		mSides.clear();
+	}
+
+	uint32_t IGAAdjacency::edgeElem( uint32_t edge_index ) const
+	{
+		// The last offset that is <= edge_index. Elements without edges share their
+		// offset with the next element, so upper_bound skips past them.
+		auto iter = std::upper_bound( mOffsets.begin(), mOffsets.end(), edge_index );
+		return static_cast< uint32_t >( iter - mOffsets.begin() ) - 1;
+	}
+}
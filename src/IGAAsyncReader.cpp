@@ -0,0 +1,627 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAAsyncReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "iga/IGAParallel.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined( __linux__ ) && !defined( IGA_NO_IO_URING ) && defined( __has_include )
+#if __has_include( <linux/io_uring.h> )
+#define IGA_USE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace iga_fileio
+{
+	namespace
+	{
+		#ifdef _WIN32
+		using NativeFile = void *;
+		#else
+		using NativeFile = int;
+		#endif
+
+		// Reads exactly 'length' bytes at 'offset', or fails.
+		bool readFully( NativeFile file, uint64_t offset, char *destination, size_t length )
+		{
+			while( length > 0 )
+			{
+				#ifdef _WIN32
+				// ReadFile takes a 32-bit length, so large reads are done in pieces.
+				DWORD piece = static_cast< DWORD >( std::min< size_t >( length, 1u << 30 ) );
+				OVERLAPPED position = {};
+				position.Offset = static_cast< DWORD >( offset );
+				position.OffsetHigh = static_cast< DWORD >( offset >> 32 );
+				DWORD count = 0;
+				if( !ReadFile( file, destination, piece, &count, &position ) || count == 0 )
+					return false;
+				#else
+				ssize_t count = pread( file, destination, length, static_cast< off_t >( offset ) );
+				if( count < 0 && errno == EINTR )
+					continue;
+				if( count <= 0 )
+					return false;
+				#endif
+				destination += count;
+				offset += static_cast< uint64_t >( count );
+				length -= static_cast< size_t >( count );
+			}
+			return true;
+		}
+
+		// A read handed to a ReadService. 'finished' is called on one of the
+		// service's threads once the read is done, and the service doesn't touch
+		// the request after that.
+		struct ReadRequest
+		{
+			NativeFile file = NativeFile();
+			uint64_t offset = 0;
+			char *destination = nullptr;
+			size_t length = 0;
+			void ( *finished )( ReadRequest *request, bool ok ) = nullptr;
+
+			#ifdef IGA_USE_IO_URING
+			// The number of bytes read so far, since io_uring may return fewer bytes
+			// than were asked for, and the iovec for the rest.
+			size_t progress = 0;
+			struct iovec iov = {};
+			#endif
+		};
+
+		// Performs reads in the background for any number of readers.
+		class ReadService
+		{
+		public:
+			virtual ~ReadService() {}
+			virtual void submit( ReadRequest *request ) = 0;
+		};
+
+		// Performs each read with a blocking call on one of a few threads.
+		class ThreadReadService : public ReadService
+		{
+		public:
+			explicit ThreadReadService( unsigned thread_count )
+			{
+				for( unsigned ithread = 0; ithread < thread_count; ++ithread )
+					mThreads.emplace_back( [this]() { run(); } );
+			}
+
+			void submit( ReadRequest *request ) override
+			{
+				{
+					std::lock_guard< std::mutex > lock( mMutex );
+					mRequests.push_back( request );
+				}
+				mRequestReady.notify_one();
+			}
+
+		private:
+			void run()
+			{
+				for( ;; )
+				{
+					ReadRequest *request = nullptr;
+					{
+						std::unique_lock< std::mutex > lock( mMutex );
+						mRequestReady.wait( lock, [this]() { return !mRequests.empty(); } );
+						request = mRequests.front();
+						mRequests.pop_front();
+					}
+					bool ok = readFully( request->file, request->offset, request->destination, request->length );
+					request->finished( request, ok );
+				}
+			}
+
+			std::vector< std::thread > mThreads;
+			std::deque< ReadRequest * > mRequests;
+			std::mutex mMutex;
+			std::condition_variable mRequestReady;
+		};
+
+		#ifdef IGA_USE_IO_URING
+		// Submits reads to an io_uring, and completes them on a single thread that
+		// waits for the kernel to finish them. This uses the system calls directly,
+		// so there's no dependency on liburing.
+		class UringReadService : public ReadService
+		{
+		public:
+			// Returns nullptr if the kernel doesn't support io_uring, or won't let us
+			// use it.
+			static UringReadService *create()
+			{
+				io_uring_params params;
+				memset( &params, 0, sizeof( params ) );
+				int ring = static_cast< int >( syscall( __NR_io_uring_setup, RING_ENTRIES, &params ) );
+				if( ring < 0 )
+					return nullptr;
+				UringReadService *service = new UringReadService( ring, params );
+				if( !service->mapRings( params ) )
+				{
+					delete service;
+					return nullptr;
+				}
+				service->mReaper = std::thread( [service]() { service->reap(); } );
+				return service;
+			}
+
+			~UringReadService()
+			{
+				if( mReaper.joinable() )
+				{
+					// A request with no ReadRequest tells the reaper to stop. If it can't
+					// be submitted, the reaper may never return, so leave it running
+					// and keep the rings it uses.
+					bool stopping = false;
+					{
+						std::lock_guard< std::mutex > lock( mMutex );
+						stopping = push( IORING_OP_NOP, nullptr );
+					}
+					if( !stopping )
+					{
+						mReaper.detach();
+						return;
+					}
+					mReaper.join();
+				}
+				if( mSqes != MAP_FAILED )
+					munmap( mSqes, mSqesSize );
+				if( mCqRing != MAP_FAILED && mCqRing != mSqRing )
+					munmap( mCqRing, mCqRingSize );
+				if( mSqRing != MAP_FAILED )
+					munmap( mSqRing, mSqRingSize );
+				::close( mRing );
+			}
+
+			void submit( ReadRequest *request ) override
+			{
+				request->progress = 0;
+				std::unique_lock< std::mutex > lock( mMutex );
+				// Every request in flight needs room for its completion.
+				mSlotFree.wait( lock, [this]() { return mInFlight < mMaxInFlight; } );
+				++mInFlight;
+				if( push( IORING_OP_READV, request ) )
+					return;
+				--mInFlight;
+				lock.unlock();
+				mSlotFree.notify_one();
+				readRest( request );
+			}
+
+		private:
+			// Large enough to keep plenty of reads in flight across all the readers.
+			static const unsigned RING_ENTRIES = 64;
+
+			UringReadService( int ring, const io_uring_params &params )
+				: mRing( ring ), mMaxInFlight( std::min( params.sq_entries, params.cq_entries ) )
+			{
+			}
+
+			bool mapRings( const io_uring_params &params )
+			{
+				mSqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+				mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+				bool single_mmap = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+				if( single_mmap )
+					mSqRingSize = mCqRingSize = std::max( mSqRingSize, mCqRingSize );
+				mSqRing = mmap( nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_SQ_RING );
+				if( mSqRing == MAP_FAILED )
+					return false;
+				mCqRing = single_mmap ? mSqRing :
+					mmap( nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_CQ_RING );
+				if( mCqRing == MAP_FAILED )
+					return false;
+				mSqesSize = params.sq_entries * sizeof( io_uring_sqe );
+				mSqes = mmap( nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_SQES );
+				if( mSqes == MAP_FAILED )
+					return false;
+
+				char *sq = static_cast< char * >( mSqRing );
+				mSqTail = reinterpret_cast< unsigned * >( sq + params.sq_off.tail );
+				mSqMask = *reinterpret_cast< unsigned * >( sq + params.sq_off.ring_mask );
+				mSqArray = reinterpret_cast< unsigned * >( sq + params.sq_off.array );
+				char *cq = static_cast< char * >( mCqRing );
+				mCqHead = reinterpret_cast< unsigned * >( cq + params.cq_off.head );
+				mCqTail = reinterpret_cast< unsigned * >( cq + params.cq_off.tail );
+				mCqMask = *reinterpret_cast< unsigned * >( cq + params.cq_off.ring_mask );
+				mCqes = reinterpret_cast< io_uring_cqe * >( cq + params.cq_off.cqes );
+				return true;
+			}
+
+			// Finishes a request that the ring couldn't take with blocking reads.
+			static void readRest( ReadRequest *request )
+			{
+				bool ok = readFully( request->file, request->offset + request->progress,
+					request->destination + request->progress, request->length - request->progress );
+				request->finished( request, ok );
+			}
+
+			// Queues one operation and submits it. mMutex must be held. The kernel
+			// takes every queued entry on each io_uring_enter, so the submission
+			// ring never fills up. Returns false if the kernel wouldn't take the
+			// entry, in which case it is taken off the ring again; the caller must
+			// then finish the request some other way, or it would never complete.
+			bool push( uint8_t opcode, ReadRequest *request )
+			{
+				unsigned tail = *mSqTail;
+				unsigned index = tail & mSqMask;
+				io_uring_sqe *sqe = static_cast< io_uring_sqe * >( mSqes ) + index;
+				memset( sqe, 0, sizeof( io_uring_sqe ) );
+				sqe->opcode = opcode;
+				sqe->fd = -1;
+				if( request )
+				{
+					request->iov.iov_base = request->destination + request->progress;
+					request->iov.iov_len = request->length - request->progress;
+					sqe->fd = request->file;
+					sqe->off = request->offset + request->progress;
+					sqe->addr = reinterpret_cast< uintptr_t >( &request->iov );
+					sqe->len = 1;
+				}
+				sqe->user_data = reinterpret_cast< uintptr_t >( request );
+				mSqArray[ index ] = index;
+				__atomic_store_n( mSqTail, tail + 1, __ATOMIC_RELEASE );
+				for( ;; )
+				{
+					long submitted = syscall( __NR_io_uring_enter, mRing, 1, 0, 0, nullptr, 0 );
+					if( submitted > 0 )
+						return true;
+					if( submitted == 0 || ( errno != EINTR && errno != EAGAIN && errno != EBUSY ) )
+						break;
+					std::this_thread::yield();
+				}
+				// Nothing else is queued, since each push submits its own entry, and
+				// mMutex keeps anyone else from queuing one meanwhile.
+				__atomic_store_n( mSqTail, tail, __ATOMIC_RELEASE );
+				return false;
+			}
+
+			// Runs on mReaper: waits for reads to finish, resubmits the ones that
+			// came up short, and passes the rest back to their readers.
+			void reap()
+			{
+				for( ;; )
+				{
+					syscall( __NR_io_uring_enter, mRing, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0 );
+					unsigned head = *mCqHead;
+					unsigned tail = __atomic_load_n( mCqTail, __ATOMIC_ACQUIRE );
+					bool stop = false;
+					for( ; head != tail; ++head )
+					{
+						const io_uring_cqe &cqe = mCqes[ head & mCqMask ];
+						ReadRequest *request = reinterpret_cast< ReadRequest * >( static_cast< uintptr_t >( cqe.user_data ) );
+						int result = cqe.res;
+						__atomic_store_n( mCqHead, head + 1, __ATOMIC_RELEASE );
+						if( request == nullptr )
+						{
+							stop = true;
+							continue;
+						}
+
+						// The request was written under mMutex by submit; the kernel orders
+						// that before this, but taking the lock makes it plain to tools
+						// such as ThreadSanitizer.
+						bool ok = false;
+						bool resubmit_failed = false;
+						{
+							std::lock_guard< std::mutex > lock( mMutex );
+							if( result > 0 )
+								request->progress += static_cast< size_t >( result );
+							bool retry = result == -EINTR || result == -EAGAIN;
+							if( retry || ( result > 0 && request->progress < request->length ) )
+							{
+								if( push( IORING_OP_READV, request ) )
+									continue;
+								resubmit_failed = true;
+							}
+							ok = result > 0 || request->length == 0;
+							--mInFlight;
+						}
+						mSlotFree.notify_one();
+						if( resubmit_failed )
+							readRest( request );
+						else
+							request->finished( request, ok );
+					}
+					if( stop )
+						return;
+				}
+			}
+
+			int mRing = -1;
+			unsigned mMaxInFlight = 0;
+
+			void *mSqRing = MAP_FAILED;
+			void *mCqRing = MAP_FAILED;
+			void *mSqes = MAP_FAILED;
+			size_t mSqRingSize = 0;
+			size_t mCqRingSize = 0;
+			size_t mSqesSize = 0;
+
+			unsigned *mSqTail = nullptr;
+			unsigned mSqMask = 0;
+			unsigned *mSqArray = nullptr;
+			unsigned *mCqHead = nullptr;
+			unsigned *mCqTail = nullptr;
+			unsigned mCqMask = 0;
+			io_uring_cqe *mCqes = nullptr;
+
+			// Guards the submission ring and mInFlight.
+			std::mutex mMutex;
+			std::condition_variable mSlotFree;
+			unsigned mInFlight = 0;
+
+			std::thread mReaper;
+		};
+		#endif
+
+		ReadService &readService()
+		{
+			// The service is never destroyed, since reads may still be in flight when
+			// static objects are destroyed at exit.
+			static ReadService *s_service = []() -> ReadService * {
+				#ifdef IGA_USE_IO_URING
+				if( ReadService *uring = UringReadService::create() )
+					return uring;
+				#endif
+				// Blocking reads mostly wait, so it's worth having more threads than
+				// processors.
+				return new ThreadReadService( std::max( 4u, defaultThreadCount() ) );
+			}();
+			return *s_service;
+		}
+	}
+
+	struct IGAAsyncFileReader::ReadAhead : ReadRequest
+	{
+		IGAAsyncFileReader *owner = nullptr;
+		std::vector< char > buffer;
+		/// Set, along with 'ok', when the read finishes. Guarded by owner->mMutex.
+		bool done = false;
+		bool ok = false;
+	};
+
+	IGAAsyncFileReader::IGAAsyncFileReader( size_t buffer_size, unsigned buffer_count )
+		: mBufferSize( std::max< size_t >( buffer_size, 4096 ) ), mBufferCount( std::max( buffer_count, 1u ) )
+	{
+	}
+
+	IGAAsyncFileReader::~IGAAsyncFileReader()
+	{
+		close();
+	}
+
+	bool IGAAsyncFileReader::open( const char *filename )
+	{
+		close();
+
+		#ifdef _WIN32
+		HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if( file == INVALID_HANDLE_VALUE )
+			return false;
+		LARGE_INTEGER file_size;
+		if( !GetFileSizeEx( file, &file_size ) )
+		{
+			CloseHandle( file );
+			return false;
+		}
+		mFileHandle = file;
+		mSize = static_cast< uint64_t >( file_size.QuadPart );
+		#else
+		int fd = ::open( filename, O_RDONLY );
+		if( fd < 0 )
+			return false;
+		struct stat file_stat;
+		if( fstat( fd, &file_stat ) != 0 || file_stat.st_size < 0 )
+		{
+			::close( fd );
+			return false;
+		}
+		mFile = fd;
+		mSize = static_cast< uint64_t >( file_stat.st_size );
+		#endif
+
+		mPosition = 0;
+		mNextRead = 0;
+		return true;
+	}
+
+	void IGAAsyncFileReader::close()
+	{
+		dropAll();
+		mSpareBuffers.clear();
+		#ifdef _WIN32
+		if( mFileHandle )
+			CloseHandle( mFileHandle );
+		mFileHandle = nullptr;
+		#else
+		if( mFile >= 0 )
+			::close( mFile );
+		mFile = -1;
+		#endif
+		mSize = 0;
+		mPosition = 0;
+		mNextRead = 0;
+	}
+
+	void IGAAsyncFileReader::startReads()
+	{
+		while( mReadAhead.size() < mBufferCount && mNextRead < mSize )
+		{
+			std::unique_ptr< ReadAhead > read( new ReadAhead );
+			if( !mSpareBuffers.empty() )
+			{
+				read->buffer = std::move( mSpareBuffers.back() );
+				mSpareBuffers.pop_back();
+			}
+			read->buffer.resize( mBufferSize );
+			#ifdef _WIN32
+			read->file = mFileHandle;
+			#else
+			read->file = mFile;
+			#endif
+			read->offset = mNextRead;
+			read->length = static_cast< size_t >( std::min< uint64_t >( mBufferSize, mSize - mNextRead ) );
+			read->destination = read->buffer.data();
+			read->owner = this;
+			read->finished = []( ReadRequest *request, bool ok ) {
+				ReadAhead *read = static_cast< ReadAhead * >( request );
+				// The reader may be destroyed as soon as the lock is released, so
+				// notify while holding it.
+				std::lock_guard< std::mutex > lock( read->owner->mMutex );
+				read->done = true;
+				read->ok = ok;
+				read->owner->mReadDone.notify_all();
+			};
+			mNextRead += read->length;
+			ReadAhead *submitted = read.get();
+			mReadAhead.push_back( std::move( read ) );
+			readService().submit( submitted );
+		}
+	}
+
+	void IGAAsyncFileReader::dropOldest()
+	{
+		ReadAhead *read = mReadAhead.front().get();
+		{
+			std::unique_lock< std::mutex > lock( mMutex );
+			mReadDone.wait( lock, [read]() { return read->done; } );
+		}
+		mSpareBuffers.push_back( std::move( read->buffer ) );
+		mReadAhead.pop_front();
+	}
+
+	void IGAAsyncFileReader::dropAll()
+	{
+		while( !mReadAhead.empty() )
+			dropOldest();
+		mNextRead = mPosition;
+	}
+
+	bool IGAAsyncFileReader::readData( char *destination, size_t length )
+	{
+		// Failing to read past the end is how readIGAFile finds the end of the file.
+		if( mPosition > mSize || length > mSize - mPosition )
+			return false;
+
+		while( length > 0 )
+		{
+			// Drop the reads that are behind the read position. If that leaves none,
+			// or the oldest starts after the read position, start again from here.
+			while( !mReadAhead.empty() && mPosition >= mReadAhead.front()->offset + mReadAhead.front()->length )
+				dropOldest();
+			if( mReadAhead.empty() || mReadAhead.front()->offset > mPosition )
+				dropAll();
+			startReads();
+
+			ReadAhead *read = mReadAhead.front().get();
+			{
+				std::unique_lock< std::mutex > lock( mMutex );
+				mReadDone.wait( lock, [read]() { return read->done; } );
+			}
+			if( !read->ok )
+				return false;
+
+			size_t start = static_cast< size_t >( mPosition - read->offset );
+			size_t count = std::min( length, read->length - start );
+			memcpy( destination, read->buffer.data() + start, count );
+			destination += count;
+			length -= count;
+			mPosition += count;
+
+			// Reuse a finished buffer straight away, so that as many reads as possible
+			// stay in flight while the caller works on this data.
+			if( mPosition == read->offset + read->length )
+			{
+				dropOldest();
+				startReads();
+			}
+		}
+		return true;
+	}
+
+	bool IGAAsyncFileReader::skipData( uint64_t length )
+	{
+		if( mPosition > mSize || length > mSize - mPosition )
+			return false;
+		mPosition += length;
+		return true;
+	}
+
+	bool IGAAsyncFileReader::seekData( uint64_t offset )
+	{
+		if( offset > mSize )
+			return false;
+		mPosition = offset;
+		return true;
+	}
+
+	bool IGAAsyncFileReader::readDataAt( uint64_t offset, char *destination, size_t length )
+	{
+		if( offset > mSize || length > mSize - offset )
+			return false;
+		#ifdef _WIN32
+		return mFileHandle != nullptr && readFully( mFileHandle, offset, destination, length );
+		#else
+		return mFile >= 0 && readFully( mFile, offset, destination, length );
+		#endif
+	}
+
+	void IGAAsyncFileReader::readFinished()
+	{
+		dropAll();
+		mSpareBuffers.clear();
+	}
+
+	std::future< bool > readIGAFileAsync( const char *filename, IGAData &geometry, uint32_t block_mask )
+	{
+		auto promise = std::make_shared< std::promise< bool > >();
+		std::future< bool > result = promise->get_future();
+		readIGAFileAsync( filename, geometry, [promise]( bool ok ) { promise->set_value( ok ); }, block_mask );
+		return result;
+	}
+
+	void readIGAFileAsync( const char *filename, IGAData &geometry, std::function< void( bool ) > on_finished, uint32_t block_mask )
+	{
+		std::string name( filename );
+		runInBackground( [name, &geometry, on_finished, block_mask]() {
+			IGAAsyncFileReader reader;
+			bool ok = reader.open( name.c_str() ) && reader.readIGAFile( geometry, block_mask );
+			on_finished( ok );
+		} );
+	}
+}
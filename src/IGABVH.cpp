@@ -0,0 +1,449 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGABVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
+#include "iga/IGAParallel.h"
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// Boxing an element, or dividing out a point's weight, is a few compares
+		// or divides, so ranges of them must be fairly long to be worth a thread.
+		const size_t MIN_ELEMS_PER_RANGE = 1024;
+
+		// A query descends the tree and sorts its hits, which is far more work, so
+		// much shorter ranges of queries still pay off.
+		const size_t MIN_QUERIES_PER_RANGE = 64;
+
+		// The most elements in a leaf.
+		const uint32_t MAX_LEAF_ELEMS = 4;
+
+		// The deepest a traversal stack can get. The tree is split on each of the 30
+		// bits of the Morton codes, and then in half while elements share a code, so
+		// it's never deeper than 30 + 32 levels.
+		const size_t MAX_STACK_DEPTH = 64;
+
+		// The number of bits of each coordinate in a Morton code.
+		const int MORTON_BITS = 10;
+
+		double coord( const Vector3d &v, int axis )
+		{
+			return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+		}
+
+		void expandBox( IGABoundingBox &box, const IGABoundingBox &other )
+		{
+			box.min.x = std::min( box.min.x, other.min.x );
+			box.min.y = std::min( box.min.y, other.min.y );
+			box.min.z = std::min( box.min.z, other.min.z );
+			box.max.x = std::max( box.max.x, other.max.x );
+			box.max.y = std::max( box.max.y, other.max.y );
+			box.max.z = std::max( box.max.z, other.max.z );
+		}
+
+		// Spreads the bottom MORTON_BITS bits of x out to every third bit.
+		uint32_t spreadBits( uint32_t x )
+		{
+			x = ( x | ( x << 16 ) ) & 0x030000FF;
+			x = ( x | ( x << 8 ) ) & 0x0300F00F;
+			x = ( x | ( x << 4 ) ) & 0x030C30C3;
+			x = ( x | ( x << 2 ) ) & 0x09249249;
+			return x;
+		}
+
+		// Sorts keys by the Morton codes in their top 32 bits, keeping keys with the
+		// same code in order. This is a radix sort, a byte at a time, which is several
+		// times quicker than std::sort here and quick enough to leave on one thread.
+		void sortByCode( std::vector< uint64_t > &keys )
+		{
+			std::vector< uint64_t > sorted( keys.size() );
+			for( int shift = 32; shift < 32 + 3 * MORTON_BITS; shift += 8 )
+			{
+				size_t starts[ 257 ] = {};
+				for( uint64_t key : keys )
+					++starts[ ( ( key >> shift ) & 0xFF ) + 1 ];
+				for( int digit = 1; digit <= 256; ++digit )
+					starts[ digit ] += starts[ digit - 1 ];
+				for( uint64_t key : keys )
+					sorted[ starts[ ( key >> shift ) & 0xFF ]++ ] = key;
+				keys.swap( sorted );
+			}
+		}
+
+		// The part of a ray that's inside a box, if any, narrowed down from
+		// [ t_near, t_far ].
+		bool clipRay( const IGABoundingBox &box, const IGARay &ray, const double inv_direction[ 3 ], double &t_near, double &t_far )
+		{
+			if( box.empty() )
+				return false;
+			for( int axis = 0; axis < 3; ++axis )
+			{
+				double origin = coord( ray.origin, axis ), lo = coord( box.min, axis ), hi = coord( box.max, axis );
+				if( coord( ray.direction, axis ) == 0 )
+				{
+					// Parallel to this pair of faces.
+					if( origin < lo || origin > hi )
+						return false;
+					continue;
+				}
+				double t_lo = ( lo - origin ) * inv_direction[ axis ];
+				double t_hi = ( hi - origin ) * inv_direction[ axis ];
+				if( t_lo > t_hi )
+					std::swap( t_lo, t_hi );
+				t_near = std::max( t_near, t_lo );
+				t_far = std::min( t_far, t_hi );
+			}
+			return t_near <= t_far;
+		}
+
+		// The squared distances from a point to the nearest and farthest points of
+		// a box, which must not be empty.
+		void boxDistances( const IGABoundingBox &box, const Vector3d &point, double &near2, double &far2 )
+		{
+			near2 = 0;
+			far2 = 0;
+			for( int axis = 0; axis < 3; ++axis )
+			{
+				double p = coord( point, axis ), lo = coord( box.min, axis ), hi = coord( box.max, axis );
+				double outside = std::max( std::max( lo - p, p - hi ), 0.0 );
+				double farthest = std::max( std::abs( p - lo ), std::abs( p - hi ) );
+				near2 += outside * outside;
+				far2 += farthest * farthest;
+			}
+		}
+
+		bool hitLess( const IGABVHHit &lhs, const IGABVHHit &rhs )
+		{
+			if( lhs.near_distance != rhs.near_distance )
+				return lhs.near_distance < rhs.near_distance;
+			return lhs.elem < rhs.elem;
+		}
+
+		// Runs query( index, hits ) for each of 'count' queries on up to thread_count
+		// threads, and gathers the hits in order as described by
+		// IGABVH::intersectRays.
+		template< typename Query >
+		void runQueries( size_t count, unsigned thread_count, std::vector< size_t > &hit_ends,
+			std::vector< IGABVHHit > &hits, Query query )
+		{
+			struct RangeHits
+			{
+				size_t begin = 0;
+				std::vector< size_t > ends;
+				std::vector< IGABVHHit > hits;
+			};
+			std::mutex ranges_mutex;
+			std::vector< RangeHits > ranges;
+			parallelRanges( count, MIN_QUERIES_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+				RangeHits range;
+				range.begin = begin;
+				std::vector< IGABVHHit > found;
+				for( size_t index = begin; index < end; ++index )
+				{
+					query( index, found );
+					range.hits.insert( range.hits.end(), found.begin(), found.end() );
+					range.ends.push_back( range.hits.size() );
+				}
+				std::lock_guard< std::mutex > lock( ranges_mutex );
+				ranges.push_back( std::move( range ) );
+			} );
+
+			std::sort( ranges.begin(), ranges.end(), []( const RangeHits &lhs, const RangeHits &rhs ) { return lhs.begin < rhs.begin; } );
+			hit_ends.clear();
+			hits.clear();
+			for( const RangeHits &range : ranges )
+			{
+				size_t base = hits.size();
+				for( size_t end : range.ends )
+					hit_ends.push_back( base + end );
+				hits.insert( hits.end(), range.hits.begin(), range.hits.end() );
+			}
+		}
+	}
+
+	void IGABVH::build( const IGADataView &data, unsigned thread_count )
+	{
+		uint32_t elem_count = data.elemCount();
+		IGASpan< Piece2D > pieces = data.pieces();
+		IGASpan< Point3d > points = data.points();
+		mNodes.clear();
+
+		// Divide out the weights once for each point, as points are usually shared
+		// by several pieces. Points with no weight become NaN, which std::min and
+		// std::max ignore when it's their second argument.
+		std::vector< Vector3d > positions( points.size() );
+		parallelRanges( points.size(), MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			const double nan = std::numeric_limits< double >::quiet_NaN();
+			for( size_t ipoint = begin; ipoint < end; ++ipoint )
+			{
+				const Point3d &pt = points[ ipoint ];
+				if( pt.w == 0 )
+					positions[ ipoint ] = { nan, nan, nan };
+				else
+					positions[ ipoint ] = { pt.x / pt.w, pt.y / pt.w, pt.z / pt.w };
+			}
+		} );
+
+		mElemBoxes.assign( elem_count, IGABoundingBox() );
+		parallelRanges( elem_count, MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				// Work on a local copy, which the compiler can keep in registers.
+				uint32_t elem_index = static_cast< uint32_t >( ielem );
+				IGABoundingBox box;
+				uint32_t piece_end = data.pieceEnd( elem_index );
+				for( uint32_t ipiece = data.pieceBegin( elem_index ); ipiece < piece_end; ++ipiece )
+				{
+					const Vector3d &position = positions[ pieces[ ipiece ].pt_index ];
+					box.min.x = std::min( box.min.x, position.x );
+					box.min.y = std::min( box.min.y, position.y );
+					box.min.z = std::min( box.min.z, position.z );
+					box.max.x = std::max( box.max.x, position.x );
+					box.max.y = std::max( box.max.y, position.y );
+					box.max.z = std::max( box.max.z, position.z );
+				}
+				mElemBoxes[ ielem ] = box;
+			}
+		} );
+		if( elem_count == 0 )
+		{
+			mElemOrder.clear();
+			return;
+		}
+
+		// Sort the elements along a Morton curve through the centers of their boxes,
+		// so that elements near each other in space are near each other in the order.
+		IGABoundingBox centers;
+		for( const IGABoundingBox &box : mElemBoxes )
+		{
+			if( box.empty() )
+				continue;
+			IGABoundingBox center_box;
+			center_box.min = center_box.max = { ( box.min.x + box.max.x ) / 2, ( box.min.y + box.max.y ) / 2, ( box.min.z + box.max.z ) / 2 };
+			expandBox( centers, center_box );
+		}
+		// Each center is scaled to a cell number from 0 to max_cell on each axis.
+		const double max_cell = ( 1 << MORTON_BITS ) - 1;
+		double offsets[ 3 ], scales[ 3 ];
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			double lo = coord( centers.min, axis ), hi = coord( centers.max, axis );
+			offsets[ axis ] = lo;
+			scales[ axis ] = hi > lo ? max_cell / ( hi - lo ) : 0.0;
+		}
+		std::vector< uint64_t > codes( elem_count );
+		parallelRanges( elem_count, MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				const IGABoundingBox &box = mElemBoxes[ ielem ];
+				uint32_t code = 0;
+				if( !box.empty() )
+				{
+					for( int axis = 0; axis < 3; ++axis )
+					{
+						double center = ( coord( box.min, axis ) + coord( box.max, axis ) ) / 2;
+						double cell = std::min( std::max( ( center - offsets[ axis ] ) * scales[ axis ], 0.0 ), max_cell );
+						code |= spreadBits( static_cast< uint32_t >( cell ) ) << axis;
+					}
+				}
+				codes[ ielem ] = uint64_t( code ) << 32 | ielem;
+			}
+		} );
+		sortByCode( codes );
+		mElemOrder.resize( elem_count );
+		for( uint32_t ielem = 0; ielem < elem_count; ++ielem )
+			mElemOrder[ ielem ] = static_cast< uint32_t >( codes[ ielem ] );
+
+		// Build the tree, and then fill in the boxes from the leaves up. Children
+		// always come after their parents.
+		mNodes.reserve( 2 * ( elem_count / MAX_LEAF_ELEMS + 1 ) );
+		buildNode( codes, 0, elem_count );
+		for( size_t inode = mNodes.size(); inode-- > 0; )
+		{
+			Node &node = mNodes[ inode ];
+			if( node.elem_count > 0 )
+			{
+				for( uint32_t iorder = node.first; iorder < node.first + node.elem_count; ++iorder )
+					expandBox( node.box, mElemBoxes[ mElemOrder[ iorder ] ] );
+			}
+			else
+			{
+				expandBox( node.box, mNodes[ inode + 1 ].box );
+				expandBox( node.box, mNodes[ node.first ].box );
+			}
+		}
+	}
+
+	uint32_t IGABVH::buildNode( const std::vector< uint64_t > &codes, uint32_t begin, uint32_t end )
+	{
+		uint32_t node_index = static_cast< uint32_t >( mNodes.size() );
+		mNodes.emplace_back();
+		if( end - begin <= MAX_LEAF_ELEMS )
+		{
+			mNodes[ node_index ].first = begin;
+			mNodes[ node_index ].elem_count = end - begin;
+			return node_index;
+		}
+
+		// Split where the highest bit that differs within the range changes, or in
+		// the middle if every element has the same code.
+		uint32_t first_code = static_cast< uint32_t >( codes[ begin ] >> 32 );
+		uint32_t last_code = static_cast< uint32_t >( codes[ end - 1 ] >> 32 );
+		uint32_t split = begin + ( end - begin ) / 2;
+		if( first_code != last_code )
+		{
+			int bit = 0;
+			while( ( first_code ^ last_code ) >> ( bit + 1 ) )
+				++bit;
+			uint64_t split_key = uint64_t( ( first_code >> bit ) + 1 ) << bit << 32;
+			split = static_cast< uint32_t >( std::lower_bound( codes.begin() + begin, codes.begin() + end, split_key ) - codes.begin() );
+		}
+		buildNode( codes, begin, split );
+		uint32_t right = buildNode( codes, split, end );
+		mNodes[ node_index ].first = right;
+		return node_index;
+	}
+
+	void IGABVH::clear()
+	{
+		mElemBoxes.clear();
+		mElemOrder.clear();
+		mNodes.clear();
+	}
+
+	void IGABVH::intersectRay( const IGARay &ray, std::vector< IGABVHHit > &hits ) const
+	{
+		hits.clear();
+		if( mNodes.empty() )
+			return;
+
+		double inv_direction[ 3 ];
+		for( int axis = 0; axis < 3; ++axis )
+			inv_direction[ axis ] = 1.0 / coord( ray.direction, axis );
+
+		uint32_t stack[ MAX_STACK_DEPTH ];
+		size_t stack_size = 0;
+		stack[ stack_size++ ] = 0;
+		while( stack_size > 0 )
+		{
+			const Node &node = mNodes[ stack[ --stack_size ] ];
+			double t_near = ray.t_min, t_far = ray.t_max;
+			if( !clipRay( node.box, ray, inv_direction, t_near, t_far ) )
+				continue;
+			if( node.elem_count == 0 )
+			{
+				stack[ stack_size++ ] = node.first;
+				stack[ stack_size++ ] = static_cast< uint32_t >( &node - mNodes.data() ) + 1;
+				continue;
+			}
+			for( uint32_t iorder = node.first; iorder < node.first + node.elem_count; ++iorder )
+			{
+				IGABVHHit hit;
+				hit.elem = mElemOrder[ iorder ];
+				hit.near_distance = ray.t_min;
+				hit.far_distance = ray.t_max;
+				if( clipRay( mElemBoxes[ hit.elem ], ray, inv_direction, hit.near_distance, hit.far_distance ) )
+					hits.push_back( hit );
+			}
+		}
+		std::sort( hits.begin(), hits.end(), hitLess );
+	}
+
+	void IGABVH::intersectRays( const IGARay *rays, size_t count, std::vector< size_t > &hit_ends,
+		std::vector< IGABVHHit > &hits, unsigned thread_count ) const
+	{
+		runQueries( count, thread_count, hit_ends, hits, [&]( size_t index, std::vector< IGABVHHit > &found ) {
+			intersectRay( rays[ index ], found );
+		} );
+	}
+
+	void IGABVH::findNearest( const Vector3d &point, std::vector< IGABVHHit > &hits ) const
+	{
+		hits.clear();
+		if( mNodes.empty() || mNodes[ 0 ].box.empty() )
+			return;
+
+		// The farthest any box's nearest point can be and still be a candidate. The
+		// farthest point of any box bounds the distance to the nearest element, so it
+		// shrinks as boxes are found; hits are kept in squared distances until then.
+		double bound2 = std::numeric_limits< double >::infinity();
+		uint32_t stack[ MAX_STACK_DEPTH ];
+		size_t stack_size = 0;
+		stack[ stack_size++ ] = 0;
+		while( stack_size > 0 )
+		{
+			const Node &node = mNodes[ stack[ --stack_size ] ];
+			double near2, far2;
+			if( node.box.empty() )
+				continue;
+			boxDistances( node.box, point, near2, far2 );
+			if( near2 > bound2 )
+				continue;
+			bound2 = std::min( bound2, far2 );
+			if( node.elem_count == 0 )
+			{
+				// Visit the nearer child first, so the bound shrinks sooner.
+				uint32_t left = static_cast< uint32_t >( &node - mNodes.data() ) + 1, right = node.first;
+				double left_near2 = 0, right_near2 = 0, unused;
+				if( !mNodes[ left ].box.empty() )
+					boxDistances( mNodes[ left ].box, point, left_near2, unused );
+				if( !mNodes[ right ].box.empty() )
+					boxDistances( mNodes[ right ].box, point, right_near2, unused );
+				if( left_near2 < right_near2 )
+					std::swap( left, right );
+				stack[ stack_size++ ] = left;
+				stack[ stack_size++ ] = right;
+				continue;
+			}
+			for( uint32_t iorder = node.first; iorder < node.first + node.elem_count; ++iorder )
+			{
+				uint32_t elem_index = mElemOrder[ iorder ];
+				const IGABoundingBox &box = mElemBoxes[ elem_index ];
+				if( box.empty() )
+					continue;
+				IGABVHHit hit;
+				hit.elem = elem_index;
+				boxDistances( box, point, hit.near_distance, hit.far_distance );
+				if( hit.near_distance > bound2 )
+					continue;
+				bound2 = std::min( bound2, hit.far_distance );
+				hits.push_back( hit );
+			}
+		}
+
+		// Drop the hits found before the bound got down to where it is now.
+		hits.erase( std::remove_if( hits.begin(), hits.end(), [&]( const IGABVHHit &hit ) { return hit.near_distance > bound2; } ), hits.end() );
+		for( IGABVHHit &hit : hits )
+		{
+			hit.near_distance = std::sqrt( hit.near_distance );
+			hit.far_distance = std::sqrt( hit.far_distance );
+		}
+		std::sort( hits.begin(), hits.end(), hitLess );
+	}
+
+	void IGABVH::findNearest( const Vector3d *points, size_t count, std::vector< size_t > &hit_ends,
+		std::vector< IGABVHHit > &hits, unsigned thread_count ) const
+	{
+		runQueries( count, thread_count, hit_ends, hits, [&]( size_t index, std::vector< IGABVHHit > &found ) {
+			findNearest( points[ index ], found );
+		} );
+	}
+}
@@ -0,0 +1,119 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGABezierCache.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "iga/IGAParallel.h"
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// Extracting an element goes through all of its pieces, so a few hundred of
+		// them are enough work to be worth a range of their own.
+		const size_t MIN_ELEMS_PER_RANGE = 256;
+
+		const size_t POINT_ALIGNMENT = 64;
+	}
+
+	IGABezierCache::IGABezierCache( IGABezierCache &&other )
+	{
+		*this = std::move( other );
+	}
+
+	IGABezierCache &IGABezierCache::operator=( IGABezierCache &&other )
+	{
+		if( this == &other )
+			return *this;
+		// mStorage's buffer moves with it, so mPoints and the patches still point
+		// into it. The other object's copy of mPoints doesn't, so it's emptied.
+		mPatches = std::move( other.mPatches );
+		mPatchEnds = std::move( other.mPatchEnds );
+		mStorage = std::move( other.mStorage );
+		mPoints = other.mPoints;
+		other.clear();
+		return *this;
+	}
+
+	void IGABezierCache::build( const IGADataView &data, unsigned thread_count )
+	{
+		uint32_t elem_count = data.elemCount();
+
+		// First count each element's patches and control points, so that every
+		// element's place in the arrays is known before any of them is filled in.
+		std::vector< size_t > point_begins( elem_count + size_t( 1 ) );
+		mPatchEnds.assign( elem_count, 0 );
+		parallelRanges( elem_count, MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			std::vector< uint32_t > orders;
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				uint32_t elem_index = static_cast< uint32_t >( ielem );
+				size_t point_count = 0;
+				orders.clear();
+				for( uint32_t ipiece = data.pieceBegin( elem_index ); ipiece < data.pieceEnd( elem_index ); ++ipiece )
+				{
+					// As in extractBezierElem, there's a patch for each pair of orders.
+					int s_order = data.pieceSOrder( ipiece ), t_order = data.pieceTOrder( ipiece );
+					uint32_t st_order = data.pieces()[ ipiece ].st_order;
+					if( s_order == 0 || t_order == 0 || std::find( orders.begin(), orders.end(), st_order ) != orders.end() )
+						continue;
+					orders.push_back( st_order );
+					point_count += static_cast< size_t >( s_order ) * t_order;
+				}
+				mPatchEnds[ ielem ] = orders.size();
+				point_begins[ ielem + 1 ] = point_count;
+			}
+		} );
+		for( uint32_t ielem = 1; ielem < elem_count; ++ielem )
+			mPatchEnds[ ielem ] += mPatchEnds[ ielem - 1 ];
+		for( uint32_t ielem = 1; ielem <= elem_count; ++ielem )
+			point_begins[ ielem ] += point_begins[ ielem - 1 ];
+
+		// Then extract the elements straight into place.
+		mPatches.assign( elem_count == 0 ? 0 : mPatchEnds.back(), IGABezierPatchRef() );
+		mStorage.assign( ( point_begins.back() * sizeof( Point3d ) + POINT_ALIGNMENT ) / sizeof( uint64_t ), 0 );
+		uintptr_t address = reinterpret_cast< uintptr_t >( mStorage.data() );
+		mPoints = reinterpret_cast< Point3d * >( reinterpret_cast< char * >( mStorage.data() ) + ( POINT_ALIGNMENT - address % POINT_ALIGNMENT ) % POINT_ALIGNMENT );
+		parallelRanges( elem_count, MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			IGABezierElem bezier;
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				uint32_t elem_index = static_cast< uint32_t >( ielem );
+				extractBezierElem( data, elem_index, bezier );
+				IGABezierPatchRef *refs = mPatches.data() + patchBegin( elem_index );
+				Point3d *points = mPoints + point_begins[ ielem ];
+				for( const IGABezierPatch &patch : bezier.patches )
+				{
+					std::copy( patch.points.begin(), patch.points.end(), points );
+					refs->s_order = patch.s_order;
+					refs->t_order = patch.t_order;
+					refs->points = points;
+					++refs;
+					points += patch.points.size();
+				}
+			}
+		} );
+	}
+
+	void IGABezierCache::clear()
+	{
+		mPatches.clear();
+		mPatchEnds.clear();
+		mStorage.clear();
+		mPoints = nullptr;
+	}
+}
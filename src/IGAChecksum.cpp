@@ -0,0 +1,296 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAChecksum.h"
+
+#include <cstring>
+
+#if defined( _MSC_VER ) && defined( _M_X64 )
+#define IGA_CRC32C_X86 1
+#include <intrin.h>
+#include <nmmintrin.h>
+#elif ( defined( __GNUC__ ) || defined( __clang__ ) ) && defined( __x86_64__ )
+#define IGA_CRC32C_X86 1
+#include <nmmintrin.h>
+#elif defined( __aarch64__ ) && defined( __ARM_FEATURE_CRC32 )
+// The compiler was told that every target processor has the CRC instructions.
+#define IGA_CRC32C_ARM 1
+#include <arm_acle.h>
+#elif defined( __aarch64__ ) && defined( __linux__ ) && defined( __GNUC__ )
+// Check for the CRC instructions at run time.
+#define IGA_CRC32C_ARM 1
+#define IGA_CRC32C_ARM_HWCAP 1
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// The CRC-32C polynomial, bit-reversed.
+		const uint32_t CRC32C_POLY = 0x82F63B78u;
+
+		// The hardware version checksums three streams of LONG_BLOCK (or SHORT_BLOCK)
+		// bytes at once, since the instruction's latency is three times its
+		// throughput, and then combines them with the tables below.
+		const size_t LONG_BLOCK = 8192;
+		const size_t SHORT_BLOCK = 256;
+
+		// Multiplies a vector by a 32x32 GF(2) matrix.
+		uint32_t gf2MatrixTimes( const uint32_t *mat, uint32_t vec )
+		{
+			uint32_t sum = 0;
+			while( vec )
+			{
+				if( vec & 1 )
+					sum ^= *mat;
+				vec >>= 1;
+				++mat;
+			}
+			return sum;
+		}
+
+		void gf2MatrixSquare( uint32_t *square, const uint32_t *mat )
+		{
+			for( int n = 0; n < 32; ++n )
+				square[ n ] = gf2MatrixTimes( mat, mat[ n ] );
+		}
+
+		// Builds the operator that applies 'length' zero bytes to a crc.
+		void zerosOperator( uint32_t *even, size_t length )
+		{
+			uint32_t odd[ 32 ];
+			// The operator for one zero bit.
+			odd[ 0 ] = CRC32C_POLY;
+			uint32_t row = 1;
+			for( int n = 1; n < 32; ++n )
+			{
+				odd[ n ] = row;
+				row <<= 1;
+			}
+			// Two zero bits, then four.
+			gf2MatrixSquare( even, odd );
+			gf2MatrixSquare( odd, even );
+			// Each further squaring doubles the number of zeros, starting from one
+			// byte; apply the ones that make up 'length'.
+			do
+			{
+				gf2MatrixSquare( even, odd );
+				length >>= 1;
+				if( length == 0 )
+					return;
+				gf2MatrixSquare( odd, even );
+				length >>= 1;
+			} while( length );
+			memcpy( even, odd, sizeof( odd ) );
+		}
+
+		// The tables that apply a fixed number of zero bytes to a crc, one byte of the
+		// crc at a time.
+		struct ZerosTable
+		{
+			uint32_t table[ 4 ][ 256 ];
+
+			explicit ZerosTable( size_t length )
+			{
+				uint32_t op[ 32 ];
+				zerosOperator( op, length );
+				for( uint32_t n = 0; n < 256; ++n )
+				{
+					table[ 0 ][ n ] = gf2MatrixTimes( op, n );
+					table[ 1 ][ n ] = gf2MatrixTimes( op, n << 8 );
+					table[ 2 ][ n ] = gf2MatrixTimes( op, n << 16 );
+					table[ 3 ][ n ] = gf2MatrixTimes( op, n << 24 );
+				}
+			}
+
+			uint32_t shift( uint32_t crc ) const
+			{
+				return table[ 0 ][ crc & 0xFF ] ^ table[ 1 ][ ( crc >> 8 ) & 0xFF ] ^
+					table[ 2 ][ ( crc >> 16 ) & 0xFF ] ^ table[ 3 ][ crc >> 24 ];
+			}
+		};
+
+		// Tables for the portable slice-by-8 version.
+		struct SliceTable
+		{
+			uint32_t table[ 8 ][ 256 ];
+
+			SliceTable()
+			{
+				for( uint32_t n = 0; n < 256; ++n )
+				{
+					uint32_t crc = n;
+					for( int k = 0; k < 8; ++k )
+						crc = crc & 1 ? ( crc >> 1 ) ^ CRC32C_POLY : crc >> 1;
+					table[ 0 ][ n ] = crc;
+				}
+				for( uint32_t n = 0; n < 256; ++n )
+				{
+					uint32_t crc = table[ 0 ][ n ];
+					for( int k = 1; k < 8; ++k )
+					{
+						crc = table[ 0 ][ crc & 0xFF ] ^ ( crc >> 8 );
+						table[ k ][ n ] = crc;
+					}
+				}
+			}
+		};
+
+		uint32_t crc32cPortable( uint32_t crc, const unsigned char *next, size_t length )
+		{
+			static const SliceTable s_tables;
+			const uint32_t ( *table )[ 256 ] = s_tables.table;
+			crc = ~crc;
+			while( length > 0 && ( reinterpret_cast< uintptr_t >( next ) & 7 ) != 0 )
+			{
+				crc = table[ 0 ][ ( crc ^ *next++ ) & 0xFF ] ^ ( crc >> 8 );
+				--length;
+			}
+			while( length >= 8 )
+			{
+				// This assumes a little-endian processor, as the file format does.
+				uint64_t word;
+				memcpy( &word, next, 8 );
+				word ^= crc;
+				crc = table[ 7 ][ word & 0xFF ] ^ table[ 6 ][ ( word >> 8 ) & 0xFF ] ^
+					table[ 5 ][ ( word >> 16 ) & 0xFF ] ^ table[ 4 ][ ( word >> 24 ) & 0xFF ] ^
+					table[ 3 ][ ( word >> 32 ) & 0xFF ] ^ table[ 2 ][ ( word >> 40 ) & 0xFF ] ^
+					table[ 1 ][ ( word >> 48 ) & 0xFF ] ^ table[ 0 ][ word >> 56 ];
+				next += 8;
+				length -= 8;
+			}
+			while( length > 0 )
+			{
+				crc = table[ 0 ][ ( crc ^ *next++ ) & 0xFF ] ^ ( crc >> 8 );
+				--length;
+			}
+			return ~crc;
+		}
+
+		#if defined( IGA_CRC32C_X86 ) || defined( IGA_CRC32C_ARM )
+		// The hardware instructions, wrapped so that the algorithm below can be shared.
+		#if defined( IGA_CRC32C_X86 ) && !defined( _MSC_VER )
+		#define IGA_CRC32C_TARGET __attribute__( ( target( "sse4.2" ) ) )
+		#elif defined( IGA_CRC32C_ARM_HWCAP )
+		#define IGA_CRC32C_TARGET __attribute__( ( target( "+crc" ) ) )
+		#else
+		#define IGA_CRC32C_TARGET
+		#endif
+
+		IGA_CRC32C_TARGET inline uint32_t crcByte( uint32_t crc, unsigned char byte )
+		{
+			#ifdef IGA_CRC32C_X86
+			return _mm_crc32_u8( crc, byte );
+			#else
+			return __crc32cb( crc, byte );
+			#endif
+		}
+
+		IGA_CRC32C_TARGET inline uint32_t crcWord( uint32_t crc, const unsigned char *next )
+		{
+			uint64_t word;
+			memcpy( &word, next, 8 );
+			#ifdef IGA_CRC32C_X86
+			return static_cast< uint32_t >( _mm_crc32_u64( crc, word ) );
+			#else
+			return __crc32cd( crc, word );
+			#endif
+		}
+
+		IGA_CRC32C_TARGET uint32_t crc32cHardware( uint32_t crc, const unsigned char *next, size_t length )
+		{
+			static const ZerosTable s_long_zeros( LONG_BLOCK );
+			static const ZerosTable s_short_zeros( SHORT_BLOCK );
+
+			uint64_t crc0 = ~crc;
+			while( length > 0 && ( reinterpret_cast< uintptr_t >( next ) & 7 ) != 0 )
+			{
+				crc0 = crcByte( static_cast< uint32_t >( crc0 ), *next++ );
+				--length;
+			}
+
+			// Checksum three adjacent blocks at once, then shift the first two past
+			// the blocks that follow them and combine the results.
+			const size_t block_sizes[ 2 ] = { LONG_BLOCK, SHORT_BLOCK };
+			const ZerosTable *zeros[ 2 ] = { &s_long_zeros, &s_short_zeros };
+			for( int isize = 0; isize < 2; ++isize )
+			{
+				const size_t block = block_sizes[ isize ];
+				while( length >= block * 3 )
+				{
+					uint32_t crc1 = 0;
+					uint32_t crc2 = 0;
+					const unsigned char *end = next + block;
+					uint32_t c0 = static_cast< uint32_t >( crc0 );
+					do
+					{
+						c0 = crcWord( c0, next );
+						crc1 = crcWord( crc1, next + block );
+						crc2 = crcWord( crc2, next + 2 * block );
+						next += 8;
+					} while( next < end );
+					c0 = zeros[ isize ]->shift( c0 ) ^ crc1;
+					c0 = zeros[ isize ]->shift( c0 ) ^ crc2;
+					crc0 = c0;
+					next += 2 * block;
+					length -= 3 * block;
+				}
+			}
+
+			uint32_t c0 = static_cast< uint32_t >( crc0 );
+			while( length >= 8 )
+			{
+				c0 = crcWord( c0, next );
+				next += 8;
+				length -= 8;
+			}
+			while( length > 0 )
+			{
+				c0 = crcByte( c0, *next++ );
+				--length;
+			}
+			return ~c0;
+		}
+
+		bool haveHardwareCrc()
+		{
+			#if defined( IGA_CRC32C_X86 ) && defined( _MSC_VER )
+			int info[ 4 ];
+			__cpuid( info, 1 );
+			return ( info[ 2 ] & ( 1 << 20 ) ) != 0;
+			#elif defined( IGA_CRC32C_X86 )
+			return __builtin_cpu_supports( "sse4.2" ) != 0;
+			#elif defined( IGA_CRC32C_ARM_HWCAP )
+			return ( getauxval( AT_HWCAP ) & HWCAP_CRC32 ) != 0;
+			#else
+			return true;
+			#endif
+		}
+		#endif
+	}
+
+	uint32_t crc32c( uint32_t crc, const void *data, size_t length )
+	{
+		const unsigned char *next = static_cast< const unsigned char * >( data );
+		#if defined( IGA_CRC32C_X86 ) || defined( IGA_CRC32C_ARM )
+		static const bool s_hardware = haveHardwareCrc();
+		if( s_hardware )
+			return crc32cHardware( crc, next, length );
+		#endif
+		return crc32cPortable( crc, next, length );
+	}
+}
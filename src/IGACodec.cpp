@@ -0,0 +1,304 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGACodec.h"
+
+#include <cstring>
+
+#include "iga/IGACommon.h"
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// The LZ77 coder uses the same sequence layout as LZ4 blocks: a token byte
+		// holding the literal count and match length in its high and low nibbles,
+		// with 255-byte continuations for long runs, then the literals, then a 16-bit
+		// match offset. The final sequence has literals only.
+		const size_t LZ_MIN_MATCH = 4;
+		const size_t LZ_MAX_OFFSET = 0xFFFF;
+		const int LZ_HASH_BITS = 16;
+		const uint32_t LZ_NO_POSITION = 0xFFFFFFFFu;
+
+		uint32_t read32( const uint8_t *p )
+		{
+			uint32_t value;
+			memcpy( &value, p, 4 );
+			return value;
+		}
+
+		void writeLength( std::vector< char > &out, size_t length )
+		{
+			while( length >= 255 )
+			{
+				out.push_back( static_cast< char >( 255 ) );
+				length -= 255;
+			}
+			out.push_back( static_cast< char >( length ) );
+		}
+
+		void lzSequence( std::vector< char > &out, const uint8_t *literals, size_t literal_count, size_t offset, size_t match_len )
+		{
+			size_t match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+			uint8_t token = static_cast< uint8_t >( ( literal_count < 15 ? literal_count : 15 ) << 4 );
+			token |= static_cast< uint8_t >( match_code < 15 ? match_code : 15 );
+			out.push_back( static_cast< char >( token ) );
+			if( literal_count >= 15 )
+				writeLength( out, literal_count - 15 );
+			out.insert( out.end(), literals, literals + literal_count );
+			if( match_len == 0 )
+				return;
+			out.push_back( static_cast< char >( offset & 0xFF ) );
+			out.push_back( static_cast< char >( offset >> 8 ) );
+			if( match_code >= 15 )
+				writeLength( out, match_code - 15 );
+		}
+
+		// Appends the compressed form of src to out. Blocks are limited to IGA_MAX_ALLOC,
+		// so 32-bit positions are enough.
+		void lzCompress( const uint8_t *src, size_t length, std::vector< char > &out )
+		{
+			std::vector< uint32_t > table( size_t( 1 ) << LZ_HASH_BITS, LZ_NO_POSITION );
+			size_t anchor = 0;
+			size_t pos = 0;
+			while( pos + LZ_MIN_MATCH <= length )
+			{
+				uint32_t value = read32( src + pos );
+				uint32_t &slot = table[ ( value * 2654435761u ) >> ( 32 - LZ_HASH_BITS ) ];
+				size_t candidate = slot;
+				slot = static_cast< uint32_t >( pos );
+				if( candidate == LZ_NO_POSITION || pos - candidate > LZ_MAX_OFFSET || read32( src + candidate ) != value )
+				{
+					++pos;
+					continue;
+				}
+
+				size_t match_len = LZ_MIN_MATCH;
+				while( pos + match_len < length && src[ candidate + match_len ] == src[ pos + match_len ] )
+					++match_len;
+				lzSequence( out, src + anchor, pos - anchor, pos - candidate, match_len );
+				pos += match_len;
+				anchor = pos;
+				// Remember a position near the end of the match, so that runs of
+				// repeated data keep matching.
+				if( pos + 2 <= length )
+					table[ ( read32( src + pos - 2 ) * 2654435761u ) >> ( 32 - LZ_HASH_BITS ) ] = static_cast< uint32_t >( pos - 2 );
+			}
+			lzSequence( out, src + anchor, length - anchor, 0, 0 );
+		}
+
+		// Reads a 255-continued length, returning false if it runs off the end.
+		bool readLength( const uint8_t *&in, const uint8_t *in_end, size_t &length )
+		{
+			for( ;; )
+			{
+				if( in == in_end )
+					return false;
+				uint8_t byte = *in++;
+				length += byte;
+				if( byte != 255 )
+					return true;
+			}
+		}
+
+		// Decompresses exactly dst_len bytes into dst.
+		bool lzDecompress( const uint8_t *in, size_t in_len, uint8_t *dst, size_t dst_len )
+		{
+			const uint8_t *in_end = in + in_len;
+			size_t out = 0;
+			while( in < in_end )
+			{
+				uint8_t token = *in++;
+				size_t literal_count = token >> 4;
+				if( literal_count == 15 && !readLength( in, in_end, literal_count ) )
+					return false;
+				if( literal_count > size_t( in_end - in ) || literal_count > dst_len - out )
+					return false;
+				memcpy( dst + out, in, literal_count );
+				in += literal_count;
+				out += literal_count;
+
+				// The final sequence has no match.
+				if( in == in_end )
+					break;
+
+				if( in_end - in < 2 )
+					return false;
+				size_t offset = in[ 0 ] | ( size_t( in[ 1 ] ) << 8 );
+				in += 2;
+				size_t match_len = token & 0x0F;
+				if( match_len == 15 && !readLength( in, in_end, match_len ) )
+					return false;
+				match_len += LZ_MIN_MATCH;
+				if( offset == 0 || offset > out || match_len > dst_len - out )
+					return false;
+				// The match may overlap the bytes it produces, so copy byte by byte.
+				const uint8_t *match = dst + out - offset;
+				for( size_t ibyte = 0; ibyte < match_len; ++ibyte )
+					dst[ out + ibyte ] = match[ ibyte ];
+				out += match_len;
+			}
+			return out == dst_len;
+		}
+
+		void shuffle( const char *src, size_t length, size_t stride, char *dst )
+		{
+			size_t count = length / stride;
+			for( size_t ibyte = 0; ibyte < stride; ++ibyte )
+			{
+				for( size_t ivalue = 0; ivalue < count; ++ivalue )
+					dst[ ibyte * count + ivalue ] = src[ ivalue * stride + ibyte ];
+			}
+		}
+
+		void unshuffle( const char *src, size_t length, size_t stride, char *dst )
+		{
+			size_t count = length / stride;
+			for( size_t ibyte = 0; ibyte < stride; ++ibyte )
+			{
+				for( size_t ivalue = 0; ivalue < count; ++ivalue )
+					dst[ ivalue * stride + ibyte ] = src[ ibyte * count + ivalue ];
+			}
+		}
+
+		void deltaEncode( const char *src, size_t length, size_t stride, std::vector< char > &dst )
+		{
+			size_t count = length / 4;
+			dst.reserve( count * 2 );
+			for( size_t iword = 0; iword < count; ++iword )
+			{
+				uint32_t word;
+				memcpy( &word, src + iword * 4, 4 );
+				uint32_t previous = 0;
+				if( iword >= stride )
+					memcpy( &previous, src + ( iword - stride ) * 4, 4 );
+				// Zigzag encoding makes small negative differences small too.
+				uint32_t delta = word - previous;
+				uint32_t zigzag = ( delta << 1 ) ^ ( 0u - ( delta >> 31 ) );
+				while( zigzag >= 0x80 )
+				{
+					dst.push_back( static_cast< char >( ( zigzag & 0x7F ) | 0x80 ) );
+					zigzag >>= 7;
+				}
+				dst.push_back( static_cast< char >( zigzag ) );
+			}
+		}
+
+		bool deltaDecode( const uint8_t *src, size_t src_len, size_t stride, char *dst, size_t length )
+		{
+			size_t count = length / 4;
+			const uint8_t *src_end = src + src_len;
+			for( size_t iword = 0; iword < count; ++iword )
+			{
+				uint32_t zigzag = 0;
+				for( int shift = 0;; shift += 7 )
+				{
+					if( src == src_end || shift > 28 )
+						return false;
+					uint8_t byte = *src++;
+					zigzag |= uint32_t( byte & 0x7F ) << shift;
+					if( ( byte & 0x80 ) == 0 )
+						break;
+				}
+				uint32_t delta = ( zigzag >> 1 ) ^ ( 0u - ( zigzag & 1 ) );
+				uint32_t previous = 0;
+				if( iword >= stride )
+					memcpy( &previous, dst + ( iword - stride ) * 4, 4 );
+				uint32_t word = previous + delta;
+				memcpy( dst + iword * 4, &word, 4 );
+			}
+			return src == src_end;
+		}
+	}
+
+	bool packBlock( uint64_t tag, const char *contents, size_t length, std::vector< char > &packed )
+	{
+		PackedBlockHeader header;
+		header.inner_tag = tag;
+		header.raw_len = length;
+		if( tag == tagValue( "VECDICT" ) || tag == tagValue( "PT3DW" ) || tag == tagValue( "KNOTINT" ) )
+		{
+			header.codec = CODEC_SHUFFLE_LZ;
+			header.stride = 8;
+		}
+		else
+		{
+			header.codec = CODEC_DELTA_VARINT_LZ;
+			if( tag == tagValue( "2DPIECE" ) )
+				header.stride = 4;
+			else if( tag == tagValue( "SHAPE" ) )
+				header.stride = 3;
+			else if( tag == tagValue( "EDGES" ) )
+				header.stride = 1;
+			else if( tag == tagValue( "LAYOUT" ) )
+				header.stride = 5;
+			else
+				return false;
+		}
+		// Tiny blocks aren't worth it, and huge ones couldn't be read back anyway.
+		if( length < 64 || length >= IGA_MAX_ALLOC || length % ( header.codec == CODEC_SHUFFLE_LZ ? header.stride : 4 ) != 0 )
+			return false;
+
+		std::vector< char > coded;
+		if( header.codec == CODEC_SHUFFLE_LZ )
+		{
+			coded.resize( length );
+			shuffle( contents, length, header.stride, coded.data() );
+		}
+		else
+			deltaEncode( contents, length, header.stride, coded );
+		header.coded_len = coded.size();
+
+		packed.clear();
+		packed.resize( sizeof( PackedBlockHeader ) );
+		memcpy( packed.data(), &header, sizeof( PackedBlockHeader ) );
+		lzCompress( reinterpret_cast< const uint8_t * >( coded.data() ), coded.size(), packed );
+		return packed.size() < length;
+	}
+
+	bool readPackedHeader( const char *packed, size_t packed_len, PackedBlockHeader &header )
+	{
+		if( packed_len < sizeof( PackedBlockHeader ) )
+			return false;
+		memcpy( &header, packed, sizeof( PackedBlockHeader ) );
+		if( header.raw_len >= IGA_MAX_ALLOC )
+			return false;
+		if( header.codec == CODEC_SHUFFLE_LZ )
+			return header.stride > 0 && header.raw_len % header.stride == 0 && header.coded_len == header.raw_len;
+		if( header.codec == CODEC_DELTA_VARINT_LZ )
+			return header.stride > 0 && header.raw_len % 4 == 0 && header.coded_len <= header.raw_len / 4 * 5;
+		return false;
+	}
+
+	bool unpackBlock( const char *packed, size_t packed_len, char *destination )
+	{
+		PackedBlockHeader header;
+		if( !readPackedHeader( packed, packed_len, header ) )
+			return false;
+
+		const uint8_t *compressed = reinterpret_cast< const uint8_t * >( packed + sizeof( PackedBlockHeader ) );
+		size_t compressed_len = packed_len - sizeof( PackedBlockHeader );
+		std::vector< char > coded( static_cast< size_t >( header.coded_len ) );
+		if( !lzDecompress( compressed, compressed_len, reinterpret_cast< uint8_t * >( coded.data() ), coded.size() ) )
+			return false;
+
+		size_t raw_len = static_cast< size_t >( header.raw_len );
+		if( header.codec == CODEC_SHUFFLE_LZ )
+		{
+			unshuffle( coded.data(), raw_len, header.stride, destination );
+			return true;
+		}
+		return deltaDecode( reinterpret_cast< const uint8_t * >( coded.data() ), coded.size(), header.stride, destination, raw_len );
+	}
+}
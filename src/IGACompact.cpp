@@ -0,0 +1,218 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGACompact.h"
+#include <algorithm>
+#include <cstring>
+
+#include "iga/IGAParallel.h"
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// The number of pieces whose vectors are collected together.
+		const size_t PIECES_PER_RANGE = 4096;
+
+		// The number of pieces or elements handed to a thread at a time when
+		// renumbering them.
+		const size_t MIN_ITEMS_PER_RANGE = 4096;
+
+		// A coefficient vector used by a piece: where it starts in the old
+		// dictionary, and how long it is. Pieces may use vectors that overlap, so
+		// both are needed to tell them apart.
+		struct CoeffRef
+		{
+			uint32_t index = 0;
+			uint32_t length = 0;
+
+			bool operator<( const CoeffRef &rhs ) const
+			{
+				return index < rhs.index || ( index == rhs.index && length < rhs.length );
+			}
+			bool operator==( const CoeffRef &rhs ) const
+			{
+				return index == rhs.index && length == rhs.length;
+			}
+		};
+
+		// Appends the vectors used by 'piece' to 'refs'.
+		void addCoeffRefs( const Piece2D &piece, std::vector< CoeffRef > &refs )
+		{
+			uint32_t s_order = piece.st_order & 0xFFFF;
+			uint32_t t_order = piece.st_order >> 16;
+			CoeffRef ref;
+			ref.index = piece.s_index;
+			if( piece.maybe_t_index == INVALID_INDEX )
+			{
+				ref.length = s_order * t_order;
+				refs.push_back( ref );
+				return;
+			}
+			ref.length = s_order;
+			refs.push_back( ref );
+			ref.index = piece.maybe_t_index;
+			ref.length = t_order;
+			refs.push_back( ref );
+		}
+
+		// Sorts 'refs' and removes the duplicates.
+		void sortUnique( std::vector< CoeffRef > &refs )
+		{
+			std::sort( refs.begin(), refs.end() );
+			refs.erase( std::unique( refs.begin(), refs.end() ), refs.end() );
+		}
+
+		// Returns true if 'error' is about a layout that is the same as an earlier one.
+		bool isDuplicateLayout( const IGAData &data, const IGAValidationError &error )
+		{
+			const std::vector< FaceLayout > &layouts = data.layouts();
+			if( strcmp( error.array, "layouts" ) != 0 || error.index >= layouts.size() )
+				return false;
+			const FaceLayout &layout = layouts[ error.index ];
+			for( size_t ilayout = 0; ilayout < error.index; ++ilayout )
+			{
+				if( !( layouts[ ilayout ] < layout ) && !( layout < layouts[ ilayout ] ) )
+					return true;
+			}
+			return false;
+		}
+
+		// Returns the new index of a vector, which must be in 'refs'.
+		uint32_t newCoeffIndex( const std::vector< CoeffRef > &refs, const std::vector< uint32_t > &new_indices,
+			uint32_t index, uint32_t length )
+		{
+			CoeffRef ref;
+			ref.index = index;
+			ref.length = length;
+			return new_indices[ std::lower_bound( refs.begin(), refs.end(), ref ) - refs.begin() ];
+		}
+	}
+
+	bool compact( IGAData &data, const IGADedupOptions &options, unsigned thread_count )
+	{
+		// Duplicate layouts are allowed, since merging them is part of the job.
+		std::vector< IGAValidationError > errors;
+		data.validate( errors, true, thread_count );
+		for( const IGAValidationError &error : errors )
+		{
+			if( !isDuplicateLayout( data, error ) )
+				return false;
+		}
+
+		// Build the new data with an IGACreator, so that the dictionaries come out
+		// as they would if the model were built again from scratch.
+		IGAData compacted;
+		IGACreator creator( &compacted );
+		IGADedupOptions merge_options = options;
+		merge_options.merge_points = true;
+		if( !creator.setDedupOptions( merge_options ) || !creator.setSharedDictionary( data.sharedDictionary() ) )
+			return false;
+		creator.setSurfaceType( data.surfaceType() );
+
+		// Collect the distinct vectors used by each range of pieces, and then by all
+		// of them.
+		const std::vector< Piece2D > &pieces = data.pieces();
+		size_t range_count = ( pieces.size() + PIECES_PER_RANGE - 1 ) / PIECES_PER_RANGE;
+		std::vector< std::vector< CoeffRef > > range_refs( range_count );
+		parallelRanges( range_count, 1, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t irange = begin; irange < end; ++irange )
+			{
+				size_t piece_end = std::min( pieces.size(), ( irange + 1 ) * PIECES_PER_RANGE );
+				for( size_t ipiece = irange * PIECES_PER_RANGE; ipiece < piece_end; ++ipiece )
+					addCoeffRefs( pieces[ ipiece ], range_refs[ irange ] );
+				sortUnique( range_refs[ irange ] );
+			}
+		} );
+		std::vector< CoeffRef > refs;
+		for( const std::vector< CoeffRef > &range : range_refs )
+			refs.insert( refs.end(), range.begin(), range.end() );
+		range_refs.clear();
+		sortUnique( refs );
+
+		// Add the vectors, points and layouts that are used to the new
+		// dictionaries, in their old order.
+		std::vector< uint32_t > new_coeff_indices( refs.size() );
+		for( size_t iref = 0; iref < refs.size(); ++iref )
+		{
+			new_coeff_indices[ iref ] = creator.getDictionaryIndex( data.coeffs().data() + refs[ iref ].index, refs[ iref ].length );
+			if( new_coeff_indices[ iref ] == INVALID_INDEX )
+				return false;
+		}
+
+		std::vector< uint32_t > new_point_indices( data.points().size(), INVALID_INDEX );
+		for( const Piece2D &piece : pieces )
+			new_point_indices[ piece.pt_index ] = 0;
+		for( size_t ipoint = 0; ipoint < new_point_indices.size(); ++ipoint )
+		{
+			if( new_point_indices[ ipoint ] == INVALID_INDEX )
+				continue;
+			new_point_indices[ ipoint ] = creator.addPoint( data.points()[ ipoint ] );
+			if( new_point_indices[ ipoint ] == INVALID_INDEX )
+				return false;
+		}
+
+		// Layout 0 is always the default layout, so it needs no entry of its own;
+		// leaving it out keeps a model that only uses the default layout without
+		// any stored layouts.
+		const std::vector< Elem > &elems = data.elems();
+		std::vector< uint32_t > new_layout_indices( std::max( data.layouts().size(), size_t( 1 ) ), INVALID_INDEX );
+		new_layout_indices[ 0 ] = 0;
+		for( const Elem &elem : elems )
+		{
+			uint32_t &new_index = new_layout_indices[ elem.layout_index ];
+			if( new_index != INVALID_INDEX )
+				continue;
+			new_index = creator.getLayoutIndex( data.layout( elem.layout_index ) );
+			if( new_index == INVALID_INDEX )
+				return false;
+		}
+
+		// Renumber the pieces and elements.
+		std::vector< Piece2D > new_pieces( pieces.size() );
+		parallelRanges( pieces.size(), MIN_ITEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ipiece = begin; ipiece < end; ++ipiece )
+			{
+				Piece2D piece = pieces[ ipiece ];
+				uint32_t s_order = piece.st_order & 0xFFFF;
+				uint32_t t_order = piece.st_order >> 16;
+				if( piece.maybe_t_index == INVALID_INDEX )
+					piece.s_index = newCoeffIndex( refs, new_coeff_indices, piece.s_index, s_order * t_order );
+				else
+				{
+					piece.s_index = newCoeffIndex( refs, new_coeff_indices, piece.s_index, s_order );
+					piece.maybe_t_index = newCoeffIndex( refs, new_coeff_indices, piece.maybe_t_index, t_order );
+				}
+				piece.pt_index = new_point_indices[ piece.pt_index ];
+				new_pieces[ ipiece ] = piece;
+			}
+		} );
+
+		std::vector< Elem > new_elems( elems.begin(), elems.end() );
+		parallelRanges( new_elems.size(), MIN_ITEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ielem = begin; ielem < end; ++ielem )
+				new_elems[ ielem ].layout_index = new_layout_indices[ new_elems[ ielem ].layout_index ];
+		} );
+
+		// The edges refer to elements, which don't move, so they're copied as they are.
+		const std::vector< uint32_t > &edges = data.edges();
+		if( ( !new_pieces.empty() && creator.addPieces( new_pieces.data(), new_pieces.size() ) == INVALID_INDEX ) ||
+			( !new_elems.empty() && creator.addElems( new_elems.data(), new_elems.size() ) == INVALID_INDEX ) ||
+			( !edges.empty() && creator.addEdges( edges.data(), data.intervals().empty() ? nullptr : data.intervals().data(), edges.size() ) == INVALID_INDEX ) )
+			return false;
+
+		data = std::move( compacted );
+		return true;
+	}
+}
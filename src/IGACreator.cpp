@@ -14,6 +14,12 @@
 
 #include "iga/IGACreator.h"
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "iga/IGAParallel.h"
+#include "iga/IGASharedDictionary.h"
 
 namespace iga_fileio
 {
@@ -22,11 +28,179 @@ namespace iga_fileio
 		return std::lexicographical_compare( a.begin(), a.end(), b.begin(), b.end() );
 	}
 
+	uint64_t CoeffHashLookup::hashCoeffs( const double *coeffs, size_t length )
+	{
+		uint64_t hash = 0x9E3779B97F4A7C15ull ^ length;
+		for( size_t icoeff = 0; icoeff < length; ++icoeff )
+		{
+			// Hash the bits of each value, except that -0.0 must hash like 0.0 since
+			// they compare equal.
+			uint64_t bits = 0;
+			if( coeffs[ icoeff ] != 0.0 )
+				memcpy( &bits, &coeffs[ icoeff ], sizeof( bits ) );
+			hash = ( hash ^ bits ) * 0xFF51AFD7ED558CCDull;
+			hash ^= hash >> 32;
+		}
+		// Finish with the splitmix64 mixer, so that the low bits (which pick the
+		// slot) depend on every input bit.
+		hash ^= hash >> 30;
+		hash *= 0xBF58476D1CE4E5B9ull;
+		hash ^= hash >> 27;
+		hash *= 0x94D049BB133111EBull;
+		hash ^= hash >> 31;
+		return hash;
+	}
+
+	uint32_t CoeffHashLookup::find( IGASpan< double > dictionary, const double *coeffs, size_t length, uint64_t hash ) const
+	{
+		if( mSlots.empty() )
+			return INVALID_INDEX;
+
+		// Linear probing: look from the hashed slot until we find a match or an
+		// empty slot.
+		size_t mask = mSlots.size() - 1;
+		for( size_t islot = static_cast< size_t >( hash ) & mask;; islot = ( islot + 1 ) & mask )
+		{
+			const Entry &entry = mSlots[ islot ];
+			if( entry.dict_index == INVALID_INDEX )
+				return INVALID_INDEX;
+			if( entry.hash == hash && entry.length == length &&
+				std::equal( coeffs, coeffs + length, dictionary.begin() + entry.dict_index ) )
+				return entry.dict_index;
+		}
+	}
+
+	uint32_t CoeffHashLookup::findNear( IGASpan< double > dictionary, const double *coeffs, size_t length, uint64_t hash, double tolerance ) const
+	{
+		if( mSlots.empty() )
+			return INVALID_INDEX;
+
+		auto near = [tolerance]( double a, double b ) { return std::fabs( a - b ) <= tolerance; };
+		size_t mask = mSlots.size() - 1;
+		for( size_t islot = static_cast< size_t >( hash ) & mask;; islot = ( islot + 1 ) & mask )
+		{
+			const Entry &entry = mSlots[ islot ];
+			if( entry.dict_index == INVALID_INDEX )
+				return INVALID_INDEX;
+			if( entry.hash == hash && entry.length == length &&
+				std::equal( coeffs, coeffs + length, dictionary.begin() + entry.dict_index, near ) )
+				return entry.dict_index;
+		}
+	}
+
+	void CoeffHashLookup::insert( uint64_t hash, uint32_t dict_index, uint32_t length )
+	{
+		// Keep the table at most half full, so that probe sequences stay short.
+		if( ( mCount + 1 ) * 2 > mSlots.size() )
+		{
+			std::vector< Entry > old_slots( mSlots.size() < 16 ? 32 : mSlots.size() * 2 );
+			old_slots.swap( mSlots );
+			mCount = 0;
+			for( const Entry &entry : old_slots )
+			{
+				if( entry.dict_index != INVALID_INDEX )
+					insert( entry.hash, entry.dict_index, entry.length );
+			}
+		}
+
+		size_t mask = mSlots.size() - 1;
+		size_t islot = static_cast< size_t >( hash ) & mask;
+		while( mSlots[ islot ].dict_index != INVALID_INDEX )
+			islot = ( islot + 1 ) & mask;
+		mSlots[ islot ].hash = hash;
+		mSlots[ islot ].dict_index = dict_index;
+		mSlots[ islot ].length = length;
+		++mCount;
+	}
+
+	void CoeffHashLookup::clear()
+	{
+		mSlots.clear();
+		mCount = 0;
+	}
+
 	IGACreator::IGACreator( IGAData *parent ) : mParent( parent )
 	{
 		parent->clear();
 	}
 
+	namespace
+	{
+		// How many values of a vector that lie near the edge of their grid cell are
+		// also looked for in the next cell. Each one doubles the number of lookups.
+		const size_t MAX_NEAR_PROBES = 4;
+
+		// The hash that the 'count' values at 'values' are inserted into a lookup
+		// with: the hash of the values themselves if 'tolerance' is 0, and otherwise
+		// of the cells they round to. 'cells' is scratch space.
+		uint64_t insertHash( const double *values, size_t count, double tolerance, std::vector< double > &cells )
+		{
+			if( tolerance == 0.0 )
+				return CoeffHashLookup::hashCoeffs( values, count );
+			cells.resize( count );
+			for( size_t ivalue = 0; ivalue < count; ++ivalue )
+				cells[ ivalue ] = std::floor( values[ ivalue ] / tolerance + 0.5 );
+			return CoeffHashLookup::hashCoeffs( cells.data(), count );
+		}
+
+		// Looks in 'lookup' for a vector within 'tolerance' of the 'count' values at
+		// 'values', as described at IGACreator::setDedupOptions, and returns its
+		// index in 'dictionary' or INVALID_INDEX. Sets 'hash' to insertHash() of the
+		// values, to insert them with if they're added. 'cells' is scratch space.
+		uint32_t findNearValues( const CoeffHashLookup &lookup, IGASpan< double > dictionary, const double *values, size_t count,
+			double tolerance, std::vector< double > &cells, uint64_t &hash )
+		{
+			if( tolerance == 0.0 )
+			{
+				hash = CoeffHashLookup::hashCoeffs( values, count );
+				return lookup.find( dictionary, values, count, hash );
+			}
+
+			// Round each value to its cell, noting the values that are within a
+			// quarter of a cell of the next one. The cells are whole numbers held as
+			// doubles, so they can't overflow.
+			cells.resize( count );
+			size_t probe_indices[ MAX_NEAR_PROBES ];
+			double probe_cells[ MAX_NEAR_PROBES ][ 2 ];
+			size_t probe_count = 0;
+			for( size_t ivalue = 0; ivalue < count; ++ivalue )
+			{
+				double scaled = values[ ivalue ] / tolerance;
+				double cell = std::floor( scaled + 0.5 );
+				cells[ ivalue ] = cell;
+				double offset = scaled - cell;
+				if( probe_count < MAX_NEAR_PROBES && std::fabs( offset ) > 0.25 )
+				{
+					probe_indices[ probe_count ] = ivalue;
+					probe_cells[ probe_count ][ 0 ] = cell;
+					probe_cells[ probe_count ][ 1 ] = offset > 0.0 ? cell + 1.0 : cell - 1.0;
+					++probe_count;
+				}
+			}
+			hash = CoeffHashLookup::hashCoeffs( cells.data(), count );
+			uint32_t found_index = lookup.findNear( dictionary, values, count, hash, tolerance );
+
+			// Try each combination of the neighbouring cells.
+			for( size_t combination = 1; found_index == INVALID_INDEX && combination < ( size_t( 1 ) << probe_count ); ++combination )
+			{
+				for( size_t iprobe = 0; iprobe < probe_count; ++iprobe )
+					cells[ probe_indices[ iprobe ] ] = probe_cells[ iprobe ][ ( combination >> iprobe ) & 1 ];
+				uint64_t probe_hash = CoeffHashLookup::hashCoeffs( cells.data(), count );
+				found_index = lookup.findNear( dictionary, values, count, probe_hash, tolerance );
+			}
+			return found_index;
+		}
+
+		// The largest difference between the 'count' values at 'a' and 'b'.
+		double maxDifference( const double *a, const double *b, size_t count )
+		{
+			double difference = 0.0;
+			for( size_t ivalue = 0; ivalue < count; ++ivalue )
+				difference = std::max( difference, std::fabs( a[ ivalue ] - b[ ivalue ] ) );
+			return difference;
+		}
+	}
+
 	// Used by several of the IGACreator member functions. This appends to a vector
 	// with some guards against 32-bit integer overflow, as we use 32-bit integers
 	// for our indexing.
@@ -43,7 +217,26 @@ namespace iga_fileio
 		return added_index;
 	}
 
+	// The batch form of safeAppend. The whole range is checked before anything is
+	// added, so a failure leaves the vector unchanged.
+	template< typename T >
+	uint32_t safeAppendRange( std::vector< T > &vec, const T *values, size_t count )
+	{
+		if( count >= INVALID_INDEX || vec.size() >= INVALID_INDEX - count ||
+			count > vec.max_size() - vec.size() )
+			return INVALID_INDEX;
+
+		uint32_t first_index = static_cast< unsigned >( vec.size() );
+		vec.insert( vec.end(), values, values + count );
+		return first_index;
+	}
+
 	uint32_t IGACreator::addCoeffs( const CoeffVector &coeffs )
+	{
+		return addCoeffs( coeffs.data(), coeffs.size() );
+	}
+
+	uint32_t IGACreator::addCoeffs( const double *coeffs, size_t coeff_count )
 	{
 		// Alias to the mCoeffs in mParent.
 		auto &mCoeffs = mParent->mCoeffs;
@@ -53,14 +246,14 @@ namespace iga_fileio
 		// integer overflow that are possible in that case. The check against 0x7FFF
 		// guards against appending unrepresentable orders; reasonable orders are
 		// much lower.
-		if( mCoeffs.size() + coeffs.size() >= INVALID_INDEX ||
-			mCoeffs.size() + coeffs.size() > mCoeffs.max_size() ||
-			coeffs.size() >= 0x7FFF )
+		if( mCoeffs.size() + coeff_count >= INVALID_INDEX ||
+			mCoeffs.size() + coeff_count > mCoeffs.max_size() ||
+			coeff_count >= 0x7FFF )
 			return INVALID_INDEX;
 
 		// Add these coefficients to our coefficient array and return the index used.
 		uint32_t dict_index = static_cast< unsigned >( mCoeffs.size() );
-		mCoeffs.insert( mCoeffs.end(), coeffs.begin(), coeffs.end() );
+		mCoeffs.insert( mCoeffs.end(), coeffs, coeffs + coeff_count );
 		return dict_index;
 	}
 
@@ -70,9 +263,13 @@ namespace iga_fileio
 		auto &mEdges = mParent->mEdges;
 		auto &mIntervals = mParent->mIntervals;
 
+		mParent->mAdjacency.reset();
 		uint32_t edge_index = safeAppend( mEdges, elem );
 		if( knot_interval >= 0.0 )
 		{
+			// Make the intervals follow any space reserved for the edges.
+			if( mIntervals.empty() )
+				mIntervals.reserve( mEdges.capacity() );
 			uint32_t interval_index = safeAppend( mIntervals, knot_interval );
 			// You must keep these in sync.
 			if( edge_index != interval_index )
@@ -83,28 +280,71 @@ namespace iga_fileio
 		return edge_index;
 	}
 
+	uint32_t IGACreator::addEdges( const uint32_t *edges, const double *knot_intervals, size_t count )
+	{
+		// Alias to the member variables in the parent.
+		auto &mEdges = mParent->mEdges;
+		auto &mIntervals = mParent->mIntervals;
+
+		// Check everything up front, so that nothing is added if we fail.
+		if( knot_intervals )
+		{
+			if( mIntervals.size() != mEdges.size() )
+				return INVALID_INDEX;
+			for( size_t iedge = 0; iedge < count; ++iedge )
+				if( !( knot_intervals[ iedge ] >= 0.0 ) )
+					return INVALID_INDEX;
+		}
+		else if( !mIntervals.empty() )
+			return INVALID_INDEX;
+
+		mParent->mAdjacency.reset();
+		uint32_t edge_index = safeAppendRange( mEdges, edges, count );
+		if( edge_index == INVALID_INDEX )
+			return INVALID_INDEX;
+		if( knot_intervals )
+		{
+			if( mIntervals.empty() )
+				mIntervals.reserve( mEdges.capacity() );
+			mIntervals.insert( mIntervals.end(), knot_intervals, knot_intervals + count );
+		}
+		return edge_index;
+	}
+
 	uint32_t IGACreator::addElem( const Elem &elem )
 	{
+		mParent->mAdjacency.reset();
 		return safeAppend( mParent->mElems, elem );
 	}
 
+	uint32_t IGACreator::addElems( const Elem *elems, size_t count )
+	{
+		mParent->mAdjacency.reset();
+		return safeAppendRange( mParent->mElems, elems, count );
+	}
+
 	uint32_t IGACreator::addExplicitPiece( int s_order, uint32_t pt_index, const CoeffVector &coeffs )
 	{
-		if( coeffs.size() > 0x7FFF * 0x7FFF )
+		return addExplicitPiece( s_order, pt_index, coeffs.data(), coeffs.size() );
+	}
+
+	uint32_t IGACreator::addExplicitPiece( int s_order, uint32_t pt_index, const double *coeffs, size_t coeff_count )
+	{
+		if( coeff_count > 0x7FFF * 0x7FFF || s_order <= 0 )
 			return INVALID_INDEX;
-		int t_order = static_cast< int >( coeffs.size() ) / s_order;
+		int t_order = static_cast< int >( coeff_count ) / s_order;
 		if( s_order < 0 || s_order > 0x7FFF ||
 			t_order < 0 || t_order > 0x7FFF )
 			return INVALID_INDEX;
 
 		// The static_casts should be unnecessary, as we checked the range already,
 		// but can help avoid compiler warnings about arithmetic overflow.
-		if( static_cast< size_t >( s_order ) * static_cast< size_t >( t_order ) != coeffs.size() )
+		if( static_cast< size_t >( s_order ) * static_cast< size_t >( t_order ) != coeff_count )
 			return INVALID_INDEX;
 
 		Piece2D p;
 		p.st_order = ( s_order ) | ( t_order << 16 );
-		p.s_index = getDictionaryIndex( coeffs );
+		p.s_index = getDictionaryIndex( coeffs, coeff_count );
 		if( p.s_index == INVALID_INDEX )
 			return INVALID_INDEX;
 		p.maybe_t_index = INVALID_INDEX;
@@ -114,6 +354,7 @@ namespace iga_fileio
 
 	uint32_t IGACreator::addLayout( const FaceLayout &layout )
 	{
+		mParent->mAdjacency.reset();
 		return safeAppend( mParent->mLayouts, layout );
 	}
 
@@ -122,31 +363,321 @@ namespace iga_fileio
 		return safeAppend( mParent->mPieces, piece );
 	}
 
+	uint32_t IGACreator::addPieces( const Piece2D *pieces, size_t count )
+	{
+		return safeAppendRange( mParent->mPieces, pieces, count );
+	}
+
 	uint32_t IGACreator::addPoint( const Point3d &pt )
 	{
-		return safeAppend( mParent->mPoints, pt );
+		// Alias to the mPoints in mParent.
+		auto &mPoints = mParent->mPoints;
+
+		static_assert( sizeof( Point3d ) == 4 * sizeof( double ), "The point lookup treats Point3d as 4 doubles." );
+		const double *values = &pt.x;
+
+		// Points that aren't finite can't be looked up, and the lookup table can
+		// only index the first quarter of the 32-bit range of points, so those are
+		// always added.
+		if( !mDedupOptions.merge_points || !finite( pt.x ) || !finite( pt.y ) || !finite( pt.z ) || !finite( pt.w ) ||
+			mPoints.size() >= INVALID_INDEX / 4 )
+			return safeAppend( mPoints, pt );
+
+		IGASpan< double > dictionary( reinterpret_cast< const double * >( mPoints.data() ), mPoints.size() * 4 );
+		uint64_t hash = 0;
+		uint32_t found_index = findNearValues( mPointLookup, dictionary, values, 4, mDedupOptions.point_tolerance, mCells, hash );
+		if( found_index != INVALID_INDEX )
+		{
+			mMaxPointError = std::max( mMaxPointError, maxDifference( values, dictionary.data() + found_index, 4 ) );
+			return found_index / 4;
+		}
+
+		uint32_t new_index = safeAppend( mPoints, pt );
+		if( new_index != INVALID_INDEX )
+			mPointLookup.insert( hash, new_index * 4, 4 );
+		return new_index;
+	}
+
+	uint32_t IGACreator::addPoints( const Point3d *pts, size_t count )
+	{
+		uint32_t first_index = safeAppendRange( mParent->mPoints, pts, count );
+		if( first_index == INVALID_INDEX || !mDedupOptions.merge_points )
+			return first_index;
+
+		// These points aren't merged, but points added later may be merged with
+		// them, so they go into the lookup table as addPoint would put them there.
+		for( size_t ipoint = 0; ipoint < count; ++ipoint )
+		{
+			const Point3d &pt = pts[ ipoint ];
+			size_t index = first_index + ipoint;
+			if( !finite( pt.x ) || !finite( pt.y ) || !finite( pt.z ) || !finite( pt.w ) || index >= INVALID_INDEX / 4 )
+				continue;
+			uint64_t hash = insertHash( &pt.x, 4, mDedupOptions.point_tolerance, mCells );
+			mPointLookup.insert( hash, static_cast< uint32_t >( index * 4 ), 4 );
+		}
+		return first_index;
+	}
+
+	bool IGACreator::addPoints( const Point3d *pts, size_t count, uint32_t *indices )
+	{
+		if( !mDedupOptions.merge_points )
+		{
+			uint32_t first_index = addPoints( pts, count );
+			if( first_index == INVALID_INDEX )
+				return false;
+			for( size_t ipoint = 0; ipoint < count; ++ipoint )
+				indices[ ipoint ] = first_index + static_cast< uint32_t >( ipoint );
+			return true;
+		}
+
+		for( size_t ipoint = 0; ipoint < count; ++ipoint )
+		{
+			indices[ ipoint ] = addPoint( pts[ ipoint ] );
+			if( indices[ ipoint ] == INVALID_INDEX )
+				return false;
+		}
+		return true;
 	}
 
 	uint32_t IGACreator::addTensorPiece( const CoeffVector &s_coeffs, const CoeffVector &t_coeffs, uint32_t pt_index )
 	{
-		int s_order = static_cast< int >( s_coeffs.size() );
-		int t_order = static_cast< int >( t_coeffs.size() );
+		if( s_coeffs.size() > 0x7FFF || t_coeffs.size() > 0x7FFF )
+			return INVALID_INDEX;
+		return addTensorPiece( s_coeffs.data(), static_cast< int >( s_coeffs.size() ),
+			t_coeffs.data(), static_cast< int >( t_coeffs.size() ), pt_index );
+	}
+
+	uint32_t IGACreator::addTensorPiece( const double *s_coeffs, int s_order, const double *t_coeffs, int t_order, uint32_t pt_index )
+	{
 		if( s_order < 0 || s_order > 0x7FFF ||
 			t_order < 0 || t_order > 0x7FFF )
 			return INVALID_INDEX;
 
 		Piece2D p;
 		p.st_order = ( s_order ) | ( t_order << 16 );
-		p.s_index = getDictionaryIndex( s_coeffs );
+		p.s_index = getDictionaryIndex( s_coeffs, static_cast< size_t >( s_order ) );
 		if( p.s_index == INVALID_INDEX )
 			return INVALID_INDEX;
-		p.maybe_t_index = getDictionaryIndex( t_coeffs );
+		p.maybe_t_index = getDictionaryIndex( t_coeffs, static_cast< size_t >( t_order ) );
 		if( p.maybe_t_index == INVALID_INDEX )
 			return INVALID_INDEX;
 		p.pt_index = pt_index;
 		return addPiece( p );
 	}
 
+	namespace
+	{
+		// What appendShards needs to know about each shard.
+		struct ShardMerge
+		{
+			// The offsets of the shard's data in the merged arrays.
+			size_t elem_base = 0;
+			size_t piece_base = 0;
+			size_t edge_base = 0;
+			size_t point_base = 0;
+
+			// The dictionary indices and layouts used by the shard, in the order in which
+			// they're first used, which is the order the serial path would add them.
+			std::vector< uint32_t > coeff_refs;
+			std::vector< uint32_t > layout_refs;
+
+			// Indexed by shard dictionary index. This first holds one more than the
+			// length of the vector used there (0 if it isn't used) and is then replaced
+			// with the merged dictionary index.
+			std::vector< uint32_t > coeff_map;
+
+			// Maps shard layout indices to merged ones.
+			std::vector< uint32_t > layout_map;
+		};
+
+		// Records a reference to the 'length' coefficients at 'index' in a shard,
+		// returning false if it's out of range or the index is used with another length.
+		bool addCoeffRef( ShardMerge &merge, size_t coeff_count, uint32_t index, uint32_t length )
+		{
+			if( index > coeff_count || length > coeff_count - index )
+				return false;
+			uint32_t &entry = merge.coeff_map[ index ];
+			if( entry == 0 )
+			{
+				entry = length + 1;
+				merge.coeff_refs.push_back( index );
+				return true;
+			}
+			return entry == length + 1;
+		}
+
+		// Checks a shard and collects the dictionary entries and layouts it uses.
+		bool planShard( const IGAData &shard, ShardMerge &merge )
+		{
+			const auto &pieces = shard.pieces();
+			const auto &elems = shard.elems();
+
+			// All of the shard's pieces and edges must belong to its elements.
+			uint32_t last_piece_end = elems.empty() ? 0 : elems.back().piece_end_index;
+			uint32_t last_edge_end = elems.empty() ? 0 : elems.back().edge_end_index;
+			if( last_piece_end != pieces.size() || last_edge_end != shard.edges().size() )
+				return false;
+
+			merge.coeff_map.assign( shard.coeffs().size() + 1, 0 );
+			for( const Piece2D &piece : pieces )
+			{
+				uint32_t s_order = piece.st_order & 0xFFFF;
+				uint32_t t_order = piece.st_order >> 16;
+				if( piece.pt_index >= shard.points().size() )
+					return false;
+				if( piece.maybe_t_index == INVALID_INDEX )
+				{
+					if( !addCoeffRef( merge, shard.coeffs().size(), piece.s_index, s_order * t_order ) )
+						return false;
+				}
+				else if( !addCoeffRef( merge, shard.coeffs().size(), piece.s_index, s_order ) ||
+					!addCoeffRef( merge, shard.coeffs().size(), piece.maybe_t_index, t_order ) )
+					return false;
+			}
+
+			// As in IGADataView::validate, layout 0 is the default layout even if the
+			// shard doesn't store any layouts.
+			merge.layout_map.assign( std::max( shard.layouts().size(), size_t( 1 ) ), INVALID_INDEX );
+			for( const Elem &elem : elems )
+			{
+				if( ( elem.layout_index != 0 && elem.layout_index >= shard.layouts().size() ) ||
+					elem.piece_end_index > pieces.size() || elem.edge_end_index > shard.edges().size() )
+					return false;
+				uint32_t &entry = merge.layout_map[ elem.layout_index ];
+				if( entry == INVALID_INDEX )
+				{
+					entry = 0;
+					merge.layout_refs.push_back( elem.layout_index );
+				}
+			}
+			return true;
+		}
+	}
+
+	bool IGACreator::appendShards( const std::vector< const IGAData * > &shards, unsigned thread_count )
+	{
+		// Alias to the member variables in the parent.
+		auto &mElems = mParent->mElems;
+		auto &mPieces = mParent->mPieces;
+		auto &mEdges = mParent->mEdges;
+		auto &mIntervals = mParent->mIntervals;
+		auto &mPoints = mParent->mPoints;
+
+		// Work out where each shard goes, and check that the totals fit in our
+		// 32-bit indices and that everyone agrees about intervals.
+		std::vector< ShardMerge > merges( shards.size() );
+		size_t elem_count = mElems.size();
+		size_t piece_count = mPieces.size();
+		size_t edge_count = mEdges.size();
+		size_t point_count = mPoints.size();
+		int use_intervals = mEdges.empty() ? -1 : !mIntervals.empty();
+		for( size_t ishard = 0; ishard < shards.size(); ++ishard )
+		{
+			const IGAData &shard = *shards[ ishard ];
+			ShardMerge &merge = merges[ ishard ];
+			merge.elem_base = elem_count;
+			merge.piece_base = piece_count;
+			merge.edge_base = edge_count;
+			merge.point_base = point_count;
+			elem_count += shard.elems().size();
+			piece_count += shard.pieces().size();
+			edge_count += shard.edges().size();
+			point_count += shard.points().size();
+			if( elem_count >= INVALID_INDEX - 1 || piece_count >= INVALID_INDEX - 1 ||
+				edge_count >= INVALID_INDEX - 1 || point_count >= INVALID_INDEX - 1 )
+				return false;
+
+			if( !shard.intervals().empty() && shard.intervals().size() != shard.edges().size() )
+				return false;
+			if( !shard.edges().empty() )
+			{
+				int shard_intervals = !shard.intervals().empty();
+				if( use_intervals == -1 )
+					use_intervals = shard_intervals;
+				else if( use_intervals != shard_intervals )
+					return false;
+			}
+		}
+
+		// Check each shard and find the dictionary entries and layouts it uses.
+		std::atomic< bool > all_ok( true );
+		parallelRanges( shards.size(), 1, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ishard = begin; ishard < end && all_ok; ++ishard )
+			{
+				if( !planShard( *shards[ ishard ], merges[ ishard ] ) )
+					all_ok = false;
+			}
+		} );
+		if( !all_ok )
+			return false;
+
+		// Merge the dictionaries. This must be done in order, to get the same
+		// dictionaries as the serial path, but it only visits each shard's
+		// distinct entries.
+		for( size_t ishard = 0; ishard < shards.size(); ++ishard )
+		{
+			const IGAData &shard = *shards[ ishard ];
+			ShardMerge &merge = merges[ ishard ];
+			for( uint32_t index : merge.coeff_refs )
+			{
+				uint32_t &entry = merge.coeff_map[ index ];
+				entry = getDictionaryIndex( shard.coeffs().data() + index, entry - 1 );
+				if( entry == INVALID_INDEX )
+					return false;
+			}
+			for( uint32_t index : merge.layout_refs )
+			{
+				uint32_t &entry = merge.layout_map[ index ];
+				entry = getLayoutIndex( shard.layout( index ) );
+				if( entry == INVALID_INDEX )
+					return false;
+			}
+		}
+
+		// Copy everything else into place, remapping as we go.
+		mParent->mAdjacency.reset();
+		mElems.resize( elem_count );
+		mPieces.resize( piece_count );
+		mEdges.resize( edge_count );
+		if( use_intervals == 1 )
+			mIntervals.resize( edge_count );
+		mPoints.resize( point_count );
+		parallelRanges( shards.size(), 1, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ishard = begin; ishard < end; ++ishard )
+			{
+				const IGAData &shard = *shards[ ishard ];
+				const ShardMerge &merge = merges[ ishard ];
+
+				const auto &pieces = shard.pieces();
+				for( size_t ipiece = 0; ipiece < pieces.size(); ++ipiece )
+				{
+					Piece2D piece = pieces[ ipiece ];
+					piece.s_index = merge.coeff_map[ piece.s_index ];
+					if( piece.maybe_t_index != INVALID_INDEX )
+						piece.maybe_t_index = merge.coeff_map[ piece.maybe_t_index ];
+					piece.pt_index += static_cast< uint32_t >( merge.point_base );
+					mPieces[ merge.piece_base + ipiece ] = piece;
+				}
+
+				const auto &elems = shard.elems();
+				for( size_t ielem = 0; ielem < elems.size(); ++ielem )
+				{
+					Elem elem = elems[ ielem ];
+					elem.piece_end_index += static_cast< uint32_t >( merge.piece_base );
+					elem.edge_end_index += static_cast< uint32_t >( merge.edge_base );
+					elem.layout_index = merge.layout_map[ elem.layout_index ];
+					mElems[ merge.elem_base + ielem ] = elem;
+				}
+
+				std::copy( shard.edges().begin(), shard.edges().end(), mEdges.begin() + merge.edge_base );
+				if( !shard.intervals().empty() )
+					std::copy( shard.intervals().begin(), shard.intervals().end(), mIntervals.begin() + merge.edge_base );
+				std::copy( shard.points().begin(), shard.points().end(), mPoints.begin() + merge.point_base );
+			}
+		} );
+		return true;
+	}
+
 	uint32_t IGACreator::finishElem( uint32_t layout_index )
 	{
 		Elem elem;
@@ -172,23 +703,34 @@ namespace iga_fileio
 	}
 
 	uint32_t IGACreator::getDictionaryIndex( const CoeffVector &coeffs )
+	{
+		return getDictionaryIndex( coeffs.data(), coeffs.size() );
+	}
+
+	uint32_t IGACreator::getDictionaryIndex( const double *coeffs, size_t coeff_count )
 	{
 		// Ensure that these coefficients contain no bad data. No infinities,
 		// and no NAN values (NAN in particular will cause issues with our
 		// lookup table).
-		for( double i : coeffs )
-			if( !finite( i ) )
+		for( size_t icoeff = 0; icoeff < coeff_count; ++icoeff )
+			if( !finite( coeffs[ icoeff ] ) )
 				return INVALID_INDEX;
 
-		// Do we already have an entry for these coeffs? It must be an exact match.
-		auto iter = mCoeffLookup.find( coeffs );
-		if( iter != mCoeffLookup.end() )
-			return iter->second;
+		// Do we already have an entry for these coeffs? Unless a tolerance is set,
+		// it must be an exact match.
+		uint64_t hash = 0;
+		uint32_t found_index = findNearValues( mCoeffLookup, mParent->mCoeffs, coeffs, coeff_count,
+			mDedupOptions.coeff_tolerance, mCells, hash );
+		if( found_index != INVALID_INDEX )
+		{
+			mMaxCoeffError = std::max( mMaxCoeffError, maxDifference( coeffs, mParent->mCoeffs.data() + found_index, coeff_count ) );
+			return found_index;
+		}
 
-		uint32_t new_index = addCoeffs( coeffs );
+		uint32_t new_index = addCoeffs( coeffs, coeff_count );
 		if( new_index == INVALID_INDEX )
 			return INVALID_INDEX;
-		mCoeffLookup[ coeffs ] = new_index;
+		mCoeffLookup.insert( hash, new_index, static_cast< uint32_t >( coeff_count ) );
 		return new_index;
 	}
 
@@ -215,6 +757,55 @@ namespace iga_fileio
 		return new_index;
 	}
 
+	void IGACreator::reserve( size_t elem_count, size_t piece_count, size_t edge_count, size_t point_count, size_t coeff_count )
+	{
+		mParent->mElems.reserve( elem_count );
+		mParent->mPieces.reserve( piece_count );
+		mParent->mEdges.reserve( edge_count );
+		mParent->mPoints.reserve( point_count );
+		mParent->mCoeffs.reserve( coeff_count );
+		if( !mParent->mIntervals.empty() )
+			mParent->mIntervals.reserve( edge_count );
+	}
+
+	bool IGACreator::setDedupOptions( const IGADedupOptions &options )
+	{
+		if( !mParent->mCoeffs.empty() || !mParent->mPoints.empty() )
+			return false;
+		if( !( options.coeff_tolerance >= 0.0 ) || !finite( options.coeff_tolerance ) ||
+			!( options.point_tolerance >= 0.0 ) || !finite( options.point_tolerance ) )
+			return false;
+		mDedupOptions = options;
+		return true;
+	}
+
+	bool IGACreator::setSharedDictionary( std::shared_ptr< const IGASharedDictionary > dictionary )
+	{
+		// Alias to the mCoeffs in mParent.
+		auto &mCoeffs = mParent->mCoeffs;
+
+		if( !mCoeffs.empty() )
+			return false;
+		mCoeffLookup.clear();
+		mParent->mSharedDictionary = dictionary;
+		if( !dictionary )
+			return true;
+
+		// The dictionary has checked its vectors, so they can go straight into the
+		// lookup table, unless they match one that's already there.
+		IGASpan< double > shared_coeffs = dictionary->coeffs();
+		mCoeffs.assign( shared_coeffs.begin(), shared_coeffs.end() );
+		for( const Piece2D &vector : dictionary->vectors() )
+		{
+			uint32_t length = vector.st_order & 0xFFFF;
+			uint64_t hash = 0;
+			if( findNearValues( mCoeffLookup, mCoeffs, mCoeffs.data() + vector.s_index, length,
+				mDedupOptions.coeff_tolerance, mCells, hash ) == INVALID_INDEX )
+				mCoeffLookup.insert( hash, vector.s_index, length );
+		}
+		return true;
+	}
+
 	void IGACreator::setSurfaceType( const std::string &surface_type )
 	{
 		mParent->mSrfType = surface_type;
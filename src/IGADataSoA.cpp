@@ -0,0 +1,175 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGADataSoA.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "iga/IGAParallel.h"
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// The alignment of every array.
+		const size_t ARRAY_ALIGNMENT = 64;
+
+		// Each piece or element is only a handful of loads and stores here, so a
+		// range has to be long to cover the cost of handing it to another thread.
+		const size_t MIN_ITEMS_PER_RANGE = 4096;
+	}
+
+	IGADataSoA::IGADataSoA( IGADataSoA &&other )
+	{
+		*this = std::move( other );
+	}
+
+	IGADataSoA &IGADataSoA::operator=( IGADataSoA &&other )
+	{
+		if( this == &other )
+			return *this;
+		// mStorage's buffer moves with it, so mAligned still points into it. The
+		// other object's copy of mAligned doesn't, so it's emptied.
+		mPieceCount = other.mPieceCount;
+		mGroups = std::move( other.mGroups );
+		mStorage = std::move( other.mStorage );
+		mAligned = other.mAligned;
+		std::copy( other.mOffsets, other.mOffsets + ARRAY_COUNT, mOffsets );
+		other.clear();
+		return *this;
+	}
+
+	void IGADataSoA::build( const IGADataView &data, unsigned thread_count )
+	{
+		IGASpan< Piece2D > pieces = data.pieces();
+		mPieceCount = static_cast< uint32_t >( pieces.size() );
+
+		// Find the signatures and count their pieces. Models seldom have more than a
+		// few, so a list is quicker than a map.
+		std::vector< uint32_t > signatures;
+		std::vector< uint32_t > counts;
+		for( const Piece2D &piece : pieces )
+		{
+			size_t isignature = std::find( signatures.begin(), signatures.end(), piece.st_order ) - signatures.begin();
+			if( isignature == signatures.size() )
+			{
+				signatures.push_back( piece.st_order );
+				counts.push_back( 0 );
+			}
+			++counts[ isignature ];
+		}
+
+		// Sort the groups and lay them out one after another.
+		std::vector< size_t > group_order( signatures.size() );
+		for( size_t igroup = 0; igroup < group_order.size(); ++igroup )
+			group_order[ igroup ] = igroup;
+		auto orders = []( uint32_t st_order ) { return std::make_pair( st_order & 0xFFFF, st_order >> 16 ); };
+		std::sort( group_order.begin(), group_order.end(), [&]( size_t a, size_t b ) {
+			return orders( signatures[ a ] ) < orders( signatures[ b ] );
+		} );
+		mGroups.assign( signatures.size(), Group() );
+		std::vector< uint32_t > group_next( signatures.size() );
+		uint32_t next = 0;
+		for( size_t igroup = 0; igroup < group_order.size(); ++igroup )
+		{
+			size_t isignature = group_order[ igroup ];
+			Group &group = mGroups[ igroup ];
+			group.s_order = static_cast< int >( signatures[ isignature ] & 0xFFFF );
+			group.t_order = static_cast< int >( signatures[ isignature ] >> 16 );
+			group.begin = next;
+			next += counts[ isignature ];
+			group.end = next;
+			group_next[ isignature ] = group.begin;
+		}
+
+		// Lay out the arrays.
+		size_t total = 0;
+		for( int array = 0; array < ARRAY_COUNT; ++array )
+		{
+			size_t item_size = array < ARRAY_X ? sizeof( uint32_t ) : sizeof( double );
+			mOffsets[ array ] = total;
+			total += ( size_t( mPieceCount ) * item_size + ARRAY_ALIGNMENT - 1 ) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+		}
+		mStorage.assign( ( total + ARRAY_ALIGNMENT ) / sizeof( uint64_t ), 0 );
+		uintptr_t address = reinterpret_cast< uintptr_t >( mStorage.data() );
+		mAligned = reinterpret_cast< char * >( mStorage.data() ) + ( ARRAY_ALIGNMENT - address % ARRAY_ALIGNMENT ) % ARRAY_ALIGNMENT;
+
+		uint32_t *s_orders = reinterpret_cast< uint32_t * >( arrayData( ARRAY_S_ORDER ) );
+		uint32_t *t_orders = reinterpret_cast< uint32_t * >( arrayData( ARRAY_T_ORDER ) );
+		uint32_t *s_indices = reinterpret_cast< uint32_t * >( arrayData( ARRAY_S_INDEX ) );
+		uint32_t *t_indices = reinterpret_cast< uint32_t * >( arrayData( ARRAY_T_INDEX ) );
+		uint32_t *point_indices = reinterpret_cast< uint32_t * >( arrayData( ARRAY_POINT_INDEX ) );
+		uint32_t *elems = reinterpret_cast< uint32_t * >( arrayData( ARRAY_ELEM ) );
+		uint32_t *piece_ids = reinterpret_cast< uint32_t * >( arrayData( ARRAY_PIECE_ID ) );
+		uint32_t *soa_indices = reinterpret_cast< uint32_t * >( arrayData( ARRAY_SOA_INDEX ) );
+		double *xs = reinterpret_cast< double * >( arrayData( ARRAY_X ) );
+		double *ys = reinterpret_cast< double * >( arrayData( ARRAY_Y ) );
+		double *zs = reinterpret_cast< double * >( arrayData( ARRAY_Z ) );
+		double *ws = reinterpret_cast< double * >( arrayData( ARRAY_W ) );
+
+		// Give each piece its place. This is a counting sort, so it keeps the
+		// pieces of each group in order; it's cheap enough to do on one thread.
+		uint32_t last_st_order = 0;
+		size_t last_signature = 0;
+		for( uint32_t ipiece = 0; ipiece < mPieceCount; ++ipiece )
+		{
+			if( ipiece == 0 || pieces[ ipiece ].st_order != last_st_order )
+			{
+				last_st_order = pieces[ ipiece ].st_order;
+				last_signature = std::find( signatures.begin(), signatures.end(), last_st_order ) - signatures.begin();
+			}
+			soa_indices[ ipiece ] = group_next[ last_signature ]++;
+		}
+
+		// Then copy everything into place.
+		parallelRanges( mPieceCount, MIN_ITEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ipiece = begin; ipiece < end; ++ipiece )
+			{
+				const Piece2D &piece = pieces[ ipiece ];
+				uint32_t isoa = soa_indices[ ipiece ];
+				s_orders[ isoa ] = piece.st_order & 0xFFFF;
+				t_orders[ isoa ] = piece.st_order >> 16;
+				s_indices[ isoa ] = piece.s_index;
+				t_indices[ isoa ] = piece.maybe_t_index;
+				point_indices[ isoa ] = piece.pt_index;
+				piece_ids[ isoa ] = static_cast< uint32_t >( ipiece );
+				elems[ isoa ] = INVALID_INDEX;
+				const Point3d &pt = data.points()[ piece.pt_index ];
+				xs[ isoa ] = pt.x;
+				ys[ isoa ] = pt.y;
+				zs[ isoa ] = pt.z;
+				ws[ isoa ] = pt.w;
+			}
+		} );
+		parallelRanges( data.elemCount(), MIN_ITEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				uint32_t elem_index = static_cast< uint32_t >( ielem );
+				for( uint32_t ipiece = data.pieceBegin( elem_index ); ipiece < data.pieceEnd( elem_index ); ++ipiece )
+					elems[ soa_indices[ ipiece ] ] = elem_index;
+			}
+		} );
+	}
+
+	void IGADataSoA::clear()
+	{
+		mPieceCount = 0;
+		mGroups.clear();
+		mStorage.clear();
+		mAligned = nullptr;
+		for( size_t &offset : mOffsets )
+			offset = 0;
+	}
+}
@@ -0,0 +1,487 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGADataView.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "iga/IGAParallel.h"
+
+namespace iga_fileio
+{
+	IGADataView::IGADataView( const IGAData &data )
+		: mSrfType( data.surfaceType() ),
+		mCoeffs( data.coeffs() ),
+		mPoints( data.points() ),
+		mPieces( data.pieces() ),
+		mEdges( data.edges() ),
+		mIntervals( data.intervals() ),
+		mLayouts( data.layouts() ),
+		mElems( data.elems() ),
+		mSharedDictionary( data.sharedDictionary() )
+	{
+	}
+
+	void IGADataView::clear()
+	{
+		*this = IGADataView();
+	}
+
+	uint32_t IGADataView::edgeBegin( uint32_t elem_index ) const
+	{
+		if( elem_index >= mElems.size() )
+			return INVALID_INDEX;
+
+		if( elem_index == 0 )
+			return 0;
+
+		return mElems[ elem_index - 1 ].edge_end_index;
+	}
+
+	uint32_t IGADataView::edgeCount() const
+	{
+		return static_cast< uint32_t >( mEdges.size() );
+	}
+
+	uint32_t IGADataView::edgeEnd( uint32_t elem_index ) const
+	{
+		if( elem_index >= mElems.size() )
+			return INVALID_INDEX;
+
+		return mElems[ elem_index ].edge_end_index;
+	}
+
+	double IGADataView::edgeInterval( uint32_t edge_index ) const
+	{
+		if( mIntervals.empty() )
+			return 1.0;
+
+		return mIntervals[ edge_index ];
+	}
+
+	uint32_t IGADataView::edgeOther( uint32_t edge_index ) const
+	{
+		return mEdges[ edge_index ];
+	}
+
+	uint32_t IGADataView::elemCount() const
+	{
+		return static_cast< uint32_t >( mElems.size() );
+	}
+
+	uint32_t IGADataView::elemEdgeCount( uint32_t elem_index ) const
+	{
+		const FaceLayout &elem_layout = layout( mElems[ elem_index ].layout_index );
+		return elem_layout.side_range[ 4 ];
+	}
+
+	uint32_t IGADataView::elemEdgesOnSide( uint32_t elem_index, int side ) const
+	{
+		const FaceLayout &elem_layout = layout( mElems[ elem_index ].layout_index );
+		return elem_layout.side_range[ side + 1 ] - elem_layout.side_range[ side ];
+	}
+
+	namespace
+	{
+		// How many items validate() checks at a time on each thread. Arrays smaller
+		// than this are checked on the calling thread.
+		const size_t VALIDATE_CHUNK_SIZE = 16384;
+
+		IGAValidationError makeError( const char *array, size_t index, const std::string &message )
+		{
+			IGAValidationError error;
+			error.array = array;
+			error.index = index;
+			error.message = message;
+			return error;
+		}
+
+		// Calls check( index, found ) for every item of an array, in parallel, and
+		// appends the errors it adds to 'found' to 'errors' in index order. Unless
+		// collect_all is set, only the error with the lowest index is kept, and the
+		// threads stop once they pass an index that's known to be bad.
+		template< typename Check >
+		void checkItems( size_t count, bool collect_all, unsigned thread_count,
+			std::vector< IGAValidationError > &errors, Check check )
+		{
+			std::mutex found_mutex;
+			std::vector< std::pair< size_t, std::vector< IGAValidationError > > > found_ranges;
+			std::atomic< size_t > first_bad( count );
+			parallelRanges( count, VALIDATE_CHUNK_SIZE, thread_count, [&]( size_t begin, size_t end ) {
+				std::vector< IGAValidationError > found;
+				for( size_t index = begin; index < end; ++index )
+				{
+					if( !collect_all && index >= first_bad.load( std::memory_order_relaxed ) )
+						break;
+					size_t found_count = found.size();
+					check( index, found );
+					if( !collect_all && found.size() > found_count )
+					{
+						found.resize( found_count + 1 );
+						size_t bad = first_bad.load();
+						while( index < bad && !first_bad.compare_exchange_weak( bad, index ) )
+							;
+						break;
+					}
+				}
+				if( !found.empty() )
+				{
+					std::lock_guard< std::mutex > lock( found_mutex );
+					found_ranges.emplace_back( begin, std::move( found ) );
+				}
+			} );
+
+			std::sort( found_ranges.begin(), found_ranges.end(),
+				[]( const std::pair< size_t, std::vector< IGAValidationError > > &lhs,
+					const std::pair< size_t, std::vector< IGAValidationError > > &rhs ) { return lhs.first < rhs.first; } );
+			for( auto &range : found_ranges )
+			{
+				// The first range with an error holds the one with the lowest index.
+				if( !collect_all )
+				{
+					errors.push_back( std::move( range.second.front() ) );
+					return;
+				}
+				for( IGAValidationError &error : range.second )
+					errors.push_back( std::move( error ) );
+			}
+		}
+
+		struct FaceLayoutHash
+		{
+			size_t operator()( const FaceLayout &layout ) const
+			{
+				uint64_t hash = 0;
+				for( uint32_t side : layout.side_range )
+					hash = ( hash ^ side ) * 0x100000001B3ull;
+				return static_cast< size_t >( hash ^ ( hash >> 32 ) );
+			}
+		};
+
+		struct FaceLayoutEqual
+		{
+			bool operator()( const FaceLayout &lhs, const FaceLayout &rhs ) const
+			{
+				return std::equal( lhs.side_range, lhs.side_range + 5, rhs.side_range );
+			}
+		};
+	}
+
+	bool IGADataView::isValid( std::ostream &err ) const
+	{
+		std::vector< IGAValidationError > errors;
+		if( validate( errors ) )
+			return true;
+		err << errors.front().message << std::endl;
+		return false;
+	}
+
+	bool IGADataView::validateLayouts( IGASpan< FaceLayout > layouts, bool has_intervals, std::vector< IGAValidationError > &errors, bool collect_all )
+	{
+		using std::to_string;
+		const size_t first_error = errors.size();
+		auto stop = [&]() { return !collect_all && errors.size() > first_error; };
+
+		for( size_t ilayout = 0; ilayout < layouts.size() && !stop(); ++ilayout )
+		{
+			const FaceLayout &layout = layouts[ ilayout ];
+			if( ilayout == 0 &&
+				( layout < FaceLayout() || FaceLayout() < layout ) )
+			{
+				// Note that this only applies if any layouts are stored at all.
+				errors.push_back( makeError( "layouts", ilayout, "Layout 0 must be the default layout" ) );
+				continue;
+			}
+			if( layout.side_range[ 0 ] >= layout.side_range[ 1 ] ||
+				layout.side_range[ 1 ] >= layout.side_range[ 2 ] ||
+				layout.side_range[ 2 ] >= layout.side_range[ 3 ] ||
+				layout.side_range[ 3 ] >= layout.side_range[ 4 ] )
+				errors.push_back( makeError( "layouts", ilayout, "Layout " + to_string( ilayout ) + " doesn't have at least one edge on each side" ) );
+		}
+		if( stop() )
+			return false;
+		std::unordered_set< FaceLayout, FaceLayoutHash, FaceLayoutEqual > distinct;
+		distinct.reserve( layouts.size() );
+		for( size_t ilayout = 0; ilayout < layouts.size(); ++ilayout )
+		{
+			if( !distinct.insert( layouts[ ilayout ] ).second )
+			{
+				errors.push_back( makeError( "layouts", ilayout, "Some of the face layouts were duplicates. Face layouts should be unique." ) );
+				break;
+			}
+		}
+		if( stop() )
+			return false;
+		if( layouts.size() > 1 && !has_intervals )
+			errors.push_back( makeError( "", 0, "This model has multiple face layouts but doesn't specify edge intervals." ) );
+		return errors.size() == first_error;
+	}
+
+	bool IGADataView::validate( std::vector< IGAValidationError > &errors, bool collect_all, unsigned thread_count ) const
+	{
+		using std::to_string;
+		const size_t first_error = errors.size();
+		// Unless we're collecting every error, we stop after the first check that fails.
+		auto stop = [&]() { return !collect_all && errors.size() > first_error; };
+
+		// Loop through all the coefficients
+		checkItems( mCoeffs.size(), collect_all, thread_count, errors, [&]( size_t icoeff, std::vector< IGAValidationError > &found ) {
+			if( !finite( mCoeffs[ icoeff ] ) )
+				found.push_back( makeError( "coeffs", icoeff, "Coeff " + to_string( icoeff ) + " is not finite or is Not A Number" ) );
+		} );
+		if( stop() )
+			return false;
+
+		// Loop through all the points
+		checkItems( mPoints.size(), collect_all, thread_count, errors, [&]( size_t ipoint, std::vector< IGAValidationError > &found ) {
+			const Point3d &pt = mPoints[ ipoint ];
+			if( !finite( pt.x ) || !finite( pt.y ) || !finite( pt.z ) || !finite( pt.w ) )
+				found.push_back( makeError( "points", ipoint, "Point " + to_string( ipoint ) + " has non-finite/NAN values." ) );
+			// I'm not checking for 0 weights on the points, although those are typically
+			// illegal. If you do choose to check for 0 weights, be aware that (0,0,0,0)
+			// is a magic value for unused point indices, and is permitted.
+		} );
+		if( stop() )
+			return false;
+
+		// Check the layouts. There are normally only a handful, so this isn't worth
+		// splitting up.
+		validateLayouts( mLayouts, !mIntervals.empty(), errors, collect_all );
+		if( stop() )
+			return false;
+
+		// Loop through all the pieces
+		checkItems( mPieces.size(), collect_all, thread_count, errors, [&]( size_t ipiece, std::vector< IGAValidationError > &found ) {
+			const Piece2D &piece = mPieces[ ipiece ];
+			if( piece.pt_index >= mPoints.size() )
+			{
+				found.push_back( makeError( "pieces", ipiece, "Piece " + to_string( ipiece ) + " has an OOB pt_index" ) );
+				return;
+			}
+			int s_order = piece.st_order & 0xFFFF;
+			int t_order = piece.st_order >> 16;
+			if( piece.maybe_t_index == INVALID_INDEX )
+			{
+				// Explicit piece validity check
+				size_t piece_size = s_order * t_order;
+				if( piece.s_index + piece_size > mCoeffs.size() )
+					found.push_back( makeError( "pieces", ipiece, "Piece " + to_string( ipiece ) + " refers to OOB coefficients" ) );
+			}
+			else
+			{
+				// Tensor-produce piece validity check
+				if( piece.s_index + s_order > mCoeffs.size() )
+					found.push_back( makeError( "pieces", ipiece, "Piece " + to_string( ipiece ) + " in S (TP) refers to OOB coefficients" ) );
+				else if( piece.maybe_t_index + t_order > mCoeffs.size() )
+					found.push_back( makeError( "pieces", ipiece, "Piece " + to_string( ipiece ) + " in T (TP) refers to OOB coefficients" ) );
+			}
+		} );
+		if( stop() )
+			return false;
+
+		// Verify that the edges and the intervals have matching sizes.
+		if( !mIntervals.empty() && mEdges.size() != mIntervals.size() )
+		{
+			errors.push_back( makeError( "", 0, "The interval and the edge vectors must be the same size (unless intervals is empty)" ) );
+			if( stop() )
+				return false;
+		}
+
+		// Loop through all the intervals.
+		checkItems( mIntervals.size(), collect_all, thread_count, errors, [&]( size_t iinterval, std::vector< IGAValidationError > &found ) {
+			if( mIntervals[ iinterval ] < 0.0 || !finite( mIntervals[ iinterval ] ) )
+				found.push_back( makeError( "intervals", iinterval, "Interval on edge " + to_string( iinterval ) + " has an illegal value (must be >= 0.0 and finite)" ) );
+		} );
+		if( stop() )
+			return false;
+
+		// Loop through all the edges (table of element adjacency)
+		checkItems( mEdges.size(), collect_all, thread_count, errors, [&]( size_t iedge, std::vector< IGAValidationError > &found ) {
+			if( mEdges[ iedge ] != INVALID_INDEX && mEdges[ iedge ] >= mElems.size() )
+				found.push_back( makeError( "edges", iedge, "Edge " + to_string( iedge ) + " is adjacent to an OOB element" ) );
+		} );
+		if( stop() )
+			return false;
+
+		// Loop through all the elements. Each one is compared with the one before it
+		// to check for monotonically increasing indices.
+		checkItems( mElems.size(), collect_all, thread_count, errors, [&]( size_t ielem, std::vector< IGAValidationError > &found ) {
+			// The diagnostic messages are a bit vague but will hopefully give enough of a clue
+			// to find problems.
+			const Elem &elem = mElems[ ielem ];
+			uint32_t last_edge_end = ielem == 0 ? 0u : mElems[ ielem - 1 ].edge_end_index;
+			uint32_t last_piece_end = ielem == 0 ? 0u : mElems[ ielem - 1 ].piece_end_index;
+			std::string elem_name = "Elem " + to_string( ielem );
+			if( elem.edge_end_index < last_edge_end )
+				found.push_back( makeError( "elems", ielem, elem_name + " has an edge_end_index < last_edge_end" ) );
+			if( elem.edge_end_index > mEdges.size() )
+				found.push_back( makeError( "elems", ielem, elem_name + " has an edge_end_index > mEdges.size()" ) );
+			if( elem.piece_end_index < last_piece_end )
+				found.push_back( makeError( "elems", ielem, elem_name + " has a piece_end_index < last_piece_end" ) );
+			if( elem.piece_end_index > mPieces.size() )
+				found.push_back( makeError( "elems", ielem, elem_name + " has a piece_end_index > mPieces.size()" ) );
+			if( elem.layout_index != 0 && elem.layout_index >= mLayouts.size() )
+				found.push_back( makeError( "elems", ielem, elem_name + " has a layout_index >= mLayouts.size()" ) );
+			// Layout 0 is not required to be explicitly stored.
+			if( elem.layout_index < mLayouts.size() )
+			{
+				const FaceLayout &layout = mLayouts[ elem.layout_index ];
+				if( elem.edge_end_index - last_edge_end != layout.side_range[ 4 ] )
+					found.push_back( makeError( "elems", ielem, elem_name + " has " + to_string( elem.edge_end_index - last_edge_end ) +
+						" edges but its layout has " + to_string( layout.side_range[ 4 ] ) + " edges" ) );
+			}
+		} );
+		if( stop() )
+			return false;
+
+		uint32_t last_edge_end = mElems.empty() ? 0u : mElems.back().edge_end_index;
+		uint32_t last_piece_end = mElems.empty() ? 0u : mElems.back().piece_end_index;
+		if( last_edge_end != mEdges.size() || last_piece_end != mPieces.size() )
+			errors.push_back( makeError( "", 0, "The Elems do not refer to all the edges/pieces" ) );
+
+		return errors.size() == first_error;
+	}
+
+	// Needed to make the NothingStream.
+	class NothingBuffer: public std::streambuf
+	{
+	public:
+		int overflow( int c ) override { return c; }
+	};
+
+	// A quick-and-dirty "do-nothing" output stream
+	class NothingStream : public std::ostream
+	{
+	public:
+		NothingStream() : std::ostream( &mBuffer ) {}
+	private:
+		NothingBuffer mBuffer;
+	};
+
+	bool IGADataView::isValid() const
+	{
+		NothingStream no_out;
+		return isValid( no_out );
+	}
+
+	const FaceLayout &IGADataView::layout( uint32_t layout_index ) const
+	{
+		const static FaceLayout s_default_layout;
+		// Implements the requirement that if no layouts are stored at all, we should return the
+		// default layout, and that layout 0 always be the default layout.
+		if( layout_index == 0 )
+			return s_default_layout;
+		return mLayouts[ layout_index ];
+	}
+
+	uint32_t IGADataView::layoutIndex( uint32_t elem_index ) const
+	{
+		return mElems[ elem_index ].layout_index;
+	}
+
+	uint32_t IGADataView::pieceBegin( uint32_t elem_index ) const
+	{
+		if( elem_index == 0 )
+			return 0u;
+		else
+			return mElems[ elem_index - 1 ].piece_end_index;
+	}
+
+	uint32_t IGADataView::pieceCount() const
+	{
+		return static_cast< uint32_t >( mPieces.size() );
+	}
+
+	uint32_t IGADataView::pieceEnd( uint32_t elem_index ) const
+	{
+		return mElems[ elem_index ].piece_end_index;
+	}
+
+	const double *IGADataView::pieceExplicitCoeffs( uint32_t piece_index ) const
+	{
+		return &mCoeffs[ mPieces[ piece_index ].s_index ];
+	}
+
+	bool IGADataView::pieceIsExplicit( uint32_t piece_index ) const
+	{
+		return mPieces[ piece_index ].maybe_t_index == INVALID_INDEX;
+	}
+
+	bool IGADataView::pieceIsTensor( uint32_t piece_index ) const
+	{
+		return mPieces[ piece_index ].maybe_t_index != INVALID_INDEX;
+	}
+
+	const Point3d &IGADataView::piecePoint( uint32_t piece_index ) const
+	{
+		return mPoints[ mPieces[ piece_index ].pt_index ];
+	}
+
+	uint32_t IGADataView::piecePointIndex( uint32_t piece_index ) const
+	{
+		return mPieces[ piece_index ].pt_index;
+	}
+
+	uint32_t IGADataView::pieceSIndex( uint32_t piece_index ) const
+	{
+		return mPieces[ piece_index ].s_index;
+	}
+
+	const double *IGADataView::pieceSCoeffs( uint32_t piece_index ) const
+	{
+		return &mCoeffs[ mPieces[ piece_index ].s_index ];
+	}
+
+	int IGADataView::pieceSOrder( uint32_t piece_index ) const
+	{
+		return mPieces[ piece_index ].st_order & 0xFFFF;
+	}
+
+	uint32_t IGADataView::pieceTIndex( uint32_t piece_index ) const
+	{
+		return mPieces[ piece_index ].maybe_t_index;
+	}
+
+	const double *IGADataView::pieceTCoeffs( uint32_t piece_index ) const
+	{
+		return &mCoeffs[ mPieces[ piece_index ].maybe_t_index ];
+	}
+
+	int IGADataView::pieceTOrder( uint32_t piece_index ) const
+	{
+		return mPieces[ piece_index ].st_order >> 16;
+	}
+
+	uint32_t IGADataView::pointCount() const
+	{
+		return static_cast< uint32_t >( mPoints.size() );
+	}
+
+	uint32_t IGADataView::sideBegin( uint32_t elem_index, int side ) const
+	{
+		const FaceLayout &elem_layout = layout( mElems[ elem_index ].layout_index );
+		return elem_layout.side_range[ side ];
+	}
+
+	uint32_t IGADataView::sideEnd( uint32_t elem_index, int side ) const
+	{
+		const FaceLayout &elem_layout = layout( mElems[ elem_index ].layout_index );
+		return elem_layout.side_range[ side + 1 ];
+	}
+
+}
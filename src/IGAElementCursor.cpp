@@ -0,0 +1,359 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAElementCursor.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "iga/IGACommon.h"
+#include "iga/IGASharedDictionary.h"
+
+namespace iga_fileio
+{
+	IGAElementCursor::IGAElementCursor( size_t cache_bytes, size_t page_bytes )
+		: mPageBytes( std::max< size_t >( page_bytes, 4096 ) )
+	{
+		// Enough pages for each array to have one, with some to spare for the
+		// points and coefficients, which are used in no particular order.
+		mMaxPages = std::max< size_t >( cache_bytes / mPageBytes, 2 * ARRAY_COUNT );
+	}
+
+	bool IGAElementCursor::open( IGAReader &reader )
+	{
+		std::vector< IGAModelHandle > models;
+		if( !reader.readIGAModels( models ) )
+			return fail( "The file's models couldn't be found." );
+		// As with readIGAFile, a file without a model holds an empty one.
+		return open( reader, models.empty() ? IGAModelHandle() : models.back() );
+	}
+
+	bool IGAElementCursor::open( IGAReader &reader, const IGAModelHandle &model )
+	{
+		mReader = &reader;
+		for( BlockLocation &block : mBlocks )
+			block = BlockLocation();
+		mSrfType = "unknown";
+		mLayouts.clear();
+		mSharedDictionary.reset();
+		mPages.clear();
+		mPageSlots.clear();
+		rewind();
+
+		// As in IGAReader::loadIGAModelParallel, the last non-empty block of each kind
+		// is the one that counts, and it mustn't be compressed.
+		static const char *const s_array_tags[ ARRAY_COUNT ] = { "VECDICT", "PT3DW", "2DPIECE", "EDGES", "KNOTINT", "SHAPE" };
+		bool packed[ ARRAY_COUNT + 1 ] = {};
+		BlockLocation layout_block;
+		for( const BlockIndexEntry &entry : model.blocks )
+		{
+			uint64_t tag = entry.tag == tagValue( "PACKED" ) ? entry.id : entry.tag;
+			int array = 0;
+			while( array < ARRAY_COUNT && tag != tagValue( s_array_tags[ array ] ) )
+				++array;
+			// ARRAY_COUNT stands for the LAYOUT block here.
+			bool is_layout = tag == tagValue( "LAYOUT" );
+			if( tag == tagValue( "DICTREF" ) )
+			{
+				// The coefficients start with those of a shared dictionary, which the
+				// reader must have, as it must when loading the model.
+				SharedDictionaryRef ref;
+				if( entry.tag == tagValue( "PACKED" ) || entry.block_len != sizeof( SharedDictionaryRef ) ||
+					!reader.seekData( entry.offset + sizeof( BlockHeader ) ) ||
+					!reader.readData( reinterpret_cast< char * >( &ref ), sizeof( SharedDictionaryRef ) ) )
+					return fail( "The DICTREF block couldn't be read." );
+				mSharedDictionary = reader.findSharedDictionary( ref.dict_id );
+				if( !mSharedDictionary || mSharedDictionary->coeffCount() != ref.coeff_count )
+					return fail( "The reader doesn't have the shared dictionary that the model was built with." );
+				continue;
+			}
+			if( array == ARRAY_COUNT && !is_layout )
+			{
+				if( entry.tag != tagValue( "SRFTYPE" ) )
+					continue;
+				// The SRFTYPE block starts the model.
+				if( entry.block_len >= IGA_MAX_ALLOC )
+					return fail( "The SRFTYPE block is too large." );
+				std::vector< char > srf_type( static_cast< size_t >( entry.block_len ) );
+				if( !reader.seekData( entry.offset + sizeof( BlockHeader ) ) ||
+					( !srf_type.empty() && !reader.readData( srf_type.data(), srf_type.size() ) ) )
+					return fail( "The SRFTYPE block couldn't be read." );
+				mSrfType.assign( srf_type.begin(), srf_type.end() );
+				continue;
+			}
+
+			if( entry.tag == tagValue( "PACKED" ) )
+				packed[ array ] = true;
+			else if( entry.block_len > 0 )
+			{
+				packed[ array ] = false;
+				BlockLocation &location = is_layout ? layout_block : mBlocks[ array ];
+				location.offset = entry.offset + sizeof( BlockHeader );
+				location.length = entry.block_len;
+			}
+		}
+		for( bool is_packed : packed )
+		{
+			if( is_packed )
+				return fail( "Some of the model's blocks are compressed, which the cursor can't read." );
+		}
+
+		// Sizes must exactly fit the struct size
+		if( mBlocks[ ARRAY_VECDICT ].length % sizeof( double ) != 0 ||
+			mBlocks[ ARRAY_PT3DW ].length % sizeof( Point3d ) != 0 ||
+			mBlocks[ ARRAY_2DPIECE ].length % sizeof( Piece2D ) != 0 ||
+			mBlocks[ ARRAY_EDGES ].length % sizeof( uint32_t ) != 0 ||
+			mBlocks[ ARRAY_KNOTINT ].length % sizeof( double ) != 0 ||
+			mBlocks[ ARRAY_SHAPE ].length % sizeof( Elem ) != 0 ||
+			layout_block.length % sizeof( FaceLayout ) != 0 )
+			return fail( "The size of one of the blocks isn't a whole number of items." );
+		// Indices are 32 bits.
+		for( const BlockLocation &block : mBlocks )
+		{
+			if( block.length / 4 > INVALID_INDEX )
+				return fail( "One of the blocks has too many items for 32-bit indices." );
+		}
+		// So must the coefficients, counting those in the shared dictionary.
+		if( mSharedDictionary && mBlocks[ ARRAY_VECDICT ].length / sizeof( double ) >= INVALID_INDEX - mSharedDictionary->coeffCount() )
+			return fail( "The model has too many coefficients for 32-bit indices." );
+		// Intervals, if there are any, go with the edges.
+		if( hasIntervals() && mBlocks[ ARRAY_KNOTINT ].length / sizeof( double ) != mBlocks[ ARRAY_EDGES ].length / sizeof( uint32_t ) )
+			return fail( "The interval and the edge vectors must be the same size (unless intervals is empty)" );
+		mElemCount = static_cast< uint32_t >( mBlocks[ ARRAY_SHAPE ].length / sizeof( Elem ) );
+		mPointCount = static_cast< uint32_t >( mBlocks[ ARRAY_PT3DW ].length / sizeof( Point3d ) );
+		mCoeffCount = mBlocks[ ARRAY_VECDICT ].length / sizeof( double ) + ( mSharedDictionary ? mSharedDictionary->coeffCount() : 0 );
+
+		// The layouts are a dictionary, so they're small enough to keep.
+		if( layout_block.length >= IGA_MAX_ALLOC )
+			return fail( "The LAYOUT block is too large." );
+		mLayouts.resize( static_cast< size_t >( layout_block.length / sizeof( FaceLayout ) ) );
+		if( !mLayouts.empty() &&
+			( !reader.seekData( layout_block.offset ) ||
+			!reader.readData( reinterpret_cast< char * >( mLayouts.data() ), static_cast< size_t >( layout_block.length ) ) ) )
+			return fail( "The LAYOUT block couldn't be read." );
+
+		// Elements are checked as they're read, but the layouts can only be checked
+		// as a whole, so they're checked now, the same way IGAData::validate checks
+		// them.
+		std::vector< IGAValidationError > errors;
+		if( !IGADataView::validateLayouts( mLayouts, hasIntervals(), errors ) )
+			return fail( errors.front().message );
+		return true;
+	}
+
+	void IGAElementCursor::rewind()
+	{
+		mNextElem = 0;
+		mPieceBegin = 0;
+		mEdgeBegin = 0;
+		mFailed = false;
+		mError.clear();
+	}
+
+	bool IGAElementCursor::fail( const std::string &message )
+	{
+		mFailed = true;
+		mError = message;
+		return false;
+	}
+
+	const IGAElementCursor::Page *IGAElementCursor::findPage( Array array, uint64_t page_index )
+	{
+		uint64_t key = ( static_cast< uint64_t >( array ) << 56 ) | page_index;
+		auto found = mPageSlots.find( key );
+		if( found != mPageSlots.end() )
+		{
+			Page &page = mPages[ found->second ];
+			page.last_use = ++mUseCounter;
+			return &page;
+		}
+
+		// Use a new page until the cache is full, then replace the least recently
+		// used one.
+		size_t slot = mPages.size();
+		if( slot < mMaxPages )
+			mPages.emplace_back();
+		else
+		{
+			slot = 0;
+			for( size_t ipage = 1; ipage < mPages.size(); ++ipage )
+			{
+				if( mPages[ ipage ].last_use < mPages[ slot ].last_use )
+					slot = ipage;
+			}
+			mPageSlots.erase( mPages[ slot ].key );
+		}
+
+		Page &page = mPages[ slot ];
+		const BlockLocation &block = mBlocks[ array ];
+		uint64_t page_start = page_index * mPageBytes;
+		page.data.resize( static_cast< size_t >( std::min< uint64_t >( mPageBytes, block.length - page_start ) ) );
+		if( !mReader->seekData( block.offset + page_start ) || !mReader->readData( page.data.data(), page.data.size() ) )
+		{
+			// Leave the slot unused.
+			page.key = ~0ull;
+			page.last_use = 0;
+			return nullptr;
+		}
+		page.key = key;
+		page.last_use = ++mUseCounter;
+		mPageSlots[ key ] = slot;
+		return &page;
+	}
+
+	bool IGAElementCursor::readBytes( Array array, uint64_t offset, size_t length, char *destination )
+	{
+		while( length > 0 )
+		{
+			const Page *page = findPage( array, offset / mPageBytes );
+			if( page == nullptr )
+				return false;
+			size_t start = static_cast< size_t >( offset % mPageBytes );
+			size_t count = std::min( length, page->data.size() - start );
+			memcpy( destination, page->data.data() + start, count );
+			destination += count;
+			offset += count;
+			length -= count;
+		}
+		return true;
+	}
+
+	template< typename T >
+	bool IGAElementCursor::readItems( Array array, uint64_t first, size_t count, T *destination )
+	{
+		uint64_t item_count = mBlocks[ array ].length / sizeof( T );
+		if( first > item_count || count > item_count - first )
+			return false;
+		return readBytes( array, first * sizeof( T ), count * sizeof( T ), reinterpret_cast< char * >( destination ) );
+	}
+
+	bool IGAElementCursor::readCoeffs( uint64_t first, size_t count, double *destination )
+	{
+		if( mSharedDictionary )
+		{
+			IGASpan< double > shared = mSharedDictionary->coeffs();
+			if( first < shared.size() )
+			{
+				size_t shared_count = std::min( count, static_cast< size_t >( shared.size() - first ) );
+				memcpy( destination, shared.data() + first, shared_count * sizeof( double ) );
+				destination += shared_count;
+				count -= shared_count;
+				first = shared.size();
+			}
+			first -= shared.size();
+		}
+		return readItems( ARRAY_VECDICT, first, count, destination );
+	}
+
+	bool IGAElementCursor::next( IGAStreamElem &elem )
+	{
+		using std::to_string;
+		if( mFailed || mNextElem >= mElemCount )
+			return false;
+
+		// The messages are the ones IGAData::validate gives for the same problems.
+		Elem shape;
+		if( !readItems( ARRAY_SHAPE, mNextElem, 1, &shape ) )
+			return fail( "The SHAPE block couldn't be read." );
+		std::string elem_name = "Elem " + to_string( mNextElem );
+
+		// The element's layout, which is the default layout for index 0.
+		elem.elem_index = mNextElem;
+		elem.layout_index = shape.layout_index;
+		if( shape.layout_index == 0 )
+			elem.layout = FaceLayout();
+		else if( shape.layout_index < mLayouts.size() )
+			elem.layout = mLayouts[ shape.layout_index ];
+		else
+			return fail( elem_name + " has a layout_index >= mLayouts.size()" );
+
+		// Pieces, and the points and coefficients they refer to.
+		if( shape.piece_end_index < mPieceBegin )
+			return fail( elem_name + " has a piece_end_index < last_piece_end" );
+		if( shape.piece_end_index > mBlocks[ ARRAY_2DPIECE ].length / sizeof( Piece2D ) )
+			return fail( elem_name + " has a piece_end_index > mPieces.size()" );
+		size_t piece_count = shape.piece_end_index - mPieceBegin;
+		elem.pieces.resize( piece_count );
+		if( !readItems( ARRAY_2DPIECE, mPieceBegin, piece_count, elem.pieces.data() ) )
+			return fail( "The 2DPIECE block couldn't be read." );
+		elem.points.resize( piece_count );
+		elem.coeff_begin.resize( piece_count + 1 );
+		elem.coeffs.clear();
+		for( size_t ipiece = 0; ipiece < piece_count; ++ipiece )
+		{
+			const Piece2D &piece = elem.pieces[ ipiece ];
+			std::string piece_name = "Piece " + to_string( mPieceBegin + ipiece );
+			if( piece.pt_index >= mPointCount )
+				return fail( piece_name + " has an OOB pt_index" );
+			if( !readItems( ARRAY_PT3DW, piece.pt_index, 1, &elem.points[ ipiece ] ) )
+				return fail( "The PT3DW block couldn't be read." );
+
+			size_t s_order = piece.st_order & 0xFFFF;
+			size_t t_order = piece.st_order >> 16;
+			size_t begin = elem.coeffs.size();
+			elem.coeff_begin[ ipiece ] = static_cast< uint32_t >( begin );
+			if( piece.maybe_t_index == INVALID_INDEX )
+			{
+				if( piece.s_index + s_order * t_order > mCoeffCount )
+					return fail( piece_name + " refers to OOB coefficients" );
+				elem.coeffs.resize( begin + s_order * t_order );
+				if( !readCoeffs( piece.s_index, s_order * t_order, elem.coeffs.data() + begin ) )
+					return fail( "The VECDICT block couldn't be read." );
+			}
+			else
+			{
+				if( piece.s_index + s_order > mCoeffCount )
+					return fail( piece_name + " in S (TP) refers to OOB coefficients" );
+				if( piece.maybe_t_index + t_order > mCoeffCount )
+					return fail( piece_name + " in T (TP) refers to OOB coefficients" );
+				elem.coeffs.resize( begin + s_order + t_order );
+				if( !readCoeffs( piece.s_index, s_order, elem.coeffs.data() + begin ) ||
+					!readCoeffs( piece.maybe_t_index, t_order, elem.coeffs.data() + begin + s_order ) )
+					return fail( "The VECDICT block couldn't be read." );
+			}
+		}
+		elem.coeff_begin[ piece_count ] = static_cast< uint32_t >( elem.coeffs.size() );
+
+		// Edges, which must match the layout (if it's stored), and their intervals.
+		if( shape.edge_end_index < mEdgeBegin )
+			return fail( elem_name + " has an edge_end_index < last_edge_end" );
+		if( shape.edge_end_index > mBlocks[ ARRAY_EDGES ].length / sizeof( uint32_t ) )
+			return fail( elem_name + " has an edge_end_index > mEdges.size()" );
+		size_t edge_count = shape.edge_end_index - mEdgeBegin;
+		if( shape.layout_index < mLayouts.size() && edge_count != elem.layout.side_range[ 4 ] )
+			return fail( elem_name + " has " + to_string( edge_count ) + " edges but its layout has " + to_string( elem.layout.side_range[ 4 ] ) + " edges" );
+		elem.edges.resize( edge_count );
+		if( !readItems( ARRAY_EDGES, mEdgeBegin, edge_count, elem.edges.data() ) )
+			return fail( "The EDGES block couldn't be read." );
+		for( size_t iedge = 0; iedge < edge_count; ++iedge )
+		{
+			uint32_t edge = elem.edges[ iedge ];
+			if( edge != INVALID_INDEX && edge >= mElemCount )
+				return fail( "Edge " + to_string( mEdgeBegin + iedge ) + " is adjacent to an OOB element" );
+		}
+		elem.intervals.resize( hasIntervals() ? edge_count : 0 );
+		if( hasIntervals() && !readItems( ARRAY_KNOTINT, mEdgeBegin, edge_count, elem.intervals.data() ) )
+			return fail( "The KNOTINT block couldn't be read." );
+
+		++mNextElem;
+		mPieceBegin = shape.piece_end_index;
+		mEdgeBegin = shape.edge_end_index;
+
+		// The last element must use up all of the pieces and edges.
+		if( mNextElem == mElemCount &&
+			( mPieceBegin != mBlocks[ ARRAY_2DPIECE ].length / sizeof( Piece2D ) || mEdgeBegin != mBlocks[ ARRAY_EDGES ].length / sizeof( uint32_t ) ) )
+			return fail( "The Elems do not refer to all the edges/pieces" );
+		return true;
+	}
+}
@@ -0,0 +1,311 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAElementWriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "iga/IGAChecksum.h"
+
+namespace iga_fileio
+{
+	IGAElementWriter::IGAElementWriter( IGAWriter &writer, size_t buffer_bytes )
+		: mWriter( &writer ), mBufferBytes( std::max< size_t >( buffer_bytes, 4096 ) )
+	{
+	}
+
+	IGAElementWriter::~IGAElementWriter()
+	{
+		clear();
+	}
+
+	void IGAElementWriter::clear()
+	{
+		for( Spool &spool : mSpools )
+		{
+			if( spool.file )
+				fclose( spool.file );
+			spool = Spool();
+		}
+		mFailed = false;
+		mElemPieceBegin = 0;
+		mElemEdgeBegin = 0;
+		mSrfType = "unknown";
+		mCoeffs.clear();
+		mLayouts.clear();
+		mCoeffLookup.clear();
+		mLayoutLookup.clear();
+	}
+
+	bool IGAElementWriter::spill( Spool &spool )
+	{
+		if( !spool.file )
+		{
+			spool.file = std::tmpfile();
+			if( !spool.file )
+				return false;
+		}
+		if( !spool.buffer.empty() && fwrite( spool.buffer.data(), 1, spool.buffer.size(), spool.file ) != spool.buffer.size() )
+			return false;
+		spool.buffer.clear();
+		return true;
+	}
+
+	uint32_t IGAElementWriter::appendItems( Array array, const void *items, size_t item_size, size_t count )
+	{
+		// The same overflow guards as IGACreator's safeAppendRange.
+		Spool &spool = mSpools[ array ];
+		uint32_t first_index = itemCount( array, item_size );
+		if( count >= INVALID_INDEX || first_index >= INVALID_INDEX - count )
+			return INVALID_INDEX;
+
+		size_t length = count * item_size;
+		bool direct = false;
+		if( spool.buffer.size() + length > mBufferBytes )
+		{
+			// Anything too big for the buffer goes straight to the file.
+			direct = length > mBufferBytes;
+			if( !spill( spool ) || ( direct && fwrite( items, 1, length, spool.file ) != length ) )
+			{
+				mFailed = true;
+				return INVALID_INDEX;
+			}
+			spool.buffer.reserve( mBufferBytes );
+		}
+		if( !direct )
+		{
+			const char *bytes = static_cast< const char * >( items );
+			spool.buffer.insert( spool.buffer.end(), bytes, bytes + length );
+		}
+		spool.crc = crc32c( spool.crc, items, length );
+		spool.length += length;
+		return first_index;
+	}
+
+	uint32_t IGAElementWriter::addEdge( uint32_t elem, double knot_interval )
+	{
+		return addEdges( &elem, knot_interval >= 0.0 ? &knot_interval : nullptr, 1 );
+	}
+
+	uint32_t IGAElementWriter::addEdges( const uint32_t *edges, const double *knot_intervals, size_t count )
+	{
+		// Check everything up front, so that nothing is added if we fail.
+		uint32_t edge_count = itemCount( ARRAY_EDGES, sizeof( uint32_t ) );
+		uint32_t interval_count = itemCount( ARRAY_KNOTINT, sizeof( double ) );
+		if( knot_intervals )
+		{
+			if( interval_count != edge_count )
+				return INVALID_INDEX;
+			for( size_t iedge = 0; iedge < count; ++iedge )
+				if( !( knot_intervals[ iedge ] >= 0.0 ) )
+					return INVALID_INDEX;
+		}
+		else if( interval_count != 0 )
+			return INVALID_INDEX;
+
+		uint32_t edge_index = appendItems( ARRAY_EDGES, edges, sizeof( uint32_t ), count );
+		if( edge_index == INVALID_INDEX )
+			return INVALID_INDEX;
+		if( knot_intervals && appendItems( ARRAY_KNOTINT, knot_intervals, sizeof( double ), count ) == INVALID_INDEX )
+		{
+			// The edges are already in, so the model can't be written.
+			mFailed = true;
+			return INVALID_INDEX;
+		}
+		return edge_index;
+	}
+
+	uint32_t IGAElementWriter::addExplicitPiece( int s_order, uint32_t pt_index, const CoeffVector &coeffs )
+	{
+		return addExplicitPiece( s_order, pt_index, coeffs.data(), coeffs.size() );
+	}
+
+	uint32_t IGAElementWriter::addExplicitPiece( int s_order, uint32_t pt_index, const double *coeffs, size_t coeff_count )
+	{
+		if( coeff_count > 0x7FFF * 0x7FFF || s_order <= 0 )
+			return INVALID_INDEX;
+		int t_order = static_cast< int >( coeff_count ) / s_order;
+		if( s_order > 0x7FFF || t_order < 0 || t_order > 0x7FFF )
+			return INVALID_INDEX;
+		if( static_cast< size_t >( s_order ) * static_cast< size_t >( t_order ) != coeff_count )
+			return INVALID_INDEX;
+
+		Piece2D p;
+		p.st_order = ( s_order ) | ( t_order << 16 );
+		p.s_index = getDictionaryIndex( coeffs, coeff_count );
+		if( p.s_index == INVALID_INDEX )
+			return INVALID_INDEX;
+		p.maybe_t_index = INVALID_INDEX;
+		p.pt_index = pt_index;
+		return addPiece( p );
+	}
+
+	uint32_t IGAElementWriter::addPiece( const Piece2D &piece )
+	{
+		return appendItems( ARRAY_2DPIECE, &piece, sizeof( Piece2D ), 1 );
+	}
+
+	uint32_t IGAElementWriter::addPieces( const Piece2D *pieces, size_t count )
+	{
+		return appendItems( ARRAY_2DPIECE, pieces, sizeof( Piece2D ), count );
+	}
+
+	uint32_t IGAElementWriter::addPoint( const Point3d &pt )
+	{
+		return appendItems( ARRAY_PT3DW, &pt, sizeof( Point3d ), 1 );
+	}
+
+	uint32_t IGAElementWriter::addPoints( const Point3d *pts, size_t count )
+	{
+		return appendItems( ARRAY_PT3DW, pts, sizeof( Point3d ), count );
+	}
+
+	uint32_t IGAElementWriter::addTensorPiece( const CoeffVector &s_coeffs, const CoeffVector &t_coeffs, uint32_t pt_index )
+	{
+		if( s_coeffs.size() > 0x7FFF || t_coeffs.size() > 0x7FFF )
+			return INVALID_INDEX;
+		return addTensorPiece( s_coeffs.data(), static_cast< int >( s_coeffs.size() ),
+			t_coeffs.data(), static_cast< int >( t_coeffs.size() ), pt_index );
+	}
+
+	uint32_t IGAElementWriter::addTensorPiece( const double *s_coeffs, int s_order, const double *t_coeffs, int t_order, uint32_t pt_index )
+	{
+		if( s_order < 0 || s_order > 0x7FFF ||
+			t_order < 0 || t_order > 0x7FFF )
+			return INVALID_INDEX;
+
+		Piece2D p;
+		p.st_order = ( s_order ) | ( t_order << 16 );
+		p.s_index = getDictionaryIndex( s_coeffs, static_cast< size_t >( s_order ) );
+		if( p.s_index == INVALID_INDEX )
+			return INVALID_INDEX;
+		p.maybe_t_index = getDictionaryIndex( t_coeffs, static_cast< size_t >( t_order ) );
+		if( p.maybe_t_index == INVALID_INDEX )
+			return INVALID_INDEX;
+		p.pt_index = pt_index;
+		return addPiece( p );
+	}
+
+	uint32_t IGAElementWriter::finishElem( uint32_t layout_index )
+	{
+		Elem elem;
+		elem.edge_end_index = itemCount( ARRAY_EDGES, sizeof( uint32_t ) );
+		elem.layout_index = layout_index;
+		elem.piece_end_index = itemCount( ARRAY_2DPIECE, sizeof( Piece2D ) );
+
+		// Check to make sure the caller didn't make a layout mistake.
+		if( layout_index >= mLayouts.size() )
+			return INVALID_INDEX;
+		if( elem.edge_end_index - mElemEdgeBegin != mLayouts[ layout_index ].side_range[ 4 ] )
+			return INVALID_INDEX;
+
+		uint32_t elem_index = appendItems( ARRAY_SHAPE, &elem, sizeof( Elem ), 1 );
+		if( elem_index == INVALID_INDEX )
+			return INVALID_INDEX;
+		mElemPieceBegin = elem.piece_end_index;
+		mElemEdgeBegin = elem.edge_end_index;
+		return elem_index;
+	}
+
+	uint32_t IGAElementWriter::getDictionaryIndex( const CoeffVector &coeffs )
+	{
+		return getDictionaryIndex( coeffs.data(), coeffs.size() );
+	}
+
+	uint32_t IGAElementWriter::getDictionaryIndex( const double *coeffs, size_t coeff_count )
+	{
+		// As in IGACreator, no infinities or NANs.
+		for( size_t icoeff = 0; icoeff < coeff_count; ++icoeff )
+			if( !finite( coeffs[ icoeff ] ) )
+				return INVALID_INDEX;
+
+		uint64_t hash = CoeffHashLookup::hashCoeffs( coeffs, coeff_count );
+		uint32_t found_index = mCoeffLookup.find( mCoeffs, coeffs, coeff_count, hash );
+		if( found_index != INVALID_INDEX )
+			return found_index;
+
+		if( mCoeffs.size() + coeff_count >= INVALID_INDEX ||
+			mCoeffs.size() + coeff_count > mCoeffs.max_size() ||
+			coeff_count >= 0x7FFF )
+			return INVALID_INDEX;
+		uint32_t new_index = static_cast< uint32_t >( mCoeffs.size() );
+		mCoeffs.insert( mCoeffs.end(), coeffs, coeffs + coeff_count );
+		mCoeffLookup.insert( hash, new_index, static_cast< uint32_t >( coeff_count ) );
+		return new_index;
+	}
+
+	uint32_t IGAElementWriter::getLayoutIndex( const FaceLayout &layout )
+	{
+		auto iter = mLayoutLookup.find( layout );
+		if( iter != mLayoutLookup.end() )
+			return iter->second;
+
+		// Layout 0 is always the uniform layout, as in IGACreator.
+		FaceLayout default_layout;
+		if( mLayouts.empty() && ( layout < default_layout || default_layout < layout ) )
+		{
+			mLayoutLookup[ default_layout ] = 0;
+			mLayouts.push_back( default_layout );
+		}
+
+		if( mLayouts.size() >= INVALID_INDEX - 1 )
+			return INVALID_INDEX;
+		uint32_t new_index = static_cast< uint32_t >( mLayouts.size() );
+		mLayouts.push_back( layout );
+		mLayoutLookup[ layout ] = new_index;
+		return new_index;
+	}
+
+	bool IGAElementWriter::writeSpool( const char *block_type, Spool &spool )
+	{
+		if( !spool.file )
+			return mWriter->writeFileBlock( block_type, spool.buffer.data(), spool.buffer.size() );
+
+		// Move the rest of the contents to the file, then read them back through the
+		// buffer.
+		if( !spill( spool ) || fflush( spool.file ) != 0 || fseek( spool.file, 0, SEEK_SET ) != 0 )
+			return false;
+		spool.buffer.resize( mBufferBytes );
+		std::FILE *file = spool.file;
+		return mWriter->writeStreamedBlock( block_type, spool.length, spool.crc,
+			[file]( char *destination, size_t length ) { return fread( destination, 1, length, file ) == length; },
+			spool.buffer.data(), spool.buffer.size() );
+	}
+
+	bool IGAElementWriter::finish()
+	{
+		// Every piece and edge must belong to an element.
+		bool ok = !mFailed &&
+			mElemPieceBegin == itemCount( ARRAY_2DPIECE, sizeof( Piece2D ) ) &&
+			mElemEdgeBegin == itemCount( ARRAY_EDGES, sizeof( uint32_t ) );
+
+		// The same blocks in the same order as IGAWriter::writeModelBlocks.
+		ok = ok && mWriter->beginFile();
+		ok = ok && mWriter->writeFileBlock( "SRFTYPE", mSrfType.data(), mSrfType.size() );
+		ok = ok && mWriter->writeFileBlock( "VECDICT", reinterpret_cast< const char * >( mCoeffs.data() ), mCoeffs.size() * sizeof( double ) );
+		ok = ok && writeSpool( "PT3DW", mSpools[ ARRAY_PT3DW ] );
+		ok = ok && writeSpool( "2DPIECE", mSpools[ ARRAY_2DPIECE ] );
+		ok = ok && mWriter->writeFileBlock( "LAYOUT", reinterpret_cast< const char * >( mLayouts.data() ), mLayouts.size() * sizeof( FaceLayout ) );
+		ok = ok && writeSpool( "EDGES", mSpools[ ARRAY_EDGES ] );
+		if( mSpools[ ARRAY_KNOTINT ].length > 0 )
+			ok = ok && writeSpool( "KNOTINT", mSpools[ ARRAY_KNOTINT ] );
+		ok = ok && writeSpool( "SHAPE", mSpools[ ARRAY_SHAPE ] );
+		ok = mWriter->finishFile( ok );
+
+		clear();
+		return ok;
+	}
+}
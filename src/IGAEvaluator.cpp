@@ -0,0 +1,445 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAEvaluator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined( _MSC_VER ) && defined( _M_X64 )
+#define IGA_EVAL_X86 1
+#include <immintrin.h>
+#include <intrin.h>
+#elif ( defined( __GNUC__ ) || defined( __clang__ ) ) && defined( __x86_64__ )
+#define IGA_EVAL_X86 1
+#endif
+
+// Multiplies and adds mustn't be fused into FMA instructions, which round once
+// instead of twice, so that every kernel gives the same results as the scalar
+// one. MSVC only fuses them when asked to with /fp:contract.
+#if defined( __clang__ )
+#pragma STDC FP_CONTRACT OFF
+#elif defined( __GNUC__ )
+#pragma GCC optimize( "fp-contract=off" )
+#endif
+
+#if defined( _MSC_VER )
+#define IGA_EVAL_INLINE __forceinline
+#define IGA_EVAL_TARGET_AVX2
+#define IGA_EVAL_TARGET_AVX512
+#else
+#define IGA_EVAL_INLINE inline __attribute__( ( always_inline ) )
+#define IGA_EVAL_TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+#define IGA_EVAL_TARGET_AVX512 __attribute__( ( target( "avx512f" ) ) )
+#endif
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// Elements with higher orders than this are evaluated by the scalar kernel,
+		// which keeps its basis functions on the heap rather than the stack. Real
+		// models use orders of four or so.
+		const int MAX_SIMD_ORDER = 32;
+
+		// The kernels below are written once, for a type V holding W doubles which
+		// supports +, -, * and / with another V, and + and * with a double (so that
+		// V{} + x holds x in every lane). That's double itself for the scalar kernel,
+		// and a vector of 4 or 8 doubles for AVX2 and AVX-512. Each kernel is
+		// inlined into a function compiled for its instruction set.
+		#if defined( IGA_EVAL_X86 ) && !defined( _MSC_VER )
+		typedef double Lanes4 __attribute__( ( vector_size( 32 ) ) );
+		typedef double Lanes8 __attribute__( ( vector_size( 64 ) ) );
+		#elif defined( IGA_EVAL_X86 )
+		// MSVC has no vector extensions, so wrap the intrinsic types instead.
+		struct Lanes4 { __m256d v; };
+		IGA_EVAL_INLINE Lanes4 operator+( Lanes4 a, Lanes4 b ) { return { _mm256_add_pd( a.v, b.v ) }; }
+		IGA_EVAL_INLINE Lanes4 operator-( Lanes4 a, Lanes4 b ) { return { _mm256_sub_pd( a.v, b.v ) }; }
+		IGA_EVAL_INLINE Lanes4 operator*( Lanes4 a, Lanes4 b ) { return { _mm256_mul_pd( a.v, b.v ) }; }
+		IGA_EVAL_INLINE Lanes4 operator/( Lanes4 a, Lanes4 b ) { return { _mm256_div_pd( a.v, b.v ) }; }
+		IGA_EVAL_INLINE Lanes4 operator+( Lanes4 a, double b ) { return { _mm256_add_pd( a.v, _mm256_set1_pd( b ) ) }; }
+		IGA_EVAL_INLINE Lanes4 operator*( Lanes4 a, double b ) { return { _mm256_mul_pd( a.v, _mm256_set1_pd( b ) ) }; }
+
+		struct Lanes8 { __m512d v; };
+		IGA_EVAL_INLINE Lanes8 operator+( Lanes8 a, Lanes8 b ) { return { _mm512_add_pd( a.v, b.v ) }; }
+		IGA_EVAL_INLINE Lanes8 operator-( Lanes8 a, Lanes8 b ) { return { _mm512_sub_pd( a.v, b.v ) }; }
+		IGA_EVAL_INLINE Lanes8 operator*( Lanes8 a, Lanes8 b ) { return { _mm512_mul_pd( a.v, b.v ) }; }
+		IGA_EVAL_INLINE Lanes8 operator/( Lanes8 a, Lanes8 b ) { return { _mm512_div_pd( a.v, b.v ) }; }
+		IGA_EVAL_INLINE Lanes8 operator+( Lanes8 a, double b ) { return { _mm512_add_pd( a.v, _mm512_set1_pd( b ) ) }; }
+		IGA_EVAL_INLINE Lanes8 operator*( Lanes8 a, double b ) { return { _mm512_mul_pd( a.v, _mm512_set1_pd( b ) ) }; }
+		#endif
+
+		// Computes the 'order' Bernstein basis functions of degree order - 1 at u,
+		// and their derivatives if 'derivs' isn't null, using de Casteljau's
+		// recurrence.
+		template< typename V >
+		IGA_EVAL_INLINE void bernstein( int order, const V &u, V *basis, V *derivs )
+		{
+			V zero = V{} + 0.0, one = V{} + 1.0;
+			V one_minus_u = one - u;
+			basis[ 0 ] = one;
+			if( derivs && order == 1 )
+				derivs[ 0 ] = zero;
+			for( int degree = 1; degree < order; ++degree )
+			{
+				// The derivative of a basis function of degree n is n times the
+				// difference of the two degree n - 1 functions below it.
+				if( derivs && degree == order - 1 )
+				{
+					double n = static_cast< double >( degree );
+					derivs[ 0 ] = zero - basis[ 0 ] * n;
+					for( int i = 1; i < degree; ++i )
+						derivs[ i ] = ( basis[ i - 1 ] - basis[ i ] ) * n;
+					derivs[ degree ] = basis[ degree - 1 ] * n;
+				}
+				basis[ degree ] = u * basis[ degree - 1 ];
+				for( int i = degree - 1; i > 0; --i )
+					basis[ i ] = one_minus_u * basis[ i ] + u * basis[ i - 1 ];
+				basis[ 0 ] = one_minus_u * basis[ 0 ];
+			}
+		}
+
+		// Evaluates W parameter pairs at once. 'basis' has room for 4 * max_order
+		// values. results receives the x, y and z of the positions, then of the s
+		// derivatives and of the t derivatives if DERIVS is set.
+		template< typename V, bool DERIVS >
+		IGA_EVAL_INLINE void evaluateLanes( const IGABezierPatchRef *patches, size_t patch_count, const V &u, const V &v, V *basis, int max_order, V *results )
+		{
+			V zero = V{} + 0.0;
+			V h[ 4 ] = { zero, zero, zero, zero };
+			V hs[ 4 ] = { zero, zero, zero, zero };
+			V ht[ 4 ] = { zero, zero, zero, zero };
+			V *s_basis = basis, *s_derivs = basis + max_order;
+			V *t_basis = basis + 2 * max_order, *t_derivs = basis + 3 * max_order;
+			for( size_t ipatch = 0; ipatch < patch_count; ++ipatch )
+			{
+				const IGABezierPatchRef &patch = patches[ ipatch ];
+				bernstein( patch.s_order, u, s_basis, DERIVS ? s_derivs : nullptr );
+				bernstein( patch.t_order, v, t_basis, DERIVS ? t_derivs : nullptr );
+
+				// Sum each row of control points in s, then the rows in t.
+				const Point3d *row = patch.points;
+				for( int it = 0; it < patch.t_order; ++it, row += patch.s_order )
+				{
+					V r[ 4 ] = { zero, zero, zero, zero };
+					V rs[ 4 ] = { zero, zero, zero, zero };
+					for( int is = 0; is < patch.s_order; ++is )
+					{
+						const Point3d &pt = row[ is ];
+						r[ 0 ] = r[ 0 ] + s_basis[ is ] * pt.x;
+						r[ 1 ] = r[ 1 ] + s_basis[ is ] * pt.y;
+						r[ 2 ] = r[ 2 ] + s_basis[ is ] * pt.z;
+						r[ 3 ] = r[ 3 ] + s_basis[ is ] * pt.w;
+						if( DERIVS )
+						{
+							rs[ 0 ] = rs[ 0 ] + s_derivs[ is ] * pt.x;
+							rs[ 1 ] = rs[ 1 ] + s_derivs[ is ] * pt.y;
+							rs[ 2 ] = rs[ 2 ] + s_derivs[ is ] * pt.z;
+							rs[ 3 ] = rs[ 3 ] + s_derivs[ is ] * pt.w;
+						}
+					}
+					for( int k = 0; k < 4; ++k )
+					{
+						h[ k ] = h[ k ] + t_basis[ it ] * r[ k ];
+						if( DERIVS )
+						{
+							hs[ k ] = hs[ k ] + t_basis[ it ] * rs[ k ];
+							ht[ k ] = ht[ k ] + t_derivs[ it ] * r[ k ];
+						}
+					}
+				}
+			}
+
+			// Divide through by the weight. The derivative of x / w is
+			// ( x' - ( x / w ) w' ) / w.
+			V inv_w = ( V{} + 1.0 ) / h[ 3 ];
+			for( int k = 0; k < 3; ++k )
+			{
+				results[ k ] = h[ k ] * inv_w;
+				if( DERIVS )
+				{
+					results[ 3 + k ] = ( hs[ k ] - results[ k ] * hs[ 3 ] ) * inv_w;
+					results[ 6 + k ] = ( ht[ k ] - results[ k ] * ht[ 3 ] ) * inv_w;
+				}
+			}
+		}
+
+		template< typename V, int W >
+		IGA_EVAL_INLINE void evaluateBatches( const IGABezierPatchRef *patches, size_t patch_count, const double *s, const double *t, size_t count,
+			Vector3d *positions, Vector3d *s_derivs, Vector3d *t_derivs, V *basis, int max_order )
+		{
+			for( size_t first = 0; first < count; first += W )
+			{
+				// The last batch may be partly filled, so copy the parameters.
+				size_t lanes = std::min< size_t >( W, count - first );
+				double s_lanes[ W ], t_lanes[ W ];
+				for( size_t lane = 0; lane < W; ++lane )
+				{
+					s_lanes[ lane ] = lane < lanes ? s[ first + lane ] : 0.0;
+					t_lanes[ lane ] = lane < lanes ? t[ first + lane ] : 0.0;
+				}
+				V u, v;
+				memcpy( &u, s_lanes, sizeof( V ) );
+				memcpy( &v, t_lanes, sizeof( V ) );
+
+				V results[ 9 ];
+				bool derivs = s_derivs || t_derivs;
+				if( derivs )
+					evaluateLanes< V, true >( patches, patch_count, u, v, basis, max_order, results );
+				else
+					evaluateLanes< V, false >( patches, patch_count, u, v, basis, max_order, results );
+				double values[ 9 ][ W ];
+				memcpy( values, results, ( derivs ? 9 : 3 ) * sizeof( V ) );
+
+				for( size_t lane = 0; lane < lanes; ++lane )
+				{
+					Vector3d &pos = positions[ first + lane ];
+					pos.x = values[ 0 ][ lane ];
+					pos.y = values[ 1 ][ lane ];
+					pos.z = values[ 2 ][ lane ];
+					if( s_derivs )
+					{
+						Vector3d &ds = s_derivs[ first + lane ];
+						ds.x = values[ 3 ][ lane ];
+						ds.y = values[ 4 ][ lane ];
+						ds.z = values[ 5 ][ lane ];
+					}
+					if( t_derivs )
+					{
+						Vector3d &dt = t_derivs[ first + lane ];
+						dt.x = values[ 6 ][ lane ];
+						dt.y = values[ 7 ][ lane ];
+						dt.z = values[ 8 ][ lane ];
+					}
+				}
+			}
+		}
+
+		void evaluateScalar( const IGABezierPatchRef *patches, size_t patch_count, const double *s, const double *t, size_t count,
+			Vector3d *positions, Vector3d *s_derivs, Vector3d *t_derivs, int max_order )
+		{
+			if( max_order <= MAX_SIMD_ORDER )
+			{
+				double basis[ 4 * MAX_SIMD_ORDER ];
+				evaluateBatches< double, 1 >( patches, patch_count, s, t, count, positions, s_derivs, t_derivs, basis, max_order );
+			}
+			else
+			{
+				std::vector< double > basis( 4 * static_cast< size_t >( max_order ) );
+				evaluateBatches< double, 1 >( patches, patch_count, s, t, count, positions, s_derivs, t_derivs, basis.data(), max_order );
+			}
+		}
+
+		#ifdef IGA_EVAL_X86
+		IGA_EVAL_TARGET_AVX2 void evaluateAvx2( const IGABezierPatchRef *patches, size_t patch_count, const double *s, const double *t, size_t count,
+			Vector3d *positions, Vector3d *s_derivs, Vector3d *t_derivs, int max_order )
+		{
+			Lanes4 basis[ 4 * MAX_SIMD_ORDER ];
+			evaluateBatches< Lanes4, 4 >( patches, patch_count, s, t, count, positions, s_derivs, t_derivs, basis, max_order );
+		}
+
+		IGA_EVAL_TARGET_AVX512 void evaluateAvx512( const IGABezierPatchRef *patches, size_t patch_count, const double *s, const double *t, size_t count,
+			Vector3d *positions, Vector3d *s_derivs, Vector3d *t_derivs, int max_order )
+		{
+			Lanes8 basis[ 4 * MAX_SIMD_ORDER ];
+			evaluateBatches< Lanes8, 8 >( patches, patch_count, s, t, count, positions, s_derivs, t_derivs, basis, max_order );
+		}
+		#endif
+
+		bool kernelSupported( EvalKernel kernel )
+		{
+			#if defined( IGA_EVAL_X86 ) && defined( _MSC_VER )
+			// The OS must save the AVX (and for AVX-512, the opmask and upper ZMM)
+			// registers, as well as the processor supporting the instructions.
+			int info[ 4 ];
+			__cpuid( info, 1 );
+			bool os_avx = ( info[ 2 ] & ( 1 << 27 ) ) != 0 && ( info[ 2 ] & ( 1 << 28 ) ) != 0 &&
+				( _xgetbv( 0 ) & 0x06 ) == 0x06;
+			__cpuidex( info, 7, 0 );
+			switch( kernel )
+			{
+			case EVAL_KERNEL_SCALAR: return true;
+			case EVAL_KERNEL_AVX2: return os_avx && ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+			case EVAL_KERNEL_AVX512: return os_avx && ( _xgetbv( 0 ) & 0xE6 ) == 0xE6 && ( info[ 1 ] & ( 1 << 16 ) ) != 0;
+			default: return false;
+			}
+			#elif defined( IGA_EVAL_X86 )
+			switch( kernel )
+			{
+			case EVAL_KERNEL_SCALAR: return true;
+			case EVAL_KERNEL_AVX2: return __builtin_cpu_supports( "avx2" ) != 0;
+			case EVAL_KERNEL_AVX512: return __builtin_cpu_supports( "avx512f" ) != 0;
+			default: return false;
+			}
+			#else
+			return kernel == EVAL_KERNEL_SCALAR;
+			#endif
+		}
+
+		EvalKernel bestKernel()
+		{
+			if( kernelSupported( EVAL_KERNEL_AVX512 ) )
+				return EVAL_KERNEL_AVX512;
+			if( kernelSupported( EVAL_KERNEL_AVX2 ) )
+				return EVAL_KERNEL_AVX2;
+			return EVAL_KERNEL_SCALAR;
+		}
+
+		std::atomic< int > &currentKernel()
+		{
+			static std::atomic< int > s_kernel( bestKernel() );
+			return s_kernel;
+		}
+	}
+
+	int IGABezierElem::maxOrder() const
+	{
+		int max_order = 0;
+		for( const IGABezierPatch &patch : patches )
+			max_order = std::max( max_order, std::max( patch.s_order, patch.t_order ) );
+		return max_order;
+	}
+
+	bool extractBezierElem( const IGADataView &data, uint32_t elem_index, IGABezierElem &bezier )
+	{
+		if( elem_index >= data.elemCount() )
+			return false;
+
+		size_t patch_count = 0;
+		for( uint32_t ipiece = data.pieceBegin( elem_index ); ipiece < data.pieceEnd( elem_index ); ++ipiece )
+		{
+			int s_order = data.pieceSOrder( ipiece ), t_order = data.pieceTOrder( ipiece );
+			if( s_order == 0 || t_order == 0 )
+				continue;
+
+			// Find the patch for these orders, reusing an old one if there's a new one
+			// to add.
+			size_t ipatch = 0;
+			while( ipatch < patch_count &&
+				( bezier.patches[ ipatch ].s_order != s_order || bezier.patches[ ipatch ].t_order != t_order ) )
+				++ipatch;
+			if( ipatch == patch_count )
+			{
+				if( patch_count == bezier.patches.size() )
+					bezier.patches.emplace_back();
+				IGABezierPatch &patch = bezier.patches[ patch_count++ ];
+				patch.s_order = s_order;
+				patch.t_order = t_order;
+				patch.points.assign( static_cast< size_t >( s_order ) * t_order, Point3d() );
+			}
+
+			// Add this piece's coefficients times its point.
+			IGABezierPatch &patch = bezier.patches[ ipatch ];
+			const Point3d &pt = data.piecePoint( ipiece );
+			bool is_explicit = data.pieceIsExplicit( ipiece );
+			const double *s_coeffs = data.pieceSCoeffs( ipiece );
+			const double *t_coeffs = is_explicit ? nullptr : data.pieceTCoeffs( ipiece );
+			for( int it = 0; it < t_order; ++it )
+			{
+				for( int is = 0; is < s_order; ++is )
+				{
+					double coeff = is_explicit ? s_coeffs[ is + it * s_order ] : s_coeffs[ is ] * t_coeffs[ it ];
+					Point3d &control = patch.points[ is + it * s_order ];
+					control.x += coeff * pt.x;
+					control.y += coeff * pt.y;
+					control.z += coeff * pt.z;
+					control.w += coeff * pt.w;
+				}
+			}
+		}
+		bezier.patches.resize( patch_count );
+		return true;
+	}
+
+	void evaluateBezierElem( const IGABezierElem &bezier, const double *s, const double *t, size_t count,
+		Vector3d *positions, Vector3d *s_derivs, Vector3d *t_derivs )
+	{
+		// Elements rarely have more than one or two patches.
+		const size_t MAX_STACK_PATCHES = 8;
+		IGABezierPatchRef stack_refs[ MAX_STACK_PATCHES ];
+		std::vector< IGABezierPatchRef > heap_refs;
+		IGABezierPatchRef *refs = stack_refs;
+		if( bezier.patches.size() > MAX_STACK_PATCHES )
+		{
+			heap_refs.resize( bezier.patches.size() );
+			refs = heap_refs.data();
+		}
+		for( size_t ipatch = 0; ipatch < bezier.patches.size(); ++ipatch )
+		{
+			refs[ ipatch ].s_order = bezier.patches[ ipatch ].s_order;
+			refs[ ipatch ].t_order = bezier.patches[ ipatch ].t_order;
+			refs[ ipatch ].points = bezier.patches[ ipatch ].points.data();
+		}
+		evaluateBezierPatches( refs, bezier.patches.size(), s, t, count, positions, s_derivs, t_derivs );
+	}
+
+	void evaluateBezierPatches( const IGABezierPatchRef *patches, size_t patch_count, const double *s, const double *t, size_t count,
+		Vector3d *positions, Vector3d *s_derivs, Vector3d *t_derivs )
+	{
+		int max_order = 0;
+		for( size_t ipatch = 0; ipatch < patch_count; ++ipatch )
+			max_order = std::max( max_order, std::max( patches[ ipatch ].s_order, patches[ ipatch ].t_order ) );
+		#ifdef IGA_EVAL_X86
+		if( max_order <= MAX_SIMD_ORDER )
+		{
+			switch( currentKernel().load( std::memory_order_relaxed ) )
+			{
+			case EVAL_KERNEL_AVX512:
+				evaluateAvx512( patches, patch_count, s, t, count, positions, s_derivs, t_derivs, max_order );
+				return;
+			case EVAL_KERNEL_AVX2:
+				evaluateAvx2( patches, patch_count, s, t, count, positions, s_derivs, t_derivs, max_order );
+				return;
+			default:
+				break;
+			}
+		}
+		#endif
+		evaluateScalar( patches, patch_count, s, t, count, positions, s_derivs, t_derivs, max_order );
+	}
+
+	bool setEvalKernel( EvalKernel kernel )
+	{
+		if( kernel == EVAL_KERNEL_AUTO )
+			kernel = bestKernel();
+		else if( !kernelSupported( kernel ) )
+			return false;
+		currentKernel().store( kernel );
+		return true;
+	}
+
+	EvalKernel evalKernel()
+	{
+		return static_cast< EvalKernel >( currentKernel().load() );
+	}
+
+	IGAEvaluator::IGAEvaluator( const IGADataView &data ) : mData( data )
+	{
+	}
+
+	bool IGAEvaluator::evaluate( uint32_t elem_index, const double *s, const double *t, size_t count,
+		Vector3d *positions, Vector3d *s_derivs, Vector3d *t_derivs )
+	{
+		if( elem_index != mBezierIndex )
+		{
+			mBezierIndex = INVALID_INDEX;
+			if( !extractBezierElem( mData, elem_index, mBezier ) )
+				return false;
+			mBezierIndex = elem_index;
+		}
+		evaluateBezierElem( mBezier, s, t, count, positions, s_derivs, t_derivs );
+		return true;
+	}
+}
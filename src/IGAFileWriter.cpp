@@ -0,0 +1,159 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAFileWriter.h"
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace iga_fileio
+{
+	IGAFileWriter::~IGAFileWriter()
+	{
+		close();
+	}
+
+	#ifdef _WIN32
+	bool IGAFileWriter::open( const char *filename )
+	{
+		close();
+		HANDLE file = CreateFileA( filename, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if( file == INVALID_HANDLE_VALUE )
+			return false;
+		mFileHandle = file;
+		return true;
+	}
+
+	bool IGAFileWriter::close()
+	{
+		if( mFileHandle == nullptr )
+			return false;
+		bool ok = CloseHandle( mFileHandle ) != 0;
+		mFileHandle = nullptr;
+		return ok;
+	}
+
+	bool IGAFileWriter::writeData( const char *data_block, size_t length )
+	{
+		if( mFileHandle == nullptr )
+			return false;
+		// WriteFile takes a 32-bit length, so large blocks are written in pieces.
+		while( length > 0 )
+		{
+			DWORD piece = static_cast< DWORD >( std::min< size_t >( length, 1u << 30 ) );
+			DWORD written = 0;
+			if( !WriteFile( mFileHandle, data_block, piece, &written, nullptr ) || written == 0 )
+				return false;
+			data_block += written;
+			length -= written;
+		}
+		return true;
+	}
+
+	bool IGAFileWriter::writeDataV( const IGAWriteSegment *segments, size_t segment_count )
+	{
+		// Windows only has a gather-write for unbuffered, page-aligned I/O, so
+		// write the segments one at a time.
+		return IGAWriter::writeDataV( segments, segment_count );
+	}
+	#else
+	bool IGAFileWriter::open( const char *filename )
+	{
+		close();
+		mFile = ::open( filename, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+		return mFile >= 0;
+	}
+
+	bool IGAFileWriter::close()
+	{
+		if( mFile < 0 )
+			return false;
+		bool ok = ::close( mFile ) == 0;
+		mFile = -1;
+		return ok;
+	}
+
+	bool IGAFileWriter::writeData( const char *data_block, size_t length )
+	{
+		IGAWriteSegment segment;
+		segment.data = data_block;
+		segment.length = length;
+		return writeDataV( &segment, 1 );
+	}
+
+	bool IGAFileWriter::writeDataV( const IGAWriteSegment *segments, size_t segment_count )
+	{
+		if( mFile < 0 )
+			return false;
+
+		// writev accepts at most IOV_MAX segments per call, and may write less
+		// than it was given, so work through the segments in batches, picking up
+		// wherever the previous call stopped.
+		const size_t max_batch = IOV_MAX;
+		std::vector< iovec > batch;
+		batch.reserve( std::min( segment_count, max_batch ) );
+		size_t isegment = 0;
+		size_t segment_offset = 0;
+		while( isegment < segment_count )
+		{
+			batch.clear();
+			for( size_t ibatch = isegment; ibatch < segment_count && batch.size() < max_batch; ++ibatch )
+			{
+				size_t skip = ibatch == isegment ? segment_offset : 0;
+				iovec vec;
+				vec.iov_base = const_cast< char * >( segments[ ibatch ].data + skip );
+				vec.iov_len = segments[ ibatch ].length - skip;
+				batch.push_back( vec );
+			}
+
+			ssize_t written = writev( mFile, batch.data(), static_cast< int >( batch.size() ) );
+			if( written < 0 )
+			{
+				if( errno == EINTR )
+					continue;
+				return false;
+			}
+
+			// Advance past whatever was written, including any empty segments.
+			size_t remaining = static_cast< size_t >( written );
+			while( isegment < segment_count && remaining >= segments[ isegment ].length - segment_offset )
+			{
+				remaining -= segments[ isegment ].length - segment_offset;
+				++isegment;
+				segment_offset = 0;
+			}
+			segment_offset += remaining;
+			if( written == 0 && isegment < segment_count )
+				return false;
+		}
+		return true;
+	}
+	#endif
+}
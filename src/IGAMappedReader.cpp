@@ -0,0 +1,386 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAMappedReader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "iga/IGAChecksum.h"
+#include "iga/IGACodec.h"
+#include "iga/IGACommon.h"
+#include "iga/IGADataView.h"
+#include "iga/IGASharedDictionary.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace iga_fileio
+{
+	IGAMappedReader::~IGAMappedReader()
+	{
+		close();
+	}
+
+	bool IGAMappedReader::open( const char *filename )
+	{
+		close();
+
+		#ifdef _WIN32
+		HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+		if( file == INVALID_HANDLE_VALUE )
+			return false;
+		LARGE_INTEGER file_size;
+		if( !GetFileSizeEx( file, &file_size ) )
+		{
+			CloseHandle( file );
+			return false;
+		}
+		mFileHandle = file;
+		mSize = static_cast< uint64_t >( file_size.QuadPart );
+		// Windows refuses to map an empty file; leave mData null, and let the
+		// header check fail later.
+		if( mSize == 0 )
+			return true;
+		HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if( mapping == nullptr )
+		{
+			close();
+			return false;
+		}
+		mMappingHandle = mapping;
+		mData = static_cast< const char * >( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+		if( mData == nullptr )
+		{
+			close();
+			return false;
+		}
+		#else
+		int fd = ::open( filename, O_RDONLY );
+		if( fd < 0 )
+			return false;
+		struct stat file_stat;
+		if( fstat( fd, &file_stat ) != 0 || file_stat.st_size < 0 )
+		{
+			::close( fd );
+			return false;
+		}
+		mSize = static_cast< uint64_t >( file_stat.st_size );
+		if( mSize > 0 )
+		{
+			void *mapped = mmap( nullptr, static_cast< size_t >( mSize ), PROT_READ, MAP_PRIVATE, fd, 0 );
+			if( mapped == MAP_FAILED )
+			{
+				::close( fd );
+				mSize = 0;
+				return false;
+			}
+			mData = static_cast< const char * >( mapped );
+		}
+		// The mapping keeps its own reference to the file.
+		::close( fd );
+		#endif
+
+		mOwnsMapping = true;
+		mPosition = 0;
+		return true;
+	}
+
+	void IGAMappedReader::openBuffer( const char *data, size_t size )
+	{
+		close();
+		mData = data;
+		mSize = size;
+		mPosition = 0;
+	}
+
+	void IGAMappedReader::close()
+	{
+		if( mOwnsMapping )
+		{
+			#ifdef _WIN32
+			if( mData )
+				UnmapViewOfFile( mData );
+			if( mMappingHandle )
+				CloseHandle( mMappingHandle );
+			if( mFileHandle )
+				CloseHandle( mFileHandle );
+			mMappingHandle = nullptr;
+			mFileHandle = nullptr;
+			#else
+			if( mData )
+				munmap( const_cast< char * >( mData ), static_cast< size_t >( mSize ) );
+			#endif
+		}
+		mData = nullptr;
+		mSize = 0;
+		mPosition = 0;
+		mOwnsMapping = false;
+	}
+
+	bool IGAMappedReader::readData( char *destination, size_t length )
+	{
+		if( mPosition > mSize || length > mSize - mPosition )
+			return false;
+		memcpy( destination, mData + mPosition, length );
+		mPosition += length;
+		return true;
+	}
+
+	bool IGAMappedReader::skipData( uint64_t length )
+	{
+		if( mPosition > mSize || length > mSize - mPosition )
+			return false;
+		mPosition += length;
+		return true;
+	}
+
+	bool IGAMappedReader::readDataAt( uint64_t offset, char *destination, size_t length )
+	{
+		if( offset > mSize || length > mSize - offset )
+			return false;
+		memcpy( destination, mData + offset, length );
+		return true;
+	}
+
+	bool IGAMappedReader::seekData( uint64_t offset )
+	{
+		if( offset > mSize )
+			return false;
+		mPosition = offset;
+		return true;
+	}
+
+	// Points 'dst' at a block's contents. If the contents aren't aligned for T, they
+	// are copied into a buffer owned by the view instead.
+	template< typename T >
+	static bool attachBlock( IGASpan< T > &dst, std::vector< std::shared_ptr< std::vector< uint64_t > > > &owned_blocks,
+		const char *contents, uint64_t len )
+	{
+		// Sizes must exactly fit the struct size
+		if( len % sizeof( T ) != 0 )
+			return false;
+		size_t n = static_cast< size_t >( len / sizeof( T ) );
+
+		if( reinterpret_cast< uintptr_t >( contents ) % alignof( T ) == 0 )
+		{
+			dst = IGASpan< T >( reinterpret_cast< const T * >( contents ), n );
+			return true;
+		}
+
+		// The same sanity limit that IGAReader applies, since we're allocating.
+		if( len >= IGA_MAX_ALLOC )
+			return false;
+		static_assert( alignof( T ) <= alignof( uint64_t ), "Block types must not need more than 8-byte alignment" );
+		auto copy = std::make_shared< std::vector< uint64_t > >( static_cast< size_t >( ( len + 7 ) / 8 ) );
+		memcpy( copy->data(), contents, static_cast< size_t >( len ) );
+		dst = IGASpan< T >( reinterpret_cast< const T * >( copy->data() ), n );
+		owned_blocks.push_back( std::move( copy ) );
+		return true;
+	}
+
+	// Decompresses a PACKED block's contents into a buffer owned by the view, and
+	// points 'dst' at it.
+	template< typename T >
+	static bool attachPackedBlock( IGASpan< T > &dst, std::vector< std::shared_ptr< std::vector< uint64_t > > > &owned_blocks,
+		const char *contents, uint64_t len, uint64_t inner_tag )
+	{
+		PackedBlockHeader header;
+		if( !readPackedHeader( contents, static_cast< size_t >( len ), header ) || header.inner_tag != inner_tag )
+			return false;
+		// Sizes must exactly fit the struct size
+		if( header.raw_len % sizeof( T ) != 0 )
+			return false;
+		auto copy = std::make_shared< std::vector< uint64_t > >( static_cast< size_t >( ( header.raw_len + 7 ) / 8 ) );
+		if( !unpackBlock( contents, static_cast< size_t >( len ), reinterpret_cast< char * >( copy->data() ) ) )
+			return false;
+		dst = IGASpan< T >( reinterpret_cast< const T * >( copy->data() ), static_cast< size_t >( header.raw_len / sizeof( T ) ) );
+		owned_blocks.push_back( std::move( copy ) );
+		return true;
+	}
+
+	// Calls attachPackedBlock if 'packed' is set, otherwise attachBlock. If
+	// 'expected_crc' isn't null, the contents must have that checksum.
+	template< typename T >
+	static bool attachAnyBlock( IGASpan< T > &dst, std::vector< std::shared_ptr< std::vector< uint64_t > > > &owned_blocks,
+		const char *contents, uint64_t len, bool packed, uint64_t inner_tag, const uint32_t *expected_crc )
+	{
+		if( expected_crc && crc32c( 0, contents, static_cast< size_t >( len ) ) != *expected_crc )
+			return false;
+		if( packed )
+			return attachPackedBlock( dst, owned_blocks, contents, len, inner_tag );
+		return attachBlock( dst, owned_blocks, contents, len );
+	}
+
+	bool IGAMappedReader::viewBlock( uint64_t offset, IGADataView &view, uint32_t block_mask, BlockHeader &block_header,
+		PendingChecksum &checksum ) const
+	{
+		if( offset > mSize || mSize - offset < sizeof( BlockHeader ) ) return false;
+		memcpy( &block_header, mData + offset, sizeof( BlockHeader ) );
+		if( tagValue( block_header.block_tag ) != tagValue( "\nBLOCK:\n" ) ) return false;
+
+		// The contents and the trailing length must both fit in the mapping,
+		// and the trailing length must match.
+		uint64_t contents_offset = offset + sizeof( BlockHeader );
+		uint64_t len = block_header.block_len;
+		if( len > mSize - contents_offset || mSize - contents_offset - len < 8 ) return false;
+		uint64_t final_len = ~0ull;
+		memcpy( &final_len, mData + contents_offset + len, 8 );
+		if( final_len != len ) return false;
+
+		const char *contents = mData + contents_offset;
+		if( block_header.tag == tagValue( "CRC32C" ) )
+		{
+			// As in IGAReader, a CRC32C block of a different size is ignored.
+			checksum.valid = len == sizeof( ChecksumBlock );
+			if( checksum.valid )
+				memcpy( &checksum.block, contents, sizeof( ChecksumBlock ) );
+			return true;
+		}
+		// A checksum applies to the next block other than a PADDING block, and only
+		// if that block has the tag it names. It's only checked if the block is used.
+		const uint32_t *expected_crc = nullptr;
+		if( block_header.tag != tagValue( "PADDING" ) )
+		{
+			if( checksum.valid && verifyChecksums() && checksum.block.tag == block_header.tag )
+				expected_crc = &checksum.block.crc;
+			checksum.valid = false;
+		}
+
+		auto &owned = view.mOwnedBlocks;
+		if( block_header.tag == tagValue( "SRFTYPE" ) )
+		{
+			if( expected_crc && crc32c( 0, contents, static_cast< size_t >( len ) ) != *expected_crc )
+				return false;
+			view.clear();
+			view.mSrfType.assign( contents, static_cast< size_t >( len ) );
+			return true;
+		}
+
+		// A PACKED block is viewed like the block it holds, whose tag is its id.
+		bool packed = block_header.tag == tagValue( "PACKED" );
+		uint64_t tag = packed ? block_header.id : block_header.tag;
+		if( tag == tagValue( "DICTREF" ) && ( block_mask & BLOCK_VECDICT ) )
+		{
+			IGASpan< SharedDictionaryRef > ref;
+			if( !attachAnyBlock( ref, owned, contents, len, packed, tag, expected_crc ) || ref.size() != 1 )
+				return false;
+			// Without the dictionary, the model's coefficients would be meaningless.
+			view.mSharedDictionary = findSharedDictionary( ref[ 0 ].dict_id );
+			return view.mSharedDictionary && view.mSharedDictionary->coeffCount() == ref[ 0 ].coeff_count;
+		}
+		if( tag == tagValue( "VECDICT" ) && ( block_mask & BLOCK_VECDICT ) )
+			return attachAnyBlock( view.mCoeffs, owned, contents, len, packed, tag, expected_crc );
+		else if( tag == tagValue( "PT3DW" ) && ( block_mask & BLOCK_PT3DW ) )
+			return attachAnyBlock( view.mPoints, owned, contents, len, packed, tag, expected_crc );
+		else if( tag == tagValue( "2DPIECE" ) && ( block_mask & BLOCK_2DPIECE ) )
+			return attachAnyBlock( view.mPieces, owned, contents, len, packed, tag, expected_crc );
+		else if( tag == tagValue( "LAYOUT" ) && ( block_mask & BLOCK_LAYOUT ) )
+			return attachAnyBlock( view.mLayouts, owned, contents, len, packed, tag, expected_crc );
+		else if( tag == tagValue( "EDGES" ) && ( block_mask & BLOCK_EDGES ) )
+			return attachAnyBlock( view.mEdges, owned, contents, len, packed, tag, expected_crc );
+		else if( tag == tagValue( "KNOTINT" ) && ( block_mask & BLOCK_KNOTINT ) )
+			return attachAnyBlock( view.mIntervals, owned, contents, len, packed, tag, expected_crc );
+		else if( tag == tagValue( "SHAPE" ) && ( block_mask & BLOCK_SHAPE ) )
+			return attachAnyBlock( view.mElems, owned, contents, len, packed, tag, expected_crc );
+		// Unknown blocks are silently skipped for forward compatibility.
+		return true;
+	}
+
+	bool IGAMappedReader::resolveSharedDictionary( IGADataView &view )
+	{
+		if( !view.mSharedDictionary )
+			return true;
+
+		// If the model has no coefficients of its own, the view can use the
+		// dictionary's directly; otherwise the two must be joined in a new buffer.
+		IGASpan< double > shared_coeffs = view.mSharedDictionary->coeffs();
+		IGASpan< double > own_coeffs = view.mCoeffs;
+		if( own_coeffs.empty() )
+		{
+			view.mCoeffs = shared_coeffs;
+			return true;
+		}
+		size_t count = shared_coeffs.size() + own_coeffs.size();
+		if( count >= INVALID_INDEX || count >= IGA_MAX_ALLOC / sizeof( double ) )
+			return false;
+		static_assert( sizeof( double ) == sizeof( uint64_t ), "The coefficients are copied into a buffer of uint64_t" );
+		auto copy = std::make_shared< std::vector< uint64_t > >( count );
+		double *joined = reinterpret_cast< double * >( copy->data() );
+		std::copy( shared_coeffs.begin(), shared_coeffs.end(), joined );
+		std::copy( own_coeffs.begin(), own_coeffs.end(), joined + shared_coeffs.size() );
+		view.mCoeffs = IGASpan< double >( joined, count );
+		view.mOwnedBlocks.push_back( std::move( copy ) );
+		return true;
+	}
+
+	bool IGAMappedReader::readIGAView( IGADataView &view, uint32_t block_mask )
+	{
+		view.clear();
+
+		// Check the TSS header, and that the first block is the IGAFILE block.
+		if( mData == nullptr || mSize < 8 || memcmp( mData, "#TSS0001", 8 ) != 0 )
+			return false;
+		BlockHeader block_header;
+		if( mSize - 8 < sizeof( BlockHeader ) )
+			return false;
+		memcpy( &block_header, mData + 8, sizeof( BlockHeader ) );
+		if( block_header.tag != tagValue( "IGAFILE" ) )
+			return false;
+
+		// Walk the block headers. As with readIGAFile, running out of data where
+		// the next header should be is how we detect the end of the file.
+		uint64_t offset = 8;
+		PendingChecksum checksum;
+		while( mSize - offset >= sizeof( BlockHeader ) )
+		{
+			if( !viewBlock( offset, view, block_mask, block_header, checksum ) )
+				return false;
+			offset += sizeof( BlockHeader ) + block_header.block_len + 8;
+		}
+		if( !resolveSharedDictionary( view ) )
+			return false;
+
+		readFinished();
+		return true;
+	}
+
+	bool IGAMappedReader::readIGAView( const IGAModelHandle &model, IGADataView &view, uint32_t block_mask ) const
+	{
+		view.clear();
+		PendingChecksum checksum;
+		for( const BlockIndexEntry &entry : model.blocks )
+		{
+			BlockHeader block_header;
+			if( !viewBlock( entry.offset, view, block_mask, block_header, checksum ) )
+				return false;
+			// The header must agree with the handle.
+			if( block_header.tag != entry.tag || block_header.id != entry.id || block_header.block_len != entry.block_len )
+				return false;
+		}
+		return resolveSharedDictionary( view );
+	}
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGAParallel.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// The threads behind runInBackground.
+		class BackgroundPool
+		{
+		public:
+			explicit BackgroundPool( unsigned thread_count )
+			{
+				for( unsigned ithread = 0; ithread < thread_count; ++ithread )
+					mThreads.emplace_back( [this]() { run(); } );
+			}
+
+			void submit( std::function< void() > task )
+			{
+				{
+					std::lock_guard< std::mutex > lock( mMutex );
+					mTasks.push_back( std::move( task ) );
+				}
+				mTaskReady.notify_one();
+			}
+
+		private:
+			void run()
+			{
+				for( ;; )
+				{
+					std::function< void() > task;
+					{
+						std::unique_lock< std::mutex > lock( mMutex );
+						mTaskReady.wait( lock, [this]() { return !mTasks.empty(); } );
+						task = std::move( mTasks.front() );
+						mTasks.pop_front();
+					}
+					task();
+				}
+			}
+
+			std::vector< std::thread > mThreads;
+			std::deque< std::function< void() > > mTasks;
+			std::mutex mMutex;
+			std::condition_variable mTaskReady;
+		};
+	}
+
+	void runInBackground( std::function< void() > task )
+	{
+		// The pool is never destroyed, since tasks may still be running when static
+		// objects are destroyed at exit.
+		static BackgroundPool *s_pool = new BackgroundPool( defaultThreadCount() );
+		s_pool->submit( std::move( task ) );
+	}
+}
@@ -14,29 +14,65 @@
 
 #include "iga/IGAReader.h"
 
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+#include "iga/IGACodec.h"
 #include "iga/IGACommon.h"
 #include "iga/IGAData.h"
+#include "iga/IGAParallel.h"
+#include "iga/IGASharedDictionary.h"
 
 namespace iga_fileio
 {
+	namespace
+	{
+		// When a block has a checksum, its contents are read and checked this many
+		// bytes at a time, so that each piece is checked while it's still in the cache.
+		const size_t CHECKSUM_CHUNK_SIZE = 1 << 18;
+	}
+
 	template< typename T >
-	bool IGAReader::readBlock( std::vector< T > &dst, size_t len )
+	bool IGAReader::readBlock( std::vector< T > &dst, uint64_t len )
 	{
+		bool check = mCheckNextBlock;
+		mCheckNextBlock = false;
+
 		// Sizes must exactly fit the struct size
 		if( len % sizeof( T ) != 0 )
 			return false;
-		size_t n = len / sizeof( T );
 
+		uint32_t crc = 0;
 		if( len != 0 )
 		{
 			dst.clear();
 			if( len >= IGA_MAX_ALLOC )
 				return false;
+			size_t n = static_cast< size_t >( len / sizeof( T ) );
 			dst.resize( n );
 			char *target_ptr = reinterpret_cast< char * >( dst.data() );
-			if( !readData( target_ptr, len ) )
-				return false;
+			if( !check )
+			{
+				if( !readData( target_ptr, static_cast< size_t >( len ) ) )
+					return false;
+			}
+			else
+			{
+				size_t remaining = static_cast< size_t >( len );
+				while( remaining > 0 )
+				{
+					size_t chunk = remaining < CHECKSUM_CHUNK_SIZE ? remaining : CHECKSUM_CHUNK_SIZE;
+					if( !readData( target_ptr, chunk ) )
+						return false;
+					crc = crc32c( crc, target_ptr, chunk );
+					target_ptr += chunk;
+					remaining -= chunk;
+				}
+			}
 		}
+		if( check && crc != mExpectedChecksum )
+			return false;
 		uint64_t final_len = ~0ull;
 		if( !readData( reinterpret_cast< char * >( &final_len ), 8 ) )
 			return false;
@@ -45,91 +81,579 @@ namespace iga_fileio
 		return true;
 	}
 
-	bool IGAReader::readIGAFile( IGAData &geometry )
+	template< typename T >
+	bool IGAReader::readPackedBlock( std::vector< T > &dst, uint64_t inner_tag, uint64_t len )
 	{
-		geometry.clear();
+		std::vector< char > packed;
+		if( !readBlock( packed, len ) )
+			return false;
+		PackedBlockHeader header;
+		if( !readPackedHeader( packed.data(), packed.size(), header ) || header.inner_tag != inner_tag )
+			return false;
+		// Sizes must exactly fit the struct size
+		if( header.raw_len % sizeof( T ) != 0 )
+			return false;
+		dst.clear();
+		dst.resize( static_cast< size_t >( header.raw_len / sizeof( T ) ) );
+		return unpackBlock( packed.data(), packed.size(), reinterpret_cast< char * >( dst.data() ) );
+	}
+
+	template< typename T >
+	bool IGAReader::readAnyBlock( std::vector< T > &dst, bool packed, uint64_t inner_tag, uint64_t len )
+	{
+		return packed ? readPackedBlock( dst, inner_tag, len ) : readBlock( dst, len );
+	}
+
+	bool IGAReader::skipBlock( uint64_t len )
+	{
+		mCheckNextBlock = false;
+		if( len != 0 && !skipData( len ) )
+			return false;
+		uint64_t final_len = ~0ull;
+		if( !readData( reinterpret_cast< char * >( &final_len ), 8 ) )
+			return false;
+		if( final_len != len )
+			return false;
+		return true;
+	}
+
+	bool IGAReader::skipData( uint64_t length )
+	{
+		// Read the skipped bytes in small pieces, so that a corrupt length can't
+		// make us allocate a huge buffer.
+		// Flawfinder: ignore
+		char buffer[ 4096 ];
+		while( length > 0 )
+		{
+			size_t chunk = length < sizeof( buffer ) ? static_cast< size_t >( length ) : sizeof( buffer );
+			if( !readData( buffer, chunk ) )
+				return false;
+			length -= chunk;
+		}
+		return true;
+	}
+
+	// The BLOCK_ flag that selects blocks with the given tag, or 0 if the tag isn't
+	// one that we load.
+	static uint32_t blockFlag( uint64_t tag )
+	{
+		if( tag == tagValue( "VECDICT" ) ) return BLOCK_VECDICT;
+		if( tag == tagValue( "DICTREF" ) ) return BLOCK_VECDICT;
+		if( tag == tagValue( "PT3DW" ) ) return BLOCK_PT3DW;
+		if( tag == tagValue( "2DPIECE" ) ) return BLOCK_2DPIECE;
+		if( tag == tagValue( "LAYOUT" ) ) return BLOCK_LAYOUT;
+		if( tag == tagValue( "EDGES" ) ) return BLOCK_EDGES;
+		if( tag == tagValue( "KNOTINT" ) ) return BLOCK_KNOTINT;
+		if( tag == tagValue( "SHAPE" ) ) return BLOCK_SHAPE;
+		return 0;
+	}
+
+	// The same as blockFlag, except that a PACKED block is treated like the block it
+	// holds, whose tag is the PACKED block's id.
+	static uint32_t blockFlag( uint64_t tag, uint64_t id )
+	{
+		return blockFlag( tag == tagValue( "PACKED" ) ? id : tag );
+	}
+
+	bool IGAReader::readBlockContents( IGAData &geometry, uint64_t tag, uint64_t id, uint64_t len, uint32_t block_mask )
+	{
+		// Check block type against known block types. Silently ignore unknown block
+		// types, to enable forward compatibility. Blocks which weren't requested are
+		// skipped the same way.
+		if( tag == tagValue( "CRC32C" ) )
+		{
+			// Keep the checksum for the next block. A CRC32C block of a different
+			// size must be from a later version of the format, so it's ignored.
+			mHaveChecksum = false;
+			if( len != sizeof( ChecksumBlock ) )
+				return skipBlock( len );
+			std::vector< ChecksumBlock > checksum;
+			if( !readBlock( checksum, len ) ) return false;
+			mChecksum = checksum[ 0 ];
+			mHaveChecksum = true;
+			return true;
+		}
+		if( tag != tagValue( "PADDING" ) )
+		{
+			// A checksum applies to the next block other than a PADDING block, and
+			// only if that block has the tag it names.
+			mCheckNextBlock = mVerifyChecksums && mHaveChecksum && mChecksum.tag == tag;
+			mExpectedChecksum = mChecksum.crc;
+			mHaveChecksum = false;
+		}
+
+		if( tag == tagValue( "SRFTYPE" ) )
+		{
+			geometry.clear();
+			// You could build a method for reading strings directly and save a copy.
+			std::vector< char > srf_type;
+			if( !readBlock( srf_type, len ) ) return false;
+			geometry.mSrfType.assign( srf_type.begin(), srf_type.end() );
+			return true;
+		}
+		if( ( blockFlag( tag, id ) & block_mask ) == 0 )
+			return skipBlock( len );
+
+		// A PACKED block is loaded like the block it holds.
+		bool packed = tag == tagValue( "PACKED" );
+		if( packed )
+			tag = id;
+		geometry.mAdjacency.reset();
+		if( tag == tagValue( "DICTREF" ) )
+			return readDictionaryRef( geometry, packed, len );
+		if( tag == tagValue( "VECDICT" ) )
+			return readAnyBlock( geometry.mCoeffs, packed, tag, len );
+		if( tag == tagValue( "PT3DW" ) )
+			return readAnyBlock( geometry.mPoints, packed, tag, len );
+		if( tag == tagValue( "2DPIECE" ) )
+			return readAnyBlock( geometry.mPieces, packed, tag, len );
+		if( tag == tagValue( "LAYOUT" ) )
+			return readAnyBlock( geometry.mLayouts, packed, tag, len );
+		if( tag == tagValue( "EDGES" ) )
+			return readAnyBlock( geometry.mEdges, packed, tag, len );
+		if( tag == tagValue( "KNOTINT" ) )
+			return readAnyBlock( geometry.mIntervals, packed, tag, len );
+		return readAnyBlock( geometry.mElems, packed, tag, len );
+	}
+
+	bool IGAReader::readDictionaryRef( IGAData &geometry, bool packed, uint64_t len )
+	{
+		std::vector< SharedDictionaryRef > ref;
+		if( !readAnyBlock( ref, packed, tagValue( "DICTREF" ), len ) || ref.size() != 1 )
+			return false;
+		// Without the dictionary, the model's coefficients would be meaningless.
+		geometry.mSharedDictionary = findSharedDictionary( ref[ 0 ].dict_id );
+		return geometry.mSharedDictionary && geometry.mSharedDictionary->coeffCount() == ref[ 0 ].coeff_count;
+	}
+
+	bool IGAReader::resolveSharedDictionary( IGAData &geometry ) const
+	{
+		if( !geometry.mSharedDictionary )
+			return true;
+		IGASpan< double > shared_coeffs = geometry.mSharedDictionary->coeffs();
+		if( geometry.mCoeffs.size() >= INVALID_INDEX - shared_coeffs.size() )
+			return false;
+		geometry.mCoeffs.insert( geometry.mCoeffs.begin(), shared_coeffs.begin(), shared_coeffs.end() );
+		return true;
+	}
+
+	void IGAReader::addSharedDictionary( std::shared_ptr< const IGASharedDictionary > dictionary )
+	{
+		if( dictionary )
+			mSharedDictionaries.push_back( std::move( dictionary ) );
+	}
+
+	std::shared_ptr< const IGASharedDictionary > IGAReader::findSharedDictionary( uint64_t dict_id ) const
+	{
+		for( const auto &dictionary : mSharedDictionaries )
+		{
+			if( dictionary->id() == dict_id )
+				return dictionary;
+		}
+		return nullptr;
+	}
+
+	bool IGAReader::readIndex( std::vector< BlockIndexEntry > &index )
+	{
+		// The smallest file with an index has the TSS header, the IGAFILE block and
+		// an INDEX block with one entry.
+		uint64_t size = sourceSize();
+		const uint64_t block_overhead = sizeof( BlockHeader ) + 8;
+		if( size < 8 + 2 * block_overhead + sizeof( BlockIndexEntry ) )
+			return false;
+
+		// The index is the last block, so its trailing length is the last 8 bytes.
+		uint64_t index_len = ~0ull;
+		if( !seekData( size - 8 ) ) return false;
+		if( !readData( reinterpret_cast< char * >( &index_len ), 8 ) ) return false;
+		if( index_len % sizeof( BlockIndexEntry ) != 0 || index_len > size - 8 - block_overhead ) return false;
+		if( index_len >= IGA_MAX_ALLOC ) return false;
+
+		uint64_t index_offset = size - block_overhead - index_len;
+		BlockHeader block_header;
+		if( !seekData( index_offset ) ) return false;
+		if( !readData( reinterpret_cast< char * >( &block_header ), sizeof( BlockHeader ) ) ) return false;
+		if( tagValue( block_header.block_tag ) != tagValue( "\nBLOCK:\n" ) ) return false;
+		if( block_header.tag != tagValue( "INDEX" ) || block_header.block_len != index_len ) return false;
+		index.resize( static_cast< size_t >( index_len / sizeof( BlockIndexEntry ) ) );
+		if( !readData( reinterpret_cast< char * >( index.data() ), static_cast< size_t >( index_len ) ) ) return false;
+
+		// The entries must tile the file exactly, from the end of the TSS header to
+		// the start of the index, and the first one must be the IGAFILE block. An
+		// index which was written by something else, or which is out of date, will
+		// fail this check and we'll read the file sequentially instead.
+		if( index.empty() || index[ 0 ].tag != tagValue( "IGAFILE" ) )
+			return false;
+		uint64_t expected_offset = 8;
+		for( const BlockIndexEntry &entry : index )
+		{
+			if( entry.offset != expected_offset || index_offset - expected_offset < block_overhead )
+				return false;
+			if( entry.block_len > index_offset - expected_offset - block_overhead )
+				return false;
+			expected_offset += block_overhead + entry.block_len;
+		}
+		if( expected_offset != index_offset )
+			return false;
 
 		// Read and check TSS header
 		{
-			// Showing up as a bounds-check warning; you can check the bounds yourself on the call
-			// to readData a few lines down.
 			// Flawfinder: ignore
 			char buf[ 9 ] = "--------";
-			if( !readData( buf, 8 ) ) return false;
+			if( !seekData( 0 ) || !readData( buf, 8 ) ) return false;
 			buf[ 8 ] = '\0';
 			if( strcmp( buf, "#TSS0001" ) != 0 ) return false;
 		}
+		return true;
+	}
 
-		// Our interface doesn't have a 'seek' operation, only a 'read' operation, so
-		// we still have to read the blocks that are not recognized. For those blocks,
-		// we'll use this buffer as the read target.
-		std::vector< char > unused_block;
+	bool IGAReader::scanBlocks( std::vector< BlockIndexEntry > &blocks )
+	{
+		blocks.clear();
 
-		// Read first block.
+		// Read and check TSS header
 		{
-			BlockHeader block_header;
-			if( !readData( reinterpret_cast< char * >( &block_header ), sizeof( BlockHeader ) ) ) return false;
-			if( tagValue( block_header.block_tag ) != tagValue( "\nBLOCK:\n" ) ) return false;
-			if( block_header.tag != tagValue( "IGAFILE" ) ) return false;
-			if( !readBlock( unused_block, block_header.block_len ) ) return false;
+			// Flawfinder: ignore
+			char buf[ 9 ] = "--------";
+			if( !seekData( 0 ) || !readData( buf, 8 ) ) return false;
+			buf[ 8 ] = '\0';
+			if( strcmp( buf, "#TSS0001" ) != 0 ) return false;
 		}
 
-		// Read blocks in a loop until reading a block header fails.
-		bool block_read_okay = false;
-		do
+		// As in readIGAFile, failing to read a block header means we're done.
+		uint64_t offset = 8;
+		BlockHeader block_header;
+		while( readData( reinterpret_cast< char * >( &block_header ), sizeof( BlockHeader ) ) )
 		{
-			// Read the next block's header.
-			BlockHeader block_header;
-			block_read_okay = readData( reinterpret_cast< char * >( &block_header ), sizeof( BlockHeader ) );
-			// Failure to read the block header is how we detect end of file, so this is
-			// an acceptable failure.
-			if( !block_read_okay )
-				break;
 			if( tagValue( block_header.block_tag ) != tagValue( "\nBLOCK:\n" ) ) return false;
+			if( blocks.empty() && block_header.tag != tagValue( "IGAFILE" ) ) return false;
+			if( !skipBlock( block_header.block_len ) ) return false;
 
-			// Check block type against known block types. Silently ignore unknown block
-			// types, to enable forward compatibility.
-			if( block_header.tag == tagValue( "SRFTYPE" ) )
+			BlockIndexEntry entry;
+			entry.tag = block_header.tag;
+			entry.id = block_header.id;
+			entry.offset = offset;
+			entry.block_len = block_header.block_len;
+			blocks.push_back( entry );
+			offset += sizeof( BlockHeader ) + block_header.block_len + 8;
+		}
+		return !blocks.empty();
+	}
+
+	// Groups a file's blocks into models. Each SRFTYPE block starts a new model. The
+	// blocks before the first SRFTYPE block only count as a model if there is
+	// something in them that we would load.
+	static void splitModels( const std::vector< BlockIndexEntry > &blocks, std::vector< IGAModelHandle > &models )
+	{
+		models.clear();
+		IGAModelHandle leading_model;
+		bool leading_model_used = false;
+		for( const BlockIndexEntry &entry : blocks )
+		{
+			if( entry.tag == tagValue( "IGAFILE" ) || entry.tag == tagValue( "INDEX" ) )
+				continue;
+			if( entry.tag == tagValue( "SRFTYPE" ) )
+				models.emplace_back();
+			if( models.empty() )
 			{
-				geometry.clear();
-				// You could build a method for reading strings directly and save a copy.
-				std::vector< char > srf_type;
-				if( !readBlock( srf_type, block_header.block_len ) ) return false;
-				geometry.mSrfType.assign( srf_type.begin(), srf_type.end() );
+				leading_model.blocks.push_back( entry );
+				leading_model_used = leading_model_used || blockFlag( entry.tag, entry.id ) != 0;
 			}
-			else if( block_header.tag == tagValue( "VECDICT" ) )
+			else
+				models.back().blocks.push_back( entry );
+		}
+		if( leading_model_used )
+			models.insert( models.begin(), std::move( leading_model ) );
+	}
+
+	namespace
+	{
+		// Turns a reader's thread-safe readDataAt into a separate, seekable reader
+		// with its own read position. This lets each thread in loadIGAModels use the
+		// ordinary sequential reading code.
+		class PositionalReader : public IGAReader
+		{
+		public:
+			PositionalReader( IGAReader &source, uint64_t size ) : mSource( source ), mSize( size )
 			{
-				if( !readBlock( geometry.mCoeffs, block_header.block_len ) ) return false;
+				setVerifyChecksums( source.verifyChecksums() );
+				for( const auto &dictionary : source.sharedDictionaries() )
+					addSharedDictionary( dictionary );
 			}
-			else if( block_header.tag == tagValue( "PT3DW" ) )
+
+			bool readData( char *destination, size_t length ) override
 			{
-				if( !readBlock( geometry.mPoints, block_header.block_len ) ) return false;
+				if( !mSource.readDataAt( mPosition, destination, length ) )
+					return false;
+				mPosition += length;
+				return true;
 			}
-			else if( block_header.tag == tagValue( "2DPIECE" ) )
+
+			bool skipData( uint64_t length ) override
 			{
-				if( !readBlock( geometry.mPieces, block_header.block_len ) ) return false;
+				mPosition += length;
+				return true;
 			}
-			else if( block_header.tag == tagValue( "LAYOUT" ) )
+
+			bool seekData( uint64_t offset ) override
 			{
-				if( !readBlock( geometry.mLayouts, block_header.block_len ) ) return false;
+				mPosition = offset;
+				return true;
 			}
-			else if( block_header.tag == tagValue( "EDGES" ) )
+
+			uint64_t sourceSize() override { return mSize; }
+
+		private:
+			IGAReader &mSource;
+			uint64_t mSize = 0;
+			uint64_t mPosition = 0;
+		};
+	}
+
+	bool IGAReader::readIGAModels( std::vector< IGAModelHandle > &models )
+	{
+		models.clear();
+		if( sourceSize() == 0 )
+			return false;
+
+		std::vector< BlockIndexEntry > blocks;
+		if( !readIndex( blocks ) && !scanBlocks( blocks ) )
+			return false;
+		splitModels( blocks, models );
+		return true;
+	}
+
+	bool IGAReader::loadIGAModel( const IGAModelHandle &model, IGAData &geometry, uint32_t block_mask )
+	{
+		geometry.clear();
+
+		// We know the size of every block before reading any of them, so reject
+		// oversized blocks before allocating anything.
+		for( const BlockIndexEntry &entry : model.blocks )
+		{
+			if( ( blockFlag( entry.tag, entry.id ) & block_mask ) != 0 && entry.block_len >= IGA_MAX_ALLOC )
+				return false;
+		}
+
+		for( size_t iblock = 0; iblock < model.blocks.size(); ++iblock )
+		{
+			// Blocks that we aren't going to load cost nothing.
+			const BlockIndexEntry &entry = model.blocks[ iblock ];
+			if( entry.tag != tagValue( "SRFTYPE" ) && ( blockFlag( entry.tag, entry.id ) & block_mask ) == 0 )
+				continue;
+
+			if( !loadChecksumFor( model, iblock, geometry ) ) return false;
+			if( !loadIndexedBlock( entry, geometry, block_mask ) ) return false;
+		}
+		return resolveSharedDictionary( geometry );
+	}
+
+	bool IGAReader::loadChecksumFor( const IGAModelHandle &model, size_t iblock, IGAData &geometry )
+	{
+		mHaveChecksum = false;
+		if( !mVerifyChecksums )
+			return true;
+		// Look back past any PADDING blocks for a CRC32C block.
+		while( iblock > 0 )
+		{
+			const BlockIndexEntry &entry = model.blocks[ --iblock ];
+			if( entry.tag == tagValue( "CRC32C" ) )
+				return loadIndexedBlock( entry, geometry, 0 );
+			if( entry.tag != tagValue( "PADDING" ) )
+				break;
+		}
+		return true;
+	}
+
+	bool IGAReader::loadIndexedBlock( const BlockIndexEntry &entry, IGAData &geometry, uint32_t block_mask )
+	{
+		// The header must agree with the handle.
+		BlockHeader block_header;
+		if( !seekData( entry.offset ) ) return false;
+		if( !readData( reinterpret_cast< char * >( &block_header ), sizeof( BlockHeader ) ) ) return false;
+		if( tagValue( block_header.block_tag ) != tagValue( "\nBLOCK:\n" ) ) return false;
+		if( block_header.tag != entry.tag || block_header.id != entry.id || block_header.block_len != entry.block_len ) return false;
+		return readBlockContents( geometry, entry.tag, entry.id, entry.block_len, block_mask );
+	}
+
+	bool IGAReader::supportsReadDataAt()
+	{
+		// Flawfinder: ignore
+		char buf[ 8 ];
+		return readDataAt( 0, buf, 8 ) && memcmp( buf, "#TSS0001", 8 ) == 0;
+	}
+
+	bool IGAReader::loadIGAModelParallel( const IGAModelHandle &model, IGAData &geometry, uint32_t block_mask, unsigned thread_count )
+	{
+		if( !supportsReadDataAt() )
+			return loadIGAModel( model, geometry, block_mask );
+		geometry.clear();
+
+		// Pick out the blocks to load. Later blocks replace earlier ones (except that
+		// an empty block leaves the array alone), so only the last block that fills
+		// each array needs reading. This also means that no two threads write to the
+		// same array.
+		std::vector< size_t > blocks;
+		uint32_t arrays_filled = 0;
+		for( size_t iblock = model.blocks.size(); iblock-- > 0; )
+		{
+			const BlockIndexEntry &entry = model.blocks[ iblock ];
+			uint32_t flag = blockFlag( entry.tag, entry.id ) & block_mask;
+			if( flag == 0 || ( arrays_filled & flag ) != 0 || entry.tag == tagValue( "DICTREF" ) )
+				continue;
+			if( entry.tag != tagValue( "PACKED" ) && entry.block_len == 0 )
+				continue;
+			// We know the size of every block before reading any of them, so reject
+			// oversized blocks before allocating anything.
+			if( entry.block_len >= IGA_MAX_ALLOC )
+				return false;
+			arrays_filled |= flag;
+			blocks.push_back( iblock );
+		}
+
+		// The SRFTYPE block clears the model, so it must be read first. DICTREF
+		// blocks are tiny, and are read along with it.
+		for( size_t iblock = 0; iblock < model.blocks.size(); ++iblock )
+		{
+			if( model.blocks[ iblock ].tag != tagValue( "SRFTYPE" ) && model.blocks[ iblock ].tag != tagValue( "DICTREF" ) )
+				continue;
+			if( !loadChecksumFor( model, iblock, geometry ) || !loadIndexedBlock( model.blocks[ iblock ], geometry, block_mask ) )
+				return false;
+		}
+
+		uint64_t size = sourceSize();
+		std::atomic< bool > all_ok( true );
+		parallelRanges( blocks.size(), 1, thread_count, [&]( size_t begin, size_t end ) {
+			PositionalReader reader( *this, size );
+			IGAReader &block_reader = reader;
+			for( size_t iblock = begin; iblock < end && all_ok; ++iblock )
 			{
-				if( !readBlock( geometry.mEdges, block_header.block_len ) ) return false;
+				if( !block_reader.loadChecksumFor( model, blocks[ iblock ], geometry ) ||
+					!block_reader.loadIndexedBlock( model.blocks[ blocks[ iblock ] ], geometry, block_mask ) )
+					all_ok = false;
 			}
-			else if( block_header.tag == tagValue( "KNOTINT" ) )
+		} );
+		return all_ok && resolveSharedDictionary( geometry );
+	}
+
+	bool IGAReader::readIGAFileParallel( IGAData &geometry, uint32_t block_mask, unsigned thread_count )
+	{
+		if( sourceSize() == 0 || !supportsReadDataAt() )
+			return readIGAFile( geometry, block_mask );
+
+		geometry.clear();
+		std::vector< IGAModelHandle > models;
+		if( !readIGAModels( models ) )
+			return false;
+		// As with readIGAFile, only the last model is kept.
+		if( !models.empty() && !loadIGAModelParallel( models.back(), geometry, block_mask, thread_count ) )
+			return false;
+		readFinished();
+		return true;
+	}
+
+	bool IGAReader::loadIGAModels( const std::vector< IGAModelHandle > &models, std::vector< IGAData > &geometry,
+		uint32_t block_mask, unsigned thread_count )
+	{
+		geometry.clear();
+		geometry.resize( models.size() );
+
+		// Check whether this reader supports reading from several threads at once.
+		bool positional = models.size() > 1 && supportsReadDataAt();
+		if( !positional )
+		{
+			for( size_t imodel = 0; imodel < models.size(); ++imodel )
 			{
-				if( !readBlock( geometry.mIntervals, block_header.block_len ) ) return false;
+				if( !loadIGAModel( models[ imodel ], geometry[ imodel ], block_mask ) )
+					return false;
 			}
-			else if( block_header.tag == tagValue( "SHAPE" ) )
+			return true;
+		}
+
+		uint64_t size = sourceSize();
+		std::atomic< bool > all_ok( true );
+		parallelRanges( models.size(), 1, thread_count, [&]( size_t begin, size_t end ) {
+			PositionalReader reader( *this, size );
+			for( size_t imodel = begin; imodel < end && all_ok; ++imodel )
 			{
-				if( !readBlock( geometry.mElems, block_header.block_len ) ) return false;
+				if( !reader.loadIGAModel( models[ imodel ], geometry[ imodel ], block_mask ) )
+					all_ok = false;
 			}
-			else
+		} );
+		return all_ok;
+	}
+
+	std::future< bool > IGAReader::readIGAFileAsync( IGAData &geometry, uint32_t block_mask )
+	{
+		auto promise = std::make_shared< std::promise< bool > >();
+		std::future< bool > result = promise->get_future();
+		readIGAFileAsync( geometry, [promise]( bool ok ) { promise->set_value( ok ); }, block_mask );
+		return result;
+	}
+
+	void IGAReader::readIGAFileAsync( IGAData &geometry, std::function< void( bool ) > on_finished, uint32_t block_mask )
+	{
+		runInBackground( [this, &geometry, on_finished, block_mask]() { on_finished( readIGAFile( geometry, block_mask ) ); } );
+	}
+
+	bool IGAReader::readIGAFile( IGAData &geometry, uint32_t block_mask )
+	{
+		geometry.clear();
+
+		// If we can seek, and the file has a usable index, we can go directly to the
+		// blocks we want. Otherwise, rewind and read the file from start to end.
+		if( sourceSize() > 0 )
+		{
+			std::vector< BlockIndexEntry > index;
+			if( readIndex( index ) )
 			{
-				if( !readBlock( unused_block, block_header.block_len ) ) return false;
+				// Only the last model is kept, so that's the only one we need to read.
+				std::vector< IGAModelHandle > models;
+				splitModels( index, models );
+				if( !models.empty() && !loadIGAModel( models.back(), geometry, block_mask ) )
+					return false;
+				readFinished();
+				return true;
 			}
+			if( !seekData( 0 ) )
+				return false;
+		}
+
+		// Read and check TSS header
+		{
+			// Showing up as a bounds-check warning; you can check the bounds yourself on the call
+			// to readData a few lines down.
+			// Flawfinder: ignore
+			char buf[ 9 ] = "--------";
+			if( !readData( buf, 8 ) ) return false;
+			buf[ 8 ] = '\0';
+			if( strcmp( buf, "#TSS0001" ) != 0 ) return false;
+		}
+
+		// Read first block.
+		{
+			BlockHeader block_header;
+			if( !readData( reinterpret_cast< char * >( &block_header ), sizeof( BlockHeader ) ) ) return false;
+			if( tagValue( block_header.block_tag ) != tagValue( "\nBLOCK:\n" ) ) return false;
+			if( block_header.tag != tagValue( "IGAFILE" ) ) return false;
+			if( !skipBlock( block_header.block_len ) ) return false;
+		}
+
+		// Read blocks in a loop until reading a block header fails.
+		bool block_read_okay = false;
+		do
+		{
+			// Read the next block's header.
+			BlockHeader block_header;
+			block_read_okay = readData( reinterpret_cast< char * >( &block_header ), sizeof( BlockHeader ) );
+			// Failure to read the block header is how we detect end of file, so this is
+			// an acceptable failure.
+			if( !block_read_okay )
+				break;
+			if( tagValue( block_header.block_tag ) != tagValue( "\nBLOCK:\n" ) ) return false;
+			if( !readBlockContents( geometry, block_header.tag, block_header.id, block_header.block_len, block_mask ) ) return false;
 		} while( block_read_okay );
+		if( !resolveSharedDictionary( geometry ) ) return false;
 
 		readFinished();
 		return true;
@@ -0,0 +1,263 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGASharedDictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "iga/IGAMappedReader.h"
+#include "iga/IGAReader.h"
+#include "iga/IGAWriter.h"
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// The surface type that marks a dictionary file.
+		const char *const SURFACE_TYPE = "shared-dictionary";
+
+		// The starting state of the hash in id().
+		const uint64_t HASH_SEED = 0x9E3779B97F4A7C15ull;
+
+		// Adds coefficients to a hash in progress. As in CoeffHashLookup::hashCoeffs,
+		// -0.0 hashes like 0.0.
+		uint64_t mixCoeffs( uint64_t state, const double *coeffs, size_t count )
+		{
+			for( size_t icoeff = 0; icoeff < count; ++icoeff )
+			{
+				uint64_t bits = 0;
+				if( coeffs[ icoeff ] != 0.0 )
+					memcpy( &bits, &coeffs[ icoeff ], sizeof( bits ) );
+				state = ( state ^ bits ) * 0xFF51AFD7ED558CCDull;
+				state ^= state >> 32;
+			}
+			return state;
+		}
+
+		// Finishes the hash of 'count' coefficients with the splitmix64 mixer.
+		uint64_t finishHash( uint64_t state, size_t count )
+		{
+			uint64_t hash = state ^ count;
+			hash ^= hash >> 30;
+			hash *= 0xBF58476D1CE4E5B9ull;
+			hash ^= hash >> 27;
+			hash *= 0x94D049BB133111EBull;
+			hash ^= hash >> 31;
+			return hash;
+		}
+	}
+
+	IGASharedDictionary::IGASharedDictionary()
+	{
+		clear();
+	}
+
+	IGASharedDictionary::~IGASharedDictionary() = default;
+
+	IGASharedDictionary::IGASharedDictionary( IGASharedDictionary &&other )
+	{
+		*this = std::move( other );
+	}
+
+	IGASharedDictionary &IGASharedDictionary::operator=( IGASharedDictionary &&other )
+	{
+		if( this == &other )
+			return *this;
+		// The spans point into the owned vectors or the mapping, whose contents
+		// don't move when they do, so they stay valid here. The other dictionary's
+		// copies of them don't, so it's emptied.
+		mCoeffs = other.mCoeffs;
+		mVectors = other.mVectors;
+		mOwnedCoeffs = std::move( other.mOwnedCoeffs );
+		mOwnedVectors = std::move( other.mOwnedVectors );
+		mMapping = std::move( other.mMapping );
+		mView = other.mView;
+		mLookup = std::move( other.mLookup );
+		mHashState = other.mHashState;
+		mId = other.mId;
+		other.clear();
+		return *this;
+	}
+
+	uint32_t IGASharedDictionary::addCoeffs( const double *coeffs, size_t coeff_count )
+	{
+		// The same checks as IGACreator::getDictionaryIndex, plus the limit on the
+		// s_order of the piece that records the vector.
+		for( size_t icoeff = 0; icoeff < coeff_count; ++icoeff )
+			if( !finite( coeffs[ icoeff ] ) )
+				return INVALID_INDEX;
+		if( coeff_count > 0x7FFF )
+			return INVALID_INDEX;
+
+		uint64_t hash = CoeffHashLookup::hashCoeffs( coeffs, coeff_count );
+		uint32_t found_index = mLookup.find( mCoeffs, coeffs, coeff_count, hash );
+		if( found_index != INVALID_INDEX )
+			return found_index;
+
+		makeOwned();
+		if( mOwnedCoeffs.size() + coeff_count >= INVALID_INDEX || mOwnedVectors.size() >= INVALID_INDEX - 1 )
+			return INVALID_INDEX;
+		uint32_t new_index = static_cast< uint32_t >( mOwnedCoeffs.size() );
+		mOwnedCoeffs.insert( mOwnedCoeffs.end(), coeffs, coeffs + coeff_count );
+		Piece2D vector;
+		vector.st_order = static_cast< uint32_t >( coeff_count ) | ( 1u << 16 );
+		vector.s_index = new_index;
+		vector.maybe_t_index = INVALID_INDEX;
+		vector.pt_index = INVALID_INDEX;
+		mOwnedVectors.push_back( vector );
+		mCoeffs = mOwnedCoeffs;
+		mVectors = mOwnedVectors;
+
+		mLookup.insert( hash, new_index, static_cast< uint32_t >( coeff_count ) );
+		mHashState = mixCoeffs( mHashState, coeffs, coeff_count );
+		mId = finishHash( mHashState, mCoeffs.size() );
+		return new_index;
+	}
+
+	bool IGASharedDictionary::addModel( const IGADataView &data )
+	{
+		IGASpan< double > coeffs = data.coeffs();
+		for( const Piece2D &piece : data.pieces() )
+		{
+			size_t s_order = piece.st_order & 0xFFFF;
+			size_t t_order = piece.st_order >> 16;
+			if( piece.maybe_t_index == INVALID_INDEX )
+			{
+				if( piece.s_index > coeffs.size() || s_order * t_order > coeffs.size() - piece.s_index ||
+					addCoeffs( coeffs.data() + piece.s_index, s_order * t_order ) == INVALID_INDEX )
+					return false;
+				continue;
+			}
+			if( piece.s_index > coeffs.size() || s_order > coeffs.size() - piece.s_index ||
+				piece.maybe_t_index > coeffs.size() || t_order > coeffs.size() - piece.maybe_t_index )
+				return false;
+			if( addCoeffs( coeffs.data() + piece.s_index, s_order ) == INVALID_INDEX ||
+				addCoeffs( coeffs.data() + piece.maybe_t_index, t_order ) == INVALID_INDEX )
+				return false;
+		}
+		return true;
+	}
+
+	bool IGASharedDictionary::attach( IGASpan< double > coeffs, IGASpan< Piece2D > vectors )
+	{
+		mCoeffs = coeffs;
+		mVectors = vectors;
+		mLookup.clear();
+		if( coeffs.size() >= INVALID_INDEX || vectors.size() >= INVALID_INDEX )
+		{
+			clear();
+			return false;
+		}
+		for( const Piece2D &vector : vectors )
+		{
+			uint32_t length = vector.st_order & 0xFFFF;
+			if( vector.maybe_t_index != INVALID_INDEX || ( vector.st_order >> 16 ) != 1 ||
+				vector.s_index > coeffs.size() || length > coeffs.size() - vector.s_index )
+			{
+				clear();
+				return false;
+			}
+			const double *start = coeffs.data() + vector.s_index;
+			mLookup.insert( CoeffHashLookup::hashCoeffs( start, length ), vector.s_index, length );
+		}
+		for( double coeff : coeffs )
+		{
+			if( !finite( coeff ) )
+			{
+				clear();
+				return false;
+			}
+		}
+		mHashState = mixCoeffs( HASH_SEED, coeffs.data(), coeffs.size() );
+		mId = finishHash( mHashState, coeffs.size() );
+		return true;
+	}
+
+	void IGASharedDictionary::clear()
+	{
+		mCoeffs = IGASpan< double >();
+		mVectors = IGASpan< Piece2D >();
+		mOwnedCoeffs.clear();
+		mOwnedVectors.clear();
+		mView.clear();
+		mMapping.reset();
+		mLookup.clear();
+		mHashState = HASH_SEED;
+		mId = finishHash( mHashState, 0 );
+	}
+
+	uint32_t IGASharedDictionary::find( const double *coeffs, size_t coeff_count ) const
+	{
+		return mLookup.find( mCoeffs, coeffs, coeff_count, CoeffHashLookup::hashCoeffs( coeffs, coeff_count ) );
+	}
+
+	void IGASharedDictionary::makeOwned()
+	{
+		if( !mMapping )
+			return;
+		mOwnedCoeffs.assign( mCoeffs.begin(), mCoeffs.end() );
+		mOwnedVectors.assign( mVectors.begin(), mVectors.end() );
+		mCoeffs = mOwnedCoeffs;
+		mVectors = mOwnedVectors;
+		mView.clear();
+		mMapping.reset();
+	}
+
+	bool IGASharedDictionary::open( const char *filename )
+	{
+		clear();
+		std::unique_ptr< IGAMappedReader > mapping( new IGAMappedReader );
+		if( !mapping->open( filename ) || !mapping->readIGAView( mView, BLOCK_VECDICT | BLOCK_2DPIECE ) ||
+			mView.surfaceType() != SURFACE_TYPE )
+		{
+			clear();
+			return false;
+		}
+		mMapping = std::move( mapping );
+		return attach( mView.coeffs(), mView.pieces() );
+	}
+
+	bool IGASharedDictionary::read( IGAReader &reader )
+	{
+		clear();
+		IGAData data;
+		if( !reader.readIGAFile( data, BLOCK_VECDICT | BLOCK_2DPIECE ) || data.surfaceType() != SURFACE_TYPE )
+			return false;
+		mOwnedCoeffs = data.coeffs();
+		mOwnedVectors = data.pieces();
+		return attach( mOwnedCoeffs, mOwnedVectors );
+	}
+
+	bool IGASharedDictionary::write( IGAWriter &writer ) const
+	{
+		IGAData data;
+		IGACreator creator( &data );
+		creator.setSurfaceType( SURFACE_TYPE );
+		creator.reserve( 0, mVectors.size(), 0, 0, mCoeffs.size() );
+
+		// addCoeffs takes at most one vector's worth of coefficients at a time.
+		const size_t chunk_size = 0x4000;
+		for( size_t icoeff = 0; icoeff < mCoeffs.size(); icoeff += chunk_size )
+		{
+			size_t count = std::min( chunk_size, mCoeffs.size() - icoeff );
+			if( creator.addCoeffs( mCoeffs.data() + icoeff, count ) == INVALID_INDEX )
+				return false;
+		}
+		if( !mVectors.empty() && creator.addPieces( mVectors.data(), mVectors.size() ) == INVALID_INDEX )
+			return false;
+		return writer.writeIGAFile( data );
+	}
+}
@@ -0,0 +1,453 @@
+// Copyright 2020 Autodesk, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 ( the "License" );
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+// http ://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iga/IGATessellator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "iga/IGAAdjacency.h"
+#include "iga/IGAParallel.h"
+
+namespace iga_fileio
+{
+	namespace
+	{
+		// Planning an element may sample its curvature, and triangulating it
+		// evaluates every vertex, so a few dozen elements are plenty for a range.
+		// Settling an edge's segment count is a couple of lookups, so ranges of
+		// edges must be much longer.
+		const size_t MIN_ELEMS_PER_RANGE = 64;
+		const size_t MIN_EDGES_PER_RANGE = 4096;
+
+		// For chord_tolerance, each element is sampled on a grid with this many
+		// cells each way, plus the midpoints of the cells.
+		const int SAMPLE_CELLS = 4;
+		const int SAMPLE_POINTS = 2 * SAMPLE_CELLS + 1;
+
+		// The fewest segments each way. With two, an element has a vertex inside it
+		// for its sides to be joined to.
+		const int MIN_SEGMENTS = 2;
+
+		// The most segments each way, which keeps an element's vertex count well
+		// within 32 bits.
+		const int MAX_SEGMENTS = 4096;
+
+		// Converts a number of segments each way to an integer between MIN_SEGMENTS
+		// and MAX_SEGMENTS. A count that isn't finite, as when evaluating an element
+		// gives NANs or infinities, becomes MIN_SEGMENTS.
+		uint32_t segmentCount( double segments )
+		{
+			if( !finite( segments ) )
+				return MIN_SEGMENTS;
+			return static_cast< uint32_t >( std::min( std::max( segments, double( MIN_SEGMENTS ) ), double( MAX_SEGMENTS ) ) );
+		}
+
+		// The parameters of the point a fraction f of the way along a side, going
+		// counter-clockwise around the element.
+		void sideParams( int side, double f, double &s, double &t )
+		{
+			switch( side )
+			{
+			case 0: s = f; t = 0; break;
+			case 1: s = 1; t = f; break;
+			case 2: s = 1 - f; t = 1; break;
+			default: s = 0; t = 1 - f; break;
+			}
+		}
+
+		double distance( const Vector3d &a, const Vector3d &b )
+		{
+			double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+			return std::sqrt( dx * dx + dy * dy + dz * dz );
+		}
+
+		// The number of segments needed for an element to stay within 'tolerance' of
+		// the surface along s (or along t, if 'along_t'), given the samples. The
+		// distance from a curve to its chord grows with the square of the chord's
+		// length, so the distance of each sampled midpoint from its cell's chord
+		// says how much smaller the cells must be.
+		double segmentsNeeded( const Vector3d *samples, bool along_t, double tolerance )
+		{
+			double deviation = 0;
+			for( int row = 0; row < SAMPLE_POINTS; row += 2 )
+			{
+				for( int cell = 0; cell < SAMPLE_CELLS; ++cell )
+				{
+					int stride = along_t ? SAMPLE_POINTS : 1;
+					int first = along_t ? row + 2 * cell * SAMPLE_POINTS : 2 * cell + row * SAMPLE_POINTS;
+					const Vector3d &a = samples[ first ], &mid = samples[ first + stride ], &b = samples[ first + 2 * stride ];
+					Vector3d chord_mid = { ( a.x + b.x ) / 2, ( a.y + b.y ) / 2, ( a.z + b.z ) / 2 };
+					deviation = std::max( deviation, distance( mid, chord_mid ) );
+				}
+			}
+			return std::ceil( SAMPLE_CELLS * std::sqrt( deviation / tolerance ) );
+		}
+
+		// Triangulates the strip between part of an element's boundary and the row
+		// of grid vertices just inside it, where both run in the same direction and
+		// are parameterized from 0 to 1 along the side. Each step advances whichever
+		// row has the nearer next vertex. This adds outer_count + inner_count - 2
+		// triangles.
+		void stitchStrip( const uint32_t *outer, const double *outer_f, size_t outer_count,
+			const uint32_t *inner, const double *inner_f, size_t inner_count, uint32_t *&out )
+		{
+			size_t iouter = 0, iinner = 0;
+			while( iouter + 1 < outer_count || iinner + 1 < inner_count )
+			{
+				bool advance_outer = iinner + 1 >= inner_count ||
+					( iouter + 1 < outer_count && outer_f[ iouter + 1 ] <= inner_f[ iinner + 1 ] );
+				*out++ = outer[ iouter ];
+				if( advance_outer )
+				{
+					*out++ = outer[ iouter + 1 ];
+					*out++ = inner[ iinner ];
+					++iouter;
+				}
+				else
+				{
+					*out++ = inner[ iinner + 1 ];
+					*out++ = inner[ iinner ];
+					++iinner;
+				}
+			}
+		}
+	}
+
+	bool IGATessellator::plan( const IGAData &data, const IGATessellationOptions &options, unsigned thread_count )
+	{
+		mData = IGADataView();
+		mAdjacency = nullptr;
+		mElems.clear();
+		mEdges.clear();
+		mVertexCount = 0;
+		bool adaptive = options.chord_tolerance > 0;
+		if( !( options.chord_tolerance >= 0 ) || ( !adaptive && options.segments < 1 ) ||
+			( adaptive && ( options.min_segments < 1 || options.max_segments < options.min_segments ) ) )
+			return false;
+
+		const IGAAdjacency &adjacency = data.adjacency( thread_count );
+		uint32_t elem_count = data.elemCount();
+		uint32_t edge_count = data.edgeCount();
+		mData = data;
+		mAdjacency = &adjacency;
+		mElems.resize( elem_count );
+		mEdges.resize( edge_count );
+
+		// Choose how finely to divide each element, and divide each side among its
+		// edges according to their knot intervals.
+		std::vector< uint32_t > edge_segments( edge_count );
+		std::vector< uint32_t > next_edges( edge_count );
+		parallelRanges( elem_count, MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			IGAEvaluator evaluator( mData );
+			double s[ SAMPLE_POINTS * SAMPLE_POINTS ], t[ SAMPLE_POINTS * SAMPLE_POINTS ];
+			Vector3d samples[ SAMPLE_POINTS * SAMPLE_POINTS ];
+			for( int j = 0; j < SAMPLE_POINTS; ++j )
+			{
+				for( int i = 0; i < SAMPLE_POINTS; ++i )
+				{
+					s[ i + j * SAMPLE_POINTS ] = double( i ) / ( SAMPLE_POINTS - 1 );
+					t[ i + j * SAMPLE_POINTS ] = double( j ) / ( SAMPLE_POINTS - 1 );
+				}
+			}
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				uint32_t elem_index = static_cast< uint32_t >( ielem );
+				ElemPlan &elem = mElems[ ielem ];
+				double s_segments = options.segments, t_segments = options.segments;
+				if( adaptive )
+				{
+					s_segments = t_segments = options.max_segments;
+					if( evaluator.evaluate( elem_index, s, t, SAMPLE_POINTS * SAMPLE_POINTS, samples ) )
+					{
+						s_segments = segmentsNeeded( samples, false, options.chord_tolerance );
+						t_segments = segmentsNeeded( samples, true, options.chord_tolerance );
+					}
+					s_segments = std::min( std::max( s_segments, double( options.min_segments ) ), double( options.max_segments ) );
+					t_segments = std::min( std::max( t_segments, double( options.min_segments ) ), double( options.max_segments ) );
+				}
+				elem.s_segments = segmentCount( s_segments );
+				elem.t_segments = segmentCount( t_segments );
+
+				uint32_t edge_begin = adjacency.edgeBegin( elem_index ), edge_end = adjacency.edgeEnd( elem_index );
+				for( uint32_t side_begin = edge_begin; side_begin < edge_end; )
+				{
+					int side = adjacency.side( side_begin );
+					uint32_t side_end = side_begin;
+					double total = 0;
+					for( ; side_end < edge_end && adjacency.side( side_end ) == side; ++side_end )
+						total += data.edgeInterval( side_end );
+					bool by_interval = total > 0 && finite( total );
+					double along = 0;
+					double side_segments = side % 2 == 0 ? elem.s_segments : elem.t_segments;
+					for( uint32_t iedge = side_begin; iedge < side_end; ++iedge )
+					{
+						EdgePlan &edge = mEdges[ iedge ];
+						edge.begin = along / ( by_interval ? total : side_end - side_begin );
+						along += by_interval ? std::max( data.edgeInterval( iedge ), 0.0 ) : 1.0;
+						edge.end = iedge + 1 == side_end ? 1.0 : along / ( by_interval ? total : side_end - side_begin );
+						double segments = std::ceil( side_segments * ( edge.end - edge.begin ) - 1e-9 );
+						edge_segments[ iedge ] = static_cast< uint32_t >( std::max( segments, 1.0 ) );
+						next_edges[ iedge ] = iedge + 1 == edge_end ? edge_begin : iedge + 1;
+					}
+					side_begin = side_end;
+				}
+			}
+		} );
+
+		// The two edges of a pair take the finer division of the two.
+		parallelRanges( edge_count, MIN_EDGES_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			for( size_t iedge = begin; iedge < end; ++iedge )
+			{
+				uint32_t twin = adjacency.reverseEdge( static_cast< uint32_t >( iedge ) );
+				uint32_t segments = edge_segments[ iedge ];
+				if( twin != INVALID_INDEX )
+					segments = std::max( segments, edge_segments[ twin ] );
+				mEdges[ iedge ].segments = segments;
+			}
+		} );
+
+		// Find the vertices where edges meet. The start of an edge is the end of the
+		// edge it's paired with, which is the start of the edge after that one, so
+		// those are joined with a union-find over the edge starts. Each set is named
+		// after its lowest edge, which evaluates the vertex.
+		std::vector< uint32_t > roots( edge_count );
+		for( uint32_t iedge = 0; iedge < edge_count; ++iedge )
+			roots[ iedge ] = iedge;
+		auto find = [&]( uint32_t edge_index ) {
+			uint32_t root = edge_index;
+			while( roots[ root ] != root )
+				root = roots[ root ];
+			while( roots[ edge_index ] != root )
+			{
+				uint32_t next = roots[ edge_index ];
+				roots[ edge_index ] = root;
+				edge_index = next;
+			}
+			return root;
+		};
+		for( uint32_t iedge = 0; iedge < edge_count; ++iedge )
+		{
+			uint32_t twin = adjacency.reverseEdge( iedge );
+			if( twin == INVALID_INDEX )
+				continue;
+			uint32_t a = find( iedge ), b = find( next_edges[ twin ] );
+			if( a < b )
+				roots[ b ] = a;
+			else if( b < a )
+				roots[ a ] = b;
+		}
+
+		// Number the vertices, as described for the class.
+		size_t vertex_count = 0;
+		for( uint32_t iedge = 0; iedge < edge_count; ++iedge )
+		{
+			EdgePlan &edge = mEdges[ iedge ];
+			uint32_t root = find( iedge );
+			edge.owns_point = root == iedge;
+			if( edge.owns_point )
+				edge.point = static_cast< uint32_t >( vertex_count++ );
+			else
+				edge.point = mEdges[ root ].point;
+		}
+		for( uint32_t iedge = 0; iedge < edge_count && vertex_count < INVALID_INDEX; ++iedge )
+		{
+			EdgePlan &edge = mEdges[ iedge ];
+			uint32_t twin = adjacency.reverseEdge( iedge );
+			edge.owns_interior = twin == INVALID_INDEX || iedge < twin;
+			if( edge.owns_interior )
+			{
+				edge.interior_begin = static_cast< uint32_t >( vertex_count );
+				vertex_count += edge.segments - 1;
+			}
+			else
+				edge.interior_begin = mEdges[ twin ].interior_begin;
+		}
+		size_t triangle_count = 0;
+		for( uint32_t ielem = 0; ielem < elem_count && vertex_count < INVALID_INDEX; ++ielem )
+		{
+			ElemPlan &elem = mElems[ ielem ];
+			uint32_t edge_begin = adjacency.edgeBegin( ielem ), edge_end = adjacency.edgeEnd( ielem );
+			elem.vertex_begin = static_cast< uint32_t >( vertex_count );
+			if( edge_begin < edge_end )
+			{
+				// The grid inside the element, then the strips around it.
+				size_t inner_s = elem.s_segments - 2, inner_t = elem.t_segments - 2;
+				vertex_count += ( inner_s + 1 ) * ( inner_t + 1 );
+				triangle_count += 2 * inner_s * inner_t + 2 * inner_s + 2 * inner_t;
+				for( uint32_t iedge = edge_begin; iedge < edge_end; ++iedge )
+					triangle_count += mEdges[ iedge ].segments;
+			}
+			elem.triangle_end = triangle_count;
+		}
+		if( vertex_count >= INVALID_INDEX )
+		{
+			mData = IGADataView();
+			mAdjacency = nullptr;
+			mElems.clear();
+			mEdges.clear();
+			return false;
+		}
+		mVertexCount = vertex_count;
+		return true;
+	}
+
+	bool IGATessellator::tessellate( Vector3d *positions, Vector3d *normals, uint32_t *indices, unsigned thread_count ) const
+	{
+		if( !mAdjacency )
+			return false;
+
+		uint32_t elem_count = static_cast< uint32_t >( mElems.size() );
+		parallelRanges( elem_count, MIN_ELEMS_PER_RANGE, thread_count, [&]( size_t begin, size_t end ) {
+			IGAEvaluator evaluator( mData );
+			std::vector< double > s, t;
+			std::vector< uint32_t > ids;
+			std::vector< Vector3d > points, s_derivs, t_derivs;
+			std::vector< uint32_t > ring, outer, inner;
+			std::vector< double > ring_f, outer_f, inner_f;
+			std::vector< int > ring_sides;
+			auto addSample = [&]( double s_param, double t_param, uint32_t id ) {
+				s.push_back( s_param );
+				t.push_back( t_param );
+				ids.push_back( id );
+			};
+			for( size_t ielem = begin; ielem < end; ++ielem )
+			{
+				uint32_t elem_index = static_cast< uint32_t >( ielem );
+				const ElemPlan &elem = mElems[ ielem ];
+				uint32_t edge_begin = mAdjacency->edgeBegin( elem_index ), edge_end = mAdjacency->edgeEnd( elem_index );
+				if( edge_begin == edge_end )
+					continue;
+				uint32_t s_segments = elem.s_segments, t_segments = elem.t_segments;
+				uint32_t inner_s = s_segments - 1, inner_t = t_segments - 1;
+				auto innerVertex = [&]( uint32_t i, uint32_t j ) { return elem.vertex_begin + ( i - 1 ) + ( j - 1 ) * inner_s; };
+
+				// Evaluate the vertices this element owns: those at the starts and
+				// inside of some of its edges, and all of those inside it.
+				s.clear();
+				t.clear();
+				ids.clear();
+				double s_param, t_param;
+				for( uint32_t iedge = edge_begin; iedge < edge_end; ++iedge )
+				{
+					const EdgePlan &edge = mEdges[ iedge ];
+					int side = mAdjacency->side( iedge );
+					if( edge.owns_point )
+					{
+						sideParams( side, edge.begin, s_param, t_param );
+						addSample( s_param, t_param, edge.point );
+					}
+					if( edge.owns_interior )
+					{
+						for( uint32_t iseg = 1; iseg < edge.segments; ++iseg )
+						{
+							sideParams( side, edge.begin + ( edge.end - edge.begin ) * iseg / edge.segments, s_param, t_param );
+							addSample( s_param, t_param, edge.interior_begin + iseg - 1 );
+						}
+					}
+				}
+				for( uint32_t j = 1; j <= inner_t; ++j )
+					for( uint32_t i = 1; i <= inner_s; ++i )
+						addSample( double( i ) / s_segments, double( j ) / t_segments, innerVertex( i, j ) );
+				points.resize( ids.size() );
+				s_derivs.resize( normals ? ids.size() : 0 );
+				t_derivs.resize( normals ? ids.size() : 0 );
+				evaluator.evaluate( elem_index, s.data(), t.data(), ids.size(), points.data(),
+					normals ? s_derivs.data() : nullptr, normals ? t_derivs.data() : nullptr );
+				for( size_t isample = 0; isample < ids.size(); ++isample )
+				{
+					positions[ ids[ isample ] ] = points[ isample ];
+					if( !normals )
+						continue;
+					const Vector3d &ds = s_derivs[ isample ], &dt = t_derivs[ isample ];
+					Vector3d normal = { ds.y * dt.z - ds.z * dt.y, ds.z * dt.x - ds.x * dt.z, ds.x * dt.y - ds.y * dt.x };
+					double length = std::sqrt( normal.x * normal.x + normal.y * normal.y + normal.z * normal.z );
+					if( length > 0 )
+						normal = { normal.x / length, normal.y / length, normal.z / length };
+					normals[ ids[ isample ] ] = normal;
+				}
+
+				// Collect the vertices around the boundary, counter-clockwise. An edge
+				// paired with a lower edge runs through that edge's vertices backwards.
+				ring.clear();
+				ring_f.clear();
+				ring_sides.clear();
+				for( uint32_t iedge = edge_begin; iedge < edge_end; ++iedge )
+				{
+					const EdgePlan &edge = mEdges[ iedge ];
+					int side = mAdjacency->side( iedge );
+					for( uint32_t iseg = 0; iseg < edge.segments; ++iseg )
+					{
+						if( iseg == 0 )
+							ring.push_back( edge.point );
+						else if( edge.owns_interior )
+							ring.push_back( edge.interior_begin + iseg - 1 );
+						else
+							ring.push_back( edge.interior_begin + ( edge.segments - iseg ) - 1 );
+						ring_f.push_back( edge.begin + ( edge.end - edge.begin ) * iseg / edge.segments );
+						ring_sides.push_back( side );
+					}
+				}
+
+				uint32_t *out = indices + 3 * elemTriangleBegin( elem_index );
+				for( uint32_t j = 1; j < inner_t; ++j )
+				{
+					for( uint32_t i = 1; i < inner_s; ++i )
+					{
+						uint32_t a = innerVertex( i, j ), b = innerVertex( i + 1, j );
+						uint32_t c = innerVertex( i + 1, j + 1 ), d = innerVertex( i, j + 1 );
+						*out++ = a; *out++ = b; *out++ = c;
+						*out++ = a; *out++ = c; *out++ = d;
+					}
+				}
+
+				// Join each side to the row of the grid inside it. A side's part of the
+				// ring ends at the first vertex of the next side.
+				size_t ring_size = ring.size(), side_begin = 0;
+				for( int side = 0; side < 4; ++side )
+				{
+					size_t side_end = side_begin;
+					while( side_end < ring_size && ring_sides[ side_end ] == side )
+						++side_end;
+					outer.assign( ring.begin() + side_begin, ring.begin() + side_end );
+					outer_f.assign( ring_f.begin() + side_begin, ring_f.begin() + side_end );
+					outer.push_back( ring[ side_end % ring_size ] );
+					outer_f.push_back( 1.0 );
+
+					inner.clear();
+					inner_f.clear();
+					bool along_s = side % 2 == 0;
+					uint32_t inner_count = along_s ? inner_s : inner_t;
+					uint32_t segments = along_s ? s_segments : t_segments;
+					for( uint32_t k = 1; k <= inner_count; ++k )
+					{
+						// k counts along the side, counter-clockwise.
+						uint32_t forward = side < 2 ? k : inner_count + 1 - k;
+						switch( side )
+						{
+						case 0: inner.push_back( innerVertex( forward, 1 ) ); break;
+						case 1: inner.push_back( innerVertex( inner_s, forward ) ); break;
+						case 2: inner.push_back( innerVertex( forward, inner_t ) ); break;
+						default: inner.push_back( innerVertex( 1, forward ) ); break;
+						}
+						inner_f.push_back( double( k ) / segments );
+					}
+					stitchStrip( outer.data(), outer_f.data(), outer.size(), inner.data(), inner_f.data(), inner.size(), out );
+					side_begin = side_end;
+				}
+			}
+		} );
+		return true;
+	}
+}
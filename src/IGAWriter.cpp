@@ -14,55 +14,241 @@
 
 #include "iga/IGAWriter.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "iga/IGACodec.h"
 #include "iga/IGACommon.h"
 #include "iga/IGAData.h"
+#include "iga/IGASharedDictionary.h"
 
 namespace iga_fileio
 {
+	namespace
+	{
+		// The number of segments writeBlock queues before handing them to writeDataV.
+		// This bounds the memory used by the queue for files with many blocks.
+		const size_t MAX_QUEUED_SEGMENTS = 1024;
+	}
+
+	bool IGAWriter::writeDataV( const IGAWriteSegment *segments, size_t segment_count )
+	{
+		for( size_t isegment = 0; isegment < segment_count; ++isegment )
+		{
+			if( !writeData( segments[ isegment ].data, segments[ isegment ].length ) )
+				return false;
+		}
+		return true;
+	}
+
 	bool IGAWriter::writeBlock( const char *block_type, const char *contents, size_t length, uint64_t id )
 	{
+		QueuedBlock block;
 		// Block header
-		if( !writeData( "\nBLOCK:\n", 8 ) )
-			return false;
-		uint64_t tag = tagValue( block_type );
+		memcpy( block.header.block_tag, "\nBLOCK:\n", 8 );
 		// Block tag
-		if( !writeData( reinterpret_cast< const char * >( &tag ), 8 ) )
-			return false;
+		block.header.tag = tagValue( block_type );
 		// Block ID
-		if( !writeData( reinterpret_cast< const char * >( &id ), 8 ) )
+		block.header.id = id;
+		// Block prefix length. size_t isn't always 64 bits but we must have a 64-bit value.
+		block.header.block_len = length;
+		// Block postfix length
+		block.final_len = length;
+
+		if( !mQueueBlocks )
+		{
+			// Block header, contents, and postfix length.
+			IGAWriteSegment segments[ 3 ];
+			segments[ 0 ].data = reinterpret_cast< const char * >( &block.header );
+			segments[ 0 ].length = sizeof( BlockHeader );
+			segments[ 1 ].data = contents;
+			segments[ 1 ].length = length;
+			segments[ 2 ].data = reinterpret_cast< const char * >( &block.final_len );
+			segments[ 2 ].length = 8;
+			return writeDataV( segments, 3 );
+		}
+
+		mQueuedBlocks.push_back( block );
+		const QueuedBlock &queued = mQueuedBlocks.back();
+		IGAWriteSegment segment;
+		segment.data = reinterpret_cast< const char * >( &queued.header );
+		segment.length = sizeof( BlockHeader );
+		mQueue.push_back( segment );
+		if( length > 0 )
+		{
+			segment.data = contents;
+			segment.length = length;
+			mQueue.push_back( segment );
+		}
+		segment.data = reinterpret_cast< const char * >( &queued.final_len );
+		segment.length = 8;
+		mQueue.push_back( segment );
+
+		if( mQueue.size() >= MAX_QUEUED_SEGMENTS )
+			return flushBlocks();
+		return true;
+	}
+
+	bool IGAWriter::flushBlocks()
+	{
+		bool ok = mQueue.empty() || writeDataV( mQueue.data(), mQueue.size() );
+		mQueue.clear();
+		mQueuedBlocks.clear();
+		mPackedBlocks.clear();
+		mChecksums.clear();
+		mDictionaryRefs.clear();
+		return ok;
+	}
+
+	bool IGAWriter::writeFileBlock( const char *block_type, const char *contents, size_t length )
+	{
+		// A compressed block is always copied when it's read, so it doesn't need to
+		// be aligned. Its id holds the tag of the block inside it.
+		uint64_t id = 0;
+		if( mCompressBlocks )
+		{
+			std::vector< char > packed;
+			if( packBlock( tagValue( block_type ), contents, length, packed ) )
+			{
+				// Moving the vector into the deque doesn't move its contents, which
+				// must stay put until the queue is flushed.
+				mPackedBlocks.push_back( std::move( packed ) );
+				const std::vector< char > &stored = mPackedBlocks.back();
+				id = tagValue( block_type );
+				block_type = "PACKED";
+				contents = stored.data();
+				length = stored.size();
+			}
+		}
+
+		// The SRFTYPE block starts a model, so a CRC32C block before it would be
+		// grouped with the previous model by readIGAModels. Empty blocks have
+		// nothing to check.
+		if( mWriteChecksums && length > 0 && tagValue( block_type ) != tagValue( "SRFTYPE" ) )
+		{
+			if( !writeChecksumBlock( tagValue( block_type ), crc32c( 0, contents, length ) ) )
+				return false;
+		}
+		if( id != 0 )
+			return writeIndexedBlock( block_type, contents, length, id );
+
+		if( mAlignBlocks && length > 0 && !writeAlignment() )
 			return false;
-		// size_t isn't always 64 bits but we must have a 64-bit value.
-		uint64_t len64 = length;
-		// Block prefix length
-		if( !writeData( reinterpret_cast< const char * >( &len64 ), 8 ) )
+		return writeIndexedBlock( block_type, contents, length, 0 );
+	}
+
+	bool IGAWriter::writeStreamedBlock( const char *block_type, uint64_t length, uint32_t crc,
+		const std::function< bool( char *, size_t ) > &read_contents, char *buffer, size_t buffer_size )
+	{
+		if( mWriteChecksums && length > 0 && !writeChecksumBlock( tagValue( block_type ), crc ) )
 			return false;
-		// Block contents
-		if( !writeData( contents, length ) )
+		if( mAlignBlocks && length > 0 && !writeAlignment() )
 			return false;
-		// Block postfix length
-		if( !writeData( reinterpret_cast< const char * >( &len64 ), 8 ) )
+
+		// The contents go straight to writeDataV, so anything queued must go first.
+		if( !flushBlocks() )
 			return false;
+		BlockHeader header;
+		memcpy( header.block_tag, "\nBLOCK:\n", 8 );
+		header.tag = tagValue( block_type );
+		header.id = 0;
+		header.block_len = length;
+		IGAWriteSegment segment;
+		segment.data = reinterpret_cast< const char * >( &header );
+		segment.length = sizeof( BlockHeader );
+		if( !writeDataV( &segment, 1 ) )
+			return false;
+		for( uint64_t written = 0; written < length; )
+		{
+			segment.data = buffer;
+			segment.length = static_cast< size_t >( std::min< uint64_t >( buffer_size, length - written ) );
+			if( !read_contents( buffer, segment.length ) || !writeDataV( &segment, 1 ) )
+				return false;
+			written += segment.length;
+		}
+		segment.data = reinterpret_cast< const char * >( &header.block_len );
+		segment.length = 8;
+		if( !writeDataV( &segment, 1 ) )
+			return false;
+
+		BlockIndexEntry entry;
+		entry.tag = header.tag;
+		entry.id = 0;
+		entry.offset = mOffset;
+		entry.block_len = length;
+		mIndex.push_back( entry );
+		mOffset += sizeof( BlockHeader ) + length + 8;
 		return true;
 	}
-	
-	bool IGAWriter::writeIGAFile( const IGAData &geometry )
+
+	bool IGAWriter::writeChecksumBlock( uint64_t tag, uint32_t crc )
 	{
-		#define WRITE_BLOCK( NAME, GETTER, TYPE ) \
-		if( !writeBlock( NAME, reinterpret_cast< const char * >( geometry. GETTER ().data() ), geometry. GETTER ().size() * sizeof( TYPE ) ) ) return false
+		ChecksumBlock checksum;
+		checksum.tag = tag;
+		checksum.crc = crc;
+		mChecksums.push_back( checksum );
+		return writeIndexedBlock( "CRC32C", reinterpret_cast< const char * >( &mChecksums.back() ), sizeof( ChecksumBlock ), 0 );
+	}
 
-		// Write TSS header
-		if( !writeData( "#TSS0001", 8 ) )
-			return false;
+	bool IGAWriter::writeAlignment()
+	{
+		// Every block costs 40 bytes plus its contents, and 40 is a multiple of 8, so
+		// a PADDING block with 0..7 bytes of contents can move the next block's
+		// contents onto any 8-byte boundary.
+		const uint64_t alignment = 8;
+		uint64_t misalignment = ( mOffset + sizeof( BlockHeader ) ) % alignment;
+		if( misalignment == 0 )
+			return true;
+		// Static, since writeBlock may queue the contents rather than write them.
+		static const char zeros[ 8 ] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+		size_t pad_length = static_cast< size_t >( alignment - misalignment );
+		return writeIndexedBlock( "PADDING", zeros, pad_length, 0 );
+	}
 
-		// Write IGAFILE block
-		if( !writeBlock( "IGAFILE", "", 0 ) )
+	bool IGAWriter::writeIndexedBlock( const char *block_type, const char *contents, size_t length, uint64_t id )
+	{
+		if( !writeBlock( block_type, contents, length, id ) )
 			return false;
+		BlockIndexEntry entry;
+		entry.tag = tagValue( block_type );
+		entry.id = id;
+		entry.offset = mOffset;
+		entry.block_len = length;
+		mIndex.push_back( entry );
+		mOffset += sizeof( BlockHeader ) + length + 8;
+		return true;
+	}
 
-		// Write SRFTYPE block
+	bool IGAWriter::writeModelBlocks( const IGAData &geometry )
+	{
+		#define WRITE_BLOCK( NAME, GETTER, TYPE ) \
+		if( !writeFileBlock( NAME, reinterpret_cast< const char * >( geometry. GETTER ().data() ), geometry. GETTER ().size() * sizeof( TYPE ) ) ) return false
+
+		// Write SRFTYPE block. This marks the start of the model.
 		WRITE_BLOCK( "SRFTYPE", surfaceType, char );
 
-		// Write VECDICT block
-		WRITE_BLOCK( "VECDICT", coeffs, double );
+		// Write DICTREF block if the coefficients start with a shared dictionary,
+		// and the VECDICT block with the rest of them.
+		if( geometry.sharedDictionary() )
+		{
+			SharedDictionaryRef ref;
+			ref.dict_id = geometry.sharedDictionary()->id();
+			ref.coeff_count = geometry.sharedDictionary()->coeffCount();
+			if( ref.coeff_count > geometry.coeffs().size() )
+				return false;
+			mDictionaryRefs.push_back( ref );
+			if( !writeFileBlock( "DICTREF", reinterpret_cast< const char * >( &mDictionaryRefs.back() ), sizeof( SharedDictionaryRef ) ) )
+				return false;
+			size_t shared_count = static_cast< size_t >( ref.coeff_count );
+			if( !writeFileBlock( "VECDICT", reinterpret_cast< const char * >( geometry.coeffs().data() + shared_count ),
+				( geometry.coeffs().size() - shared_count ) * sizeof( double ) ) )
+				return false;
+		}
+		else
+		{
+			// Write VECDICT block
+			WRITE_BLOCK( "VECDICT", coeffs, double );
+		}
 
 		// Write PT3DW block
 		WRITE_BLOCK( "PT3DW", points, Point3d );
@@ -85,8 +271,60 @@ namespace iga_fileio
 		// Write SHAPE block
 		WRITE_BLOCK( "SHAPE", elems, Elem );
 
+		#undef WRITE_BLOCK
+		return true;
+	}
+
+	bool IGAWriter::writeModels( const IGAData *const *models, size_t model_count )
+	{
+		bool ok = beginFile();
+
+		// Write each model's blocks
+		for( size_t imodel = 0; ok && imodel < model_count; ++imodel )
+			ok = writeModelBlocks( *models[ imodel ] );
+
+		return finishFile( ok );
+	}
+
+	bool IGAWriter::beginFile()
+	{
+		// Write TSS header
+		if( !writeData( "#TSS0001", 8 ) )
+			return false;
+		mOffset = 8;
+		mIndex.clear();
+
+		// The blocks are queued by writeBlock, and written by flushBlocks.
+		mQueueBlocks = true;
+
+		// Write IGAFILE block
+		return writeFileBlock( "IGAFILE", "", 0 );
+	}
+
+	bool IGAWriter::finishFile( bool ok )
+	{
+		// Write INDEX block, which must be last.
+		if( ok && mWriteIndex )
+			ok = writeBlock( "INDEX", reinterpret_cast< const char * >( mIndex.data() ), mIndex.size() * sizeof( BlockIndexEntry ) );
+
+		ok = flushBlocks() && ok;
+		mQueueBlocks = false;
+		if( !ok )
+			return false;
+
 		writeFinished();
 
 		return true;
 	}
+
+	bool IGAWriter::writeIGAFile( const IGAData &geometry )
+	{
+		const IGAData *models[ 1 ] = { &geometry };
+		return writeModels( models, 1 );
+	}
+
+	bool IGAWriter::writeIGAModels( const std::vector< const IGAData * > &models )
+	{
+		return writeModels( models.data(), models.size() );
+	}
 }
\ No newline at end of file
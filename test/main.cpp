@@ -12,10 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <random>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <utility>
 #include "iga/IGAFileIO.h"
 
 using std::cerr;
@@ -23,6 +27,9 @@ using std::cout;
 using std::endl;
 
 bool verbose = false;
+bool all_errors = false;
+bool compress = false;
+bool checksums = false;
 
 // A class to let you read IGA files using standard istreams. You can load
 // IGA data from any type for which you can implement this reader interface.
@@ -33,6 +40,12 @@ public:
 
 	bool readData( char *destination, size_t length ) override;
 
+	bool skipData( uint64_t length ) override;
+
+	bool seekData( uint64_t offset ) override;
+
+	uint64_t sourceSize() override;
+
 	void readFinished() override
 	{
 		if( verbose )
@@ -53,6 +66,32 @@ bool IGAStreamReader::readData( char *destination, size_t length )
 	return mStream->gcount() == length;
 }
 
+bool IGAStreamReader::skipData( uint64_t length )
+{
+	// Seeking is much cheaper than reading, which is what the default implementation does.
+	mStream->seekg( length, std::ios::cur );
+	return !mStream->fail();
+}
+
+bool IGAStreamReader::seekData( uint64_t offset )
+{
+	// A failed read sets eofbit, which would make the seek fail.
+	mStream->clear();
+	mStream->seekg( offset, std::ios::beg );
+	return !mStream->fail();
+}
+
+uint64_t IGAStreamReader::sourceSize()
+{
+	// Returning 0 tells the reader that we don't know the size.
+	std::streampos position = mStream->tellg();
+	if( position < 0 || !mStream->seekg( 0, std::ios::end ) )
+		return 0;
+	std::streampos size = mStream->tellg();
+	mStream->seekg( position );
+	return size < 0 ? 0 : static_cast< uint64_t >( size );
+}
+
 // A class to let you write IGA files using standard ostreams. You can write
 // IGA data to any type for which you can implement this writer interface.
 class IGAStreamWriter: public iga_fileio::IGAWriter
@@ -82,7 +121,7 @@ bool IGAStreamWriter::writeData( const char *data_block, size_t length )
 	return mStream->good();
 }
 
-void printVerboseIGA( const iga_fileio::IGAData &iga, std::ostream &o )
+void printVerboseIGA( const iga_fileio::IGADataView &iga, std::ostream &o )
 {
 	// This output was written using only ostream to avoid a dependency on std::fmt,
 	// which is not yet widely available.
@@ -143,38 +182,1021 @@ void printVerboseIGA( const iga_fileio::IGAData &iga, std::ostream &o )
 	}
 }
 
-int main( int argc, char **argv )
+// Demonstrates how to look at an IGA file without copying it, by viewing it in
+// place through a memory mapping.
+// Checks the IGA data, printing the first problem found, or every problem if
+// --all-errors was passed.
+bool checkIGA( const iga_fileio::IGADataView &iga )
 {
-	if( argc < 2 )
+	if( !all_errors )
+		return iga.isValid( cerr );
+
+	std::vector< iga_fileio::IGAValidationError > errors;
+	if( iga.validate( errors, true ) )
+		return true;
+	for( const iga_fileio::IGAValidationError &error : errors )
+		cerr << error.message << endl;
+	return false;
+}
+
+int viewMappedFile( const char *filename )
+{
+	iga_fileio::IGAMappedReader reader;
+	if( !reader.open( filename ) )
 	{
-		std::cerr << "Usage: " << argv[ 0 ] << " filename.iga [--verbose]" << endl;
-		return 1;
+		std::cerr << "Failed to map that file." << endl;
+		return 2;
 	}
 
-	if( argc > 2 && std::string( argv[ 2 ] ) == "--verbose" )
+	iga_fileio::IGADataView iga_view;
+	if( !reader.readIGAView( iga_view ) )
 	{
-		verbose = true;
+		std::cerr << "Failed to load valid data from that file." << endl;
+		return 3;
 	}
 
-	// Create a file stream using the passed filename.
-	std::ifstream in_file( argv[ 1 ], std::ios::in | std::ios::binary );
-	if( !in_file.good() )
+	if( !checkIGA( iga_view ) )
+	{
+		cerr << " ===== The IGA file is not valid." << endl;
+		return 4;
+	}
+	else
+		cout << "Mapped the IGA file; it contains " << iga_view.elemCount() << " elements." << endl;
+	if( verbose )
+		printVerboseIGA( iga_view, cout );
+	return 0;
+}
+
+int streamFile( const char *filename, const char *output_filename )
+{
+	iga_fileio::IGAAsyncFileReader reader;
+	if( !reader.open( filename ) )
 	{
 		std::cerr << "Failed to open that file." << endl;
-		std::cerr << "Usage: " << argv[ 0 ] << " filename.iga" << endl;
 		return 2;
 	}
 
-	// Use that file stream and our reader class to load some IGA data.
-	IGAStreamReader reader( in_file );
-	iga_fileio::IGAData iga_data;
-	if( !reader.readIGAFile( iga_data ) )
+	// Visit the elements one at a time, holding only a small part of the file in
+	// memory.
+	iga_fileio::IGAElementCursor cursor;
+	if( !cursor.open( reader ) )
 	{
+		std::cerr << cursor.error() << endl;
 		std::cerr << "Failed to load valid data from that file." << endl;
 		return 3;
 	}
 
-	if( !iga_data.isValid( cerr ) )
+	// If there's an output file, copy each element to it as we go. Like the
+	// cursor, IGAElementWriter only keeps the dictionaries in memory.
+	iga_fileio::IGAFileWriter file_writer;
+	file_writer.setCompressBlocks( compress );
+	file_writer.setWriteChecksums( checksums );
+	iga_fileio::IGAElementWriter elem_writer( file_writer );
+	elem_writer.setSurfaceType( cursor.surfaceType() );
+	bool copied = true;
+
+	iga_fileio::IGAStreamElem elem;
+	size_t piece_count = 0;
+	while( cursor.next( elem ) )
+	{
+		piece_count += elem.pieces.size();
+		if( !output_filename )
+			continue;
+		for( size_t ipiece = 0; ipiece < elem.pieces.size(); ++ipiece )
+		{
+			const iga_fileio::Piece2D &piece = elem.pieces[ ipiece ];
+			int s_order = piece.st_order & 0xFFFF, t_order = piece.st_order >> 16;
+			uint32_t pt_index = elem_writer.addPoint( elem.points[ ipiece ] );
+			if( piece.maybe_t_index == iga_fileio::INVALID_INDEX )
+				copied &= elem_writer.addExplicitPiece( s_order, pt_index, elem.pieceSCoeffs( ipiece ), s_order * t_order ) != iga_fileio::INVALID_INDEX;
+			else
+				copied &= elem_writer.addTensorPiece( elem.pieceSCoeffs( ipiece ), s_order, elem.pieceTCoeffs( ipiece ), t_order, pt_index ) != iga_fileio::INVALID_INDEX;
+		}
+		for( size_t iedge = 0; iedge < elem.edges.size(); ++iedge )
+			copied &= elem_writer.addEdge( elem.edges[ iedge ], elem.intervals.empty() ? -1.0 : elem.intervals[ iedge ] ) != iga_fileio::INVALID_INDEX;
+		copied &= elem_writer.finishElem( elem_writer.getLayoutIndex( elem.layout ) ) != iga_fileio::INVALID_INDEX;
+	}
+	if( cursor.failed() )
+	{
+		cerr << cursor.error() << endl;
+		cerr << " ===== The IGA file is not valid." << endl;
+		return 4;
+	}
+	cout << "Streamed the IGA file; it contains " << cursor.elemCount() << " elements with " << piece_count << " pieces." << endl;
+
+	if( output_filename &&
+		( !copied || !file_writer.open( output_filename ) || !elem_writer.finish() || !file_writer.close() ) )
+	{
+		cerr << "Writing " << output_filename << " failed." << endl;
+		return 5;
+	}
+	return 0;
+}
+
+// Adds the elements [elem_begin..elem_end) of 'iga' through 'creator', the way a
+// program building a model would: each piece gets its own point, and the
+// dictionaries are looked up as it goes.
+bool addElems( const iga_fileio::IGADataView &iga, uint32_t elem_begin, uint32_t elem_end, iga_fileio::IGACreator &creator )
+{
+	for( uint32_t ielem = elem_begin; ielem < elem_end; ++ielem )
+	{
+		for( uint32_t ipiece = iga.pieceBegin( ielem ); ipiece < iga.pieceEnd( ielem ); ++ipiece )
+		{
+			int s_order = iga.pieceSOrder( ipiece ), t_order = iga.pieceTOrder( ipiece );
+			uint32_t pt_index = creator.addPoint( iga.piecePoint( ipiece ) );
+			uint32_t added;
+			if( iga.pieceIsExplicit( ipiece ) )
+				added = creator.addExplicitPiece( s_order, pt_index, iga.pieceExplicitCoeffs( ipiece ), s_order * t_order );
+			else
+				added = creator.addTensorPiece( iga.pieceSCoeffs( ipiece ), s_order, iga.pieceTCoeffs( ipiece ), t_order, pt_index );
+			if( pt_index == iga_fileio::INVALID_INDEX || added == iga_fileio::INVALID_INDEX )
+				return false;
+		}
+		for( uint32_t iedge = iga.edgeBegin( ielem ); iedge < iga.edgeEnd( ielem ); ++iedge )
+		{
+			if( creator.addEdge( iga.edgeOther( iedge ), iga.intervals().empty() ? -1.0 : iga.edgeInterval( iedge ) ) == iga_fileio::INVALID_INDEX )
+				return false;
+		}
+		if( creator.finishElem( creator.getLayoutIndex( iga.layout( iga.layoutIndex( ielem ) ) ) ) == iga_fileio::INVALID_INDEX )
+			return false;
+	}
+	return true;
+}
+
+// Writes 'iga' to a string, so that two models can be compared byte for byte.
+std::string writeToString( const iga_fileio::IGAData &iga )
+{
+	std::stringstream out_stream;
+	IGAStreamWriter writer( out_stream );
+	if( !writer.writeIGAFile( iga ) )
+		return std::string();
+	return out_stream.str();
+}
+
+// Checks that IGACreator::appendShards gives the same file as adding every
+// element through one IGACreator, and that it accepts the loaded model itself
+// as a shard, both as it is and compacted. A compacted model that only uses the
+// default layout stores no layouts at all.
+int checkShards( const iga_fileio::IGAData &iga )
+{
+	iga_fileio::IGAData serial;
+	iga_fileio::IGACreator serial_creator( &serial );
+	serial_creator.setSurfaceType( iga.surfaceType() );
+	if( !addElems( iga, 0, iga.elemCount(), serial_creator ) )
+	{
+		cerr << "Building the model serially failed." << endl;
+		return 6;
+	}
+
+	// Split the elements into a few shards, each built on its own creator.
+	const uint32_t shard_count = 4;
+	std::vector< iga_fileio::IGAData > shards( shard_count );
+	std::vector< const iga_fileio::IGAData * > shard_pointers;
+	for( uint32_t ishard = 0; ishard < shard_count; ++ishard )
+	{
+		uint32_t elem_begin = static_cast< uint32_t >( uint64_t( iga.elemCount() ) * ishard / shard_count );
+		uint32_t elem_end = static_cast< uint32_t >( uint64_t( iga.elemCount() ) * ( ishard + 1 ) / shard_count );
+		iga_fileio::IGACreator shard_creator( &shards[ ishard ] );
+		if( !addElems( iga, elem_begin, elem_end, shard_creator ) )
+		{
+			cerr << "Building shard " << ishard << " failed." << endl;
+			return 6;
+		}
+		shard_pointers.push_back( &shards[ ishard ] );
+	}
+	iga_fileio::IGAData appended;
+	iga_fileio::IGACreator appended_creator( &appended );
+	appended_creator.setSurfaceType( iga.surfaceType() );
+	if( !appended_creator.appendShards( shard_pointers ) )
+	{
+		cerr << "Appending the shards failed." << endl;
+		return 6;
+	}
+	std::string serial_bytes = writeToString( serial );
+	if( serial_bytes.empty() || serial_bytes != writeToString( appended ) )
+	{
+		cerr << " ===== Appending the shards gave a different file from building the model serially." << endl;
+		return 6;
+	}
+
+	iga_fileio::IGAData compacted = iga;
+	if( !iga_fileio::compact( compacted ) )
+	{
+		cerr << "Compacting the model failed." << endl;
+		return 6;
+	}
+	for( const iga_fileio::IGAData *shard : { &iga, static_cast< const iga_fileio::IGAData * >( &compacted ) } )
+	{
+		iga_fileio::IGAData whole;
+		iga_fileio::IGACreator whole_creator( &whole );
+		whole_creator.setSurfaceType( iga.surfaceType() );
+		if( !whole_creator.appendShards( { shard } ) || !checkIGA( whole ) || whole.elemCount() != iga.elemCount() )
+		{
+			cerr << " ===== Appending the " << ( shard == &iga ? "loaded" : "compacted" ) << " model as a shard failed." << endl;
+			return 6;
+		}
+	}
+	cout << "Appending " << shard_count << " shards matched building the model serially (" << serial_bytes.size() << " bytes)." << endl;
+	return 0;
+}
+
+// Returns true if the element read by a cursor matches element 'ielem' of 'iga'.
+// The indices in the pieces depend on how the dictionaries were built, so only
+// the values they refer to are compared.
+bool sameElem( const iga_fileio::IGADataView &iga, uint32_t ielem, const iga_fileio::IGAStreamElem &elem )
+{
+	const iga_fileio::FaceLayout &layout = iga.layout( iga.layoutIndex( ielem ) );
+	uint32_t piece_begin = iga.pieceBegin( ielem ), edge_begin = iga.edgeBegin( ielem );
+	if( elem.elem_index != ielem || elem.layout < layout || layout < elem.layout ||
+		elem.pieces.size() != iga.pieceEnd( ielem ) - piece_begin || elem.edges.size() != iga.edgeEnd( ielem ) - edge_begin )
+		return false;
+	for( size_t ipiece = 0; ipiece < elem.pieces.size(); ++ipiece )
+	{
+		uint32_t piece = static_cast< uint32_t >( piece_begin + ipiece );
+		const iga_fileio::Point3d &point = iga.piecePoint( piece );
+		const iga_fileio::Point3d &elem_point = elem.points[ ipiece ];
+		int s_order = iga.pieceSOrder( piece ), t_order = iga.pieceTOrder( piece );
+		if( elem.pieces[ ipiece ].st_order != iga.pieces()[ piece ].st_order ||
+			( elem.pieces[ ipiece ].maybe_t_index == iga_fileio::INVALID_INDEX ) != iga.pieceIsExplicit( piece ) ||
+			elem_point.x != point.x || elem_point.y != point.y || elem_point.z != point.z || elem_point.w != point.w )
+			return false;
+		if( iga.pieceIsExplicit( piece ) ?
+			!std::equal( iga.pieceExplicitCoeffs( piece ), iga.pieceExplicitCoeffs( piece ) + s_order * t_order, elem.pieceSCoeffs( ipiece ) ) :
+			!std::equal( iga.pieceSCoeffs( piece ), iga.pieceSCoeffs( piece ) + s_order, elem.pieceSCoeffs( ipiece ) ) ||
+			!std::equal( iga.pieceTCoeffs( piece ), iga.pieceTCoeffs( piece ) + t_order, elem.pieceTCoeffs( ipiece ) ) )
+			return false;
+	}
+	for( size_t iedge = 0; iedge < elem.edges.size(); ++iedge )
+	{
+		uint32_t edge = static_cast< uint32_t >( edge_begin + iedge );
+		if( elem.edges[ iedge ] != iga.edgeOther( edge ) || ( !elem.intervals.empty() && elem.intervals[ iedge ] != iga.edgeInterval( edge ) ) )
+			return false;
+	}
+	return elem.intervals.empty() == iga.intervals().empty();
+}
+
+// Checks that a model built with a shared dictionary streams back the same as
+// the file it came from. The dictionary only holds the vectors of the first half
+// of the elements, so that the model keeps some coefficients of its own, and
+// both are written to files in memory and read back.
+int checkSharedStream( const char *filename )
+{
+	iga_fileio::IGAAsyncFileReader reader;
+	iga_fileio::IGAData iga;
+	if( !reader.open( filename ) || !reader.readIGAFile( iga ) )
+	{
+		std::cerr << "Failed to load valid data from that file." << endl;
+		return 3;
+	}
+
+	iga_fileio::IGAData half;
+	iga_fileio::IGACreator half_creator( &half );
+	iga_fileio::IGASharedDictionary dictionary;
+	if( !addElems( iga, 0, iga.elemCount() / 2, half_creator ) || !dictionary.addModel( half ) )
+	{
+		cerr << "Building the shared dictionary failed." << endl;
+		return 8;
+	}
+	std::stringstream dictionary_stream;
+	IGAStreamWriter dictionary_writer( dictionary_stream );
+	auto shared = std::make_shared< iga_fileio::IGASharedDictionary >();
+	IGAStreamReader dictionary_reader( dictionary_stream );
+	if( !dictionary.write( dictionary_writer ) || !shared->read( dictionary_reader ) )
+	{
+		cerr << "Writing and reading the shared dictionary failed." << endl;
+		return 8;
+	}
+
+	iga_fileio::IGAData shared_model;
+	iga_fileio::IGACreator shared_creator( &shared_model );
+	shared_creator.setSurfaceType( iga.surfaceType() );
+	std::stringstream model_stream;
+	IGAStreamWriter model_writer( model_stream );
+	if( !shared_creator.setSharedDictionary( shared ) || !shared_creator.appendShards( { &iga } ) || !model_writer.writeIGAFile( shared_model ) )
+	{
+		cerr << "Building the model with the shared dictionary failed." << endl;
+		return 8;
+	}
+
+	IGAStreamReader model_reader( model_stream );
+	model_reader.addSharedDictionary( shared );
+	iga_fileio::IGAElementCursor cursor;
+	if( !cursor.open( model_reader ) || cursor.elemCount() != iga.elemCount() )
+	{
+		cerr << cursor.error() << endl;
+		cerr << " ===== The cursor couldn't open the model that uses the shared dictionary." << endl;
+		return 8;
+	}
+	iga_fileio::IGAStreamElem elem;
+	uint32_t elem_count = 0;
+	while( cursor.next( elem ) )
+	{
+		if( !sameElem( iga, elem_count++, elem ) )
+		{
+			cerr << " ===== Element " << elem.elem_index << " of the model that uses the shared dictionary streamed back differently." << endl;
+			return 8;
+		}
+	}
+	if( cursor.failed() || elem_count != iga.elemCount() )
+	{
+		cerr << cursor.error() << endl;
+		cerr << " ===== Streaming the model that uses the shared dictionary failed." << endl;
+		return 8;
+	}
+	cout << "Streaming the model with a shared dictionary of " << shared->coeffCount() << " coefficients gave the same elements." << endl;
+	return 0;
+}
+
+// The parameters of a grid of samples over an element. The grid has 81 samples,
+// which isn't a multiple of any kernel's width, so the partial batches are
+// covered too.
+void gridParams( std::vector< double > &s, std::vector< double > &t )
+{
+	const int grid_size = 9;
+	for( int it = 0; it < grid_size; ++it )
+	{
+		for( int is = 0; is < grid_size; ++is )
+		{
+			s.push_back( is / double( grid_size - 1 ) );
+			t.push_back( it / double( grid_size - 1 ) );
+		}
+	}
+}
+
+// Evaluates every element of 'iga' on the gridParams() grid, appending the
+// positions and both derivatives to 'results'.
+void evaluateElems( const iga_fileio::IGADataView &iga, std::vector< iga_fileio::Vector3d > &results )
+{
+	std::vector< double > s, t;
+	gridParams( s, t );
+	std::vector< iga_fileio::Vector3d > positions( s.size() ), s_derivs( s.size() ), t_derivs( s.size() );
+	iga_fileio::IGAEvaluator evaluator( iga );
+	for( uint32_t ielem = 0; ielem < iga.elemCount(); ++ielem )
+	{
+		evaluator.evaluate( ielem, s.data(), t.data(), s.size(), positions.data(), s_derivs.data(), t_derivs.data() );
+		results.insert( results.end(), positions.begin(), positions.end() );
+		results.insert( results.end(), s_derivs.begin(), s_derivs.end() );
+		results.insert( results.end(), t_derivs.begin(), t_derivs.end() );
+	}
+}
+
+// The largest difference between two sets of evaluated values, relative to the
+// size of the values (or absolute, for values smaller than 1). Values that are
+// both NAN, as they are where a model's weights are zero, count as equal.
+double maxDifference( const std::vector< iga_fileio::Vector3d > &a, const std::vector< iga_fileio::Vector3d > &b )
+{
+	if( a.size() != b.size() )
+		return INFINITY;
+	double max_difference = 0.0;
+	for( size_t ivalue = 0; ivalue < a.size(); ++ivalue )
+	{
+		const double a_values[ 3 ] = { a[ ivalue ].x, a[ ivalue ].y, a[ ivalue ].z };
+		const double b_values[ 3 ] = { b[ ivalue ].x, b[ ivalue ].y, b[ ivalue ].z };
+		for( int icomponent = 0; icomponent < 3; ++icomponent )
+		{
+			double x = a_values[ icomponent ], y = b_values[ icomponent ];
+			if( std::isnan( x ) && std::isnan( y ) )
+				continue;
+			double difference = std::fabs( x - y ) / std::max( 1.0, std::fabs( x ) );
+			if( !( difference <= max_difference ) )
+				max_difference = std::isnan( difference ) ? INFINITY : difference;
+		}
+	}
+	return max_difference;
+}
+
+// Evaluated values are expected to agree this closely, relative to their size.
+const double EVAL_TOLERANCE = 1e-9;
+
+// Evaluates every element with each evaluation kernel this processor supports,
+// and checks that they agree with the scalar kernel.
+int checkKernels( const iga_fileio::IGAData &iga )
+{
+	if( !iga_fileio::setEvalKernel( iga_fileio::EVAL_KERNEL_SCALAR ) )
+	{
+		cerr << "The scalar kernel isn't available." << endl;
+		return 7;
+	}
+	std::vector< iga_fileio::Vector3d > expected;
+	evaluateElems( iga, expected );
+
+	const struct
+	{
+		iga_fileio::EvalKernel kernel;
+		const char *name;
+	} kernels[] = { { iga_fileio::EVAL_KERNEL_AVX2, "AVX2" }, { iga_fileio::EVAL_KERNEL_AVX512, "AVX-512" } };
+	int result = 0;
+	for( const auto &kernel : kernels )
+	{
+		if( !iga_fileio::setEvalKernel( kernel.kernel ) )
+		{
+			cout << "The " << kernel.name << " kernel isn't supported here; skipped." << endl;
+			continue;
+		}
+		std::vector< iga_fileio::Vector3d > values;
+		evaluateElems( iga, values );
+		double difference = maxDifference( expected, values );
+		if( difference <= EVAL_TOLERANCE )
+			cout << "The " << kernel.name << " kernel matched the scalar kernel (largest difference " << difference << ")." << endl;
+		else
+		{
+			cerr << " ===== The " << kernel.name << " kernel differs from the scalar kernel by " << difference << "." << endl;
+			result = 7;
+		}
+	}
+	iga_fileio::setEvalKernel( iga_fileio::EVAL_KERNEL_AUTO );
+	return result;
+}
+
+// Compacts a copy of the model, and checks that the result is valid and that
+// every element evaluates as it did before.
+int checkCompact( const iga_fileio::IGAData &iga )
+{
+	iga_fileio::IGAData compacted = iga;
+	if( !iga_fileio::compact( compacted ) )
+	{
+		cerr << " ===== Compacting the model failed." << endl;
+		return 9;
+	}
+	if( !checkIGA( compacted ) || compacted.elemCount() != iga.elemCount() )
+	{
+		cerr << " ===== The compacted model is not valid." << endl;
+		return 9;
+	}
+	std::vector< iga_fileio::Vector3d > expected, values;
+	evaluateElems( iga, expected );
+	evaluateElems( compacted, values );
+	double difference = maxDifference( expected, values );
+	if( !( difference <= EVAL_TOLERANCE ) )
+	{
+		cerr << " ===== The compacted model evaluates differently, by up to " << difference << "." << endl;
+		return 9;
+	}
+	cout << "Compacting the model took it from " << writeToString( iga ).size() << " to " << writeToString( compacted ).size() <<
+		" bytes, and it evaluated the same (largest difference " << difference << ")." << endl;
+	return 0;
+}
+
+// Checks that IGACreator merges values that are nudged by less than the merge
+// tolerance. The points are added in bulk first, and each is then added again,
+// nudged, which must give back a point that was added in bulk. Each coefficient
+// vector is added, and then added again nudged, which must give back a vector
+// within the tolerance; vectors of up to four values must be merged.
+int checkDedup( const iga_fileio::IGAData &iga )
+{
+	const double tolerance = 1e-6, nudge = tolerance / 8;
+	iga_fileio::IGAData merged;
+	iga_fileio::IGACreator creator( &merged );
+	iga_fileio::IGADedupOptions options;
+	options.coeff_tolerance = tolerance;
+	options.merge_points = true;
+	options.point_tolerance = tolerance;
+	const std::vector< iga_fileio::Point3d > &points = iga.points();
+	if( !creator.setDedupOptions( options ) ||
+		( !points.empty() && creator.addPoints( points.data(), points.size() ) == iga_fileio::INVALID_INDEX ) )
+	{
+		cerr << "Adding the points failed." << endl;
+		return 10;
+	}
+	for( const iga_fileio::Point3d &point : points )
+	{
+		iga_fileio::Point3d nudged = { point.x + nudge, point.y - nudge, point.z + nudge, point.w - nudge };
+		if( creator.addPoint( nudged ) >= points.size() )
+		{
+			cerr << " ===== A nudged point wasn't merged with the points added in bulk." << endl;
+			return 10;
+		}
+	}
+
+	size_t vector_count = 0;
+	std::vector< double > nudged;
+	for( uint32_t ipiece = 0; ipiece < iga.pieceCount(); ++ipiece )
+	{
+		int s_order = iga.pieceSOrder( ipiece ), t_order = iga.pieceTOrder( ipiece );
+		const double *vectors[ 2 ] = { iga.pieceIsExplicit( ipiece ) ? iga.pieceExplicitCoeffs( ipiece ) : iga.pieceSCoeffs( ipiece ),
+			iga.pieceIsExplicit( ipiece ) ? nullptr : iga.pieceTCoeffs( ipiece ) };
+		size_t lengths[ 2 ] = { size_t( iga.pieceIsExplicit( ipiece ) ? s_order * t_order : s_order ), size_t( t_order ) };
+		for( int ivector = 0; ivector < 2 && vectors[ ivector ]; ++ivector )
+		{
+			const double *coeffs = vectors[ ivector ];
+			size_t length = lengths[ ivector ];
+			nudged.assign( coeffs, coeffs + length );
+			for( size_t icoeff = 0; icoeff < length; ++icoeff )
+				nudged[ icoeff ] += icoeff % 2 == 0 ? nudge : -nudge;
+			uint32_t index = creator.getDictionaryIndex( coeffs, length );
+			uint32_t nudged_index = creator.getDictionaryIndex( nudged.data(), length );
+			if( index == iga_fileio::INVALID_INDEX || nudged_index == iga_fileio::INVALID_INDEX ||
+				( length <= 4 && nudged_index != index ) )
+			{
+				cerr << " ===== A nudged coefficient vector wasn't merged with the original." << endl;
+				return 10;
+			}
+			for( size_t icoeff = 0; icoeff < length; ++icoeff )
+			{
+				if( !( std::fabs( merged.coeffs()[ nudged_index + icoeff ] - nudged[ icoeff ] ) <= tolerance ) )
+				{
+					cerr << " ===== A coefficient vector was merged with one that isn't within the tolerance." << endl;
+					return 10;
+				}
+			}
+			++vector_count;
+		}
+	}
+	if( merged.points().size() != points.size() || creator.maxPointError() > tolerance || creator.maxCoeffError() > tolerance )
+	{
+		cerr << " ===== Merging moved values by more than the tolerance, or added points." << endl;
+		return 10;
+	}
+	cout << "Merging nudged copies of " << points.size() << " points and " << vector_count << " coefficient vectors kept them within " <<
+		tolerance << " (largest moves " << creator.maxPointError() << " and " << creator.maxCoeffError() << ")." << endl;
+	return 0;
+}
+
+// Checks that an IGABezierCache evaluates every element as IGAEvaluator does,
+// after being moved, and that the cache it was moved from is empty.
+int checkBezierCache( const iga_fileio::IGAData &iga )
+{
+	iga_fileio::IGABezierCache built;
+	built.build( iga );
+	iga_fileio::IGABezierCache cache( std::move( built ) );
+	if( built.elemCount() != 0 || cache.elemCount() != iga.elemCount() )
+	{
+		cerr << " ===== The Bezier cache has the wrong number of elements." << endl;
+		return 11;
+	}
+
+	std::vector< double > s, t;
+	gridParams( s, t );
+	std::vector< iga_fileio::Vector3d > expected, values;
+	evaluateElems( iga, expected );
+	std::vector< iga_fileio::Vector3d > positions( s.size() ), s_derivs( s.size() ), t_derivs( s.size() );
+	for( uint32_t ielem = 0; ielem < cache.elemCount(); ++ielem )
+	{
+		cache.evaluate( ielem, s.data(), t.data(), s.size(), positions.data(), s_derivs.data(), t_derivs.data() );
+		values.insert( values.end(), positions.begin(), positions.end() );
+		values.insert( values.end(), s_derivs.begin(), s_derivs.end() );
+		values.insert( values.end(), t_derivs.begin(), t_derivs.end() );
+	}
+	double difference = maxDifference( expected, values );
+	if( !( difference <= EVAL_TOLERANCE ) )
+	{
+		cerr << " ===== The Bezier cache evaluates differently from IGAEvaluator, by up to " << difference << "." << endl;
+		return 11;
+	}
+	cout << "The Bezier cache matched IGAEvaluator (largest difference " << difference << ")." << endl;
+	return 0;
+}
+
+// Checks that IGADataSoA has every field of every piece, and its point, at the
+// entry given by soaIndices(), that the groups cover the arrays in order, and
+// that every array is 64-byte aligned. The arrays are checked after a move, and
+// the object moved from must be empty.
+int checkSoA( const iga_fileio::IGAData &iga )
+{
+	iga_fileio::IGADataSoA built;
+	built.build( iga );
+	iga_fileio::IGADataSoA soa( std::move( built ) );
+	if( built.pieceCount() != 0 || soa.pieceCount() != iga.pieceCount() )
+	{
+		cerr << " ===== The SoA arrays have the wrong number of pieces." << endl;
+		return 11;
+	}
+
+	const uintptr_t addresses[] = { uintptr_t( soa.sOrders().data() ), uintptr_t( soa.tOrders().data() ),
+		uintptr_t( soa.sIndices().data() ), uintptr_t( soa.tIndices().data() ), uintptr_t( soa.pointIndices().data() ),
+		uintptr_t( soa.elems().data() ), uintptr_t( soa.pieceIds().data() ), uintptr_t( soa.soaIndices().data() ),
+		uintptr_t( soa.pointX().data() ), uintptr_t( soa.pointY().data() ), uintptr_t( soa.pointZ().data() ),
+		uintptr_t( soa.pointW().data() ) };
+	for( uintptr_t address : addresses )
+	{
+		if( soa.pieceCount() > 0 && address % 64 != 0 )
+		{
+			cerr << " ===== An SoA array isn't 64-byte aligned." << endl;
+			return 11;
+		}
+	}
+
+	uint32_t group_end = 0;
+	for( const iga_fileio::IGADataSoA::Group &group : soa.groups() )
+	{
+		if( group.begin != group_end || group.end <= group.begin || group.end > soa.pieceCount() )
+		{
+			cerr << " ===== The SoA groups don't cover the arrays in order." << endl;
+			return 11;
+		}
+		for( uint32_t isoa = group.begin; isoa < group.end; ++isoa )
+		{
+			if( int( soa.sOrders()[ isoa ] ) != group.s_order || int( soa.tOrders()[ isoa ] ) != group.t_order )
+			{
+				cerr << " ===== SoA entry " << isoa << " has different orders from its group." << endl;
+				return 11;
+			}
+		}
+		group_end = group.end;
+	}
+	if( group_end != soa.pieceCount() )
+	{
+		cerr << " ===== The SoA groups don't cover the arrays in order." << endl;
+		return 11;
+	}
+
+	for( uint32_t ielem = 0; ielem < iga.elemCount(); ++ielem )
+	{
+		for( uint32_t ipiece = iga.pieceBegin( ielem ); ipiece < iga.pieceEnd( ielem ); ++ipiece )
+		{
+			const iga_fileio::Piece2D &piece = iga.pieces()[ ipiece ];
+			const iga_fileio::Point3d &point = iga.points()[ piece.pt_index ];
+			uint32_t isoa = soa.soaIndices()[ ipiece ];
+			if( isoa >= soa.pieceCount() || soa.pieceIds()[ isoa ] != ipiece || soa.elems()[ isoa ] != ielem ||
+				int( soa.sOrders()[ isoa ] ) != iga.pieceSOrder( ipiece ) || int( soa.tOrders()[ isoa ] ) != iga.pieceTOrder( ipiece ) ||
+				soa.sIndices()[ isoa ] != piece.s_index || soa.tIndices()[ isoa ] != piece.maybe_t_index ||
+				soa.pointIndices()[ isoa ] != piece.pt_index || soa.pointX()[ isoa ] != point.x || soa.pointY()[ isoa ] != point.y ||
+				soa.pointZ()[ isoa ] != point.z || soa.pointW()[ isoa ] != point.w )
+			{
+				cerr << " ===== The SoA arrays don't match piece " << ipiece << "." << endl;
+				return 11;
+			}
+		}
+	}
+	cout << "The SoA arrays matched all " << soa.pieceCount() << " pieces, in " << soa.groups().size() << " groups." << endl;
+	return 0;
+}
+
+// Checks that the adjacency graph agrees with the model's edges, and that every
+// paired edge's reverse edge leads back to it, from the neighbor.
+int checkAdjacency( const iga_fileio::IGAData &iga )
+{
+	const iga_fileio::IGAAdjacency &adjacency = iga.adjacency();
+	if( adjacency.elemCount() != iga.elemCount() || adjacency.edgeCount() != iga.edgeCount() )
+	{
+		cerr << " ===== The adjacency graph has the wrong number of elements or edges." << endl;
+		return 11;
+	}
+	size_t paired = 0, unpaired = 0;
+	for( uint32_t ielem = 0; ielem < iga.elemCount(); ++ielem )
+	{
+		for( uint32_t iedge = iga.edgeBegin( ielem ); iedge < iga.edgeEnd( ielem ); ++iedge )
+		{
+			uint32_t neighbor = adjacency.neighbor( iedge ), reverse = adjacency.reverseEdge( iedge );
+			if( adjacency.edgeElem( iedge ) != ielem || neighbor != iga.edgeOther( iedge ) )
+			{
+				cerr << " ===== The adjacency graph doesn't match edge " << iedge << "." << endl;
+				return 11;
+			}
+			if( reverse == iga_fileio::INVALID_INDEX )
+			{
+				unpaired += neighbor != iga_fileio::INVALID_INDEX;
+				continue;
+			}
+			if( neighbor == iga_fileio::INVALID_INDEX || reverse >= adjacency.edgeCount() ||
+				adjacency.reverseEdge( reverse ) != iedge || adjacency.edgeElem( reverse ) != neighbor ||
+				adjacency.neighbor( reverse ) != ielem )
+			{
+				cerr << " ===== The reverse edge of edge " << iedge << " doesn't lead back to it." << endl;
+				return 11;
+			}
+			++paired;
+		}
+	}
+	cout << "The adjacency graph paired " << paired << " edges; " << unpaired << " edges with a neighbor were left unpaired." << endl;
+	return 0;
+}
+
+// The elements whose boxes a ray passes through, found by testing every box.
+std::vector< uint32_t > bruteForceRay( const iga_fileio::IGABVH &bvh, const iga_fileio::IGARay &ray )
+{
+	std::vector< uint32_t > elems;
+	const double origin[ 3 ] = { ray.origin.x, ray.origin.y, ray.origin.z };
+	const double direction[ 3 ] = { ray.direction.x, ray.direction.y, ray.direction.z };
+	for( uint32_t ielem = 0; ielem < bvh.elemCount(); ++ielem )
+	{
+		const iga_fileio::IGABoundingBox &box = bvh.elemBox( ielem );
+		if( box.empty() )
+			continue;
+		const double lo[ 3 ] = { box.min.x, box.min.y, box.min.z }, hi[ 3 ] = { box.max.x, box.max.y, box.max.z };
+		double t_near = ray.t_min, t_far = ray.t_max;
+		for( int axis = 0; axis < 3 && t_near <= t_far; ++axis )
+		{
+			if( direction[ axis ] == 0 )
+			{
+				if( origin[ axis ] < lo[ axis ] || origin[ axis ] > hi[ axis ] )
+					t_far = -INFINITY;
+				continue;
+			}
+			double t_lo = ( lo[ axis ] - origin[ axis ] ) * ( 1.0 / direction[ axis ] );
+			double t_hi = ( hi[ axis ] - origin[ axis ] ) * ( 1.0 / direction[ axis ] );
+			t_near = std::max( t_near, std::min( t_lo, t_hi ) );
+			t_far = std::min( t_far, std::max( t_lo, t_hi ) );
+		}
+		if( t_near <= t_far )
+			elems.push_back( ielem );
+	}
+	return elems;
+}
+
+// The elements whose boxes are no farther from a point than the farthest point
+// of the nearest box, found by testing every box.
+std::vector< uint32_t > bruteForceNearest( const iga_fileio::IGABVH &bvh, const iga_fileio::Vector3d &point )
+{
+	std::vector< double > near2s( bvh.elemCount(), INFINITY );
+	double bound2 = INFINITY;
+	const double p[ 3 ] = { point.x, point.y, point.z };
+	for( uint32_t ielem = 0; ielem < bvh.elemCount(); ++ielem )
+	{
+		const iga_fileio::IGABoundingBox &box = bvh.elemBox( ielem );
+		if( box.empty() )
+			continue;
+		const double lo[ 3 ] = { box.min.x, box.min.y, box.min.z }, hi[ 3 ] = { box.max.x, box.max.y, box.max.z };
+		double near2 = 0, far2 = 0;
+		for( int axis = 0; axis < 3; ++axis )
+		{
+			double outside = std::max( std::max( lo[ axis ] - p[ axis ], p[ axis ] - hi[ axis ] ), 0.0 );
+			double farthest = std::max( std::fabs( p[ axis ] - lo[ axis ] ), std::fabs( p[ axis ] - hi[ axis ] ) );
+			near2 += outside * outside;
+			far2 += farthest * farthest;
+		}
+		near2s[ ielem ] = near2;
+		bound2 = std::min( bound2, far2 );
+	}
+	std::vector< uint32_t > elems;
+	for( uint32_t ielem = 0; ielem < bvh.elemCount(); ++ielem )
+	{
+		if( near2s[ ielem ] <= bound2 )
+			elems.push_back( ielem );
+	}
+	return elems;
+}
+
+// The elements of some query's hits, in increasing order, for comparing with a
+// brute force search.
+std::vector< uint32_t > hitElems( const std::vector< iga_fileio::IGABVHHit > &hits, size_t begin, size_t end )
+{
+	std::vector< uint32_t > elems;
+	for( size_t ihit = begin; ihit < end; ++ihit )
+		elems.push_back( hits[ ihit ].elem );
+	std::sort( elems.begin(), elems.end() );
+	return elems;
+}
+
+// Checks that every element's box in an IGABVH holds the element's surface, and
+// that ray and nearest point queries, run in batches across threads, find the
+// same elements as testing every box.
+int checkBVH( const iga_fileio::IGAData &iga )
+{
+	iga_fileio::IGABVH bvh;
+	bvh.build( iga );
+	if( bvh.elemCount() != iga.elemCount() )
+	{
+		cerr << " ===== The BVH has the wrong number of elements." << endl;
+		return 11;
+	}
+
+	std::vector< double > s, t;
+	gridParams( s, t );
+	std::vector< iga_fileio::Vector3d > positions( s.size() );
+	iga_fileio::IGAEvaluator evaluator( iga );
+	for( uint32_t ielem = 0; ielem < iga.elemCount(); ++ielem )
+	{
+		const iga_fileio::IGABoundingBox &box = bvh.elemBox( ielem );
+		evaluator.evaluate( ielem, s.data(), t.data(), s.size(), positions.data() );
+		for( const iga_fileio::Vector3d &position : positions )
+		{
+			const double values[ 3 ] = { position.x, position.y, position.z };
+			const double lo[ 3 ] = { box.min.x, box.min.y, box.min.z }, hi[ 3 ] = { box.max.x, box.max.y, box.max.z };
+			for( int axis = 0; axis < 3; ++axis )
+			{
+				double slack = EVAL_TOLERANCE * std::max( 1.0, std::fabs( values[ axis ] ) );
+				if( std::isfinite( values[ axis ] ) && !( values[ axis ] >= lo[ axis ] - slack && values[ axis ] <= hi[ axis ] + slack ) )
+				{
+					cerr << " ===== Element " << ielem << " isn't inside its BVH box." << endl;
+					return 11;
+				}
+			}
+		}
+	}
+
+	// Aim rays from around the model through points inside it, with a few along
+	// the axes to cover rays parallel to the boxes' faces, and look for the nearest
+	// elements to points scattered in and around it.
+	iga_fileio::IGABoundingBox bounds = bvh.bounds();
+	if( bounds.empty() )
+	{
+		cout << "The BVH is empty; its queries weren't checked." << endl;
+		return 0;
+	}
+	const int query_count = 256;
+	std::mt19937 random;
+	auto inBounds = [&]( double margin ) {
+		double fractions[ 3 ];
+		for( double &fraction : fractions )
+			fraction = -margin + ( 1 + 2 * margin ) * ( random() / 4294967296.0 );
+		return iga_fileio::Vector3d{ bounds.min.x + fractions[ 0 ] * ( bounds.max.x - bounds.min.x ),
+			bounds.min.y + fractions[ 1 ] * ( bounds.max.y - bounds.min.y ),
+			bounds.min.z + fractions[ 2 ] * ( bounds.max.z - bounds.min.z ) };
+	};
+	std::vector< iga_fileio::IGARay > rays( query_count );
+	std::vector< iga_fileio::Vector3d > points( query_count );
+	for( int iquery = 0; iquery < query_count; ++iquery )
+	{
+		iga_fileio::IGARay &ray = rays[ iquery ];
+		ray.origin = inBounds( 1.0 );
+		iga_fileio::Vector3d target = inBounds( 0.0 );
+		ray.direction = { target.x - ray.origin.x, target.y - ray.origin.y, target.z - ray.origin.z };
+		if( iquery % 8 == 0 )
+			ray.direction = { iquery % 3 == 0 ? 1.0 : 0.0, iquery % 3 == 1 ? -1.0 : 0.0, iquery % 3 == 2 ? 1.0 : 0.0 };
+		points[ iquery ] = inBounds( 0.5 );
+	}
+
+	std::vector< size_t > hit_ends;
+	std::vector< iga_fileio::IGABVHHit > hits;
+	bvh.intersectRays( rays.data(), rays.size(), hit_ends, hits );
+	for( int iquery = 0; iquery < query_count; ++iquery )
+	{
+		size_t begin = iquery == 0 ? 0 : hit_ends[ iquery - 1 ];
+		if( hitElems( hits, begin, hit_ends[ iquery ] ) != bruteForceRay( bvh, rays[ iquery ] ) )
+		{
+			cerr << " ===== BVH ray " << iquery << " found different elements from a brute force search." << endl;
+			return 11;
+		}
+	}
+	size_t ray_hits = hits.size();
+	bvh.findNearest( points.data(), points.size(), hit_ends, hits );
+	for( int iquery = 0; iquery < query_count; ++iquery )
+	{
+		size_t begin = iquery == 0 ? 0 : hit_ends[ iquery - 1 ];
+		if( hitElems( hits, begin, hit_ends[ iquery ] ) != bruteForceNearest( bvh, points[ iquery ] ) )
+		{
+			cerr << " ===== BVH point " << iquery << " found different nearest elements from a brute force search." << endl;
+			return 11;
+		}
+	}
+	size_t nearest_hits = hits.size();
+	cout << "The BVH matched a brute force search for " << query_count << " rays (" << ray_hits << " hits) and " << query_count <<
+		" points (" << nearest_hits << " candidates)." << endl;
+	return 0;
+}
+
+// Tessellates the model and counts the half-edges of the mesh that no triangle
+// runs back along. A closed model, one whose edges all have a neighbor, must
+// give a mesh without any, or the elements don't meet up.
+int checkTessellation( const iga_fileio::IGAData &iga )
+{
+	iga_fileio::IGATessellator tessellator;
+	if( !tessellator.plan( iga ) )
+	{
+		cerr << " ===== Planning the tessellation failed." << endl;
+		return 11;
+	}
+	std::vector< iga_fileio::Vector3d > positions( tessellator.vertexCount() );
+	std::vector< uint32_t > indices( 3 * tessellator.triangleCount() );
+	if( !tessellator.tessellate( positions.data(), nullptr, indices.data() ) )
+	{
+		cerr << " ===== Tessellating the model failed." << endl;
+		return 11;
+	}
+
+	std::vector< uint64_t > half_edges;
+	for( size_t itriangle = 0; itriangle < tessellator.triangleCount(); ++itriangle )
+	{
+		for( int icorner = 0; icorner < 3; ++icorner )
+		{
+			uint32_t from = indices[ 3 * itriangle + icorner ], to = indices[ 3 * itriangle + ( icorner + 1 ) % 3 ];
+			if( from >= positions.size() || to >= positions.size() )
+			{
+				cerr << " ===== The tessellation has an index out of range." << endl;
+				return 11;
+			}
+			if( from != to )
+				half_edges.push_back( uint64_t( from ) << 32 | to );
+		}
+	}
+	std::sort( half_edges.begin(), half_edges.end() );
+	size_t boundary = 0;
+	for( size_t ihalf = 0; ihalf < half_edges.size(); )
+	{
+		uint64_t half_edge = half_edges[ ihalf ], reverse = half_edge << 32 | half_edge >> 32;
+		size_t count = std::upper_bound( half_edges.begin() + ihalf, half_edges.end(), half_edge ) - half_edges.begin() - ihalf;
+		auto reverses = std::equal_range( half_edges.begin(), half_edges.end(), reverse );
+		boundary += count - std::min< size_t >( count, reverses.second - reverses.first );
+		ihalf += count;
+	}
+
+	bool closed = iga.elemCount() > 0 &&
+		std::find( iga.edges().begin(), iga.edges().end(), iga_fileio::INVALID_INDEX ) == iga.edges().end();
+	if( closed && boundary != 0 )
+	{
+		cerr << " ===== The tessellation of a closed model has " << boundary << " boundary half-edges." << endl;
+		return 11;
+	}
+	cout << "Tessellating the " << ( closed ? "closed" : "open" ) << " model gave " << tessellator.triangleCount() << " triangles, with " <<
+		boundary << " boundary half-edges." << endl;
+	return 0;
+}
+
+// Checks the structures built from the model for fast geometry queries against
+// the model itself.
+int checkGeometry( const iga_fileio::IGAData &iga )
+{
+	int result = checkBezierCache( iga );
+	if( result == 0 )
+		result = checkSoA( iga );
+	if( result == 0 )
+		result = checkAdjacency( iga );
+	if( result == 0 )
+		result = checkBVH( iga );
+	if( result == 0 )
+		result = checkTessellation( iga );
+	return result;
+}
+
+int main( int argc, char **argv )
+{
+	if( argc < 2 )
+	{
+		std::cerr << "Usage: " << argv[ 0 ] << " filename.iga [--verbose] [--mmap] [--all-errors] [--compress] [--checksums] [--async] [--stream] [--shards] [--kernels] [--compact] [--dedup] [--geometry] [--output out.iga]" << endl;
+		return 1;
+	}
+
+	bool use_mmap = false;
+	bool use_async = false;
+	bool use_stream = false;
+	bool check_shards = false;
+	bool check_kernels = false;
+	bool check_compact = false;
+	bool check_dedup = false;
+	bool check_geometry = false;
+	const char *output_filename = nullptr;
+	for( int iarg = 2; iarg < argc; ++iarg )
+	{
+		std::string arg( argv[ iarg ] );
+		if( arg == "--output" && iarg + 1 < argc )
+			output_filename = argv[ ++iarg ];
+		else if( arg == "--verbose" )
+			verbose = true;
+		else if( arg == "--mmap" )
+			use_mmap = true;
+		else if( arg == "--all-errors" )
+			all_errors = true;
+		else if( arg == "--compress" )
+			compress = true;
+		else if( arg == "--checksums" )
+			checksums = true;
+		else if( arg == "--async" )
+			use_async = true;
+		else if( arg == "--stream" )
+			use_stream = true;
+		else if( arg == "--shards" )
+			check_shards = true;
+		else if( arg == "--kernels" )
+			check_kernels = true;
+		else if( arg == "--compact" )
+			check_compact = true;
+		else if( arg == "--dedup" )
+			check_dedup = true;
+		else if( arg == "--geometry" )
+			check_geometry = true;
+	}
+
+	if( use_mmap )
+		return viewMappedFile( argv[ 1 ] );
+	if( use_stream )
+	{
+		int result = streamFile( argv[ 1 ], output_filename );
+		return result != 0 ? result : checkSharedStream( argv[ 1 ] );
+	}
+
+	iga_fileio::IGAData iga_data;
+	if( use_async )
+	{
+		// Load the file on a background thread, with the reads done ahead of time.
+		std::future< bool > loaded = iga_fileio::readIGAFileAsync( argv[ 1 ], iga_data );
+		if( !loaded.get() )
+		{
+			std::cerr << "Failed to load valid data from that file." << endl;
+			return 3;
+		}
+	}
+	else
+	{
+		// Create a file stream using the passed filename.
+		std::ifstream in_file( argv[ 1 ], std::ios::in | std::ios::binary );
+		if( !in_file.good() )
+		{
+			std::cerr << "Failed to open that file." << endl;
+			std::cerr << "Usage: " << argv[ 0 ] << " filename.iga" << endl;
+			return 2;
+		}
+
+		// Use that file stream and our reader class to load some IGA data.
+		IGAStreamReader reader( in_file );
+		if( !reader.readIGAFile( iga_data ) )
+		{
+			std::cerr << "Failed to load valid data from that file." << endl;
+			return 3;
+		}
+	}
+
+	if( !checkIGA( iga_data ) )
 	{
 		cerr << " ===== The IGA file is not valid." << endl;
 		return 4;
@@ -185,11 +1207,44 @@ int main( int argc, char **argv )
 	if( verbose )
 		printVerboseIGA( iga_data, cout );
 
+	if( check_shards )
+	{
+		int result = checkShards( iga_data );
+		if( result != 0 )
+			return result;
+	}
+	if( check_kernels )
+	{
+		int result = checkKernels( iga_data );
+		if( result != 0 )
+			return result;
+	}
+	if( check_compact )
+	{
+		int result = checkCompact( iga_data );
+		if( result != 0 )
+			return result;
+	}
+	if( check_dedup )
+	{
+		int result = checkDedup( iga_data );
+		if( result != 0 )
+			return result;
+	}
+	if( check_geometry )
+	{
+		int result = checkGeometry( iga_data );
+		if( result != 0 )
+			return result;
+	}
+
 	// A simple demonstration of how to write IGA data to a file. For simplicity, we'll
 	// just re-output the same data we just read in. Note that if the input IGA file had
 	// any unrecognized blocks, this will "lose" that data.
 	std::stringstream out_stream;
 	IGAStreamWriter writer( out_stream );
+	writer.setCompressBlocks( compress );
+	writer.setWriteChecksums( checksums );
 	bool ok = writer.writeIGAFile( iga_data );
 	if( !ok )
 	{
@@ -198,5 +1253,19 @@ int main( int argc, char **argv )
 	}
 	cout << "Writing the IGA file to a buffer produced " << out_stream.str().size() << " bytes." << endl;
 
+	// IGAFileWriter writes straight to a file, gathering the blocks into a few
+	// large writes.
+	if( output_filename )
+	{
+		iga_fileio::IGAFileWriter file_writer;
+		file_writer.setCompressBlocks( compress );
+		file_writer.setWriteChecksums( checksums );
+		if( !file_writer.open( output_filename ) || !file_writer.writeIGAFile( iga_data ) || !file_writer.close() )
+		{
+			cerr << "Writing " << output_filename << " failed." << endl;
+			return 5;
+		}
+	}
+
 	return 0;
 }
\ No newline at end of file
@@ -25,3 +25,27 @@ REM need to edit it if you placed it somewhere else.
 ..\build\Release\IGA-Saveload.exe corrupt\fandisk-bad.iga
 ..\build\Release\IGA-Saveload.exe corrupt\layout-bad.iga
 ..\build\Release\IGA-Saveload.exe corrupt\tetrahedron-bad.iga
+..\build\Release\IGA-Saveload.exe corrupt\alloc-bad.iga --stream
+..\build\Release\IGA-Saveload.exe corrupt\fandisk-bad.iga --stream
+..\build\Release\IGA-Saveload.exe corrupt\layout-bad.iga --stream
+..\build\Release\IGA-Saveload.exe corrupt\tetrahedron-bad.iga --stream
+..\build\Release\IGA-Saveload.exe all-creased.iga --geometry
+..\build\Release\IGA-Saveload.exe closed-cylinder.iga --geometry
+..\build\Release\IGA-Saveload.exe eyewear.iga --geometry
+..\build\Release\IGA-Saveload.exe fandisk.iga --geometry
+..\build\Release\IGA-Saveload.exe hand.iga --geometry
+..\build\Release\IGA-Saveload.exe nose.iga --geometry
+..\build\Release\IGA-Saveload.exe open-cylinder.iga --geometry
+..\build\Release\IGA-Saveload.exe quadball.iga --geometry
+..\build\Release\IGA-Saveload.exe sharp-box.iga --geometry
+..\build\Release\IGA-Saveload.exe simple-corner.iga --geometry
+..\build\Release\IGA-Saveload.exe single-elem.iga --geometry
+..\build\Release\IGA-Saveload.exe smooth-box.iga --geometry
+..\build\Release\IGA-Saveload.exe sphere.iga --geometry
+..\build\Release\IGA-Saveload.exe stadium-seat.iga --geometry
+..\build\Release\IGA-Saveload.exe star-interlock.iga --geometry
+..\build\Release\IGA-Saveload.exe strut-cube.iga --geometry
+..\build\Release\IGA-Saveload.exe tetrahedron.iga --geometry
+..\build\Release\IGA-Saveload.exe tiny-box.iga --geometry
+..\build\Release\IGA-Saveload.exe triangle.iga --geometry
+..\build\Release\IGA-Saveload.exe weighted-box.iga --geometry